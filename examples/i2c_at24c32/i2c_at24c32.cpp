@@ -106,13 +106,8 @@ class AT24C32Test {
           error(pf[LED_PIN]);
 
         /*
-         * Let the device settle after write (10ms max, see datasheet)
-         */
-
-        MillisecondTimer::delay(10);
-
-        /*
-         * Read back the byte and check it
+         * Read back the byte and check it. There's no need to wait for the write cycle
+         * to finish, the read polls the device until it's ready.
          */
 
         eeprom.seek(0);
@@ -122,21 +117,16 @@ class AT24C32Test {
           error(pf[LED_PIN]);
 
         /*
-         * Write the 237 byte sequence at a random position
+         * Write the 237 byte sequence at a random position. The stream writes one
+         * page at a time and keeps a partial last page buffered until it's flushed.
          */
 
         address=rand() % (MyEeprom::SIZE_IN_BYTES-sizeof(buffer));
 
         eeprom.seek(address);
-        if(!eeprom.write(buffer,sizeof(buffer)))
+        if(!eeprom.write(buffer,sizeof(buffer)) || !eeprom.flush())
           error(pf[LED_PIN]);
 
-        /*
-         * Let the device settle after write (10ms max, see datasheet)
-         */
-
-        MillisecondTimer::delay(10);
-
         /*
          * Clear the buffer and read back the data
          */
@@ -9,7 +9,7 @@
 /**
  * @file
  * This file gets you access to the CRC peripheral functionality. Big-endian and little-endian
- * calculation is supported.
+ * calculation is supported. Table driven software CRCs are available for other algorithms.
  */
 
 // CRC depends on output stream
@@ -23,6 +23,10 @@
 #include "crc/BigEndianCrc.h"
 #include "crc/LittleEndianCrc.h"
 
+// software implementation
+
+#include "crc/SoftwareCrc.h"
+
 // utility classes
 
 #include "crc/CrcOutputStream.h"
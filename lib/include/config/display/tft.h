@@ -63,6 +63,7 @@
 #include "display/graphic/PicoJpeg.h"
 #include "display/graphic/JpegDecoder.h"
 #include "display/graphic/GraphicsLibrary.h"
+#include "display/graphic/OffScreenCanvas.h"
 
 // include the optimised GPIO drivers in specialisation order
 
@@ -165,6 +165,10 @@
   #include "dma/features/f4/DacDmaWriterFeature.h"
 #endif
 
+#if defined(STM32PLUS_F4_HAS_CRYPTO)
+  #include "dma/features/f4/HashDmaWriterFeature.h"
+#endif
+
   #include "dma/features/f4/DmaPeripheralInfo.h"
 
 #elif defined(STM32PLUS_F0)
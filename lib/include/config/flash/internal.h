@@ -62,3 +62,4 @@
 
 #include "flash/internal/InternalFlashWordWriter.h"
 #include "flash/internal/InternalFlashSettingsStorage.h"
+#include "flash/internal/InternalFlashKeyValueStorage.h"
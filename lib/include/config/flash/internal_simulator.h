@@ -0,0 +1,21 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * This config file gets you access to InternalFlashSimulator, a RAM-backed stand-in for the internal
+ * flash that lets InternalFlashKeyValueStorage run in host and test builds. Device builds don't need it.
+ */
+
+// the simulator depends on internal flash
+
+#include "config/flash/internal.h"
+
+// includes for the feature
+
+#include "flash/internal/InternalFlashSimulator.h"
@@ -12,11 +12,12 @@
  * serial flash device and the Samsung K9F1G08Q0C NAND flash device.
  */
 
-// spi flash depends on spi, timing, stream
+// spi flash depends on spi, timing, stream, device
 
 #include "config/spi.h"
 #include "config/timing.h"
 #include "config/stream.h"
+#include "config/device.h"
 
 // include the main classes
 
@@ -56,3 +57,7 @@
 // include the stream class
 
 #include "flash/spi/SpiFlashInputStream.h"
+
+// include the flash translation layer
+
+#include "flash/spi/SpiFlashBlockDevice.h"
@@ -10,22 +10,42 @@
  * @file
  * This config file enables access to the HASH peripheral in the F4 for performing cryptographic
  * hash functions. The functionality is emulated in software for devices that don't have the
- * peripheral.
+ * peripheral. HMAC and an output stream that hashes everything written to it are built on top.
  */
 
-// hash depends on timing
+// hash depends on timing and output stream
 
 #include "config/timing.h"
+#include "config/stream.h"
+
+// software implementations, available on all devices
+
+#include "hash/software/SoftwareHashBase.h"
+#include "hash/software/SoftwareSha1.h"
+#include "hash/software/SoftwareSha256.h"
 
 // device-specific peripheral includes
 
 #if defined(STM32PLUS_F4) && defined(STM32PLUS_F4_HARDWARE_CRYPTO)
+  #include "hash/f4/HardwareHash.h"
   #include "hash/f4/SHA1.h"
+
+  #if defined(STM32F427_437xx) || defined(STM32F429_439xx)
+    #include "hash/f4/SHA256.h"
+  #else
+    #include "hash/software/SHA256.h"
+  #endif
 #else
   #include "hash/software/SHA1.h"
+  #include "hash/software/SHA256.h"
 #endif
 
 // generic peripheral includes
 
 #include "hash/HashPeripheral.h"
 
+// utility classes
+
+#include "hash/Hmac.h"
+#include "hash/HashOutputStream.h"
+
@@ -29,6 +29,7 @@
 #include "config/stream.h"
 #include "memory/scoped_array.h"
 #include "memory/circular_buffer.h"
+#include "memory/spsc_ring_buffer.h"
 #include "memory/scoped_ptr.h"
 #include "memory/linked_ptr.h"
 #include "util/Meta.h"
@@ -49,6 +50,7 @@
 #include "net/NetworkErrorEvent.h"
 #include "net/NetworkEvents.h"
 #include "net/NetworkDebugEvent.h"
+#include "net/NetworkTimerWheel.h"
 #include "net/NetworkIntervalTicker.h"
 #include "net/NetworkUtilityObjects.h"
 #include "net/NetMeta.h"
@@ -128,6 +130,7 @@
 #include "net/network/arp/ArpOperation.h"
 #include "net/network/arp/ArpFrameData.h"
 #include "net/network/arp/ArpCache.h"
+#include "net/network/arp/ArpPendingQueue.h"
 #include "net/network/arp/ArpReceiveEvent.h"
 #include "net/network/arp/Arp.h"
 
@@ -171,16 +174,19 @@
 #include "net/transport/tcp/TcpConnectionReleasedEvent.h"
 #include "net/transport/tcp/TcpConnectionClosedEvent.h"
 #include "net/transport/tcp/TcpConnectionDataReadyEvent.h"
+#include "net/transport/tcp/TcpWaitState.h"
+#include "net/transport/tcp/TcpConnectionReadyEvent.h"
 #include "net/transport/tcp/TcpReceiveBuffer.h"
+#include "net/transport/tcp/TcpResendDelayCalculator.h"
+#include "net/transport/tcp/TcpCongestionControl.h"
+#include "net/transport/tcp/TcpNewReno.h"
 #include "net/transport/tcp/TcpConnection.h"
 #include "net/transport/tcp/TcpClientConnection.h"
-#include "net/transport/tcp/TcpResendDelayCalculator.h"
 #include "net/transport/tcp/TcpAcceptEvent.h"
 #include "net/transport/tcp/TcpServerReleasedEvent.h"
 #include "net/transport/tcp/TcpServerBase.h"
 #include "net/transport/tcp/TcpServer.h"
 #include "net/transport/tcp/Tcp.h"
-#include "net/transport/tcp/TcpWaitState.h"
 #include "net/transport/tcp/TcpConnectionArray.h"
 #include "net/transport/tcp/TcpTextLineReceiver.h"
 #include "net/transport/tcp/TcpOutputStreamOfStreams.h"
@@ -194,6 +200,7 @@
 #include "net/application/dns/DnsQueryPacket.h"
 #include "net/application/dns/DnsReplyPacket.h"
 #include "net/application/dns/DnsCache.h"
+#include "net/application/dns/DnsAsyncQuery.h"
 #include "net/application/dns/Dns.h"
 
 #include "net/application/dhcp/DhcpRenewalDueEvent.h"
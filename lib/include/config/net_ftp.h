@@ -8,7 +8,9 @@
 
 /**
  * @file
- * This config file gets you access to the FTP application layer feature.
+ * This config file gets you access to the FTP application layer feature. Each active data
+ * connection uses up to 12Kb of heap on the F4 and 9Kb on the F1 with the default
+ * parameters. See FtpServerConnectionBase::Parameters.
  */
 
 #if defined(STM32PLUS_F4) || defined(STM32PLUS_F1_CL_E)
@@ -23,6 +25,7 @@
 
 
 #include "net/application/ftp/FtpServerAuthenticationState.h"
+#include "net/application/ftp/FtpServerStatistics.h"
 #include "net/application/ftp/FtpServerDataConnection.h"
 #include "net/application/ftp/FtpServerConnectionBase.h"
 #include "net/application/ftp/FtpServerConnection.h"
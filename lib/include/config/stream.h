@@ -23,6 +23,7 @@
 // includes for the feature
 
 #include "stream/StreamBase.h"
+#include "stream/IoVector.h"
 #include "stream/InputStream.h"
 #include "stream/OutputStream.h"
 #include "stream/Reader.h"
@@ -31,7 +32,9 @@
 #include "stream/ByteArrayInputStream.h"
 #include "stream/CircularBufferInputOutputStream.h"
 #include "stream/LzgDecompressionInputStream.h"
+#include "stream/LzgCompressionOutputStream.h"
 #include "stream/ConnectedInputOutputStream.h"
+#include "stream/StreamPump.h"
 #include "stream/LinearBufferInputOutputStream.h"
 #include "stream/TextOutputStream.h"
 #include "stream/StlStringInputStream.h"
@@ -42,6 +42,7 @@ namespace stm32plus {
     public:
       CrcPeripheral(const Parameters& params);
       uint32_t addNewData(uint8_t nextByte);
+      uint32_t addNewData(const void *data,uint32_t size);
 
       static uint32_t reverse(uint32_t data);
 
@@ -95,6 +96,28 @@ namespace stm32plus {
   }
 
 
+  /**
+   * Add a block of data bytes to the calculation
+   * @param data The data
+   * @param size The number of bytes
+   * @return The current value of the CRC.
+   */
+
+  inline uint32_t CrcPeripheral<Endian::BIG_ENDIAN_MCU>::addNewData(const void *data,uint32_t size) {
+
+    const uint8_t *ptr;
+    uint32_t crc;
+
+    ptr=static_cast<const uint8_t *>(data);
+    crc=currentCrc();
+
+    while(size--)
+      crc=addNewData(*ptr++);
+
+    return crc;
+  }
+
+
   /**
    * Reverse the bits in the parameter
    * @param data
@@ -12,7 +12,8 @@ namespace stm32plus {
 
 
   /**
-   * Template class for a CRC output stream.
+   * Template class for a CRC output stream. TCrc can be one of the CrcPeripheral
+   * specialisations or a SoftwareCrc.
    */
 
   template<class TCrc>
@@ -68,12 +69,7 @@ namespace stm32plus {
 
   template<class TCrc>
   inline bool CrcOutputStream<TCrc>::write(const void *buffer,uint32_t size) {
-
-    const uint8_t *ptr=reinterpret_cast<const uint8_t *>(buffer);
-
-    while(size--)
-      _crc.addNewData(*ptr++);
-
+    _crc.addNewData(buffer,size);
     return true;
   }
 
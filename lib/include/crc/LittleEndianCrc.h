@@ -40,6 +40,7 @@ namespace stm32plus {
     public:
       CrcPeripheral(const Parameters& params);
       uint32_t addNewData(uint8_t nextByte);
+      uint32_t addNewData(const void *data,uint32_t size);
       uint32_t calculateWordBuffer(uint32_t *buffer,uint32_t count) const;
 
       uint32_t finish() const;
@@ -93,6 +94,28 @@ namespace stm32plus {
   }
 
 
+  /**
+   * Add a block of data bytes to the calculation
+   * @param data The data
+   * @param size The number of bytes
+   * @return The current value of the CRC.
+   */
+
+  inline uint32_t CrcPeripheral<Endian::LITTLE_ENDIAN_MCU>::addNewData(const void *data,uint32_t size) {
+
+    const uint8_t *ptr;
+    uint32_t crc;
+
+    ptr=static_cast<const uint8_t *>(data);
+    crc=currentCrc();
+
+    while(size--)
+      crc=addNewData(*ptr++);
+
+    return crc;
+  }
+
+
   /**
    * Calculate the CRC of an whole buffer of 32-bit words
    * @param buffer The start of the buffer
@@ -0,0 +1,480 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /**
+   * Parameters of a CRC algorithm in the usual "Rocksoft" model form. The width must be
+   * 8, 16, 24 or 32 bits. Input and output reflection are the same for all the common
+   * algorithms so there is one flag for both.
+   * @tparam TWidth The width in bits
+   * @tparam TPolynomial The polynomial, without the top bit and not reflected
+   * @tparam TInitial The initial register value
+   * @tparam TReflected true if the bits of each byte and of the result are reflected
+   * @tparam TFinalXor The value to XOR with the register to get the result
+   */
+
+  template<uint8_t TWidth,uint32_t TPolynomial,uint32_t TInitial,bool TReflected,uint32_t TFinalXor>
+  struct CrcModel {
+    enum {
+      WIDTH = TWidth
+    };
+
+    static constexpr uint32_t POLYNOMIAL = TPolynomial;
+    static constexpr uint32_t INITIAL = TInitial;
+    static constexpr bool REFLECTED = TReflected;
+    static constexpr uint32_t FINAL_XOR = TFinalXor;
+  };
+
+
+  /**
+   * Common models. The check value is the CRC of the ASCII string "123456789".
+   */
+
+  typedef CrcModel<32,0x04C11DB7,0xFFFFFFFF,true,0xFFFFFFFF> Crc32IeeeModel;          ///< Ethernet, ZIP, PNG. Check 0xCBF43926
+  typedef CrcModel<32,0x1EDC6F41,0xFFFFFFFF,true,0xFFFFFFFF> Crc32CastagnoliModel;    ///< CRC-32C, iSCSI, SCTP. Check 0xE3069283
+  typedef CrcModel<32,0x04C11DB7,0xFFFFFFFF,false,0> Crc32Mpeg2Model;                 ///< The CRC peripheral's algorithm. Check 0x0376E6E7
+  typedef CrcModel<16,0x1021,0xFFFF,false,0> Crc16CcittModel;                         ///< CRC-16/CCITT-FALSE. Check 0x29B1
+  typedef CrcModel<16,0x1021,0,true,0> Crc16KermitModel;                              ///< CRC-16/KERMIT. Check 0x2189
+
+
+  /**
+   * Table driven software CRC calculation for any CrcModel. Use this when the CRC peripheral
+   * can't help: the peripheral only does CRC-32/MPEG-2 on whole words, whereas this will do any
+   * algorithm on a byte stream. It's also safe to use from more than one place at once
+   * because all the state is in the object.
+   *
+   * The lookup tables are generated by the compiler and live in flash. TSlices selects the
+   * speed/size trade-off:
+   *
+   *   1 : one 1Kb table, one lookup per byte.
+   *   4 : four tables (4Kb), each 32-bit word costs four lookups that don't depend on each other.
+   *   8 : eight tables (8Kb), the same for 64 bits at a time.
+   *
+   * The interface is the same as CrcPeripheral so this class can be used with CrcOutputStream:
+   * reset() is called on construction, addNewData() is called as many times as you like with
+   * bytes or blocks and returns the CRC so far, and finish() returns the final value. Unlike the
+   * peripheral, you can carry on adding data after finish().
+   *
+   * combine() gets the CRC of two blocks joined together from their separate CRCs and the
+   * length of the second one, so a large buffer can be done in pieces in any order.
+   *
+   * @tparam TModel A CrcModel type
+   * @tparam TSlices 1, 4 or 8
+   */
+
+  template<class TModel,uint8_t TSlices=4>
+  class SoftwareCrc {
+
+    protected:
+
+      static_assert(TModel::WIDTH>=8 && TModel::WIDTH<=32 && TModel::WIDTH % 8==0,"CRC width must be 8, 16, 24 or 32");
+      static_assert(TSlices==1 || TSlices==4 || TSlices==8,"TSlices must be 1, 4 or 8");
+
+      /*
+       * The register is right aligned when reflected and left aligned in 32 bits when not
+       * reflected, so both directions of every width can share the 32-bit table code.
+       */
+
+      enum {
+        SHIFT = TModel::REFLECTED ? 0 : 32-TModel::WIDTH
+      };
+
+      static constexpr uint32_t WIDTH_MASK=TModel::WIDTH==32 ? 0xFFFFFFFF : (1UL << TModel::WIDTH)-1;
+
+      struct Table {
+        uint32_t entries[TSlices][256];
+      };
+
+      static constexpr uint32_t reflect(uint32_t value,uint8_t bits);
+      static constexpr uint32_t polynomial();
+      static constexpr uint32_t multiplyByX(uint32_t value);
+      static constexpr Table generateTable();
+
+      static const Table _table;
+
+      uint32_t _register;
+
+    protected:
+      static uint32_t toRegister(uint32_t crc);
+      static uint32_t fromRegister(uint32_t reg);
+      static uint32_t multiply(uint32_t a,uint32_t b);
+      static uint32_t xPowerOfBytes(uint32_t count);
+
+      static uint32_t updateRegister(uint32_t reg,const uint8_t *ptr,uint32_t size);
+
+    public:
+      SoftwareCrc();
+
+      void reset();
+
+      uint32_t addNewData(uint8_t nextByte);
+      uint32_t addNewData(const void *data,uint32_t size);
+
+      uint32_t finish() const;
+      uint32_t currentCrc() const;
+
+      static uint32_t calculate(const void *data,uint32_t size);
+      static uint32_t combine(uint32_t crc1,uint32_t crc2,uint32_t length2);
+  };
+
+
+  /*
+   * Reverse the order of the bottom bits of a value
+   */
+
+  template<class TModel,uint8_t TSlices>
+  constexpr uint32_t SoftwareCrc<TModel,TSlices>::reflect(uint32_t value,uint8_t bits) {
+
+    uint32_t result=0;
+
+    for(uint8_t i=0;i<bits;i++) {
+      result=(result << 1) | (value & 1);
+      value>>=1;
+    }
+
+    return result;
+  }
+
+
+  /*
+   * The polynomial in register form
+   */
+
+  template<class TModel,uint8_t TSlices>
+  constexpr uint32_t SoftwareCrc<TModel,TSlices>::polynomial() {
+    return TModel::REFLECTED ? reflect(TModel::POLYNOMIAL,TModel::WIDTH) : TModel::POLYNOMIAL << SHIFT;
+  }
+
+
+  /*
+   * Advance the register by one bit of zero input. In polynomial terms that's a multiply
+   * by x modulo the CRC polynomial.
+   */
+
+  template<class TModel,uint8_t TSlices>
+  constexpr uint32_t SoftwareCrc<TModel,TSlices>::multiplyByX(uint32_t value) {
+
+    if(TModel::REFLECTED)
+      return (value & 1) ? (value >> 1) ^ polynomial() : value >> 1;
+
+    return (value & 0x80000000) ? (value << 1) ^ polynomial() : value << 1;
+  }
+
+
+  /*
+   * Table 0 is the classic byte-at-a-time table. Table n is the effect of a byte followed
+   * by n zero bytes, derived from table n-1 by one more step of table 0.
+   */
+
+  template<class TModel,uint8_t TSlices>
+  constexpr typename SoftwareCrc<TModel,TSlices>::Table SoftwareCrc<TModel,TSlices>::generateTable() {
+
+    Table table {};
+    uint32_t i=0,j=0,reg=0;
+
+    for(i=0;i<256;i++) {
+
+      reg=TModel::REFLECTED ? i : i << 24;
+
+      for(j=0;j<8;j++)
+        reg=multiplyByX(reg);
+
+      table.entries[0][i]=reg;
+    }
+
+    for(j=1;j<TSlices;j++) {
+      for(i=0;i<256;i++) {
+
+        reg=table.entries[j-1][i];
+
+        if(TModel::REFLECTED)
+          table.entries[j][i]=(reg >> 8) ^ table.entries[0][reg & 0xff];
+        else
+          table.entries[j][i]=(reg << 8) ^ table.entries[0][reg >> 24];
+      }
+    }
+
+    return table;
+  }
+
+
+  /**
+   * Table instance. The initialiser is a constant expression so the table is generated by
+   * the compiler and goes in flash.
+   */
+
+  template<class TModel,uint8_t TSlices>
+  const typename SoftwareCrc<TModel,TSlices>::Table SoftwareCrc<TModel,TSlices>::_table=SoftwareCrc<TModel,TSlices>::generateTable();
+
+
+  /**
+   * Constructor
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline SoftwareCrc<TModel,TSlices>::SoftwareCrc() {
+    reset();
+  }
+
+
+  /**
+   * Reset the calculation ready for re-use
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline void SoftwareCrc<TModel,TSlices>::reset() {
+    _register=TModel::INITIAL << SHIFT;
+  }
+
+
+  /**
+   * Add a byte to the calculation
+   * @param nextByte The byte to add
+   * @return The CRC of all the data so far
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::addNewData(uint8_t nextByte) {
+    _register=updateRegister(_register,&nextByte,1);
+    return currentCrc();
+  }
+
+
+  /**
+   * Add a block of data to the calculation
+   * @param data The data
+   * @param size The number of bytes
+   * @return The CRC of all the data so far
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::addNewData(const void *data,uint32_t size) {
+    _register=updateRegister(_register,static_cast<const uint8_t *>(data),size);
+    return currentCrc();
+  }
+
+
+  /**
+   * Get the final CRC. There's no pending data so this is the same as currentCrc().
+   * @return The CRC of all the data so far
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::finish() const {
+    return currentCrc();
+  }
+
+
+  /**
+   * Get the CRC of the data so far
+   * @return The current CRC
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::currentCrc() const {
+    return fromRegister(_register);
+  }
+
+
+  /**
+   * Calculate the CRC of a single block
+   * @param data The data
+   * @param size The number of bytes
+   * @return The CRC
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::calculate(const void *data,uint32_t size) {
+    return fromRegister(updateRegister(TModel::INITIAL << SHIFT,static_cast<const uint8_t *>(data),size));
+  }
+
+
+  /**
+   * Get the CRC of block 1 followed by block 2 from the CRCs of the separate blocks. Block 1
+   * is shifted over the length of block 2 by multiplying it by x^(8*length2), which takes
+   * time proportional to the log of length2 and needs no tables.
+   * @param crc1 The CRC of the first block
+   * @param crc2 The CRC of the second block
+   * @param length2 The length of the second block in bytes
+   * @return The CRC of the two blocks joined together
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::combine(uint32_t crc1,uint32_t crc2,uint32_t length2) {
+
+    uint32_t reg;
+
+    // register 1 as it would have been if the final XOR had not been applied, less the
+    // initial value that block 2 was started from, shifted over block 2
+
+    reg=toRegister(crc1 ^ TModel::FINAL_XOR ^ TModel::INITIAL);
+    reg=multiply(reg,xPowerOfBytes(length2));
+
+    return ((reg >> SHIFT) & WIDTH_MASK) ^ crc2;
+  }
+
+
+  /*
+   * Convert a CRC value (without the final XOR) to register form
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::toRegister(uint32_t crc) {
+    return (crc & WIDTH_MASK) << SHIFT;
+  }
+
+
+  /*
+   * Convert the register to a finished CRC value
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::fromRegister(uint32_t reg) {
+    return ((reg >> SHIFT) ^ TModel::FINAL_XOR) & WIDTH_MASK;
+  }
+
+
+  /*
+   * Multiply two polynomials in register form, modulo the CRC polynomial
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::multiply(uint32_t a,uint32_t b) {
+
+    uint32_t product;
+    uint8_t i;
+
+    // Horner's method from the highest power of a downwards. Reflected registers hold the
+    // highest power in bit 0, left aligned ones in bit 31.
+
+    product=0;
+
+    for(i=0;i<TModel::WIDTH;i++) {
+
+      product=multiplyByX(product);
+
+      if(TModel::REFLECTED ? (a & (1UL << i)) : (a & (0x80000000UL >> i)))
+        product^=b;
+    }
+
+    return product;
+  }
+
+
+  /*
+   * Get x^(8*count) modulo the CRC polynomial, by square and multiply
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::xPowerOfBytes(uint32_t count) {
+
+    uint32_t result,power;
+    uint8_t i;
+
+    // result = x^0, power = x^8
+
+    result=TModel::REFLECTED ? 1UL << (TModel::WIDTH-1) : 0x80000000UL >> (TModel::WIDTH-1);
+    power=result;
+
+    for(i=0;i<8;i++)
+      power=multiplyByX(power);
+
+    while(count) {
+
+      if(count & 1)
+        result=multiply(result,power);
+
+      power=multiply(power,power);
+      count>>=1;
+    }
+
+    return result;
+  }
+
+
+  /*
+   * The table-driven core. Bytes are taken one at a time until the pointer is word aligned
+   * and then a word (TSlices=4) or two (TSlices=8) at a time.
+   */
+
+  template<class TModel,uint8_t TSlices>
+  inline uint32_t SoftwareCrc<TModel,TSlices>::updateRegister(uint32_t reg,const uint8_t *ptr,uint32_t size) {
+
+    const uint32_t (*t)[256]=_table.entries;
+    uint32_t word1,word2;
+
+    if(TSlices>1) {
+
+      // get word aligned
+
+      while(size && (reinterpret_cast<uintptr_t>(ptr) & 3)!=0) {
+
+        if(TModel::REFLECTED)
+          reg=(reg >> 8) ^ t[0][(reg ^ *ptr++) & 0xff];
+        else
+          reg=(reg << 8) ^ t[0][(reg >> 24) ^ *ptr++];
+
+        size--;
+      }
+
+      // slices. the tables are indexed so that the first byte in memory goes through the
+      // table with the most zero bytes after it
+
+      while(size>=TSlices) {
+
+        word1=*reinterpret_cast<const uint32_t *>(ptr);
+
+        if(TModel::REFLECTED) {
+
+          reg^=word1;
+
+          if(TSlices==8) {
+
+            word2=*reinterpret_cast<const uint32_t *>(ptr+4);
+
+            reg=t[TSlices-1][reg & 0xff] ^ t[TSlices-2][(reg >> 8) & 0xff] ^ t[TSlices-3][(reg >> 16) & 0xff] ^ t[TSlices-4][reg >> 24]
+              ^ t[3][word2 & 0xff] ^ t[2][(word2 >> 8) & 0xff] ^ t[1][(word2 >> 16) & 0xff] ^ t[0][word2 >> 24];
+          }
+          else
+            reg=t[3][reg & 0xff] ^ t[2][(reg >> 8) & 0xff] ^ t[1][(reg >> 16) & 0xff] ^ t[0][reg >> 24];
+        }
+        else {
+
+          reg^=__builtin_bswap32(word1);
+
+          if(TSlices==8) {
+
+            word2=*reinterpret_cast<const uint32_t *>(ptr+4);
+
+            reg=t[TSlices-1][reg >> 24] ^ t[TSlices-2][(reg >> 16) & 0xff] ^ t[TSlices-3][(reg >> 8) & 0xff] ^ t[TSlices-4][reg & 0xff]
+              ^ t[3][word2 & 0xff] ^ t[2][(word2 >> 8) & 0xff] ^ t[1][(word2 >> 16) & 0xff] ^ t[0][word2 >> 24];
+          }
+          else
+            reg=t[3][reg >> 24] ^ t[2][(reg >> 16) & 0xff] ^ t[1][(reg >> 8) & 0xff] ^ t[0][reg & 0xff];
+        }
+
+        ptr+=TSlices;
+        size-=TSlices;
+      }
+    }
+
+    // the remainder, or everything if there's only one table
+
+    while(size--) {
+
+      if(TModel::REFLECTED)
+        reg=(reg >> 8) ^ t[0][(reg ^ *ptr++) & 0xff];
+      else
+        reg=(reg << 8) ^ t[0][(reg >> 24) ^ *ptr++];
+    }
+
+    return reg;
+  }
+}
@@ -111,6 +111,20 @@ namespace stm32plus {
       virtual bool writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks)=0;
 
 
+      /**
+       * Check if readBlocks() and writeBlocks() can move data straight to and from this buffer.
+       * A device that transfers with DMA may need word alignment or memory that its DMA can
+       * reach. When this is false the caller copies through a block-sized buffer of its own.
+       * Devices opt in, the default is false.
+       * @param[in] buffer The caller's buffer.
+       * @return true if the buffer can be used directly.
+       */
+
+      virtual bool canTransferDirect(const void * /* buffer */) {
+        return false;
+      }
+
+
       /**
        * Get the type of this block device.
        * @return The format type, i.e. whether this is device has an MBR or whether it behaves like a large floppy.
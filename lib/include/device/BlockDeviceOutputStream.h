@@ -11,7 +11,8 @@ namespace stm32plus {
 
   /**
    * An output stream class that writes to a block device. Optionally
-   * writes back for every write or only when a block is full
+   * writes back for every write or only when a block is full. A writev()
+   * counts as one write.
    */
 
   class BlockDeviceOutputStream : public OutputStream {
@@ -25,7 +26,8 @@ namespace stm32plus {
 
     protected:
       bool checkFillBuffer(uint32_t toWrite);
-      bool checkFlush();
+      bool checkFlush(bool writeThrough);
+      bool copyIn(const void *buffer,uint32_t size,bool writeThrough);
 
     public:
       /**
@@ -45,6 +47,7 @@ namespace stm32plus {
 
       virtual bool write(uint8_t c) override;
       virtual bool write(const void *buffer,uint32_t size) override;
+      virtual bool writev(const IoVector *vectors,uint32_t count) override;
       virtual bool close() override;
       virtual bool flush() override;
   };
@@ -53,6 +53,8 @@ namespace stm32plus {
       virtual bool writeBlock(const void *src,uint32_t blockIndex) override;
       virtual bool writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) override;
 
+      virtual bool canTransferDirect(const void *buffer) override;
+
       virtual uint32_t getTotalBlocksOnDevice() override;
 
       virtual formatType getFormatType() override;
@@ -142,6 +142,72 @@ namespace stm32plus {
       bool containsPoint(const Point& p) const {
         return p.X>=X && p.X<=X+Width && p.Y>=Y && p.Y<=Y+Height;
       }
+
+
+      /**
+       * Check if this rectangle overlaps another
+       * @param rhs The other rectangle
+       * @return true if there is at least one pixel in common
+       */
+
+      bool intersects(const Rectangle& rhs) const {
+        return X<rhs.X+rhs.Width && rhs.X<X+Width && Y<rhs.Y+rhs.Height && rhs.Y<Y+Height;
+      }
+
+
+      /**
+       * Get the intersection of this rectangle with another
+       * @param rhs The other rectangle
+       * @param result The overlapping area, undefined if there is no overlap
+       * @return true if the rectangles overlap
+       */
+
+      bool intersection(const Rectangle& rhs,Rectangle& result) const {
+
+        int16_t x2,y2;
+
+        if(!intersects(rhs))
+          return false;
+
+        x2=std::min<int16_t>(X+Width,rhs.X+rhs.Width);
+        y2=std::min<int16_t>(Y+Height,rhs.Y+rhs.Height);
+
+        result.X=std::max<int16_t>(X,rhs.X);
+        result.Y=std::max<int16_t>(Y,rhs.Y);
+        result.Width=x2-result.X;
+        result.Height=y2-result.Y;
+
+        return true;
+      }
+
+
+      /**
+       * Grow this rectangle so that it's the bounding box of itself and another
+       * @param rhs The other rectangle
+       */
+
+      void extend(const Rectangle& rhs) {
+
+        int16_t x2,y2;
+
+        x2=std::max<int16_t>(X+Width,rhs.X+rhs.Width);
+        y2=std::max<int16_t>(Y+Height,rhs.Y+rhs.Height);
+
+        X=std::min<int16_t>(X,rhs.X);
+        Y=std::min<int16_t>(Y,rhs.Y);
+        Width=x2-X;
+        Height=y2-Y;
+      }
+
+
+      /**
+       * Get the area of the rectangle in pixels
+       * @return width * height
+       */
+
+      uint32_t getArea() const {
+        return static_cast<uint32_t>(Width)*static_cast<uint32_t>(Height);
+      }
     };
 
 
@@ -0,0 +1,239 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * Compile-time flag that says whether a device can read back its own pixels and so can do
+     * real alpha compositing. Devices that can't are blended against the background colour.
+     * Specialised to true by devices such as OffScreenCanvas.
+     */
+
+    template<class TDevice>
+    struct DeviceHasReadback {
+      enum { value = false };
+    };
+
+
+    /**
+     * Tag type used to select the readback/no-readback implementations at compile time
+     */
+
+    template<bool TReadback>
+    struct ReadbackTag {
+    };
+
+
+    /**
+     * @brief Alpha blending kernels.
+     *
+     * Alpha values are 0..255 where 255 is fully opaque. The 5-6-5 kernels reduce the alpha to
+     * 5 bits (0..32), which is all the precision that a 5-bit channel can show, and that allows
+     * a whole pixel to be blended with one multiply per input using the well known trick of
+     * spreading the channels out across a 32-bit word with gaps between them.
+     *
+     * The row kernels go two pixels at a time. Each 16-bit half of a word holds one pixel and
+     * each channel is isolated into its own halfword lanes so that one 32-bit multiply-add
+     * blends that channel of both pixels without the lanes overflowing into each other. That's
+     * the same two-halfwords-per-register layout that the Cortex-M4 SIMD instructions use but
+     * it needs no special instructions so it's just as effective on the M0 and M3.
+     */
+
+    class AlphaBlend {
+
+      public:
+
+        /**
+         * Convert an 8-bit alpha to the 0..32 range used by the 5-6-5 kernels
+         * @param alpha 0..255
+         * @return 0..32
+         */
+
+        static uint32_t alpha5(uint8_t alpha) {
+          return (static_cast<uint32_t>(alpha)+4) >> 3;
+        }
+
+
+        /**
+         * Convert an 8-bit RGB triple to 5-6-5
+         */
+
+        static uint16_t rgbTo565(uint8_t red,uint8_t green,uint8_t blue) {
+          return ((red & 0xf8) << 8) | ((green & 0xfc) << 3) | (blue >> 3);
+        }
+
+
+        /**
+         * Blend two 5-6-5 pixels
+         * @param fg The foreground pixel
+         * @param bg The background pixel
+         * @param a5 The foreground weight, 0..32
+         * @return The blended pixel
+         */
+
+        static uint16_t blend565(uint16_t fg,uint16_t bg,uint32_t a5) {
+
+          uint32_t fgx,bgx;
+
+          // 00000gggggg00000rrrrr000000bbbbb
+
+          fgx=(fg | (static_cast<uint32_t>(fg) << 16)) & 0x07e0f81f;
+          bgx=(bg | (static_cast<uint32_t>(bg) << 16)) & 0x07e0f81f;
+
+          fgx=((fgx*a5+bgx*(32-a5)) >> 5) & 0x07e0f81f;
+          return fgx | (fgx >> 16);
+        }
+
+
+        /**
+         * Blend two pairs of 5-6-5 pixels held in the halfwords of a 32-bit word
+         * @param fg The foreground pixels
+         * @param bg The background pixels
+         * @param a5 The foreground weight, 0..32
+         * @return The blended pixels
+         */
+
+        static uint32_t blend565x2(uint32_t fg,uint32_t bg,uint32_t a5) {
+
+          uint32_t r,g,b,ia;
+
+          ia=32-a5;
+
+          b=(((fg & 0x001f001f)*a5+(bg & 0x001f001f)*ia) >> 5) & 0x001f001f;
+          g=((((fg >> 5) & 0x003f003f)*a5+((bg >> 5) & 0x003f003f)*ia) >> 5) & 0x003f003f;
+          r=((((fg >> 11) & 0x001f001f)*a5+((bg >> 11) & 0x001f001f)*ia) >> 5) & 0x001f001f;
+
+          return b | (g << 5) | (r << 11);
+        }
+
+
+        /**
+         * Blend a row of 5-6-5 pixels on to a destination with constant alpha
+         * @param dest The destination pixels, updated in place
+         * @param src The source pixels
+         * @param count The number of pixels
+         * @param alpha The source alpha, 0..255
+         */
+
+        static void blendRow565(uint16_t *dest,const uint16_t *src,uint32_t count,uint8_t alpha) {
+
+          uint32_t a5;
+
+          a5=alpha5(alpha);
+
+          if(a5==0)
+            return;
+
+          if(a5==32) {
+            memcpy(dest,src,count*2);
+            return;
+          }
+
+          // get the destination word aligned
+
+          if((reinterpret_cast<uint32_t>(dest) & 2) && count) {
+            *dest=blend565(*src++,*dest,a5);
+            dest++;
+            count--;
+          }
+
+          // two at a time. the source may be unaligned so it's read as halfwords
+
+          for(;count>=2;count-=2) {
+
+            *reinterpret_cast<uint32_t *>(dest)=blend565x2(src[0] | (static_cast<uint32_t>(src[1]) << 16),
+                                                           *reinterpret_cast<uint32_t *>(dest),
+                                                           a5);
+            dest+=2;
+            src+=2;
+          }
+
+          if(count)
+            *dest=blend565(*src,*dest,a5);
+        }
+
+
+        /**
+         * Blend a solid colour on to a row of 5-6-5 pixels using an 8-bit coverage mask
+         * @param dest The destination pixels, updated in place
+         * @param colour The 5-6-5 colour
+         * @param mask The alpha mask, one byte per pixel
+         * @param count The number of pixels
+         */
+
+        static void blendRowA8(uint16_t *dest,uint16_t colour,const uint8_t *mask,uint32_t count) {
+
+          uint32_t a5;
+
+          while(count--) {
+
+            a5=alpha5(*mask++);
+
+            if(a5==32)
+              *dest=colour;
+            else if(a5)
+              *dest=blend565(colour,*dest,a5);
+
+            dest++;
+          }
+        }
+
+
+        /**
+         * Blend a row of RGBA8888 pixels on to a row of 5-6-5 pixels
+         * @param dest The destination pixels, updated in place
+         * @param rgba The source pixels as R,G,B,A byte quads
+         * @param count The number of pixels
+         */
+
+        static void blendRowRgba(uint16_t *dest,const uint8_t *rgba,uint32_t count) {
+
+          uint32_t a5;
+
+          while(count--) {
+
+            a5=alpha5(rgba[3]);
+
+            if(a5==32)
+              *dest=rgbTo565(rgba[0],rgba[1],rgba[2]);
+            else if(a5)
+              *dest=blend565(rgbTo565(rgba[0],rgba[1],rgba[2]),*dest,a5);
+
+            dest++;
+            rgba+=4;
+          }
+        }
+
+
+        /**
+         * Blend two #rrggbb colours with full 8-bit precision. Used when blending against a
+         * known background colour on devices that can't read back.
+         * @param fg The foreground colour
+         * @param bg The background colour
+         * @param alpha The foreground weight, 0..255
+         * @return The blended colour
+         */
+
+        static uint32_t blend888(uint32_t fg,uint32_t bg,uint8_t alpha) {
+
+          uint32_t rb,g,ia;
+
+          ia=255-alpha;
+
+          // red and blue together, green on its own
+
+          rb=((fg & 0xff00ff)*alpha+(bg & 0xff00ff)*ia+0x800080) >> 8;
+          g=((fg & 0xff00)*alpha+(bg & 0xff00)*ia+0x8000) >> 8;
+
+          return (rb & 0xff00ff) | (g & 0xff00);
+        }
+    };
+  }
+}
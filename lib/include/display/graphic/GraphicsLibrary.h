@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include "display/graphic/AlphaBlend.h"
+
 
 namespace stm32plus {
   namespace display {
@@ -25,21 +27,54 @@ namespace stm32plus {
       typedef typename TDevice::UnpackedColour UnpackedColour;    ///< Helper type for the unpacked colour structure
       typedef typename TDevice::tCOLOUR tCOLOUR;                  ///< Helper type for the packed colour type
 
+      enum {
+        MAX_CLIP_DEPTH = 4      ///< maximum number of nested clip rectangles
+      };
+
     protected:
 
       UnpackedColour _foreground;
       UnpackedColour _background;
+      tCOLOUR _foregroundColour;          // packed copies of the colours for blending
+      tCOLOUR _backgroundColour;
 
       Point _streamSelectedPoint;         // need to keep a copy so rvalue points can be used
       const Font *_streamSelectedFont;    // can keep a ptr, user should not delete font while selected
       bool _fontFilledBackground;         // true to use filled backgrounds for fonts
 
+      Rectangle _clipStack[MAX_CLIP_DEPTH]; // clip rectangles, the top is the intersection of all of them
+      uint8_t _clipDepth;
+
+      /*
+       * Polygon edge state for the scanline rasteriser. x advances by
+       * xstep+(xrem/dy) per scanline using exact integer arithmetic
+       */
+
+      struct PolygonEdge {
+        int16_t ytop,ybottom;
+        int32_t x,xstep,xrem,xerr,dy;
+      };
+
     protected:
       void plot4EllipsePoints(int16_t cx,int16_t cy,int16_t x,int16_t y);
+      void drawSpanLine(const Point& p1,const Point& p2);
+      void drawRoundedCorners(const Rectangle& rc,int16_t radius,bool fill);
+
+      void plotCoverage(int16_t x,int16_t y,uint8_t alpha);
+      void plotCoverage(int16_t x,int16_t y,uint8_t alpha,ReadbackTag<true>);
+      void plotCoverage(int16_t x,int16_t y,uint8_t alpha,ReadbackTag<false>);
+      void plot4CoveragePoints(const Point& center,int16_t x,int16_t y,uint8_t alpha);
+      void blendRgbaRow(const Rectangle& rc,const uint8_t *rgba,ReadbackTag<true>);
+      void blendRgbaRow(const Rectangle& rc,const uint8_t *rgba,ReadbackTag<false>);
+      void blendMaskRow(const Rectangle& rc,const uint8_t *mask,ReadbackTag<true>);
+      void blendMaskRow(const Rectangle& rc,const uint8_t *mask,ReadbackTag<false>);
 
     public:
       GraphicsLibrary(TDeviceAccessMode& accessMode);
 
+      template<typename... TDeviceArgs>
+      GraphicsLibrary(TDeviceAccessMode& accessMode,TDeviceArgs... deviceArgs);
+
       // colour choices
 
       void setForeground(tCOLOUR cr);
@@ -96,6 +131,31 @@ namespace stm32plus {
       void fillEllipse(const Point& center,const Size& size);
       void drawLine(const Point& p1,const Point& p2);
 
+      // clipping. applies to the span based primitives and to filled rectangles and ellipses
+
+      bool pushClipRectangle(const Rectangle& rc);
+      void popClipRectangle();
+      Rectangle getClipRectangle() const;
+
+      // span based primitives
+
+      void fillSpan(int16_t x1,int16_t x2,int16_t y);
+      void drawPolygon(const Point *points,uint16_t numPoints);
+      void fillPolygon(const Point *points,uint16_t numPoints);
+      void drawTriangle(const Point& p1,const Point& p2,const Point& p3);
+      void fillTriangle(const Point& p1,const Point& p2,const Point& p3);
+      void drawThickLine(const Point& p1,const Point& p2,uint16_t thickness,LineCap cap=LINE_CAP_BUTT);
+      void drawRoundedRectangle(const Rectangle& rc,int16_t radius);
+      void fillRoundedRectangle(const Rectangle& rc,int16_t radius);
+
+      // anti-aliased and alpha blended primitives. devices that can read back (OffScreenCanvas)
+      // composite on to what's there, others blend against the background colour.
+
+      void drawAntiAliasedLine(const Point& p1,const Point& p2);
+      void drawAntiAliasedEllipse(const Point& center,const Size& size);
+      void drawSprite(const Point& p,const Size& size,const uint8_t *rgba);
+      void drawAlphaMask(const Point& p,const Size& size,const uint8_t *mask);
+
       // bitmap handling
 
       template<class TDmaCopierImpl>
@@ -118,6 +178,8 @@ namespace stm32plus {
 #include "gl/Primitives.inl"
 #include "gl/Ellipse.inl"
 #include "gl/Rectangle.inl"
+#include "gl/Polygon.inl"
+#include "gl/Alpha.inl"
 #include "gl/Text.inl"
 #include "gl/LzgText.inl"
 #include "gl/Bitmap.inl"
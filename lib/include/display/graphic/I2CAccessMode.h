@@ -0,0 +1,124 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include "gpio/Gpio.h"
+#include "timing/MillisecondTimer.h"
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * @brief I2C access to a panel such as the SSD1306.
+     *
+     * Each transaction starts with a control byte that tells the controller whether the
+     * following bytes are commands or display data. That maps neatly on to the "register
+     * address" byte of the single byte master polling feature so we use that to send it.
+     * Many I2C modules do not bring out the reset line so the reset pin is optional.
+     *
+     * @tparam TI2C The I2C peripheral type. Must include I2CSingleByteMasterPollingFeature.
+     */
+
+    template<class TI2C>
+    class I2CAccessMode {
+
+      public:
+        enum {
+          DEFAULT_SLAVE_ADDRESS = 0x78,   ///< 0x3C left aligned. 0x7A if SA0 is high
+
+          CONTROL_COMMAND = 0x00,         ///< Co=0, D/C#=0
+          CONTROL_DATA = 0x40             ///< Co=0, D/C#=1
+        };
+
+      protected:
+        TI2C& _i2c;
+        Gpio *_resetPin;
+
+      public:
+        I2CAccessMode(TI2C& i2c,Gpio *resetPin=nullptr,uint8_t slaveAddress=DEFAULT_SLAVE_ADDRESS);
+
+        bool writeCommand(uint8_t command);
+        bool writeData(uint8_t *data,uint16_t dataSize);
+        bool writeData(uint8_t data);
+
+        void reset();
+    };
+
+
+    /**
+     * Constructor
+     * @param i2c The I2C peripheral
+     * @param resetPin The optional reset pin
+     * @param slaveAddress The 7-bit slave address, left aligned
+     */
+
+    template<class TI2C>
+    inline I2CAccessMode<TI2C>::I2CAccessMode(TI2C& i2c,Gpio *resetPin,uint8_t slaveAddress)
+      : _i2c(i2c),
+        _resetPin(resetPin) {
+
+      _i2c.setSlaveAddress(slaveAddress);
+    }
+
+
+    /**
+     * Reset the device. Does nothing if there is no reset pin.
+     */
+
+    template<class TI2C>
+    inline void I2CAccessMode<TI2C>::reset() {
+
+      if(_resetPin==nullptr)
+        return;
+
+      _resetPin->set();
+      MillisecondTimer::delay(5);
+      _resetPin->reset();
+      MillisecondTimer::delay(50);
+      _resetPin->set();
+      MillisecondTimer::delay(50);
+    }
+
+
+    /**
+     * Send a command
+     * @param command
+     * @return false if it failed
+     */
+
+    template<class TI2C>
+    inline bool I2CAccessMode<TI2C>::writeCommand(uint8_t command) {
+      return _i2c.writeByte(CONTROL_COMMAND,command);
+    }
+
+
+    /**
+     * Write a block of display data in a single I2C transaction
+     * @param data
+     * @param dataSize Number of bytes to send
+     * @return false if it failed
+     */
+
+    template<class TI2C>
+    inline bool I2CAccessMode<TI2C>::writeData(uint8_t *data,uint16_t dataSize) {
+      return _i2c.writeBytes(CONTROL_DATA,data,dataSize);
+    }
+
+
+    /**
+     * Write a single byte
+     * @param data
+     * @return false if it failed
+     */
+
+    template<class TI2C>
+    inline bool I2CAccessMode<TI2C>::writeData(uint8_t data) {
+      return writeData(&data,1);
+    }
+  }
+}
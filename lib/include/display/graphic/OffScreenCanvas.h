@@ -0,0 +1,857 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include "display/graphic/FrameBuffer.h"
+#include "display/graphic/AlphaBlend.h"
+
+
+namespace stm32plus {
+  namespace display {
+
+    template<class TPanel>
+    class OffScreenCanvas;
+
+
+    /**
+     * The canvas can read back its pixels so it can do real alpha compositing
+     */
+
+    template<class TPanel>
+    struct DeviceHasReadback<OffScreenCanvas<TPanel> > {
+      enum { value = true };
+    };
+
+
+    /**
+     * @brief An off-screen drawing surface for a TFT panel.
+     *
+     * This class implements the same device interface as the TFT drivers so it can be plugged
+     * into the GraphicsLibrary template in place of a real panel. All the primitives, fonts,
+     * bitmaps and JPEGs then draw into SRAM instead of going over the bus. A small list of dirty
+     * rectangles is maintained and flush() sends only those regions to the real panel, either
+     * through the CPU or through the DmaFsmcLcdMemoryCopyFeature.
+     *
+     * Pixels are stored in the panel's unpacked colour format, which is also the raw transfer
+     * format for all the supported drivers. If there isn't enough SRAM for the whole panel then
+     * a tile height can be given and the canvas will hold just that many rows. The caller then
+     * redraws the scene once for each tile with selectTile() and flush(). Output that falls
+     * outside the selected tile is discarded.
+     *
+     * Because the canvas can read back its own pixels it supports real alpha compositing of
+     * 5-6-5 pixels, RGBA sprites and A8 masks. GraphicsLibrary uses this automatically for its
+     * anti-aliased and alpha primitives.
+     *
+     *   typedef ILI9325_Landscape_64K<LcdAccessMode> LcdPanel;
+     *   typedef GraphicsLibrary<OffScreenCanvas<LcdPanel>,LcdPanel> Canvas;
+     *
+     *   Canvas canvas(lcd,80);     // 3 tiles of 320x80
+     *
+     * @tparam TPanel The GraphicsLibrary type of the real panel.
+     */
+
+    template<class TPanel>
+    class OffScreenCanvas {
+
+      public:
+        typedef typename TPanel::UnpackedColour UnpackedColour;
+        typedef typename TPanel::tCOLOUR tCOLOUR;
+
+        enum {
+          MAX_DIRTY_RECTANGLES = 8,         ///< merging kicks in when this is exceeded
+          MAX_DMA_TRANSFER_BYTES = 65534    ///< largest single DMA transfer for 8 or 16-bit access modes
+        };
+
+      protected:
+        TPanel& _panel;
+        FrameBuffer<UnpackedColour> _frameBuffer;
+
+        int16_t _width;                 // panel width
+        int16_t _tileTop;               // panel Y of the first row in the frame buffer
+        int16_t _tileHeight;            // number of rows in the frame buffer
+
+        Rectangle _window;              // current output window in panel co-ordinates
+        Point _cursorPos;               // next output pixel
+
+        int16_t _pendingX1,_pendingY1;  // bounding box of pixels written since the last moveTo()
+        int16_t _pendingX2,_pendingY2;
+
+        Rectangle _dirty[MAX_DIRTY_RECTANGLES];
+        uint8_t _dirtyCount;
+
+      protected:
+        static int16_t getTileHeight(TPanel& panel,int16_t tileHeight);
+
+        void commitPending();
+        void extendPending(int16_t x1,int16_t x2,int16_t y);
+        bool clipToTile(const Rectangle& rc,Rectangle& clipped) const;
+        void addDirty(const Rectangle& rc);
+        void removeDirty(uint8_t index);
+        UnpackedColour *getRowAddress(int16_t x,int16_t y);
+
+        template<bool TIsFill>
+        void output(uint32_t numPixels,const UnpackedColour *src);
+
+      public:
+        OffScreenCanvas(TPanel& panel,int16_t tileHeight=0,UnpackedColour *buffer=nullptr);
+
+        void initialise();
+
+        // panel querying
+
+        int16_t getWidth() const;
+        int16_t getHeight() const;
+
+        // colour handling is delegated to the panel
+
+        void unpackColour(tCOLOUR src,UnpackedColour& dest) const;
+        void unpackColour(uint8_t red,uint8_t green,uint8_t blue,UnpackedColour& dest) const;
+
+        // window positioning
+
+        void moveTo(const Rectangle& rc);
+        void moveTo(int16_t xstart,int16_t ystart,int16_t xend,int16_t yend);
+        void moveX(int16_t xstart,int16_t xend);
+        void moveY(int16_t ystart,int16_t yend);
+
+        // pixel output
+
+        void beginWriting() const;
+        void writePixel(const UnpackedColour& cr);
+        void writePixelAgain(const UnpackedColour& cr);
+        void fillPixels(uint32_t numPixels,const UnpackedColour& cr);
+
+        void allocatePixelBuffer(uint32_t numPixels,uint8_t*& buffer,uint32_t& bytesPerPixel) const;
+        void rawTransfer(const void *data,uint32_t numPixels);
+
+        // alpha compositing, 64K colour panels only
+
+        void blendPixel(int16_t x,int16_t y,const UnpackedColour& cr,uint8_t alpha);
+        void blendRgb565(const Rectangle& rc,const uint16_t *pixels,uint8_t alpha);
+        void blendA8(const Rectangle& rc,const UnpackedColour& cr,const uint8_t *mask);
+        void blendRgba(const Rectangle& rc,const uint8_t *rgba);
+
+        // tiling
+
+        uint16_t getTileCount() const;
+        void selectTile(uint16_t tile);
+        Rectangle getTileRectangle() const;
+
+        // dirty region management
+
+        void invalidate(const Rectangle& rc);
+        void invalidate();
+        uint8_t getDirtyCount();
+        const Rectangle& getDirtyRectangle(uint8_t index) const;
+
+        void flush();
+
+        template<class TDmaCopierImpl,class TAccessMode>
+        bool flush(DmaLcdWriter<TDmaCopierImpl>& dma,TAccessMode& accessMode,uint32_t priority=DMA_Priority_High);
+    };
+
+
+    /**
+     * Constructor
+     * @param panel The real panel that dirty regions will be flushed to
+     * @param tileHeight The number of rows in a tile. Zero means use the full panel height.
+     * @param buffer Optional preallocated buffer of width*tileHeight pixels, e.g. in external SRAM
+     */
+
+    template<class TPanel>
+    inline OffScreenCanvas<TPanel>::OffScreenCanvas(TPanel& panel,int16_t tileHeight,UnpackedColour *buffer)
+      : _panel(panel),
+        _frameBuffer(Size(panel.getWidth(),getTileHeight(panel,tileHeight)),
+                     static_cast<uint32_t>(panel.getWidth())*static_cast<uint32_t>(getTileHeight(panel,tileHeight)),
+                     buffer),
+        _width(panel.getWidth()),
+        _tileTop(0),
+        _tileHeight(getTileHeight(panel,tileHeight)),
+        _dirtyCount(0) {
+
+      _pendingX1=_pendingY1=INT16_MAX;
+      _pendingX2=_pendingY2=INT16_MIN;
+    }
+
+
+    /**
+     * Get the real tile height
+     */
+
+    template<class TPanel>
+    inline int16_t OffScreenCanvas<TPanel>::getTileHeight(TPanel& panel,int16_t tileHeight) {
+      return tileHeight<=0 || tileHeight>panel.getHeight() ? panel.getHeight() : tileHeight;
+    }
+
+
+    /**
+     * Called by the GraphicsLibrary constructor. The real panel is already initialised
+     * so all we do here is select the first tile.
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::initialise() {
+      selectTile(0);
+    }
+
+
+    /**
+     * Get the width in pixels
+     * @return The panel width
+     */
+
+    template<class TPanel>
+    inline int16_t OffScreenCanvas<TPanel>::getWidth() const {
+      return _width;
+    }
+
+
+    /**
+     * Get the height in pixels. This is the full panel height, not the tile height.
+     * @return The panel height
+     */
+
+    template<class TPanel>
+    inline int16_t OffScreenCanvas<TPanel>::getHeight() const {
+      return _panel.getHeight();
+    }
+
+
+    /**
+     * Unpack a colour using the panel's format
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::unpackColour(tCOLOUR src,UnpackedColour& dest) const {
+      _panel.unpackColour(src,dest);
+    }
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::unpackColour(uint8_t red,uint8_t green,uint8_t blue,UnpackedColour& dest) const {
+      _panel.unpackColour(red,green,blue,dest);
+    }
+
+
+    /**
+     * Move the display output rectangle
+     * @param rc The display output rectangle
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::moveTo(const Rectangle& rc) {
+
+      commitPending();
+
+      _window=rc;
+      _cursorPos=rc.getTopLeft();
+    }
+
+
+    /**
+     * Move the display rectangle to the rectangle described by the co-ordinates
+     * @param xstart starting X position
+     * @param ystart starting Y position
+     * @param xend ending X position
+     * @param yend ending Y position
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::moveTo(int16_t xstart,int16_t ystart,int16_t xend,int16_t yend) {
+      moveTo(Rectangle(xstart,ystart,xend-xstart+1,yend-ystart+1));
+    }
+
+
+    /**
+     * Move the X position
+     * @param xstart The new X start position
+     * @param xend The new X end position
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::moveX(int16_t xstart,int16_t xend) {
+      _window.X=xstart;
+      _window.Width=xend-xstart+1;
+      _cursorPos.X=xstart;
+    }
+
+
+    /**
+     * Move the Y position
+     * @param ystart The new Y start position
+     * @param yend The new Y end position
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::moveY(int16_t ystart,int16_t yend) {
+      _window.Y=ystart;
+      _window.Height=yend-ystart+1;
+      _cursorPos.Y=ystart;
+    }
+
+
+    /**
+     * Get the address of a pixel in the frame buffer
+     * @param x panel X co-ordinate
+     * @param y panel Y co-ordinate, must be inside the current tile
+     * @return The pixel address
+     */
+
+    template<class TPanel>
+    inline typename OffScreenCanvas<TPanel>::UnpackedColour *OffScreenCanvas<TPanel>::getRowAddress(int16_t x,int16_t y) {
+      return _frameBuffer.getBuffer()+static_cast<uint32_t>(y-_tileTop)*static_cast<uint32_t>(_width)+x;
+    }
+
+
+    /**
+     * Output pixels into the window, wrapping at the right edge as the panel would.
+     * Pixels outside the panel or the current tile are discarded.
+     * @tparam TIsFill true if src is a single colour to repeat, false if it's an array
+     * @param numPixels The number of pixels
+     * @param src The source pixel(s)
+     */
+
+    template<class TPanel>
+    template<bool TIsFill>
+    inline void OffScreenCanvas<TPanel>::output(uint32_t numPixels,const UnpackedColour *src) {
+
+      int16_t windowRight,x1,x2;
+      uint32_t count;
+      UnpackedColour *dest;
+
+      windowRight=_window.X+_window.Width;
+
+      while(numPixels) {
+
+        // the number of pixels remaining on this row of the window
+
+        count=std::min<uint32_t>(numPixels,windowRight-_cursorPos.X);
+
+        // clip to the panel width and the tile
+
+        x1=std::max<int16_t>(_cursorPos.X,0);
+        x2=std::min<int16_t>(_cursorPos.X+count,_width);
+
+        if(x1<x2 && _cursorPos.Y>=_tileTop && _cursorPos.Y<_tileTop+_tileHeight) {
+
+          dest=getRowAddress(x1,_cursorPos.Y);
+
+          if(TIsFill)
+            std::fill_n(dest,x2-x1,*src);
+          else
+            memcpy(dest,src+(x1-_cursorPos.X),(x2-x1)*sizeof(UnpackedColour));
+
+          extendPending(x1,x2-1,_cursorPos.Y);
+        }
+
+        if(!TIsFill)
+          src+=count;
+
+        numPixels-=count;
+
+        // move on, wrapping to the next row if necessary
+
+        if((_cursorPos.X+=count)==windowRight) {
+          _cursorPos.X=_window.X;
+          _cursorPos.Y++;
+        }
+      }
+    }
+
+
+    /**
+     * Not relevant because there's no panel command to issue
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::beginWriting() const {
+    }
+
+
+    /**
+     * Write a single pixel to the current output position.
+     * @param cr The pixel to write
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::writePixel(const UnpackedColour& cr) {
+      output<true>(1,&cr);
+    }
+
+
+    /**
+     * Write the same colour pixel that we last wrote
+     * @param cr The same pixel to write again
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::writePixelAgain(const UnpackedColour& cr) {
+      output<true>(1,&cr);
+    }
+
+
+    /**
+     * Fill a block of pixels with the same colour.
+     * @param numPixels how many
+     * @param cr The unpacked colour to write
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::fillPixels(uint32_t numPixels,const UnpackedColour& cr) {
+      output<true>(numPixels,&cr);
+    }
+
+
+    /**
+     * Allocate a buffer for pixel data. Allocated buffers should be freed with delete[]
+     * @param numPixels The number of pixels to allocate
+     * @param buffer The output buffer
+     * @param bytesPerPixel Output the number of bytes per pixel
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::allocatePixelBuffer(uint32_t numPixels,uint8_t*& buffer,uint32_t& bytesPerPixel) const {
+      bytesPerPixel=sizeof(UnpackedColour);
+      buffer=new uint8_t[numPixels*bytesPerPixel];
+    }
+
+
+    /**
+     * Bulk-copy some pixels into the canvas at the current position.
+     * @param data The pixels, in the panel's raw format
+     * @param numPixels The number of pixels to copy
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::rawTransfer(const void *data,uint32_t numPixels) {
+      output<false>(numPixels,reinterpret_cast<const UnpackedColour *>(data));
+    }
+
+
+    /**
+     * Extend the bounding box of the pixels written since the last window move
+     * @param x1 The first X co-ordinate
+     * @param x2 The last X co-ordinate, inclusive
+     * @param y The Y co-ordinate
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::extendPending(int16_t x1,int16_t x2,int16_t y) {
+
+      if(x1<_pendingX1)
+        _pendingX1=x1;
+      if(x2>_pendingX2)
+        _pendingX2=x2;
+      if(y<_pendingY1)
+        _pendingY1=y;
+      if(y>_pendingY2)
+        _pendingY2=y;
+    }
+
+
+    /**
+     * Clip a rectangle to the current tile
+     * @param rc The rectangle in panel co-ordinates
+     * @param clipped The clipped rectangle
+     * @return false if there's nothing left
+     */
+
+    template<class TPanel>
+    inline bool OffScreenCanvas<TPanel>::clipToTile(const Rectangle& rc,Rectangle& clipped) const {
+      return rc.intersection(getTileRectangle(),clipped);
+    }
+
+
+    /**
+     * Blend a single pixel on to the canvas
+     * @param x The panel X co-ordinate
+     * @param y The panel Y co-ordinate
+     * @param cr The colour to blend
+     * @param alpha The colour's alpha, 0..255
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::blendPixel(int16_t x,int16_t y,const UnpackedColour& cr,uint8_t alpha) {
+
+      uint16_t *ptr;
+
+      static_assert(sizeof(UnpackedColour)==2,"Alpha compositing requires a 64K colour panel");
+
+      if(x<0 || x>=_width || y<_tileTop || y>=_tileTop+_tileHeight)
+        return;
+
+      ptr=reinterpret_cast<uint16_t *>(getRowAddress(x,y));
+      *ptr=AlphaBlend::blend565(*reinterpret_cast<const uint16_t *>(&cr),*ptr,AlphaBlend::alpha5(alpha));
+
+      extendPending(x,x,y);
+    }
+
+
+    /**
+     * Blend a block of 5-6-5 pixels on to the canvas with constant alpha
+     * @param rc The destination, which may extend outside the tile
+     * @param pixels The source pixels, rc.Width per row
+     * @param alpha The source alpha, 0..255
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::blendRgb565(const Rectangle& rc,const uint16_t *pixels,uint8_t alpha) {
+
+      Rectangle clipped;
+      int16_t y;
+
+      static_assert(sizeof(UnpackedColour)==2,"Alpha compositing requires a 64K colour panel");
+
+      if(!clipToTile(rc,clipped))
+        return;
+
+      pixels+=static_cast<uint32_t>(clipped.Y-rc.Y)*rc.Width+(clipped.X-rc.X);
+
+      for(y=clipped.Y;y<clipped.Y+clipped.Height;y++) {
+        AlphaBlend::blendRow565(reinterpret_cast<uint16_t *>(getRowAddress(clipped.X,y)),pixels,clipped.Width,alpha);
+        pixels+=rc.Width;
+      }
+
+      commitPending();
+      addDirty(clipped);
+    }
+
+
+    /**
+     * Blend a solid colour on to the canvas through an 8-bit coverage mask
+     * @param rc The destination, which may extend outside the tile
+     * @param cr The colour
+     * @param mask The coverage values, rc.Width per row
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::blendA8(const Rectangle& rc,const UnpackedColour& cr,const uint8_t *mask) {
+
+      Rectangle clipped;
+      int16_t y;
+
+      static_assert(sizeof(UnpackedColour)==2,"Alpha compositing requires a 64K colour panel");
+
+      if(!clipToTile(rc,clipped))
+        return;
+
+      mask+=static_cast<uint32_t>(clipped.Y-rc.Y)*rc.Width+(clipped.X-rc.X);
+
+      for(y=clipped.Y;y<clipped.Y+clipped.Height;y++) {
+
+        AlphaBlend::blendRowA8(reinterpret_cast<uint16_t *>(getRowAddress(clipped.X,y)),
+                               *reinterpret_cast<const uint16_t *>(&cr),
+                               mask,
+                               clipped.Width);
+        mask+=rc.Width;
+      }
+
+      commitPending();
+      addDirty(clipped);
+    }
+
+
+    /**
+     * Blend an RGBA8888 sprite on to the canvas
+     * @param rc The destination, which may extend outside the tile
+     * @param rgba The source pixels as R,G,B,A byte quads, rc.Width per row
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::blendRgba(const Rectangle& rc,const uint8_t *rgba) {
+
+      Rectangle clipped;
+      int16_t y;
+
+      static_assert(sizeof(UnpackedColour)==2,"Alpha compositing requires a 64K colour panel");
+
+      if(!clipToTile(rc,clipped))
+        return;
+
+      rgba+=(static_cast<uint32_t>(clipped.Y-rc.Y)*rc.Width+(clipped.X-rc.X))*4;
+
+      for(y=clipped.Y;y<clipped.Y+clipped.Height;y++) {
+        AlphaBlend::blendRowRgba(reinterpret_cast<uint16_t *>(getRowAddress(clipped.X,y)),rgba,clipped.Width);
+        rgba+=rc.Width*4;
+      }
+
+      commitPending();
+      addDirty(clipped);
+    }
+
+
+    /**
+     * Move the bounding box of the pixels written since the last window move into the dirty list
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::commitPending() {
+
+      if(_pendingX1>_pendingX2)
+        return;
+
+      addDirty(Rectangle(_pendingX1,_pendingY1,_pendingX2-_pendingX1+1,_pendingY2-_pendingY1+1));
+
+      _pendingX1=_pendingY1=INT16_MAX;
+      _pendingX2=_pendingY2=INT16_MIN;
+    }
+
+
+    /**
+     * Add a rectangle to the dirty list. Rectangles that overlap or touch an existing entry are
+     * merged with it. If the list is full then the new rectangle is merged with the entry that
+     * causes the smallest increase in area.
+     * @param rect The rectangle, which must already be clipped to the tile
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::addDirty(const Rectangle& rect) {
+
+      Rectangle rc(rect),merged,grown;
+      uint8_t i,best;
+      uint32_t cost,bestCost;
+      bool changed;
+
+      // merge with everything it touches, repeating because a merge can create new overlaps
+
+      do {
+
+        changed=false;
+
+        for(i=0;i<_dirtyCount;i++) {
+
+          grown=_dirty[i];
+          grown.X--;
+          grown.Y--;
+          grown.Width+=2;
+          grown.Height+=2;
+
+          if(grown.intersects(rc)) {
+            rc.extend(_dirty[i]);
+            removeDirty(i);
+            changed=true;
+            break;
+          }
+        }
+
+      } while(changed);
+
+      // if there's room then just add it
+
+      if(_dirtyCount<MAX_DIRTY_RECTANGLES) {
+        _dirty[_dirtyCount++]=rc;
+        return;
+      }
+
+      // find the cheapest merge
+
+      best=0;
+      bestCost=UINT32_MAX;
+
+      for(i=0;i<_dirtyCount;i++) {
+
+        merged=_dirty[i];
+        merged.extend(rc);
+
+        cost=merged.getArea()-_dirty[i].getArea();
+
+        if(cost<bestCost) {
+          bestCost=cost;
+          best=i;
+        }
+      }
+
+      rc.extend(_dirty[best]);
+      removeDirty(best);
+
+      // the merged rectangle may now overlap others
+
+      addDirty(rc);
+    }
+
+
+    /**
+     * Remove an entry from the dirty list
+     * @param index The entry to remove
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::removeDirty(uint8_t index) {
+      _dirty[index]=_dirty[--_dirtyCount];
+    }
+
+
+    /**
+     * Mark a region as dirty so that it gets flushed even if it hasn't been drawn
+     * @param rc The region in panel co-ordinates
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::invalidate(const Rectangle& rc) {
+
+      Rectangle clipped;
+
+      if(rc.intersection(getTileRectangle(),clipped))
+        addDirty(clipped);
+    }
+
+
+    /**
+     * Mark the entire current tile as dirty
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::invalidate() {
+      _dirtyCount=0;
+      addDirty(getTileRectangle());
+    }
+
+
+    /**
+     * Get the number of dirty rectangles waiting to be flushed
+     * @return The dirty rectangle count
+     */
+
+    template<class TPanel>
+    inline uint8_t OffScreenCanvas<TPanel>::getDirtyCount() {
+      commitPending();
+      return _dirtyCount;
+    }
+
+
+    /**
+     * Get a dirty rectangle
+     * @param index The index, less than getDirtyCount()
+     * @return The rectangle in panel co-ordinates
+     */
+
+    template<class TPanel>
+    inline const Rectangle& OffScreenCanvas<TPanel>::getDirtyRectangle(uint8_t index) const {
+      return _dirty[index];
+    }
+
+
+    /**
+     * Get the number of tiles needed to cover the panel
+     * @return The tile count
+     */
+
+    template<class TPanel>
+    inline uint16_t OffScreenCanvas<TPanel>::getTileCount() const {
+      return (_panel.getHeight()+_tileHeight-1)/_tileHeight;
+    }
+
+
+    /**
+     * Select a tile for drawing. Any dirty regions in the previous tile that haven't been
+     * flushed are discarded.
+     * @param tile The tile index, less than getTileCount()
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::selectTile(uint16_t tile) {
+
+      _tileTop=tile*_tileHeight;
+      _dirtyCount=0;
+
+      _pendingX1=_pendingY1=INT16_MAX;
+      _pendingX2=_pendingY2=INT16_MIN;
+    }
+
+
+    /**
+     * Get the area of the panel covered by the current tile
+     * @return The tile rectangle, the last tile may be clipped by the panel height
+     */
+
+    template<class TPanel>
+    inline Rectangle OffScreenCanvas<TPanel>::getTileRectangle() const {
+      return Rectangle(0,_tileTop,_width,std::min<int16_t>(_tileHeight,_panel.getHeight()-_tileTop));
+    }
+
+
+    /**
+     * Send the dirty regions to the panel using the CPU, one window and one raw transfer
+     * per row for each region.
+     */
+
+    template<class TPanel>
+    inline void OffScreenCanvas<TPanel>::flush() {
+
+      uint8_t i;
+      int16_t y;
+      const Rectangle *rc;
+
+      commitPending();
+
+      for(i=0;i<_dirtyCount;i++) {
+
+        rc=&_dirty[i];
+
+        _panel.moveTo(*rc);
+        _panel.beginWriting();
+
+        if(rc->Width==_width)
+          _panel.rawTransfer(getRowAddress(0,rc->Y),rc->getArea());
+        else {
+          for(y=rc->Y;y<rc->Y+rc->Height;y++)
+            _panel.rawTransfer(getRowAddress(rc->X,y),rc->Width);
+        }
+      }
+
+      _dirtyCount=0;
+    }
+
+
+    /**
+     * Send the dirty regions to the panel using DMA. Full width regions are contiguous in memory
+     * and go out in as few transfers as possible. Other regions go one row at a time.
+     * @param dma The DMA LCD writer, e.g. DmaFsmcLcdMemoryCopyFeature
+     * @param accessMode The panel access mode, used to get the data register address
+     * @param priority The DMA priority
+     * @return false if a DMA transfer failed
+     */
+
+    template<class TPanel>
+    template<class TDmaCopierImpl,class TAccessMode>
+    inline bool OffScreenCanvas<TPanel>::flush(DmaLcdWriter<TDmaCopierImpl>& dma,TAccessMode& accessMode,uint32_t priority) {
+
+      uint8_t i;
+      int16_t y,rows;
+      uint32_t rowBytes,rowsPerTransfer;
+      const Rectangle *rc;
+
+      commitPending();
+
+      for(i=0;i<_dirtyCount;i++) {
+
+        rc=&_dirty[i];
+        rowBytes=static_cast<uint32_t>(rc->Width)*sizeof(UnpackedColour);
+
+        // contiguous rows can be batched up to the DMA transfer limit
+
+        rowsPerTransfer=rc->Width==_width ? std::max<uint32_t>(1,MAX_DMA_TRANSFER_BYTES/rowBytes) : 1;
+        rowsPerTransfer=std::min<uint32_t>(rowsPerTransfer,rc->Height);
+
+        _panel.moveTo(*rc);
+        _panel.beginWriting();
+
+        for(y=rc->Y;y<rc->Y+rc->Height;y+=rows) {
+
+          rows=std::min<int16_t>(static_cast<int16_t>(rowsPerTransfer),rc->Y+rc->Height-y);
+
+          dma.beginCopyToLcd((void *)accessMode.getDataAddress(),getRowAddress(rc->X,y),rowBytes*rows,priority);
+
+          if(!dma.waitUntilComplete())
+            return false;
+        }
+      }
+
+      _dirtyCount=0;
+      return true;
+    }
+  }
+}
@@ -48,5 +48,15 @@ namespace stm32plus {
       HORIZONTAL,
       VERTICAL
     };
+
+    /*
+     * Possible end caps for thick lines
+     */
+
+    enum LineCap {
+      LINE_CAP_BUTT,          // line ends exactly at the end points
+      LINE_CAP_SQUARE,        // line extends by half its thickness past the end points
+      LINE_CAP_ROUND          // semi-circular ends centred on the end points
+    };
   }
 }
@@ -0,0 +1,330 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * Plot a pixel in the foreground colour with partial coverage. The pixel is clipped to
+     * the current clip rectangle.
+     * @param x The X co-ordinate
+     * @param y The Y co-ordinate
+     * @param alpha The coverage, 0..255
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::plotCoverage(int16_t x,int16_t y,uint8_t alpha) {
+
+      Rectangle clip(getClipRectangle());
+
+      if(alpha==0 || x<clip.X || y<clip.Y || x>=clip.X+clip.Width || y>=clip.Y+clip.Height)
+        return;
+
+      plotCoverage(x,y,alpha,ReadbackTag<DeviceHasReadback<TDevice>::value>());
+    }
+
+
+    /**
+     * Coverage plot for devices that can read back: composite on to the existing pixel
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::plotCoverage(int16_t x,int16_t y,uint8_t alpha,ReadbackTag<true>) {
+      this->blendPixel(x,y,_foreground,alpha);
+    }
+
+
+    /**
+     * Coverage plot for devices that can't read back: blend against the background colour
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::plotCoverage(int16_t x,int16_t y,uint8_t alpha,ReadbackTag<false>) {
+
+      UnpackedColour cr;
+
+      this->unpackColour(AlphaBlend::blend888(_foregroundColour,_backgroundColour,alpha),cr);
+
+      this->moveTo(Rectangle(x,y,1,1));
+      this->beginWriting();
+      this->writePixel(cr);
+    }
+
+
+    /**
+     * Plot the 4 symmetric points of an ellipse quadrant with partial coverage. Points on the
+     * axes are only plotted once so they don't get blended twice.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::plot4CoveragePoints(const Point& center,int16_t x,int16_t y,uint8_t alpha) {
+
+      plotCoverage(center.X+x,center.Y+y,alpha);
+
+      if(x)
+        plotCoverage(center.X-x,center.Y+y,alpha);
+
+      if(y) {
+        plotCoverage(center.X+x,center.Y-y,alpha);
+
+        if(x)
+          plotCoverage(center.X-x,center.Y-y,alpha);
+      }
+    }
+
+
+    /**
+     * Draw an anti-aliased line using Xiaolin Wu's algorithm. The minor axis position is
+     * tracked in 16.16 fixed point and the two pixels that straddle it share the coverage.
+     * @param p1 The first point
+     * @param p2 The second point
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawAntiAliasedLine(const Point& p1,const Point& p2) {
+
+      int16_t x0,y0,x1,y1,x,major;
+      int32_t dx,dy,gradient,intery;
+      uint8_t frac;
+      bool steep;
+
+      // horizontal, vertical and 45 degree lines have nothing to anti-alias
+
+      dx=static_cast<int32_t>(p2.X)-p1.X;
+      dy=static_cast<int32_t>(p2.Y)-p1.Y;
+
+      if(dx==0 || dy==0 || std::abs(dx)==std::abs(dy)) {
+        drawSpanLine(p1,p2);
+        return;
+      }
+
+      // work along the major axis from low to high
+
+      steep=std::abs(dy)>std::abs(dx);
+
+      if(steep) {
+        x0=p1.Y; y0=p1.X;
+        x1=p2.Y; y1=p2.X;
+      }
+      else {
+        x0=p1.X; y0=p1.Y;
+        x1=p2.X; y1=p2.Y;
+      }
+
+      if(x0>x1) {
+        std::swap(x0,x1);
+        std::swap(y0,y1);
+      }
+
+      gradient=((static_cast<int32_t>(y1)-y0) << 16)/(x1-x0);
+      intery=static_cast<int32_t>(y0) << 16;
+
+      for(x=x0;x<=x1;x++) {
+
+        major=intery >> 16;
+        frac=(intery >> 8) & 0xff;
+
+        if(steep) {
+          plotCoverage(major,x,255-frac);
+          plotCoverage(major+1,x,frac);
+        }
+        else {
+          plotCoverage(x,major,255-frac);
+          plotCoverage(x,major+1,frac);
+        }
+
+        intery+=gradient;
+      }
+    }
+
+
+    /**
+     * Draw an anti-aliased ellipse outline. The quadrant is split where the slope is 1 and each
+     * half is walked along its major axis, sharing the coverage between the two pixels that
+     * straddle the curve.
+     * @param center The centre point
+     * @param size The X and Y radii
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawAntiAliasedEllipse(const Point& center,const Size& size) {
+
+      float a2,b2,d,pos;
+      int16_t i,limit,other,xlimit;
+      uint8_t frac;
+
+      if(size.Width==0 || size.Height==0) {
+        drawSpanLine(Point(center.X-size.Width,center.Y-size.Height),Point(center.X+size.Width,center.Y+size.Height));
+        return;
+      }
+
+      a2=static_cast<float>(size.Width)*size.Width;
+      b2=static_cast<float>(size.Height)*size.Height;
+      d=sqrtf(a2+b2);
+
+      // x-major part of the quadrant, near the top and bottom
+
+      xlimit=static_cast<int16_t>(a2/d+0.5f);
+
+      for(i=0;i<=xlimit;i++) {
+
+        pos=size.Height*sqrtf(1.0f-(static_cast<float>(i)*i)/a2);
+        other=static_cast<int16_t>(pos);
+        frac=static_cast<uint8_t>((pos-other)*255.0f);
+
+        plot4CoveragePoints(center,i,other,255-frac);
+        plot4CoveragePoints(center,i,other+1,frac);
+      }
+
+      // y-major part of the quadrant, near the left and right. skip what's already done.
+
+      limit=static_cast<int16_t>(b2/d+0.5f);
+
+      for(i=0;i<=limit;i++) {
+
+        pos=size.Width*sqrtf(1.0f-(static_cast<float>(i)*i)/b2);
+        other=static_cast<int16_t>(pos);
+
+        if(other<=xlimit)
+          break;
+
+        frac=static_cast<uint8_t>((pos-other)*255.0f);
+
+        plot4CoveragePoints(center,other,i,255-frac);
+        plot4CoveragePoints(center,other+1,i,frac);
+      }
+    }
+
+
+    /**
+     * Composite a row of RGBA pixels on to a device that can read back
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::blendRgbaRow(const Rectangle& rc,const uint8_t *rgba,ReadbackTag<true>) {
+      this->blendRgba(rc,rgba);
+    }
+
+
+    /**
+     * Write a row of RGBA pixels to a device that can't read back by blending each one against
+     * the background colour. The row is written through one window.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::blendRgbaRow(const Rectangle& rc,const uint8_t *rgba,ReadbackTag<false>) {
+
+      int16_t i;
+      UnpackedColour cr;
+
+      this->moveTo(rc);
+      this->beginWriting();
+
+      for(i=0;i<rc.Width;i++) {
+
+        this->unpackColour(AlphaBlend::blend888((static_cast<uint32_t>(rgba[0]) << 16) | (static_cast<uint32_t>(rgba[1]) << 8) | rgba[2],
+                                                _backgroundColour,
+                                                rgba[3]),
+                           cr);
+        this->writePixel(cr);
+        rgba+=4;
+      }
+    }
+
+
+    /**
+     * Composite a row of foreground coverage on to a device that can read back
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::blendMaskRow(const Rectangle& rc,const uint8_t *mask,ReadbackTag<true>) {
+      this->blendA8(rc,_foreground,mask);
+    }
+
+
+    /**
+     * Write a row of foreground coverage to a device that can't read back
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::blendMaskRow(const Rectangle& rc,const uint8_t *mask,ReadbackTag<false>) {
+
+      int16_t i;
+      UnpackedColour cr;
+
+      this->moveTo(rc);
+      this->beginWriting();
+
+      for(i=0;i<rc.Width;i++) {
+
+        if(*mask==0)
+          this->writePixel(_background);
+        else if(*mask==255)
+          this->writePixel(_foreground);
+        else {
+          this->unpackColour(AlphaBlend::blend888(_foregroundColour,_backgroundColour,*mask),cr);
+          this->writePixel(cr);
+        }
+
+        mask++;
+      }
+    }
+
+
+    /**
+     * Draw an RGBA8888 sprite. The pixels are R,G,B,A byte quads, row by row.
+     * @param p The top-left position
+     * @param size The sprite size
+     * @param rgba The pixel data
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawSprite(const Point& p,const Size& size,const uint8_t *rgba) {
+
+      Rectangle rc;
+      int16_t y;
+
+      if(!Rectangle(p,size).intersection(getClipRectangle(),rc))
+        return;
+
+      rgba+=(static_cast<uint32_t>(rc.Y-p.Y)*size.Width+(rc.X-p.X))*4;
+
+      for(y=rc.Y;y<rc.Y+rc.Height;y++) {
+        blendRgbaRow(Rectangle(rc.X,y,rc.Width,1),rgba,ReadbackTag<DeviceHasReadback<TDevice>::value>());
+        rgba+=size.Width*4;
+      }
+    }
+
+
+    /**
+     * Draw the foreground colour through an 8-bit coverage mask, for example an anti-aliased
+     * glyph or icon.
+     * @param p The top-left position
+     * @param size The mask size
+     * @param mask The coverage values, one byte per pixel, row by row
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawAlphaMask(const Point& p,const Size& size,const uint8_t *mask) {
+
+      Rectangle rc;
+      int16_t y;
+
+      if(!Rectangle(p,size).intersection(getClipRectangle(),rc))
+        return;
+
+      mask+=static_cast<uint32_t>(rc.Y-p.Y)*size.Width+(rc.X-p.X);
+
+      for(y=rc.Y;y<rc.Y+rc.Height;y++) {
+        blendMaskRow(Rectangle(rc.X,y,rc.Width,1),mask,ReadbackTag<DeviceHasReadback<TDevice>::value>());
+        mask+=size.Width;
+      }
+    }
+  }
+}
@@ -20,6 +20,8 @@ namespace stm32plus {
       : TDevice(accessMode) {
 
       _fontFilledBackground=true;
+      _clipDepth=0;
+      _foregroundColour=_backgroundColour=0;
 
       // initialise the panel
 
@@ -27,17 +29,36 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Constructor for devices that take additional construction parameters, for example the
+     * tile height of an OffScreenCanvas
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    template<typename... TDeviceArgs>
+    inline GraphicsLibrary<TDevice,TDeviceAccessMode>::GraphicsLibrary(TDeviceAccessMode& accessMode,TDeviceArgs... deviceArgs)
+      : TDevice(accessMode,deviceArgs...) {
+
+      _fontFilledBackground=true;
+      _clipDepth=0;
+      _foregroundColour=_backgroundColour=0;
+      this->initialise();
+    }
+
+
     /**
      * set the foreground
      */
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setForeground(tCOLOUR cr) {
+      _foregroundColour=cr;
       this->unpackColour(cr,_foreground);
     }
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setForeground(uint8_t r,uint8_t g,uint8_t b) {
+      _foregroundColour=(static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | b;
       this->unpackColour(r,g,b,_foreground);
     }
 
@@ -47,11 +68,13 @@ namespace stm32plus {
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setBackground(tCOLOUR cr) {
+      _backgroundColour=cr;
       this->unpackColour(cr,_background);
     }
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setBackground(uint8_t r,uint8_t g,uint8_t b) {
+      _backgroundColour=(static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | b;
       this->unpackColour(r,g,b,_background);
     }
 
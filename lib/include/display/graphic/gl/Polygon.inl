@@ -0,0 +1,521 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * Push a new clip rectangle. The effective clip area is the intersection of this rectangle
+     * with the current clip area.
+     * @param rc The new clip rectangle
+     * @return false if the clip stack is full
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline bool GraphicsLibrary<TDevice,TDeviceAccessMode>::pushClipRectangle(const Rectangle& rc) {
+
+      if(_clipDepth==MAX_CLIP_DEPTH)
+        return false;
+
+      Rectangle& top=_clipStack[_clipDepth];
+
+      // an empty intersection clips everything away
+
+      if(!rc.intersection(getClipRectangle(),top)) {
+        top.X=rc.X;
+        top.Y=rc.Y;
+        top.Width=top.Height=0;
+      }
+
+      _clipDepth++;
+      return true;
+    }
+
+
+    /**
+     * Pop the last clip rectangle, restoring the previous clip area
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::popClipRectangle() {
+      if(_clipDepth)
+        _clipDepth--;
+    }
+
+
+    /**
+     * Get the current clip area. This is the full screen if nothing has been pushed.
+     * @return The clip rectangle
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline Rectangle GraphicsLibrary<TDevice,TDeviceAccessMode>::getClipRectangle() const {
+      return _clipDepth ? _clipStack[_clipDepth-1] : getFullScreenRectangle();
+    }
+
+
+    /**
+     * Fill a horizontal span in the foreground colour. This is the output stage of all the
+     * span based primitives. The span is clipped and then written with one window move and
+     * one fill.
+     * @param x1 The first X co-ordinate
+     * @param x2 The last X co-ordinate, inclusive
+     * @param y The Y co-ordinate
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillSpan(int16_t x1,int16_t x2,int16_t y) {
+
+      Rectangle clip(getClipRectangle());
+
+      if(y<clip.Y || y>=clip.Y+clip.Height)
+        return;
+
+      x1=std::max<int16_t>(x1,clip.X);
+      x2=std::min<int16_t>(x2,clip.X+clip.Width-1);
+
+      if(x1>x2)
+        return;
+
+      this->moveTo(Rectangle(x1,y,x2-x1+1,1));
+      this->fillPixels(x2-x1+1,_foreground);
+    }
+
+
+    /**
+     * Draw a one pixel wide line as a series of clipped horizontal spans. Shallow lines
+     * are made up of long horizontal runs so this is much cheaper than plotting pixels.
+     * @param p1 The first point
+     * @param p2 The last point, inclusive
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawSpanLine(const Point& p1,const Point& p2) {
+
+      int16_t x,y,x1,y1,runStart,sx;
+      int32_t dx,dy,err,i;
+
+      // always draw from top to bottom
+
+      if(p1.Y<=p2.Y) {
+        x=p1.X;
+        y=p1.Y;
+        x1=p2.X;
+        y1=p2.Y;
+      }
+      else {
+        x=p2.X;
+        y=p2.Y;
+        x1=p1.X;
+        y1=p1.Y;
+      }
+
+      dx=std::abs(static_cast<int32_t>(x1)-x);
+      dy=static_cast<int32_t>(y1)-y;
+      sx=x<x1 ? 1 : -1;
+
+      if(dx>=dy) {
+
+        // shallow: emit a span each time Y changes
+
+        runStart=x;
+        err=dx/2;
+
+        for(i=0;i<dx;i++) {
+
+          err-=dy;
+
+          if(err<0) {
+            fillSpan(std::min(runStart,x),std::max(runStart,x),y);
+
+            y++;
+            err+=dx;
+            runStart=x+sx;
+          }
+
+          x+=sx;
+        }
+
+        fillSpan(std::min(runStart,x),std::max(runStart,x),y);
+      }
+      else {
+
+        // steep: one pixel per scan line
+
+        err=dy/2;
+
+        for(i=0;i<=dy;i++) {
+
+          fillSpan(x,x,y++);
+
+          err-=dx;
+          if(err<0) {
+            x+=sx;
+            err+=dy;
+          }
+        }
+      }
+    }
+
+
+    /**
+     * Draw the outline of a closed polygon in the foreground colour
+     * @param points The vertices
+     * @param numPoints The number of vertices. The last is joined to the first.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawPolygon(const Point *points,uint16_t numPoints) {
+
+      uint16_t i;
+
+      for(i=0;i<numPoints;i++)
+        drawSpanLine(points[i],points[i==numPoints-1 ? 0 : i+1]);
+    }
+
+
+    /**
+     * Fill a polygon in the foreground colour using the even-odd rule, so concave and
+     * self-intersecting polygons are supported. The vertices are pixel centres and the
+     * fill includes the boundary so a filled polygon exactly covers its outline.
+     *
+     * Edges are walked with exact integer arithmetic, one scan line at a time. Each pair of
+     * crossings becomes a single span. A final pass adds the horizontal edges and the lowest
+     * vertices that the half-open scan line rule does not reach.
+     *
+     * @param points The vertices
+     * @param numPoints The number of vertices
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillPolygon(const Point *points,uint16_t numPoints) {
+
+      PolygonEdge *edges,*edge;
+      int32_t *crossings,key;
+      uint16_t i,j,numEdges,numCrossings;
+      int16_t y,ymin,ymax,ylast;
+      const Point *p1,*p2,*prev;
+      Rectangle clip;
+
+      if(numPoints<3) {
+        if(numPoints)
+          drawSpanLine(points[0],points[numPoints-1]);
+        return;
+      }
+
+      edges=new PolygonEdge[numPoints];
+      crossings=new int32_t[numPoints];
+
+      // build the edge list. horizontal edges are left for the final pass.
+
+      numEdges=0;
+      ymin=INT16_MAX;
+      ymax=INT16_MIN;
+
+      for(i=0;i<numPoints;i++) {
+
+        p1=&points[i];
+        p2=&points[i==numPoints-1 ? 0 : i+1];
+
+        ymin=std::min(ymin,p1->Y);
+        ymax=std::max(ymax,p1->Y);
+
+        if(p1->Y==p2->Y)
+          continue;
+
+        if(p1->Y>p2->Y)
+          std::swap(p1,p2);
+
+        edge=&edges[numEdges++];
+
+        edge->ytop=p1->Y;
+        edge->ybottom=p2->Y;
+        edge->x=p1->X;
+        edge->xerr=0;
+        edge->dy=static_cast<int32_t>(p2->Y)-p1->Y;
+
+        // floor division so that xrem is always in [0,dy)
+
+        edge->xstep=(static_cast<int32_t>(p2->X)-p1->X)/edge->dy;
+        edge->xrem=(static_cast<int32_t>(p2->X)-p1->X)%edge->dy;
+
+        if(edge->xrem<0) {
+          edge->xstep--;
+          edge->xrem+=edge->dy;
+        }
+      }
+
+      // scan each line in the half-open range [ymin,ymax) that's inside the clip area
+
+      clip=getClipRectangle();
+      ylast=std::min<int16_t>(ymax,clip.Y+clip.Height);
+
+      for(y=ymin;y<ylast;y++) {
+
+        numCrossings=0;
+
+        for(i=0;i<numEdges;i++) {
+
+          edge=&edges[i];
+
+          if(y<edge->ytop || y>=edge->ybottom)
+            continue;
+
+          // the sort key is 2*floor(x) with the low bit set if x has a fraction. this orders
+          // crossings well enough for the spans to be exact.
+
+          key=edge->x*2+(edge->xerr ? 1 : 0);
+
+          for(j=numCrossings;j>0 && crossings[j-1]>key;j--)
+            crossings[j]=crossings[j-1];
+          crossings[j]=key;
+          numCrossings++;
+
+          // step to the next scan line
+
+          edge->x+=edge->xstep;
+          edge->xerr+=edge->xrem;
+
+          if(edge->xerr>=edge->dy) {
+            edge->x++;
+            edge->xerr-=edge->dy;
+          }
+        }
+
+        // output the spans between pairs of crossings: ceil(left) to floor(right)
+
+        if(y>=clip.Y)
+          for(i=0;i+1<numCrossings;i+=2)
+            fillSpan((crossings[i]+1)>>1,crossings[i+1]>>1,y);
+      }
+
+      // the horizontal edges and the local lowest vertices complete the boundary
+
+      for(i=0;i<numPoints;i++) {
+
+        p1=&points[i];
+        p2=&points[i==numPoints-1 ? 0 : i+1];
+        prev=&points[i==0 ? numPoints-1 : i-1];
+
+        if(p1->Y==p2->Y)
+          fillSpan(std::min(p1->X,p2->X),std::max(p1->X,p2->X),p1->Y);
+        else if(prev->Y<p1->Y && p2->Y<p1->Y)
+          fillSpan(p1->X,p1->X,p1->Y);
+      }
+
+      delete [] edges;
+      delete [] crossings;
+    }
+
+
+    /**
+     * Draw the outline of a triangle in the foreground colour
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawTriangle(const Point& p1,const Point& p2,const Point& p3) {
+      drawSpanLine(p1,p2);
+      drawSpanLine(p2,p3);
+      drawSpanLine(p3,p1);
+    }
+
+
+    /**
+     * Fill a triangle in the foreground colour
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillTriangle(const Point& p1,const Point& p2,const Point& p3) {
+
+      Point points[3]={ p1,p2,p3 };
+      fillPolygon(points,3);
+    }
+
+
+    /**
+     * Draw a line of the given thickness. The line body is rasterised as a filled quadrilateral
+     * and round caps are added as filled circles.
+     * @param p1 The first point
+     * @param p2 The second point
+     * @param thickness The line thickness in pixels
+     * @param cap The type of end cap
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawThickLine(const Point& p1,const Point& p2,uint16_t thickness,LineCap cap) {
+
+      float dx,dy,length,half,nx,ny,ex,ey;
+      int16_t radius;
+      Point quad[4];
+
+      if(thickness<=1) {
+        drawSpanLine(p1,p2);
+        return;
+      }
+
+      radius=(thickness-1)/2;
+
+      dx=p2.X-p1.X;
+      dy=p2.Y-p1.Y;
+      length=sqrtf(dx*dx+dy*dy);
+
+      // degenerate line
+
+      if(length==0) {
+        if(cap==LINE_CAP_ROUND)
+          fillEllipse(p1,Size(radius,radius));
+        else
+          fillRectangle(Rectangle(p1.X-radius,p1.Y-radius,thickness,thickness));
+        return;
+      }
+
+      // the pixel centres on the outer edges are (thickness-1)/2 from the centre line
+
+      half=(thickness-1)/2.0f;
+
+      nx=-dy*half/length;
+      ny=dx*half/length;
+
+      if(cap==LINE_CAP_SQUARE) {
+        ex=dx*half/length;
+        ey=dy*half/length;
+      }
+      else
+        ex=ey=0;
+
+      quad[0].X=static_cast<int16_t>(floorf(p1.X-ex+nx+0.5f));
+      quad[0].Y=static_cast<int16_t>(floorf(p1.Y-ey+ny+0.5f));
+      quad[1].X=static_cast<int16_t>(floorf(p2.X+ex+nx+0.5f));
+      quad[1].Y=static_cast<int16_t>(floorf(p2.Y+ey+ny+0.5f));
+      quad[2].X=static_cast<int16_t>(floorf(p2.X+ex-nx+0.5f));
+      quad[2].Y=static_cast<int16_t>(floorf(p2.Y+ey-ny+0.5f));
+      quad[3].X=static_cast<int16_t>(floorf(p1.X-ex-nx+0.5f));
+      quad[3].Y=static_cast<int16_t>(floorf(p1.Y-ey-ny+0.5f));
+
+      fillPolygon(quad,4);
+
+      if(cap==LINE_CAP_ROUND) {
+        fillEllipse(p1,Size(radius,radius));
+        fillEllipse(p2,Size(radius,radius));
+      }
+    }
+
+
+    /**
+     * Draw or fill the four corner arcs of a rounded rectangle with the midpoint circle algorithm.
+     * When filling, each step of the algorithm emits the full width span across the rectangle
+     * for that row.
+     * @param rc The rectangle
+     * @param radius The corner radius, already limited to fit
+     * @param fill true to fill, false to outline
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawRoundedCorners(const Rectangle& rc,int16_t radius,bool fill) {
+
+      int16_t x,y,err,cxl,cxr,cyt,cyb;
+
+      // corner circle centres
+
+      cxl=rc.X+radius;
+      cxr=rc.X+rc.Width-1-radius;
+      cyt=rc.Y+radius;
+      cyb=rc.Y+rc.Height-1-radius;
+
+      x=radius;
+      y=0;
+      err=1-radius;
+
+      while(x>=y) {
+
+        if(fill) {
+          fillSpan(cxl-x,cxr+x,cyt-y);
+          fillSpan(cxl-x,cxr+x,cyb+y);
+          fillSpan(cxl-y,cxr+y,cyt-x);
+          fillSpan(cxl-y,cxr+y,cyb+x);
+        }
+        else {
+          fillSpan(cxl-x,cxl-x,cyt-y);
+          fillSpan(cxr+x,cxr+x,cyt-y);
+          fillSpan(cxl-x,cxl-x,cyb+y);
+          fillSpan(cxr+x,cxr+x,cyb+y);
+          fillSpan(cxl-y,cxl-y,cyt-x);
+          fillSpan(cxr+y,cxr+y,cyt-x);
+          fillSpan(cxl-y,cxl-y,cyb+x);
+          fillSpan(cxr+y,cxr+y,cyb+x);
+        }
+
+        y++;
+
+        if(err<0)
+          err+=2*y+1;
+        else {
+          x--;
+          err+=2*(y-x)+1;
+        }
+      }
+    }
+
+
+    /**
+     * Draw the outline of a rectangle with rounded corners
+     * @param rc The rectangle
+     * @param radius The corner radius. It will be reduced if it does not fit.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawRoundedRectangle(const Rectangle& rc,int16_t radius) {
+
+      radius=std::min<int16_t>(radius,std::min<int16_t>((rc.Width-1)/2,(rc.Height-1)/2));
+
+      if(radius<=0) {
+        drawRectangle(rc);
+        return;
+      }
+
+      // straight edges
+
+      fillSpan(rc.X+radius,rc.X+rc.Width-1-radius,rc.Y);
+      fillSpan(rc.X+radius,rc.X+rc.Width-1-radius,rc.Y+rc.Height-1);
+      fillRectangle(Rectangle(rc.X,rc.Y+radius,1,rc.Height-2*radius));
+      fillRectangle(Rectangle(rc.X+rc.Width-1,rc.Y+radius,1,rc.Height-2*radius));
+
+      // corners
+
+      drawRoundedCorners(rc,radius,false);
+    }
+
+
+    /**
+     * Fill a rectangle with rounded corners
+     * @param rc The rectangle
+     * @param radius The corner radius. It will be reduced if it does not fit.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillRoundedRectangle(const Rectangle& rc,int16_t radius) {
+
+      radius=std::min<int16_t>(radius,std::min<int16_t>((rc.Width-1)/2,(rc.Height-1)/2));
+
+      if(radius<=0) {
+        fillRectangle(rc);
+        return;
+      }
+
+      // the body between the corner circle centres, exclusive
+
+      if(rc.Height-2*radius-2>0)
+        fillRectangle(Rectangle(rc.X,rc.Y+radius+1,rc.Width,rc.Height-2*radius-2));
+
+      // the rounded top and bottom
+
+      drawRoundedCorners(rc,radius,true);
+    }
+  }
+}
@@ -15,7 +15,14 @@ namespace stm32plus {
      */
 
     template<class TDevice,typename TDeviceAccessMode>
-    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillRectangle(const Rectangle& rc) {
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillRectangle(const Rectangle& rect) {
+
+      Rectangle rc;
+
+      if(_clipDepth==0)
+        rc=rect;
+      else if(!rect.intersection(_clipStack[_clipDepth-1],rc))
+        return;
 
       this->moveTo(rc);
       this->fillPixels((uint32_t)rc.Width * (uint32_t)rc.Height,_foreground);
@@ -27,7 +34,14 @@ namespace stm32plus {
      */
 
     template<class TDevice,typename TDeviceAccessMode>
-    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::clearRectangle(const Rectangle& rc) {
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::clearRectangle(const Rectangle& rect) {
+
+      Rectangle rc;
+
+      if(_clipDepth==0)
+        rc=rect;
+      else if(!rect.intersection(_clipStack[_clipDepth-1],rc))
+        return;
 
       this->moveTo(rc);
       this->fillPixels((uint32_t)rc.Width * (uint32_t)rc.Height,_background);
@@ -9,6 +9,7 @@
 
 #include "display/graphic/GraphicsLibrary.h"
 #include "display/graphic/Serial4WireSpiAccessMode.h"
+#include "display/graphic/I2CAccessMode.h"
 #include "display/graphic/oled/ssd1306/SSD1306.h"
 
 
@@ -24,5 +25,11 @@ namespace stm32plus {
      */
 
     typedef GraphicsLibrary<SSD1306<LANDSCAPE,Serial4WireSpiAccessMode>,Serial4WireSpiAccessMode> SSD1306_Landscape_Serial4;
+
+    /*
+     * SSD1306 I2C interface landscape only. TI2C must include I2CSingleByteMasterPollingFeature.
+     */
+
+    template<class TI2C> using SSD1306_Landscape_I2C=GraphicsLibrary<SSD1306<LANDSCAPE,I2CAccessMode<TI2C> >,I2CAccessMode<TI2C> >;
   }
 }
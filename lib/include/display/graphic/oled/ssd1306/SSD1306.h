@@ -20,6 +20,10 @@ namespace stm32plus {
     /**
      * Generic SSD1306 template. The user can specialise based on the desired
      * orientation and access mode.
+     *
+     * By default each pixel is written through to the panel as soon as it's drawn. Call
+     * setDeferred(true) to draw only into the frame buffer and then call flush() to send
+     * just the dirty pages and columns to the panel in one go.
      */
 
     template<Orientation TOrientation,class TAccessMode>
@@ -49,6 +53,17 @@ namespace stm32plus {
         uint8_t _plotMasks[8];
         uint8_t _contrast;
 
+        bool _deferred;             // true if drawing only touches the frame buffer until flush()
+        uint8_t _dirtyFirstColumn;  // the dirty bounding box, in columns and 8-pixel pages
+        uint8_t _dirtyLastColumn;
+        uint8_t _dirtyFirstPage;
+        uint8_t _dirtyLastPage;
+
+      protected:
+        void markDirty(int16_t x,int16_t y);
+        void markDirty(const Rectangle& rc);
+        void clearDirty();
+
       public:
         SSD1306(TAccessMode& accessMode);
 
@@ -57,9 +72,15 @@ namespace stm32plus {
         void unpackColour(tCOLOUR src,UnpackedColour& dest) const;
         void unpackColour(uint8_t red,uint8_t green,uint8_t blue,UnpackedColour& dest) const;
 
+        void moveTo(const Rectangle& rc);
         void writePixel(const UnpackedColour& cr);
         void fillPixels(uint32_t numPixels,const UnpackedColour& cr);
 
+        void setDeferred(bool deferred);
+        bool isDeferred() const;
+        bool isDirty() const;
+        bool flush();
+
         void sleep() const;
         void wake() const;
         void beginWriting() const;
@@ -91,12 +112,168 @@ namespace stm32plus {
       : SSD1306Orientation<TOrientation,TAccessMode>(accessMode),
         _accessMode(accessMode),
         _frameBuffer(Size(128,64),1024),
-        _contrast(DEFAULT_CONTRAST) {
+        _contrast(DEFAULT_CONTRAST),
+        _deferred(false) {
 
       int8_t i;
 
       for(i=0;i<8;i++)
         _plotMasks[i]=~(1 << i);
+
+      clearDirty();
+    }
+
+
+    /**
+     * Switch deferred mode on or off. In deferred mode the drawing primitives only update the
+     * frame buffer and a bounding box of the dirty pages and columns is maintained. Nothing is
+     * sent to the panel until flush() is called. Switching deferred mode off will flush any
+     * outstanding changes.
+     * @param deferred true to enable deferred mode.
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline void SSD1306<TOrientation,TAccessMode>::setDeferred(bool deferred) {
+
+      if(_deferred && !deferred)
+        flush();
+
+      _deferred=deferred;
+    }
+
+
+    /**
+     * Check if deferred mode is enabled
+     * @return true if deferred mode is enabled
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline bool SSD1306<TOrientation,TAccessMode>::isDeferred() const {
+      return _deferred;
+    }
+
+
+    /**
+     * Check if there are any changes in the frame buffer that have not been sent to the panel
+     * @return true if there are dirty pages
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline bool SSD1306<TOrientation,TAccessMode>::isDirty() const {
+      return _dirtyFirstPage<=_dirtyLastPage;
+    }
+
+
+    /**
+     * Reset the dirty bounding box to empty
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline void SSD1306<TOrientation,TAccessMode>::clearDirty() {
+      _dirtyFirstColumn=_dirtyFirstPage=0xff;
+      _dirtyLastColumn=_dirtyLastPage=0;
+    }
+
+
+    /**
+     * Extend the dirty bounding box to include the given pixel
+     * @param x The pixel column
+     * @param y The pixel row
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline void SSD1306<TOrientation,TAccessMode>::markDirty(int16_t x,int16_t y) {
+
+      uint8_t page;
+
+      page=y/8;
+
+      if(x<_dirtyFirstColumn)
+        _dirtyFirstColumn=x;
+      if(x>_dirtyLastColumn)
+        _dirtyLastColumn=x;
+
+      if(page<_dirtyFirstPage)
+        _dirtyFirstPage=page;
+      if(page>_dirtyLastPage)
+        _dirtyLastPage=page;
+    }
+
+
+    /**
+     * Extend the dirty bounding box to include the given rectangle
+     * @param rc The rectangle, which must be on the panel
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline void SSD1306<TOrientation,TAccessMode>::markDirty(const Rectangle& rc) {
+      markDirty(rc.X,rc.Y);
+      markDirty(rc.X+rc.Width-1,rc.Y+rc.Height-1);
+    }
+
+
+    /**
+     * Send the dirty region of the frame buffer to the panel. The column and page address
+     * window is set to the dirty bounding box and then each dirty page is streamed out. The
+     * panel is in horizontal addressing mode so it wraps to the next page within the window
+     * for us.
+     * @return false if the access mode failed to write
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline bool SSD1306<TOrientation,TAccessMode>::flush() {
+
+      uint8_t page;
+      uint16_t width;
+
+      if(!isDirty())
+        return true;
+
+      this->_accessMode.writeCommand(0x21);       // set column address
+      this->_accessMode.writeCommand(_dirtyFirstColumn);
+      this->_accessMode.writeCommand(_dirtyLastColumn);
+
+      this->_accessMode.writeCommand(0x22);       // set page address
+      this->_accessMode.writeCommand(_dirtyFirstPage);
+      this->_accessMode.writeCommand(_dirtyLastPage);
+
+      width=_dirtyLastColumn-_dirtyFirstColumn+1;
+
+      if(width==128) {
+
+        // full width pages are contiguous in the frame buffer so they go out in one transfer
+
+        if(!this->_accessMode.writeData(&_frameBuffer[_dirtyFirstPage*128],width*(_dirtyLastPage-_dirtyFirstPage+1)))
+          return false;
+      }
+      else {
+        for(page=_dirtyFirstPage;page<=_dirtyLastPage;page++)
+          if(!this->_accessMode.writeData(&_frameBuffer[(page*128)+_dirtyFirstColumn],width))
+            return false;
+      }
+
+      // the next immediate mode moveTo() will reset the window
+
+      clearDirty();
+      return true;
+    }
+
+
+    /**
+     * Move the display output rectangle. In deferred mode there is no need to talk to the
+     * panel because all output goes to the frame buffer.
+     * @param rc The display output rectangle
+     */
+
+    template<Orientation TOrientation,class TAccessMode>
+    inline void SSD1306<TOrientation,TAccessMode>::moveTo(const Rectangle& rc) {
+
+      if(_deferred) {
+        this->_window=rc;
+        this->_cursorPos=rc.getTopLeft();
+      }
+      else
+        SSD1306Orientation<TOrientation,TAccessMode>::moveTo(rc);
     }
 
 
@@ -396,8 +573,12 @@ namespace stm32plus {
       else
         _frameBuffer.getBitbandAddress()[bitIndex]=0;
 
-      value=_frameBuffer[byteIndex];
-      this->_accessMode.writeData(&value,1);
+      if(_deferred)
+        markDirty(this->_cursorPos.X,this->_cursorPos.Y);
+      else {
+        value=_frameBuffer[byteIndex];
+        this->_accessMode.writeData(&value,1);
+      }
 
       // update cursor position
 
@@ -426,7 +607,29 @@ namespace stm32plus {
 
       if(numPixels==128*64) {
         memset(&_frameBuffer[0],cr.value ? 0xff : 0,1024);
-        this->_accessMode.writeData(&_frameBuffer[0],1024);
+
+        if(_deferred)
+          markDirty(Rectangle(0,0,128,64));
+        else
+          this->_accessMode.writeData(&_frameBuffer[0],1024);
+      }
+      else if(_deferred) {
+
+        // just update the frame buffer and the dirty box, each row of the window at a time
+
+        while(numPixels--) {
+
+          index=((this->_cursorPos.Y/8)*128)+this->_cursorPos.X;
+          bitpos=this->_cursorPos.Y % 8;
+
+          _frameBuffer[index]=(_frameBuffer[index] & _plotMasks[bitpos]) | (cr.value << bitpos);
+          markDirty(this->_cursorPos.X,this->_cursorPos.Y);
+
+          if(++this->_cursorPos.X==this->_window.X+this->_window.Width) {
+            this->_cursorPos.X=this->_window.X;
+            this->_cursorPos.Y++;
+          }
+        }
       }
       else {
 
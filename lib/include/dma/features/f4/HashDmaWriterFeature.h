@@ -0,0 +1,91 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+// ensure the MCU series is correct
+#ifndef STM32PLUS_F4
+#error This class can only be used with the STM32F4 series
+#endif
+
+
+namespace stm32plus {
+
+  /**
+   * DMA feature to enable writing to the HASH peripheral input FIFO. Use it with the
+   * HashInDmaChannel and pass the channel to the updateDma() method of the hash class.
+   *
+   * @tparam TPriority One of the DMA priority constants. The default is |DMA_Priority_High|
+   * @tparam TFifoMode Whether the DMA FIFO is enabled. The default is disabled for this peripheral
+   */
+
+  template<uint32_t TPriority=DMA_Priority_High,uint32_t TFifoMode=DMA_FIFOMode_Disable>
+  class HashDmaWriterFeature : public DmaFeatureBase {
+
+    public:
+      HashDmaWriterFeature(Dma& dma);
+      void beginWrite(const void *source,uint32_t count);
+  };
+
+
+  /**
+   * Constructor, store the reference to the DMA base class
+   * @param dma the base class reference
+   */
+
+  template<uint32_t TPriority,uint32_t TFifoMode>
+  inline HashDmaWriterFeature<TPriority,TFifoMode>::HashDmaWriterFeature(Dma& dma)
+    : DmaFeatureBase(dma) {
+
+    _init.DMA_Channel=dma.getChannelNumber();                 // channel id
+    _init.DMA_PeripheralBaseAddr=reinterpret_cast<uint32_t>(&HASH->DIN);
+    _init.DMA_DIR=DMA_DIR_MemoryToPeripheral;                 // 'peripheral' is destination
+    _init.DMA_PeripheralInc=DMA_PeripheralInc_Disable;        // 'peripheral' does not increment
+    _init.DMA_MemoryInc=DMA_MemoryInc_Enable;                 // memory is incremented
+    _init.DMA_PeripheralDataSize=DMA_PeripheralDataSize_Word; // transferring words
+    _init.DMA_MemoryDataSize=DMA_MemoryDataSize_Word;         // transferring words
+    _init.DMA_Mode=DMA_Mode_Normal;                           // not a circular buffer
+    _init.DMA_Priority=TPriority;                             // user-configurable priority
+    _init.DMA_MemoryBurst=DMA_MemoryBurst_Single;             // burst size
+    _init.DMA_PeripheralBurst=DMA_PeripheralBurst_Single;     // burst size
+    _init.DMA_FIFOMode=TFifoMode;                             // fifo mode
+
+    if(TFifoMode==DMA_FIFOMode_Enable)
+      _init.DMA_FIFOThreshold=DMA_FIFOThreshold_HalfFull;     // flush on half-full
+  }
+
+
+  /**
+   * Start a transfer of data to the HASH peripheral
+   *
+   * @param[in] source memory address of the source data. Must be word aligned.
+   * @param[in] count The number of bytes to transfer. Must be a multiple of 4.
+   */
+
+  template<uint32_t TPriority,uint32_t TFifoMode>
+  inline void HashDmaWriterFeature<TPriority,TFifoMode>::beginWrite(const void *source,uint32_t count) {
+
+    DMA_Stream_TypeDef *peripheralAddress;
+
+    // set up the parameters for this transfer
+
+    _init.DMA_Memory0BaseAddr=reinterpret_cast<uint32_t>(source);
+    _init.DMA_BufferSize=count/4;
+
+    // set the peripheral address from the overloaded operator
+
+    peripheralAddress=_dma;
+
+    // disable and then re-enable
+
+    DMA_Cmd(peripheralAddress,DISABLE);
+    DMA_Init(peripheralAddress,&_init);
+    DMA_Cmd(peripheralAddress,ENABLE);
+
+    HASH_DMACmd(ENABLE);
+  }
+}
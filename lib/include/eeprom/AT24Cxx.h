@@ -15,34 +15,52 @@ namespace stm32plus {
    *
    * The Atmel AT24C32/64 is a 32768/65536 kbit serial EEPROM IC with an I2C
    * interface. Data can be read or written using single-byte random access or it can
-   * be accessed serially in multiples of up to 32 bytes (a page). That is, you may
-   * access from where you start up to the end of a page in one burst and then you must
-   * update your position to the next page and may then read/write up to another 32 bytes
-   * in a burst. This class takes care of all that internal stuff for you.
+   * be accessed serially. Writes can be done in bursts of up to 32 bytes (a page). That is,
+   * you may write from where you start up to the end of a page in one burst and then you must
+   * update your position to the next page and may then write up to another 32 bytes
+   * in a burst. Reads are not limited to a page. This class takes care of all that internal
+   * stuff for you.
+   *
+   * After each page write the device goes busy for its internal write cycle (10ms max) and
+   * does not acknowledge its address until it's finished. Rather than wait out the maximum
+   * time we poll for that acknowledge, and only before the next access so that your code can
+   * get on with something else in the meantime.
    *
    * @tparam TI2C The I2C type that you are going to use to communicate with this EEPROM
+   * @tparam TSizeInBytes The device size
+   * @tparam TPageSize The write page size
    */
 
-  template<class TI2C,int TSizeInBytes>
+  template<class TI2C,int TSizeInBytes,int TPageSize=32>
   class AT24Cxx : public TI2C,
-                  public SerialEeprom<AT24Cxx<TI2C,TSizeInBytes> > {
+                  public SerialEeprom<AT24Cxx<TI2C,TSizeInBytes,TPageSize>,TPageSize> {
 
     public:
       enum {
         SIZE_IN_BYTES = TSizeInBytes,   ///< 32kbit/64Kbit
-        SLAVE_ADDRESS = 0xa0            ///< I2C bus address
+        PAGE_SIZE = TPageSize,          ///< write page size
+        SLAVE_ADDRESS = 0xa0,           ///< I2C bus address
+        WRITE_CYCLE_TIMEOUT = 20        ///< milliseconds to wait for a write cycle to finish
       };
 
+    protected:
+      bool _writeCycleInProgress;
+
     public:
       AT24Cxx(typename TI2C::Parameters& params);
 
       // methods to support SerialEeprom
 
-      bool writeByte(uint8_t c);
-      bool writeBytes(const uint8_t *buffer,uint32_t count);
+      bool writePage(uint32_t address,const uint8_t *buffer,uint32_t count);
+      bool waitForWriteCycle();
 
       bool readByte(uint8_t& c);
       bool readBytes(uint8_t *buffer,uint32_t count);
+
+      // unbuffered writes at the current position
+
+      bool writeByte(uint8_t c);
+      bool writeBytes(const uint8_t *buffer,uint32_t count);
   };
 
 
@@ -67,14 +85,15 @@ namespace stm32plus {
    * @param[in] params The parameters class that holds the I2C configuration
    */
 
-  template<class TI2C,int TSizeInBytes>
-  inline AT24Cxx<TI2C,TSizeInBytes>::AT24Cxx(typename TI2C::Parameters& params)
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline AT24Cxx<TI2C,TSizeInBytes,TPageSize>::AT24Cxx(typename TI2C::Parameters& params)
     : TI2C(params),
-      SerialEeprom<AT24Cxx<TI2C,TSizeInBytes> >(*this) {
+      SerialEeprom<AT24Cxx<TI2C,TSizeInBytes,TPageSize>,TPageSize>(*this),
+      _writeCycleInProgress(false) {
 
     // set the I2C slave address
 
-    this->setSlaveAddress(0xa0);
+    this->setSlaveAddress(SLAVE_ADDRESS);
 
     // this device has 2-byte addresses
 
@@ -83,15 +102,67 @@ namespace stm32plus {
 
 
   /**
-   * Write a single byte to the device
+   * Write up to a page of data. The data must not cross a page boundary. The stream
+   * position is not changed.
+   * @param address The device address to write to
+   * @param buffer The data to write
+   * @param count The number of bytes, up to the end of the page
+   * @return true if it worked
+   */
+
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline bool AT24Cxx<TI2C,TSizeInBytes,TPageSize>::writePage(uint32_t address,const uint8_t *buffer,uint32_t count) {
+
+    // the device can't be addressed until the last write cycle has finished
+
+    if(!waitForWriteCycle())
+      return false;
+
+    if(!TI2C::writeBytes(address,buffer,count))
+      return false;
+
+    // the write cycle has now started
+
+    _writeCycleInProgress=true;
+    return true;
+  }
+
+
+  /**
+   * Wait for the device to finish its internal write cycle by polling for an acknowledge
+   * @return true if it finished, false if it timed out
+   */
+
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline bool AT24Cxx<TI2C,TSizeInBytes,TPageSize>::waitForWriteCycle() {
+
+    uint32_t start;
+
+    if(!_writeCycleInProgress)
+      return true;
+
+    start=MillisecondTimer::millis();
+
+    while(!TI2C::isSlaveReady())
+      if(MillisecondTimer::hasTimedOut(start,WRITE_CYCLE_TIMEOUT))
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SERIAL_EEPROM,
+                                 SerialEeprom<AT24Cxx<TI2C,TSizeInBytes,TPageSize>,TPageSize>::E_WRITE_CYCLE_TIMEOUT);
+
+    _writeCycleInProgress=false;
+    return true;
+  }
+
+
+  /**
+   * Write a single byte to the device. Any data buffered by the stream is written first.
    * @param c The byte to write
    * @return true if it worked
    */
 
-  template<class TI2C,int TSizeInBytes>
-  inline bool AT24Cxx<TI2C,TSizeInBytes>::writeByte(uint8_t c) {
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline bool AT24Cxx<TI2C,TSizeInBytes,TPageSize>::writeByte(uint8_t c) {
 
-    if(!TI2C::writeBytes(this->_position,&c,1))
+    if(!this->flush() || !writePage(this->_position,&c,1))
       return false;
 
     this->_position++;
@@ -101,29 +172,31 @@ namespace stm32plus {
 
   /**
    * Write multiple bytes to the device. We take advantage of the ability to write
-   * multiple bytes in one go when those bytes are all in one page.
+   * multiple bytes in one go when those bytes are all in one page. Any data buffered
+   * by the stream is written first.
    * @param[in] buffer The source of data to write
    * @param[in] count The number of bytes to write
    * @return true if it worked
    */
 
-  template<class TI2C,int TSizeInBytes>
-  inline bool AT24Cxx<TI2C,TSizeInBytes>::writeBytes(const uint8_t *buffer,uint32_t count) {
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline bool AT24Cxx<TI2C,TSizeInBytes,TPageSize>::writeBytes(const uint8_t *buffer,uint32_t count) {
 
     uint32_t toWrite;
     const uint8_t *ptr;
 
+    if(!this->flush())
+      return false;
+
     for(ptr=buffer;count;count-=toWrite) {
 
-      toWrite=std::min<uint8_t>(count,0x20-(this->_position & 0x1f));
-      if(!TI2C::writeBytes(this->_position,ptr,toWrite))
+      toWrite=std::min<uint32_t>(count,TPageSize-(this->_position % TPageSize));
+
+      if(!writePage(this->_position,ptr,toWrite))
         return false;
 
       ptr+=toWrite;
       this->_position+=toWrite;
-
-      if(count>0)
-        MillisecondTimer::delay(10);
     }
 
     return true;
@@ -136,40 +209,33 @@ namespace stm32plus {
    * @return true if it worked
    */
 
-  template<class TI2C,int TSizeInBytes>
-  inline bool AT24Cxx<TI2C,TSizeInBytes>::readByte(uint8_t& c) {
-
-    if(!TI2C::readBytes(this->_position,&c,1))
-      return false;
-
-    this->_position++;
-    return true;
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline bool AT24Cxx<TI2C,TSizeInBytes,TPageSize>::readByte(uint8_t& c) {
+    return readBytes(&c,1);
   }
 
 
   /**
-   * Read multiple bytes from the device. We take advantage of the ability to read
-   * out multiple bytes in one go when those bytes are all in one page.
+   * Read multiple bytes from the device. The device's address counter runs on across
+   * page boundaries so the whole read is done in one transaction. Any data buffered by
+   * the stream is written first.
    * @param[out] buffer Where to read the data to
    * @param[in] count The number of bytes to read
    */
 
-  template<class TI2C,int TSizeInBytes>
-  inline bool AT24Cxx<TI2C,TSizeInBytes>::readBytes(uint8_t *buffer,uint32_t count) {
-
-    uint32_t toRead;
-    uint8_t *ptr;
+  template<class TI2C,int TSizeInBytes,int TPageSize>
+  inline bool AT24Cxx<TI2C,TSizeInBytes,TPageSize>::readBytes(uint8_t *buffer,uint32_t count) {
 
-    for(ptr=buffer;count;count-=toRead) {
+    if(count==0)
+      return true;
 
-      toRead=std::min<uint8_t>(count,0x20-(this->_position & 0x1f));
-      if(!TI2C::readBytes(this->_position,ptr,toRead))
-        return false;
+    if(!this->flush() || !waitForWriteCycle())
+      return false;
 
-      ptr+=toRead;
-      this->_position+=toRead;
-    }
+    if(!TI2C::readBytes(this->_position,buffer,count))
+      return false;
 
+    this->_position+=count;
     return true;
   }
 }
@@ -14,10 +14,18 @@ namespace stm32plus {
    * Template implementation of a serial EEPROM. Inherits from InputStream
    * and OutputStream. Provides the functionality for maintaining the stream pointer.
    * Delegates the actual read and write operations to the TImpl class parameter
+   *
+   * Writes through the stream are combined in a page buffer so that the device sees one
+   * page write for each page that's touched, however the data arrives. Spans that cover
+   * the rest of a page are written straight from the caller's buffer. A partly filled
+   * page is written when it's completed, or on flush(), close(), seek(), skip(), reset()
+   * or a read. Call flush() when you're done writing.
+   *
    * @tparam TImpl The device implementation (this is the CRTP template pattern)
+   * @tparam TPageSize The device's write page size in bytes
    */
 
-  template<class TImpl>
+  template<class TImpl,uint32_t TPageSize>
   class SerialEeprom : public InputStream,
                        public OutputStream {
 
@@ -25,6 +33,10 @@ namespace stm32plus {
       TImpl& _impl;
       uint32_t _position;
 
+      uint8_t _pageBuffer[TPageSize];   // pending data, all within one page
+      uint32_t _bufferAddress;          // where the pending data goes
+      uint32_t _bufferCount;            // how much is pending
+
     public:
 
       /**
@@ -33,7 +45,8 @@ namespace stm32plus {
 
       enum {
         E_INVALID_SEEK_POSITION = 1,    ///< can't seek past the end
-        E_INVALID_SIZE = 2              ///< can't write past the end
+        E_INVALID_SIZE = 2,             ///< can't write past the end
+        E_WRITE_CYCLE_TIMEOUT = 3       ///< the device did not finish its write cycle in time
       };
 
     public:
@@ -45,8 +58,8 @@ namespace stm32plus {
 
       virtual bool write(uint8_t c) override;
       virtual bool write(const void *buffer,uint32_t size) override;
-      virtual bool close() override { return true; }
-      virtual bool flush() override { return true; }
+      virtual bool close() override;
+      virtual bool flush() override;
 
       // overrides from InputStream
 
@@ -62,11 +75,12 @@ namespace stm32plus {
    * Constructor
    */
 
-  template<class TImpl>
-  inline SerialEeprom<TImpl>::SerialEeprom(TImpl& impl)
+  template<class TImpl,uint32_t TPageSize>
+  inline SerialEeprom<TImpl,TPageSize>::SerialEeprom(TImpl& impl)
     : _impl(impl) {
 
     _position=0;
+    _bufferCount=0;
   }
 
 
@@ -77,10 +91,14 @@ namespace stm32plus {
    * @return false if the position is out of range for this device.
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::seek(uint32_t position) {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::seek(uint32_t position) {
 
     if(position<TImpl::SIZE_IN_BYTES) {
+
+      if(!flush())
+        return false;
+
       _position=position;
       return true;
     }
@@ -92,43 +110,117 @@ namespace stm32plus {
 
 
   /**
-   * Write a single byte
+   * Write a single byte. The byte is buffered until its page is complete or the
+   * buffer is flushed.
    * @param c The byte to write
    * @return true if it worked
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::write(uint8_t c) {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::write(uint8_t c) {
 
     // can't write if at the end
 
     if(_position>=TImpl::SIZE_IN_BYTES)
       return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SERIAL_EEPROM,OutputStream::E_END_OF_STREAM);
 
-    // do the write
+    // add to the page buffer
+
+    if(_bufferCount==0)
+      _bufferAddress=_position;
+
+    _pageBuffer[_bufferCount++]=c;
+    _position++;
+
+    // write it out if the page is complete
 
-    return _impl.writeByte(c);
+    return _position % TPageSize!=0 || flush();
   }
 
 
   /**
-   * Write many bytes
+   * Write many bytes. Whole pages, and spans that finish a page when nothing is buffered,
+   * go straight to the device. Anything else is buffered.
    * @param buffer the source of data
    * @param size the number of bytes to write
    * @return true if it worked
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::write(const void *buffer,uint32_t size) {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::write(const void *buffer,uint32_t size) {
+
+    const uint8_t *ptr;
+    uint32_t toWrite,pageRemaining;
 
     // can't write past the end
 
     if(_position+size>TImpl::SIZE_IN_BYTES)
       return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SERIAL_EEPROM,E_INVALID_SIZE);
 
-    // do the write
+    ptr=reinterpret_cast<const uint8_t *>(buffer);
+
+    while(size) {
+
+      pageRemaining=TPageSize-(_position % TPageSize);
+      toWrite=size<pageRemaining ? size : pageRemaining;
+
+      if(_bufferCount==0 && toWrite==pageRemaining) {
+
+        // completes a page with nothing pending: write it directly
+
+        if(!_impl.writePage(_position,ptr,toWrite))
+          return false;
+      }
+      else {
 
-    return _impl.writeBytes(reinterpret_cast<const uint8_t *>(buffer),size);
+        if(_bufferCount==0)
+          _bufferAddress=_position;
+
+        memcpy(_pageBuffer+_bufferCount,ptr,toWrite);
+        _bufferCount+=toWrite;
+      }
+
+      _position+=toWrite;
+      ptr+=toWrite;
+      size-=toWrite;
+
+      // write out the buffer if that completed its page
+
+      if(_bufferCount && _position % TPageSize==0 && !flush())
+        return false;
+    }
+
+    return true;
+  }
+
+
+  /**
+   * Write out the page buffer
+   * @return true if it worked
+   */
+
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::flush() {
+
+    if(_bufferCount==0)
+      return true;
+
+    if(!_impl.writePage(_bufferAddress,_pageBuffer,_bufferCount))
+      return false;
+
+    _bufferCount=0;
+    return true;
+  }
+
+
+  /**
+   * Close the stream. The page buffer is flushed.
+   * @return true if it worked
+   */
+
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::close() {
+    return flush();
   }
 
 
@@ -139,8 +231,8 @@ namespace stm32plus {
    * provider will have the detailed reason.
    */
 
-  template<class TImpl>
-  inline int16_t SerialEeprom<TImpl>::read() {
+  template<class TImpl,uint32_t TPageSize>
+  inline int16_t SerialEeprom<TImpl,TPageSize>::read() {
 
     uint8_t c;
 
@@ -149,9 +241,9 @@ namespace stm32plus {
     if(_position>=TImpl::SIZE_IN_BYTES)
       return InputStream::E_END_OF_STREAM;
 
-    // try the read
+    // try the read. pending writes go first.
 
-    if(!_impl.readByte(c))
+    if(!flush() || !_impl.readByte(c))
       return InputStream::E_STREAM_ERROR;
 
     return c;
@@ -168,17 +260,17 @@ namespace stm32plus {
    * @return false if it fails, and actuallyRead will be undefined
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
 
     // cut down the size if there would be an overflow
 
     if(_position+size>TImpl::SIZE_IN_BYTES)
       size=TImpl::SIZE_IN_BYTES-_position;
 
-    // do the read
+    // do the read. pending writes go first.
 
-    if(!_impl.readBytes(reinterpret_cast<uint8_t *>(buffer),size))
+    if(!flush() || !_impl.readBytes(reinterpret_cast<uint8_t *>(buffer),size))
       return false;
 
     // update the bytes read
@@ -194,14 +286,17 @@ namespace stm32plus {
    * @return true if it worked
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::skip(uint32_t howMuch) {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::skip(uint32_t howMuch) {
 
     // check for out of range
 
     if(_position+howMuch>=TImpl::SIZE_IN_BYTES)
       return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SERIAL_EEPROM,E_INVALID_SEEK_POSITION);
 
+    if(!flush())
+      return false;
+
     // update the position
 
     _position+=howMuch;
@@ -214,19 +309,23 @@ namespace stm32plus {
    * @return true if at least one byte is available
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::available() {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::available() {
     return _position<TImpl::SIZE_IN_BYTES;
   }
 
 
   /**
-   * Reset the stream pointer to position zero.
-   * @return Always returns true
+   * Reset the stream pointer to position zero. The page buffer is flushed first.
+   * @return true if it worked
    */
 
-  template<class TImpl>
-  inline bool SerialEeprom<TImpl>::reset() {
+  template<class TImpl,uint32_t TPageSize>
+  inline bool SerialEeprom<TImpl,TPageSize>::reset() {
+
+    if(!flush())
+      return false;
+
     _position=0;
     return true;
   }
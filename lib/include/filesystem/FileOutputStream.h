@@ -11,9 +11,18 @@ namespace stm32plus {
 
   /**
    * @brief Implementation of an output stream for files
+   *
+   * Each write to a file that doesn't start on a sector boundary reads and writes back the
+   * sector, so writev() gathers small buffers together before writing them.
    */
 
   class FileOutputStream : public OutputStream {
+
+    public:
+      enum {
+        WRITEV_BUFFER_SIZE = 256    ///< Size of the stack buffer that writev() gathers into
+      };
+
     protected:
       File& _file;
 
@@ -26,6 +35,7 @@ namespace stm32plus {
 
       virtual bool write(uint8_t c) override;
       virtual bool write(const void *buffer,uint32_t size) override;
+      virtual bool writev(const IoVector *vectors,uint32_t count) override;
       virtual bool close() override;
 
       virtual bool flush() override;
@@ -53,6 +63,22 @@ namespace stm32plus {
   }
 
 
+  /**
+   * Write a list of buffers to the file. They are gathered into a WRITEV_BUFFER_SIZE stack
+   * buffer that is written to the file each time it fills. The middle of a larger buffer is
+   * written in place and its head and tail share writes with its neighbours.
+   * @param vectors The buffers to write
+   * @param count The number of buffers
+   * @return true if it worked
+   */
+
+  inline bool FileOutputStream::writev(const IoVector *vectors,uint32_t count) {
+
+    uint8_t buffer[WRITEV_BUFFER_SIZE];
+    return writevBuffered(vectors,count,buffer,sizeof(buffer));
+  }
+
+
   /**
    * no-op close
    * @return true
@@ -75,6 +75,9 @@ namespace stm32plus {
 
       virtual bool readSector(uint32_t sectorIndex,void *buffer);
       virtual bool writeSector(uint32_t sectorIndex,void *buffer);
+      virtual bool readSectors(uint32_t sectorIndex,void *buffer,uint32_t sectorCount);
+      virtual bool writeSectors(uint32_t sectorIndex,const void *buffer,uint32_t sectorCount);
+      bool canTransferSectorsDirect(const void *buffer);
 
       /**
        * Get the first sector index
@@ -86,6 +86,8 @@ namespace stm32plus {
         uint32_t getRootDirectoryFirstSector() const;
         bool readSectorFromCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,void *buffer);
         bool writeSectorToCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,void *buffer);
+        bool readSectorsFromCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,void *buffer,uint32_t sectorCount);
+        bool writeSectorsToCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,const void *buffer,uint32_t sectorCount);
         bool readFatEntry(uint32_t clusterNumber,uint32_t& fatEntryForCluster);
         bool allocateNewCluster(uint32_t anyClusterInChain,uint32_t& newCluster);
         bool findFreeCluster(uint32_t& freeCluster);
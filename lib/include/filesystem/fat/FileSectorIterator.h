@@ -36,6 +36,9 @@ namespace stm32plus {
 
         bool readSector(void *buffer);
         bool writeSector(void *buffer);
+        bool readSectors(void *buffer,uint32_t sectorCount);
+        bool writeSectors(const void *buffer,uint32_t sectorCount);
+        uint32_t getSectorsLeftInCluster() const;
 
         void reset(uint32_t firstClusterNumber);
 
@@ -0,0 +1,1019 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /**
+   * How InternalFlashKeyValueStorage gets at the flash contents, the flash lock and the CRC
+   * unit. This default is for the real internal flash: memory-mapped reads, the lock feature
+   * and the CRC peripheral. A simulated flash specialises it so that it can run on a host.
+   */
+
+  template<class TFlash>
+  struct InternalFlashKeyValueAccess {
+
+    typedef InternalFlashLockFeature::LockManager LockManager;
+
+
+    /**
+     * CRC calculation using the CRC peripheral
+     */
+
+    struct Crc {
+
+      void reset() {
+        CRC_ResetDR();
+      }
+
+      void add(uint32_t word) {
+        CRC_CalcCRC(word);
+      }
+
+      uint32_t get() const {
+        return CRC_GetCRC();
+      }
+    };
+
+
+    /**
+     * One-time initialisation
+     */
+
+    static void initialise() {
+      ClockControl<PERIPHERAL_CRC>::On();
+    }
+
+
+    /**
+     * Read a word of flash
+     * @param address The word-aligned address
+     * @return The word
+     */
+
+    static uint32_t readWord(const TFlash& /* flash */,uint32_t address) {
+      return *reinterpret_cast<volatile uint32_t *>(address);
+    }
+  };
+
+
+  /**
+   * High-level class to store many small, independently updated values in internal flash
+   * pages. Each value is identified by a numeric key in the range 0..TMaxKeys-1 and may
+   * be up to a quarter of a page long. Where InternalFlashSettingsStorage rewrites the whole
+   * settings structure for every change, this class appends one small record per change and
+   * leaves everything else where it is.
+   *
+   * The pages are used as a circular log. Each page starts with a two word header holding
+   * a sequence number that increases each time a page is opened, and is followed by records:
+   *
+   *   0     : bits 0-15 key, bits 16-30 value length in bytes, bit 31 always zero
+   *   4-n   : the value, padded with 0xFF up to a multiple of 4 bytes
+   *   n-n+3 : CRC of all preceding words in the record
+   *
+   * A length of 0x7FFF marks a deleted key. Records are programmed word-by-word in order, so
+   * a record that was being written when the power failed fails its CRC and is ignored.
+   *
+   * mount() scans the pages, oldest first, and builds an index in RAM that maps each key
+   * to the address of its latest record. After that, reads are a single table lookup and
+   * a write appends one record to the newest page. Unchanged values are not written again.
+   *
+   * One page is always kept erased. When the newest page fills up, the next page is
+   * opened. If that leaves no erased page then the oldest page is compacted: its records
+   * that are still current are copied to the new page and it is erased. A page is erased
+   * only once per trip around the log, so wear is spread evenly over all the pages.
+   *
+   * All the pages must be the same size and there must be at least two of them. On the F4
+   * that means the pages are sectors from a single sector size group.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys=32>
+  class InternalFlashKeyValueStorage {
+
+    public:
+
+      /**
+       * Parameters class: must be set up by the user
+       */
+
+      struct Parameters {
+
+        uint32_t firstLocation;   ///< The first location to use in flash. Must be on a page boundary.
+        uint32_t memorySize;      ///< The amount of memory to use. Must be a multiple of the page size.
+
+        /**
+         * Constructor
+         * @param location The first location in flash (must be a multiple of the page size)
+         * @param size The total amount of flash memory that you want to use
+         */
+
+        Parameters(uint32_t location,uint32_t size)
+          : firstLocation(location),
+            memorySize(size) {
+        }
+
+
+        /**
+         * Default constructor. Parameters must be set later.
+         */
+
+        Parameters() {
+        }
+      };
+
+
+      /**
+       * Error codes
+       */
+
+      enum {
+        E_NOT_FOUND = 1,          ///< the key has no value
+        E_INVALID_KEY = 2,        ///< the key is not less than TMaxKeys
+        E_TOO_LARGE = 3,          ///< the value is larger than getMaximumValueSize()
+        E_FULL = 4,               ///< the current values fill the storage
+        E_INVALID_GEOMETRY = 5,   ///< the pages are not usable, see the class comment
+        E_NOT_FORMATTED = 6,      ///< mount() found no valid pages, call format()
+        E_NOT_MOUNTED = 7,        ///< mount() or format() has not been called successfully
+        E_WRONG_SIZE = 8,         ///< the stored value is not the size of the variable being read
+        E_VERIFY_FAILED = 9       ///< a record did not read back correctly after programming
+      };
+
+    protected:
+
+      typedef InternalFlashKeyValueAccess<TFlash> Access;
+
+      enum {
+        PAGE_MAGIC = 0x4B565331,        // xor'd with the sequence number in the page header
+        PAGE_HEADER_SIZE = 8,
+        TOMBSTONE_LENGTH = 0x7FFF,
+        BLANK_WORD = 0xFFFFFFFF
+      };
+
+      const TFlash& _flash;
+
+      uint32_t _firstLocation;
+      uint32_t _memorySize;
+      uint32_t _pageSize;
+      uint32_t _pageCount;
+
+      uint32_t _index[TMaxKeys];      // address of the latest record for each key, 0 if none
+      uint32_t _headPage;             // the page being appended to
+      uint32_t _headSequence;         // its sequence number
+      uint32_t _usedPages;            // number of pages from the oldest to the head inclusive
+      uint32_t _writeAddress;         // where the next record goes in the head page
+      bool _mounted;
+
+    protected:
+      bool checkGeometry();
+      void clearIndex();
+
+      uint32_t getPageAddress(uint32_t page) const;
+      bool readPageSequence(uint32_t page,uint32_t& sequence) const;
+      bool isBlank(uint32_t address,uint32_t endAddress) const;
+      uint32_t scanPage(uint32_t page);
+
+      static bool isValidRecordHeader(uint32_t header);
+      static uint32_t getRecordWords(uint32_t header);
+      bool isValidRecord(uint32_t address,uint32_t words) const;
+
+      bool openPage(uint32_t page);
+      uint32_t getOldestPage() const;
+      uint32_t getLiveRecordWords(uint32_t page) const;
+      bool compactOldestPage();
+      bool ensureSpace(uint32_t words);
+      bool appendRecord(uint16_t key,uint16_t length,const void *data);
+      bool isValueEqual(uint32_t address,const void *data,uint16_t size) const;
+
+    public:
+      InternalFlashKeyValueStorage(const TFlash& flash,const Parameters& params);
+
+      bool format();
+      bool mount();
+
+      bool read(uint16_t key,void *data,uint16_t bufferSize,uint16_t& actualSize) const;
+      bool write(uint16_t key,const void *data,uint16_t size);
+      bool remove(uint16_t key);
+      bool exists(uint16_t key) const;
+      bool getSize(uint16_t key,uint16_t& size) const;
+
+      template<class T> bool read(uint16_t key,T& value) const;
+      template<class T> bool write(uint16_t key,const T& value);
+
+      uint16_t getMaximumValueSize() const;
+  };
+
+
+  /**
+   * Constructor. Call mount() to find the existing values, or format() to start again.
+   * @param flash The flash peripheral
+   * @param params The flash region to use
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline InternalFlashKeyValueStorage<TFlash,TMaxKeys>::InternalFlashKeyValueStorage(const TFlash& flash,const Parameters& params)
+    : _flash(flash),
+      _firstLocation(params.firstLocation),
+      _memorySize(params.memorySize),
+      _pageSize(0),
+      _pageCount(0),
+      _mounted(false) {
+
+    static_assert(TMaxKeys>0 && TMaxKeys<=0xFFFF,"TMaxKeys must be in the range 1..65535");
+
+    Access::initialise();
+    clearIndex();
+  }
+
+
+  /**
+   * Erase all the pages and start with no values
+   * @return true if it worked
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::format() {
+
+    uint32_t i;
+
+    _mounted=false;
+
+    if(!checkGeometry())
+      return false;
+
+    clearIndex();
+
+    // erase everything and open the first page
+
+    typename Access::LockManager lm;
+
+    for(i=0;i<_pageCount;i++)
+      if(!_flash.pageErase(getPageAddress(i)))
+        return false;
+
+    _usedPages=0;
+    _headSequence=0;
+
+    if(!openPage(0))
+      return false;
+
+    _mounted=true;
+    return true;
+  }
+
+
+  /**
+   * Find the pages in use and build the index from their records. A compaction that was
+   * interrupted by a power failure is completed here.
+   * @return true if it worked
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::mount() {
+
+    uint32_t i,page,sequence,oldestPage;
+    bool found;
+
+    _mounted=false;
+
+    if(!checkGeometry())
+      return false;
+
+    clearIndex();
+
+    // the head is the page with the highest sequence number
+
+    found=false;
+
+    for(i=0;i<_pageCount;i++) {
+      if(readPageSequence(i,sequence) && (!found || sequence>_headSequence)) {
+        _headPage=i;
+        _headSequence=sequence;
+        found=true;
+      }
+    }
+
+    if(!found)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_NOT_FORMATTED);
+
+    // pages are opened in ring order so the oldest is the first valid one after the head
+
+    oldestPage=_headPage;
+
+    for(i=1;i<=_pageCount;i++) {
+
+      oldestPage=(_headPage+i) % _pageCount;
+
+      if(readPageSequence(oldestPage,sequence))
+        break;
+    }
+
+    _usedPages=(_headPage+_pageCount-oldestPage) % _pageCount+1;
+
+    // replay the records, oldest first, so that later records replace earlier ones
+
+    for(i=0;i<_usedPages;i++) {
+
+      page=(oldestPage+i) % _pageCount;
+
+      if(readPageSequence(page,sequence))
+        _writeAddress=scanPage(page);
+    }
+
+    // a torn record in the head page leaves nothing safe to append to
+
+    if(!isBlank(_writeAddress,getPageAddress(_headPage)+_pageSize))
+      _writeAddress=getPageAddress(_headPage)+_pageSize;
+
+    // if there is no erased page then a compaction didn't finish. nothing is appended until
+    // it does, so the head page holds only copies of records that are still in the oldest
+    // page. if the rest won't fit alongside them then the head page is erased and the log
+    // is read again without it.
+
+    if(_usedPages==_pageCount) {
+
+      typename Access::LockManager lm;
+
+      if(_writeAddress+getLiveRecordWords(oldestPage)*4>getPageAddress(_headPage)+_pageSize) {
+
+        if(!_flash.pageErase(getPageAddress(_headPage)))
+          return false;
+
+        return mount();
+      }
+
+      if(!compactOldestPage())
+        return false;
+    }
+
+    _mounted=true;
+    return true;
+  }
+
+
+  /**
+   * Read a value
+   * @param key The key
+   * @param data Where to store the value
+   * @param bufferSize The size of data. If the value is larger then it's truncated to this size.
+   * @param actualSize The size of the stored value
+   * @return true if it worked, false with E_NOT_FOUND if there's no value
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::read(uint16_t key,void *data,uint16_t bufferSize,uint16_t& actualSize) const {
+
+    uint32_t address,word,count;
+    uint8_t *ptr;
+
+    if(!getSize(key,actualSize))
+      return false;
+
+    // copy out word by word. the words were programmed in native order and the bytes
+    // come out in the same order that they went in
+
+    address=_index[key]+4;
+    ptr=static_cast<uint8_t *>(data);
+
+    if(bufferSize>actualSize)
+      bufferSize=actualSize;
+
+    while(bufferSize) {
+
+      word=Access::readWord(_flash,address);
+      count=bufferSize<4 ? bufferSize : 4;
+
+      memcpy(ptr,&word,count);
+
+      ptr+=count;
+      bufferSize-=count;
+      address+=4;
+    }
+
+    return true;
+  }
+
+
+  /**
+   * Read a value into a variable. The stored value must be exactly the same size.
+   * @param key The key
+   * @param value Where to store the value
+   * @return true if it worked, false with E_WRONG_SIZE if the sizes differ
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  template<class T>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::read(uint16_t key,T& value) const {
+
+    uint16_t actualSize;
+
+    if(!getSize(key,actualSize))
+      return false;
+
+    if(actualSize!=sizeof(T))
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_WRONG_SIZE);
+
+    return read(key,&value,sizeof(T),actualSize);
+  }
+
+
+  /**
+   * Write a value. If it's the same as the stored value then nothing is written.
+   * @param key The key
+   * @param data The value
+   * @param size The size of the value, up to getMaximumValueSize()
+   * @return true if it worked
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::write(uint16_t key,const void *data,uint16_t size) {
+
+    if(!_mounted)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_NOT_MOUNTED);
+
+    if(key>=TMaxKeys)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_INVALID_KEY);
+
+    if(size>getMaximumValueSize())
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_TOO_LARGE);
+
+    // don't wear the flash by writing what's already there
+
+    if(isValueEqual(_index[key],data,size))
+      return true;
+
+    typename Access::LockManager lm;
+    return appendRecord(key,size,data);
+  }
+
+
+  /**
+   * Write a variable
+   * @param key The key
+   * @param value The value
+   * @return true if it worked
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  template<class T>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::write(uint16_t key,const T& value) {
+    return write(key,&value,sizeof(T));
+  }
+
+
+  /**
+   * Remove a value. It's not an error to remove a key that has no value.
+   * @param key The key
+   * @return true if it worked
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::remove(uint16_t key) {
+
+    if(!_mounted)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_NOT_MOUNTED);
+
+    if(key>=TMaxKeys)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_INVALID_KEY);
+
+    if(!exists(key))
+      return true;
+
+    typename Access::LockManager lm;
+    return appendRecord(key,TOMBSTONE_LENGTH,nullptr);
+  }
+
+
+  /**
+   * Check if a key has a value
+   * @param key The key
+   * @return true if it has
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::exists(uint16_t key) const {
+
+    if(key>=TMaxKeys || _index[key]==0)
+      return false;
+
+    return ((Access::readWord(_flash,_index[key]) >> 16) & 0x7FFF)!=TOMBSTONE_LENGTH;
+  }
+
+
+  /**
+   * Get the size of a value
+   * @param key The key
+   * @param size Where to store the size
+   * @return true if it worked, false with E_NOT_FOUND if there's no value
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::getSize(uint16_t key,uint16_t& size) const {
+
+    if(key>=TMaxKeys)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_INVALID_KEY);
+
+    if(!exists(key))
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_NOT_FOUND);
+
+    size=(Access::readWord(_flash,_index[key]) >> 16) & 0x7FFF;
+    return true;
+  }
+
+
+  /**
+   * Get the largest value that can be stored. A value is limited to a quarter of a page so
+   * that there is always room for it in a new page alongside the records that are copied
+   * there from the oldest page.
+   * @return The maximum size in bytes
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline uint16_t InternalFlashKeyValueStorage<TFlash,TMaxKeys>::getMaximumValueSize() const {
+
+    uint32_t size;
+
+    size=(_pageSize-PAGE_HEADER_SIZE)/4-8;
+    return size<TOMBSTONE_LENGTH ? size : static_cast<uint32_t>(TOMBSTONE_LENGTH-1);
+  }
+
+
+  /*
+   * Check that the region is a whole number of equal sized pages, at least two of them
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::checkGeometry() {
+
+    uint32_t address;
+
+    _pageSize=_flash.getPageSize(_firstLocation);
+
+    if(!_flash.isStartOfPage(_firstLocation) || _pageSize==0 || _memorySize % _pageSize!=0)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_INVALID_GEOMETRY);
+
+    _pageCount=_memorySize/_pageSize;
+
+    if(_pageCount<2)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_INVALID_GEOMETRY);
+
+    for(address=_firstLocation;address<_firstLocation+_memorySize;address+=_pageSize)
+      if(_flash.getPageSize(address)!=_pageSize)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_INVALID_GEOMETRY);
+
+    return true;
+  }
+
+
+  /*
+   * Forget all the values
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline void InternalFlashKeyValueStorage<TFlash,TMaxKeys>::clearIndex() {
+    memset(_index,0,sizeof(_index));
+  }
+
+
+  /*
+   * Get the address of a page
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline uint32_t InternalFlashKeyValueStorage<TFlash,TMaxKeys>::getPageAddress(uint32_t page) const {
+    return _firstLocation+page*_pageSize;
+  }
+
+
+  /*
+   * Read the header of a page. Returns false if the page is not in use.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::readPageSequence(uint32_t page,uint32_t& sequence) const {
+
+    uint32_t address;
+
+    address=getPageAddress(page);
+    sequence=Access::readWord(_flash,address);
+
+    return sequence!=BLANK_WORD && (sequence ^ PAGE_MAGIC)==Access::readWord(_flash,address+4);
+  }
+
+
+  /*
+   * Check that a range of flash is erased
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::isBlank(uint32_t address,uint32_t endAddress) const {
+
+    for(;address<endAddress;address+=4)
+      if(Access::readWord(_flash,address)!=BLANK_WORD)
+        return false;
+
+    return true;
+  }
+
+
+  /*
+   * Walk the records in a page and point the index at the valid ones. Returns the address
+   * after the last record. A header word that's been torn in half is stepped over.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline uint32_t InternalFlashKeyValueStorage<TFlash,TMaxKeys>::scanPage(uint32_t page) {
+
+    uint32_t address,endAddress,header,words;
+
+    address=getPageAddress(page)+PAGE_HEADER_SIZE;
+    endAddress=getPageAddress(page)+_pageSize;
+
+    while(address<endAddress) {
+
+      header=Access::readWord(_flash,address);
+
+      if(header==BLANK_WORD)
+        break;
+
+      if(!isValidRecordHeader(header)) {
+        address+=4;
+        continue;
+      }
+
+      words=getRecordWords(header);
+
+      if(address+words*4>endAddress)
+        return endAddress;
+
+      if(isValidRecord(address,words))
+        _index[header & 0xFFFF]=address;
+
+      address+=words*4;
+    }
+
+    return address;
+  }
+
+
+  /*
+   * Check the fixed fields of a record header
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::isValidRecordHeader(uint32_t header) {
+    return (header & 0x80000000)==0 && (header & 0xFFFF)<TMaxKeys;
+  }
+
+
+  /*
+   * Get the total size of a record in words: header, value and CRC
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline uint32_t InternalFlashKeyValueStorage<TFlash,TMaxKeys>::getRecordWords(uint32_t header) {
+
+    uint32_t length;
+
+    length=(header >> 16) & 0x7FFF;
+
+    if(length==TOMBSTONE_LENGTH)
+      length=0;
+
+    return (length+3)/4+2;
+  }
+
+
+  /*
+   * Check the CRC of a record
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::isValidRecord(uint32_t address,uint32_t words) const {
+
+    typename Access::Crc crc;
+
+    crc.reset();
+
+    for(words--;words;words--) {
+      crc.add(Access::readWord(_flash,address));
+      address+=4;
+    }
+
+    return crc.get()==Access::readWord(_flash,address);
+  }
+
+
+  /*
+   * Make a page the head of the log. It's erased first if it needs to be.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::openPage(uint32_t page) {
+
+    uint32_t address,sequence;
+
+    address=getPageAddress(page);
+
+    if(!isBlank(address,address+_pageSize) && !_flash.pageErase(address))
+      return false;
+
+    sequence=_headSequence+1;
+
+    InternalFlashWordWriter<TFlash> writer(_flash,address);
+
+    *writer=sequence;
+    if(writer.hasError())
+      return false;
+
+    writer++;
+
+    *writer=sequence ^ PAGE_MAGIC;
+    if(writer.hasError())
+      return false;
+
+    _headPage=page;
+    _headSequence=sequence;
+    _writeAddress=address+PAGE_HEADER_SIZE;
+    _usedPages++;
+
+    return true;
+  }
+
+
+  /*
+   * Get the oldest page in the log
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline uint32_t InternalFlashKeyValueStorage<TFlash,TMaxKeys>::getOldestPage() const {
+    return (_headPage+_pageCount+1-_usedPages) % _pageCount;
+  }
+
+
+  /*
+   * Count the words in the records of a page that are still current and would be copied
+   * out of it by a compaction
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline uint32_t InternalFlashKeyValueStorage<TFlash,TMaxKeys>::getLiveRecordWords(uint32_t page) const {
+
+    uint32_t address,endAddress,header,words,total,sequence;
+
+    if(!readPageSequence(page,sequence))
+      return 0;
+
+    total=0;
+    address=getPageAddress(page)+PAGE_HEADER_SIZE;
+    endAddress=getPageAddress(page)+_pageSize;
+
+    while(address<endAddress) {
+
+      header=Access::readWord(_flash,address);
+
+      if(header==BLANK_WORD)
+        break;
+
+      if(!isValidRecordHeader(header)) {
+        address+=4;
+        continue;
+      }
+
+      words=getRecordWords(header);
+
+      if(address+words*4>endAddress)
+        break;
+
+      if(_index[header & 0xFFFF]==address && ((header >> 16) & 0x7FFF)!=TOMBSTONE_LENGTH)
+        total+=words;
+
+      address+=words*4;
+    }
+
+    return total;
+  }
+
+
+  /*
+   * Copy the current records out of the oldest page into the head page and erase it.
+   * Deletion records are dropped because there's nothing older left for them to hide.
+   * Nothing is written unless all the records fit, and the page is erased only after
+   * every copy has read back correctly. A failed copy leaves the head page full and the
+   * oldest page as it was, so the compaction is tried again on the next mount.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::compactOldestPage() {
+
+    uint32_t page,address,endAddress,header,words,i,sequence,word;
+    uint16_t key;
+
+    page=getOldestPage();
+    endAddress=getPageAddress(page)+_pageSize;
+
+    if(_writeAddress+getLiveRecordWords(page)*4>getPageAddress(_headPage)+_pageSize)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_FULL);
+
+    if(readPageSequence(page,sequence)) {
+
+      address=getPageAddress(page)+PAGE_HEADER_SIZE;
+
+      while(address<endAddress) {
+
+        header=Access::readWord(_flash,address);
+
+        if(header==BLANK_WORD)
+          break;
+
+        if(!isValidRecordHeader(header)) {
+          address+=4;
+          continue;
+        }
+
+        words=getRecordWords(header);
+
+        if(address+words*4>endAddress)
+          break;
+
+        key=header & 0xFFFF;
+
+        if(_index[key]==address) {
+
+          if(((header >> 16) & 0x7FFF)==TOMBSTONE_LENGTH)
+            _index[key]=0;
+          else {
+
+            // the record is copied verbatim so its CRC is still good
+
+            InternalFlashWordWriter<TFlash> writer(_flash,_writeAddress);
+
+            for(i=0;i<words;i++) {
+
+              word=Access::readWord(_flash,address+i*4);
+
+              *writer=word;
+
+              if(writer.hasError() || Access::readWord(_flash,_writeAddress+i*4)!=word) {
+                _writeAddress=getPageAddress(_headPage)+_pageSize;
+                return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_VERIFY_FAILED);
+              }
+
+              writer++;
+            }
+
+            _index[key]=_writeAddress;
+            _writeAddress+=words*4;
+          }
+        }
+
+        address+=words*4;
+      }
+    }
+
+    if(!_flash.pageErase(getPageAddress(page)))
+      return false;
+
+    _usedPages--;
+    return true;
+  }
+
+
+  /*
+   * Make sure that the head page has room for a record, moving on to new pages and
+   * compacting old ones as needed. If a lap of the log doesn't free enough space then
+   * the current values fill the storage. A new page is never opened while there's no
+   * erased page because that would erase the oldest page before its records are copied.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::ensureSpace(uint32_t words) {
+
+    uint32_t i;
+
+    for(i=0;i<=_pageCount;i++) {
+
+      if(_usedPages==_pageCount && !compactOldestPage())
+        return false;
+
+      if(_writeAddress+words*4<=getPageAddress(_headPage)+_pageSize)
+        return true;
+
+      if(!openPage((_headPage+1) % _pageCount))
+        return false;
+    }
+
+    return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_FULL);
+  }
+
+
+  /*
+   * Append a record to the log and point the index at it. The flash must be unlocked.
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::appendRecord(uint16_t key,uint16_t length,const void *data) {
+
+    uint32_t header,words,word,count,remaining,address;
+    const uint8_t *ptr;
+    typename Access::Crc crc;
+
+    header=key | (static_cast<uint32_t>(length) << 16);
+    words=getRecordWords(header);
+
+    if(!ensureSpace(words))
+      return false;
+
+    address=_writeAddress;
+    InternalFlashWordWriter<TFlash> writer(_flash,address);
+
+    crc.reset();
+
+    *writer=header;
+    writer++;
+    crc.add(header);
+
+    // the value is programmed a word at a time with the last word padded out with 0xFF
+
+    ptr=static_cast<const uint8_t *>(data);
+    remaining=length==TOMBSTONE_LENGTH ? 0 : length;
+
+    while(remaining) {
+
+      count=remaining<4 ? remaining : 4;
+
+      word=BLANK_WORD;
+      memcpy(&word,ptr,count);
+
+      *writer=word;
+      writer++;
+      crc.add(word);
+
+      ptr+=count;
+      remaining-=count;
+    }
+
+    // the CRC goes last. only after this is the record valid
+
+    *writer=crc.get();
+
+    // the writer only keeps the result of the last program so the record is read back
+    // to catch an earlier failure. nothing more is appended to a page with a bad record.
+
+    if(writer.hasError()) {
+      _writeAddress=getPageAddress(_headPage)+_pageSize;
+      return false;
+    }
+
+    if(!isValidRecord(address,words)) {
+      _writeAddress=getPageAddress(_headPage)+_pageSize;
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH_KEY_VALUE,E_VERIFY_FAILED);
+    }
+
+    _index[key]=address;
+    _writeAddress=address+words*4;
+
+    return true;
+  }
+
+
+  /*
+   * Compare a stored value with a new one
+   */
+
+  template<class TFlash,uint16_t TMaxKeys>
+  inline bool InternalFlashKeyValueStorage<TFlash,TMaxKeys>::isValueEqual(uint32_t address,const void *data,uint16_t size) const {
+
+    uint32_t header,word,count;
+    const uint8_t *ptr;
+
+    if(address==0)
+      return false;
+
+    header=Access::readWord(_flash,address);
+
+    if(((header >> 16) & 0x7FFF)!=size)
+      return false;
+
+    ptr=static_cast<const uint8_t *>(data);
+
+    while(size) {
+
+      address+=4;
+      word=Access::readWord(_flash,address);
+      count=size<4 ? size : 4;
+
+      if(memcmp(&word,ptr,count)!=0)
+        return false;
+
+      ptr+=count;
+      size-=count;
+    }
+
+    return true;
+  }
+}
@@ -0,0 +1,370 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * A simulated internal flash backed by a caller-supplied block of RAM. It has the page
+   * and program methods of an InternalFlashDevice with the write feature, so it can stand in
+   * for one underneath InternalFlashKeyValueStorage, and it needs no peripherals so that
+   * code can be run and tested on a host. Flash addresses start at a base address of your
+   * choosing and map on to the RAM.
+   *
+   * Flash rules are enforced: a word can only be programmed if it's erased, and an erase
+   * sets the whole page to 0xFF. Counters are kept for the program and erase operations.
+   *
+   * A power failure can be simulated by setting the number of program/erase operations
+   * that will succeed. The one after that is half-completed, as a word program that gets
+   * only its first half-word done or an erase that clears half the page, and all subsequent
+   * operations fail until the counter is reset.
+   *
+   * This is not part of config/flash/internal.h. Include config/flash/internal_simulator.h
+   * in the host or test build that needs it.
+   */
+
+  class InternalFlashSimulator {
+
+    public:
+
+      /**
+       * Error codes, the same as InternalFlashWriteFeature's
+       */
+
+      enum {
+        E_ERASE_FAILED = 1,          ///< erase operation failed: see extended code for reason
+        E_PROGRAM_FAILED = 2         ///< program operation failed: see extended code for reason
+      };
+
+      /**
+       * Extended error codes
+       */
+
+      enum {
+        E_OUT_OF_RANGE = 1,          ///< address outside the simulated flash, or misaligned
+        E_NOT_ERASED = 2,            ///< the location has already been programmed
+        E_POWER_FAILED = 3           ///< simulated power failure
+      };
+
+    protected:
+      uint8_t *_memory;
+      uint32_t _baseAddress;
+      uint32_t _size;
+      uint32_t _pageSize;
+
+      mutable uint32_t _wordPrograms;
+      mutable uint32_t _pageErases;
+      mutable uint32_t _operationsUntilPowerFail;
+      mutable bool _powerFailed;
+
+    protected:
+      bool beginWriteOperation(uint32_t flashAddress,uint32_t alignment,uint32_t errorCode) const;
+
+    public:
+      InternalFlashSimulator(uint8_t *memory,uint32_t baseAddress,uint32_t size,uint32_t pageSize);
+
+      uint32_t getPageSize(uint32_t address) const;
+      bool isStartOfPage(uint32_t address) const;
+      uint32_t getFlashSizeInBytes() const;
+
+      bool chipErase() const;
+      bool pageErase(uint32_t flashAddress) const;
+      bool wordProgram(uint32_t flashAddress,uint32_t data) const;
+      bool halfWordProgram(uint32_t flashAddress,uint16_t data) const;
+
+      uint32_t readWord(uint32_t flashAddress) const;
+
+      uint32_t getWordProgramCount() const;
+      uint32_t getPageEraseCount() const;
+      void resetCounters();
+
+      void setOperationsUntilPowerFail(uint32_t count);
+  };
+
+
+  /**
+   * InternalFlashKeyValueStorage access for the simulator: reads go through readWord(),
+   * there's nothing to lock and the CRC is done in software with the same polynomial,
+   * initial value and word-at-a-time input as the CRC peripheral.
+   */
+
+  template<>
+  struct InternalFlashKeyValueAccess<InternalFlashSimulator> {
+
+    struct LockManager {
+      LockManager() {}
+      ~LockManager() {}
+    };
+
+
+    /**
+     * Software version of the CRC peripheral
+     */
+
+    struct Crc {
+
+      uint32_t _crc;
+
+      void reset() {
+        _crc=0xFFFFFFFF;
+      }
+
+      void add(uint32_t word) {
+
+        uint8_t i;
+
+        _crc^=word;
+
+        for(i=0;i<32;i++)
+          _crc=(_crc & 0x80000000) ? (_crc << 1) ^ 0x04C11DB7 : (_crc << 1);
+      }
+
+      uint32_t get() const {
+        return _crc;
+      }
+    };
+
+
+    static void initialise() {
+    }
+
+
+    static uint32_t readWord(const InternalFlashSimulator& flash,uint32_t address) {
+      return flash.readWord(address);
+    }
+  };
+
+
+  /**
+   * Constructor. The memory is not initialised, call chipErase() if you want to start
+   * with an erased device.
+   * @param memory The memory that holds the flash contents. Must not go out of scope.
+   * @param baseAddress The flash address of the first byte of memory
+   * @param size The size of the memory. Must be a multiple of pageSize.
+   * @param pageSize The erase page size
+   */
+
+  inline InternalFlashSimulator::InternalFlashSimulator(uint8_t *memory,uint32_t baseAddress,uint32_t size,uint32_t pageSize)
+    : _memory(memory),
+      _baseAddress(baseAddress),
+      _size(size),
+      _pageSize(pageSize),
+      _operationsUntilPowerFail(UINT32_MAX),
+      _powerFailed(false) {
+
+    resetCounters();
+  }
+
+
+  /**
+   * Get the page size
+   * @return The page size
+   */
+
+  inline uint32_t InternalFlashSimulator::getPageSize(uint32_t /* address */) const {
+    return _pageSize;
+  }
+
+
+  /**
+   * Check if the given address is at the start of a page
+   * @param address The address
+   * @return true if at the start of a page
+   */
+
+  inline bool InternalFlashSimulator::isStartOfPage(uint32_t address) const {
+    return (address-_baseAddress) % _pageSize==0;
+  }
+
+
+  /**
+   * Get the total flash size in bytes
+   * @return The size that was passed to the constructor
+   */
+
+  inline uint32_t InternalFlashSimulator::getFlashSizeInBytes() const {
+    return _size;
+  }
+
+
+  /*
+   * Common checks before a program or erase
+   */
+
+  inline bool InternalFlashSimulator::beginWriteOperation(uint32_t flashAddress,uint32_t alignment,uint32_t errorCode) const {
+
+    if(flashAddress<_baseAddress || flashAddress-_baseAddress>=_size || flashAddress % alignment!=0)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,errorCode,E_OUT_OF_RANGE);
+
+    if(_powerFailed)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,errorCode,E_POWER_FAILED);
+
+    // count down to the failure. the operation that finds zero is the one that fails
+
+    if(_operationsUntilPowerFail==0)
+      _powerFailed=true;
+    else if(_operationsUntilPowerFail!=UINT32_MAX)
+      _operationsUntilPowerFail--;
+
+    return true;
+  }
+
+
+  /**
+   * Erase the whole device. This is not counted as a page erase and ignores the
+   * power failure simulation.
+   * @return true
+   */
+
+  inline bool InternalFlashSimulator::chipErase() const {
+    memset(_memory,0xff,_size);
+    return true;
+  }
+
+
+  /**
+   * Erase a page
+   * @param flashAddress The address to erase - must be a page multiple.
+   * @return true if it worked
+   */
+
+  inline bool InternalFlashSimulator::pageErase(uint32_t flashAddress) const {
+
+    if(!beginWriteOperation(flashAddress,1,E_ERASE_FAILED))
+      return false;
+
+    if(!isStartOfPage(flashAddress))
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,E_ERASE_FAILED,E_OUT_OF_RANGE);
+
+    memset(_memory+(flashAddress-_baseAddress),0xff,_powerFailed ? _pageSize/2 : _pageSize);
+    _pageErases++;
+
+    if(_powerFailed)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,E_ERASE_FAILED,E_POWER_FAILED);
+
+    return true;
+  }
+
+
+  /**
+   * Program a 32-bit word. The word must be erased.
+   * @param flashAddress The address to program. Must be a 4-byte boundary.
+   * @param data The 32-bit word to program
+   * @return true if it worked
+   */
+
+  inline bool InternalFlashSimulator::wordProgram(uint32_t flashAddress,uint32_t data) const {
+
+    uint8_t *ptr;
+
+    if(!beginWriteOperation(flashAddress,4,E_PROGRAM_FAILED))
+      return false;
+
+    ptr=_memory+(flashAddress-_baseAddress);
+
+    if(readWord(flashAddress)!=0xFFFFFFFF)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,E_PROGRAM_FAILED,E_NOT_ERASED);
+
+    // a power failure leaves just the first half-word programmed
+
+    memcpy(ptr,&data,_powerFailed ? 2 : 4);
+    _wordPrograms++;
+
+    if(_powerFailed)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,E_PROGRAM_FAILED,E_POWER_FAILED);
+
+    return true;
+  }
+
+
+  /**
+   * Program a 16-bit half word. The half word must be erased.
+   * @param flashAddress The address to program. Must be a 2-byte boundary.
+   * @param data The 16-bit half-word to program
+   * @return true if it worked
+   */
+
+  inline bool InternalFlashSimulator::halfWordProgram(uint32_t flashAddress,uint16_t data) const {
+
+    uint8_t *ptr;
+
+    if(!beginWriteOperation(flashAddress,2,E_PROGRAM_FAILED))
+      return false;
+
+    ptr=_memory+(flashAddress-_baseAddress);
+
+    if(ptr[0]!=0xff || ptr[1]!=0xff)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,E_PROGRAM_FAILED,E_NOT_ERASED);
+
+    if(_powerFailed)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_INTERNAL_FLASH,E_PROGRAM_FAILED,E_POWER_FAILED);
+
+    memcpy(ptr,&data,2);
+    _wordPrograms++;
+
+    return true;
+  }
+
+
+  /**
+   * Read a word
+   * @param flashAddress The word-aligned address to read
+   * @return The word
+   */
+
+  inline uint32_t InternalFlashSimulator::readWord(uint32_t flashAddress) const {
+
+    uint32_t word;
+
+    memcpy(&word,_memory+(flashAddress-_baseAddress),4);
+    return word;
+  }
+
+
+  /**
+   * Get the number of word and half-word program operations since the counters were last reset
+   * @return The program count
+   */
+
+  inline uint32_t InternalFlashSimulator::getWordProgramCount() const {
+    return _wordPrograms;
+  }
+
+
+  /**
+   * Get the number of page erase operations since the counters were last reset
+   * @return The erase count
+   */
+
+  inline uint32_t InternalFlashSimulator::getPageEraseCount() const {
+    return _pageErases;
+  }
+
+
+  /**
+   * Reset the operation counters to zero
+   */
+
+  inline void InternalFlashSimulator::resetCounters() {
+    _wordPrograms=0;
+    _pageErases=0;
+  }
+
+
+  /**
+   * Simulate a power failure after the given number of program/erase operations. Calling
+   * this also restores power after a previous simulated failure.
+   * @param count The number of operations that will succeed. UINT32_MAX disables the simulation.
+   */
+
+  inline void InternalFlashSimulator::setOperationsUntilPowerFail(uint32_t count) {
+    _operationsUntilPowerFail=count;
+    _powerFailed=false;
+  }
+}
@@ -0,0 +1,1123 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace spiflash {
+
+
+    /**
+     * @brief Flash translation layer that presents a region of SPI NOR flash as a BlockDevice.
+     *
+     * NOR flash can only be erased in 4Kb sectors so rewriting a 512 byte block in place would
+     * cost an erase every time and quickly wear out the sectors that hold the FAT. Instead this
+     * class writes blocks to the flash as a log. Each write goes to the next free slot in the
+     * 'active' sector and an in-RAM logical-to-physical map is updated to point at it. The
+     * previous copy of the block becomes stale and is reclaimed later by garbage collection,
+     * which moves the live blocks out of a mostly-stale sector and then erases it.
+     *
+     * Each 4Kb sector holds a 256 byte metadata page followed by seven 512 byte data slots.
+     * The metadata page contains a sector header (magic number and erase count) and a tag for
+     * each slot that records which logical block it holds and a sequence number. Tags are
+     * programmed only after their data so a slot is never valid until its data is complete.
+     * Each header and tag carries a check word so that one torn by a power failure is ignored.
+     * When the map is rebuilt by mount() the copy with the highest sequence number wins, so
+     * there's no metadata to update in place and no window in which a power failure can lose
+     * anything other than the write that was in progress.
+     *
+     * Wear levelling is dynamic and static. New active sectors are the free sectors with the
+     * lowest erase counts, and the background collector will move cold data out of the least
+     * worn sector and into the most worn free sector when the spread of erase counts grows
+     * too large.
+     *
+     * Foreground writes only collect garbage when they have to. Call backgroundCollect() from
+     * your idle loop to erase and compact ahead of time so that writes rarely stall.
+     *
+     * RAM usage is 2 bytes per logical block for the map and 6 bytes per sector. A whole 16Mb
+     * device with the default spare sectors needs about 72Kb so you may want to manage a smaller
+     * region. At most 9362 sectors (about 36Mb) can be managed.
+     *
+     * @tparam TSpiFlash A SPI flash device, or the RamSpiFlashDevice simulator
+     */
+
+    template<class TSpiFlash>
+    class SpiFlashBlockDevice : public BlockDevice {
+
+      public:
+
+        /**
+         * Error codes
+         */
+
+        enum {
+          E_NOT_FORMATTED = 1,        //!< mount() didn't find any formatted sectors
+          E_INVALID_BLOCK = 2,        //!< block index is beyond the end of the device
+          E_DEVICE_FULL = 3,          //!< no free sector and nothing to collect (cannot happen if the spares are sufficient)
+          E_INVALID_GEOMETRY = 4,     //!< too few or too many sectors
+          E_NO_MBR = 5                //!< this device does not have an MBR
+        };
+
+        /**
+         * Geometry constants
+         */
+
+        enum {
+          SECTOR_SIZE = 4096,         //!< flash erase unit
+          METADATA_SIZE = 256,        //!< metadata page at the start of each sector
+          BLOCK_SIZE = 512,           //!< logical block size
+          SLOTS_PER_SECTOR = 7,       //!< data slots after the metadata page
+          MIN_FREE_SECTORS = 2,       //!< foreground writes keep at least this many sectors free
+          MIN_SPARE_SECTORS = 3,      //!< smallest usable over-provisioning
+          MAX_SECTORS = 9362          //!< slot numbers must fit in 16 bits
+        };
+
+        /**
+         * Counters for measuring write amplification and collector activity
+         */
+
+        struct Statistics {
+          uint32_t hostBlocksWritten;       //!< blocks written by the user
+          uint32_t flashBlocksWritten;      //!< blocks programmed including collector moves
+          uint32_t sectorsErased;           //!< sector erase operations
+          uint32_t garbageCollections;      //!< sectors reclaimed
+          uint32_t wearLevellingMoves;      //!< sectors moved to level the wear
+        };
+
+      protected:
+
+        /*
+         * On-flash structures in the metadata page
+         */
+
+        struct SectorHeader {
+          uint32_t magic;
+          uint32_t eraseCount;
+          uint32_t check;
+        } __attribute__((packed));
+
+        struct SlotTag {
+          uint32_t logicalBlock;
+          uint32_t sequence;
+          uint32_t check;
+        } __attribute__((packed));
+
+        struct SectorMetadata {
+          SectorHeader header;
+          SlotTag tags[SLOTS_PER_SECTOR];
+        } __attribute__((packed));
+
+        /*
+         * In-RAM sector states
+         */
+
+        enum {
+          SECTOR_FREE,                // erased, header written, no slots used
+          SECTOR_ACTIVE,              // currently being filled
+          SECTOR_FULL,                // no more slots, may contain stale data
+          SECTOR_DIRTY                // needs an erase before it can be used
+        };
+
+        enum {
+          SECTOR_MAGIC = 0x4c544653,  // "SFTL"
+          UNMAPPED = 0xffff,
+          NO_SECTOR = 0xffffffff,
+          WEAR_LEVEL_THRESHOLD = 64   // erase count spread that triggers a static wear levelling move
+        };
+
+        TSpiFlash& _flash;
+        uint32_t _baseAddress;
+        uint32_t _sectorCount;
+        uint32_t _spareSectors;
+        uint32_t _logicalBlocks;
+
+        uint16_t *_map;
+        uint32_t *_eraseCounts;
+        uint8_t *_validCounts;
+        uint8_t *_sectorStates;
+
+        uint32_t _activeSector;
+        uint32_t _activeSlot;
+        uint32_t _freeSectors;
+        uint32_t _dirtySectors;
+        uint32_t _sequence;
+        bool _mounted;
+        bool _collecting;
+        bool _coldData;
+
+        Statistics _statistics;
+        uint8_t _buffer[BLOCK_SIZE];
+
+      protected:
+        static uint32_t mix(uint32_t value);
+        static bool isBlank(const void *data,uint32_t size);
+
+        uint32_t sectorAddress(uint32_t sector) const;
+        uint32_t slotAddress(uint32_t slot) const;
+        uint32_t tagAddress(uint32_t slot) const;
+
+        bool readFlash(uint32_t address,void *data,uint32_t size) const;
+        bool isBlankFlash(uint32_t address,uint32_t size,bool& blank) const;
+        bool programFlash(uint32_t address,const void *data,uint32_t size);
+        bool eraseSector(uint32_t sector);
+        bool writeSlot(uint32_t slot,const void *data,uint32_t logicalBlock);
+
+        void resetState();
+        bool scanSector(uint32_t sector,uint32_t& usedSlots,bool& headerValid);
+        bool addMapping(uint32_t logicalBlock,uint32_t slot,uint32_t sequence);
+
+        bool openSector();
+        bool allocateSlot(uint32_t& slot);
+        bool ensureFreeSectors();
+        bool eraseDirtySector();
+        uint32_t selectVictim() const;
+        bool collectSector(uint32_t sector);
+
+      public:
+        SpiFlashBlockDevice(TSpiFlash& flash,uint32_t firstSector,uint32_t sectorCount,uint32_t spareSectors=4);
+        virtual ~SpiFlashBlockDevice();
+
+        bool format();
+        bool mount();
+
+        bool needsBackgroundCollect() const;
+        bool backgroundCollect();
+
+        const Statistics& getStatistics() const;
+        uint32_t getEraseCount(uint32_t sector) const;
+
+        // overrides from BlockDevice
+
+        virtual uint32_t getTotalBlocksOnDevice() override;
+        virtual uint32_t getBlockSizeInBytes() override;
+        virtual bool readBlock(void *dest,uint32_t blockIndex) override;
+        virtual bool readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) override;
+        virtual bool writeBlock(const void *src,uint32_t blockIndex) override;
+        virtual bool writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) override;
+        virtual formatType getFormatType() override;
+        virtual bool getMbr(Mbr *mbr) override;
+    };
+
+
+    /**
+     * Constructor. The device is not usable until mount() or format() has succeeded.
+     * @param flash The flash device. Must not go out of scope.
+     * @param firstSector The first 4Kb sector of the region to manage
+     * @param sectorCount The number of 4Kb sectors to manage
+     * @param spareSectors Sectors held back from the logical capacity. More spares mean less
+     *   write amplification. Minimum is 3.
+     */
+
+    template<class TSpiFlash>
+    inline SpiFlashBlockDevice<TSpiFlash>::SpiFlashBlockDevice(TSpiFlash& flash,uint32_t firstSector,uint32_t sectorCount,uint32_t spareSectors)
+      : _flash(flash),
+        _baseAddress(firstSector*SECTOR_SIZE),
+        _sectorCount(sectorCount),
+        _spareSectors(spareSectors<MIN_SPARE_SECTORS ? static_cast<uint32_t>(MIN_SPARE_SECTORS) : spareSectors),
+        _map(nullptr),
+        _eraseCounts(nullptr),
+        _validCounts(nullptr),
+        _sectorStates(nullptr),
+        _mounted(false),
+        _collecting(false),
+        _coldData(false) {
+
+      // the geometry is checked by mount() and format()
+
+      if(_sectorCount<=_spareSectors || _sectorCount>MAX_SECTORS)
+        _logicalBlocks=0;
+      else {
+
+        _logicalBlocks=(_sectorCount-_spareSectors)*SLOTS_PER_SECTOR;
+
+        _map=new uint16_t[_logicalBlocks];
+        _eraseCounts=new uint32_t[_sectorCount];
+        _validCounts=new uint8_t[_sectorCount];
+        _sectorStates=new uint8_t[_sectorCount];
+      }
+
+      memset(&_statistics,0,sizeof(_statistics));
+    }
+
+
+    /**
+     * Destructor, free the RAM tables
+     */
+
+    template<class TSpiFlash>
+    inline SpiFlashBlockDevice<TSpiFlash>::~SpiFlashBlockDevice() {
+      delete [] _map;
+      delete [] _eraseCounts;
+      delete [] _validCounts;
+      delete [] _sectorStates;
+    }
+
+
+    /**
+     * Erase the whole region and write fresh sector headers. Existing erase counts are
+     * carried over from sectors that have a valid header so that the wear history survives.
+     * All data is lost.
+     * @return true if it worked
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::format() {
+
+      SectorHeader header;
+      uint32_t i,maxEraseCount;
+
+      if(_logicalBlocks==0)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_INVALID_GEOMETRY);
+
+      resetState();
+
+      // recover the erase counts that we can
+
+      maxEraseCount=0;
+
+      for(i=0;i<_sectorCount;i++) {
+
+        if(!readFlash(sectorAddress(i),&header,sizeof(header)))
+          return false;
+
+        if(header.magic==SECTOR_MAGIC && header.check==mix(header.magic ^ header.eraseCount)) {
+          _eraseCounts[i]=header.eraseCount;
+          if(header.eraseCount>maxEraseCount)
+            maxEraseCount=header.eraseCount;
+        }
+        else
+          _eraseCounts[i]=UINT32_MAX;
+      }
+
+      // unknown counts are assumed to be the worst we've seen
+
+      for(i=0;i<_sectorCount;i++) {
+
+        if(_eraseCounts[i]==UINT32_MAX)
+          _eraseCounts[i]=maxEraseCount;
+
+        if(!eraseSector(i))
+          return false;
+      }
+
+      _mounted=true;
+      return true;
+    }
+
+
+    /**
+     * Mount the device by scanning the metadata of every sector and rebuilding the map.
+     * This recovers cleanly from a power failure at any point during a previous session.
+     * @return true if it worked. E_NOT_FORMATTED is set if there are no formatted sectors.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::mount() {
+
+      uint32_t i,usedSlots,maxEraseCount,formattedSectors;
+      bool headerValid,blank;
+
+      if(_logicalBlocks==0)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_INVALID_GEOMETRY);
+
+      resetState();
+
+      formattedSectors=0;
+      maxEraseCount=0;
+
+      for(i=0;i<_sectorCount;i++) {
+
+        if(!scanSector(i,usedSlots,headerValid))
+          return false;
+
+        if(!headerValid) {
+
+          // torn erase or header: the erase count is unknown and the sector must be erased again
+
+          _sectorStates[i]=SECTOR_DIRTY;
+          _eraseCounts[i]=UINT32_MAX;
+          _dirtySectors++;
+          continue;
+        }
+
+        formattedSectors++;
+
+        if(_eraseCounts[i]>maxEraseCount)
+          maxEraseCount=_eraseCounts[i];
+
+        if(usedSlots==0) {
+          _sectorStates[i]=SECTOR_FREE;
+          _freeSectors++;
+        }
+        else if(usedSlots==SLOTS_PER_SECTOR || _activeSector!=NO_SECTOR)
+          _sectorStates[i]=SECTOR_FULL;
+        else {
+
+          // this was the active sector. it can carry on being filled only if the next slot
+          // wasn't part-programmed by a write that lost power before its tag was written
+
+          if(!isBlankFlash(slotAddress(i*SLOTS_PER_SECTOR+usedSlots),BLOCK_SIZE,blank))
+            return false;
+
+          if(blank) {
+            _sectorStates[i]=SECTOR_ACTIVE;
+            _activeSector=i;
+            _activeSlot=usedSlots;
+          }
+          else
+            _sectorStates[i]=SECTOR_FULL;
+        }
+      }
+
+      if(formattedSectors==0)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_NOT_FORMATTED);
+
+      // sectors with unknown erase counts are assumed to be the most worn
+
+      for(i=0;i<_sectorCount;i++)
+        if(_eraseCounts[i]==UINT32_MAX)
+          _eraseCounts[i]=maxEraseCount;
+
+      // count the live slots in each sector now that duplicates have been resolved
+
+      for(i=0;i<_logicalBlocks;i++)
+        if(_map[i]!=UNMAPPED)
+          _validCounts[_map[i]/SLOTS_PER_SECTOR]++;
+
+      _mounted=true;
+      return true;
+    }
+
+
+    /**
+     * Check if there is work that backgroundCollect() could usefully do
+     * @return true if there is
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::needsBackgroundCollect() const {
+
+      uint32_t i,minErase,maxErase;
+
+      if(!_mounted)
+        return false;
+
+      if(_dirtySectors>0)
+        return true;
+
+      if(_freeSectors<_spareSectors) {
+        i=selectVictim();
+        if(i!=NO_SECTOR && _validCounts[i]<SLOTS_PER_SECTOR)
+          return true;
+      }
+
+      if(_freeSectors<MIN_FREE_SECTORS)
+        return false;
+
+      minErase=UINT32_MAX;
+      maxErase=0;
+
+      for(i=0;i<_sectorCount;i++) {
+        if(_sectorStates[i]==SECTOR_FULL && _eraseCounts[i]<minErase)
+          minErase=_eraseCounts[i];
+        if(_eraseCounts[i]>maxErase)
+          maxErase=_eraseCounts[i];
+      }
+
+      return minErase!=UINT32_MAX && maxErase-minErase>WEAR_LEVEL_THRESHOLD;
+    }
+
+
+    /**
+     * Do one unit of background work: erase a dirty sector, reclaim the most stale sector
+     * or move the data out of the least worn sector. Call this from your idle loop while
+     * needsBackgroundCollect() returns true. Each call takes at most one sector erase and
+     * seven block moves.
+     * @return false if there was an error
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::backgroundCollect() {
+
+      uint32_t i,victim,maxErase;
+      bool retval;
+
+      if(!_mounted)
+        return true;
+
+      // erasing a sector that's already dirty is the cheapest gain
+
+      if(_dirtySectors>0)
+        return eraseDirtySector();
+
+      // top up the free sectors to the number of spares
+
+      if(_freeSectors<_spareSectors) {
+
+        victim=selectVictim();
+
+        if(victim!=NO_SECTOR && _validCounts[victim]<SLOTS_PER_SECTOR)
+          return collectSector(victim);
+      }
+
+      // static wear levelling. the least worn full sector holds data that never changes. moving
+      // it out puts that sector back into circulation. only do it when we have room to spare.
+
+      if(_freeSectors<MIN_FREE_SECTORS)
+        return true;
+
+      victim=NO_SECTOR;
+      maxErase=0;
+
+      for(i=0;i<_sectorCount;i++) {
+
+        if(_sectorStates[i]==SECTOR_FULL && (victim==NO_SECTOR || _eraseCounts[i]<_eraseCounts[victim]))
+          victim=i;
+
+        if(_eraseCounts[i]>maxErase)
+          maxErase=_eraseCounts[i];
+      }
+
+      if(victim==NO_SECTOR || maxErase-_eraseCounts[victim]<=WEAR_LEVEL_THRESHOLD)
+        return true;
+
+      _statistics.wearLevellingMoves++;
+
+      _coldData=true;
+      retval=collectSector(victim);
+      _coldData=false;
+
+      return retval;
+    }
+
+
+    /**
+     * Get the statistics counters
+     * @return A reference to the counters
+     */
+
+    template<class TSpiFlash>
+    inline const typename SpiFlashBlockDevice<TSpiFlash>::Statistics& SpiFlashBlockDevice<TSpiFlash>::getStatistics() const {
+      return _statistics;
+    }
+
+
+    /**
+     * Get the erase count of a sector
+     * @param sector The sector index, relative to the first sector in the region
+     * @return The number of times the sector has been erased
+     */
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::getEraseCount(uint32_t sector) const {
+      return _eraseCounts[sector];
+    }
+
+
+    /**
+     * Get the number of logical blocks on the device
+     * @return The number of blocks
+     */
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::getTotalBlocksOnDevice() {
+      return _logicalBlocks;
+    }
+
+
+    /**
+     * Get the block size
+     * @return always 512
+     */
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::getBlockSizeInBytes() {
+      return BLOCK_SIZE;
+    }
+
+
+    /**
+     * Read a block. Blocks that have never been written read back as 0xFF.
+     * @param dest Where to store the block
+     * @param blockIndex The logical block number
+     * @return true if it worked
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::readBlock(void *dest,uint32_t blockIndex) {
+
+      if(!_mounted || blockIndex>=_logicalBlocks)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_INVALID_BLOCK);
+
+      if(_map[blockIndex]==UNMAPPED) {
+        memset(dest,0xff,BLOCK_SIZE);
+        return true;
+      }
+
+      return readFlash(slotAddress(_map[blockIndex]),dest,BLOCK_SIZE);
+    }
+
+
+    /**
+     * Read many blocks
+     * @param dest Where to store the blocks
+     * @param blockIndex The first logical block number
+     * @param numBlocks The number of blocks
+     * @return true if it worked
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) {
+
+      uint8_t *ptr;
+
+      for(ptr=static_cast<uint8_t *>(dest);numBlocks--;ptr+=BLOCK_SIZE)
+        if(!readBlock(ptr,blockIndex++))
+          return false;
+
+      return true;
+    }
+
+
+    /**
+     * Write a block to the next free slot and remap it
+     * @param src The block data
+     * @param blockIndex The logical block number
+     * @return true if it worked
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::writeBlock(const void *src,uint32_t blockIndex) {
+
+      uint32_t slot;
+
+      if(!_mounted || blockIndex>=_logicalBlocks)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_INVALID_BLOCK);
+
+      if(!allocateSlot(slot) || !writeSlot(slot,src,blockIndex))
+        return false;
+
+      _statistics.hostBlocksWritten++;
+      return true;
+    }
+
+
+    /**
+     * Write many blocks
+     * @param src The block data
+     * @param blockIndex The first logical block number
+     * @param numBlocks The number of blocks
+     * @return true if it worked
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) {
+
+      const uint8_t *ptr;
+
+      for(ptr=static_cast<const uint8_t *>(src);numBlocks--;ptr+=BLOCK_SIZE)
+        if(!writeBlock(ptr,blockIndex++))
+          return false;
+
+      return true;
+    }
+
+
+    /**
+     * The device behaves like a big floppy
+     * @return formatNoMbr
+     */
+
+    template<class TSpiFlash>
+    inline BlockDevice::formatType SpiFlashBlockDevice<TSpiFlash>::getFormatType() {
+      return BlockDevice::formatNoMbr;
+    }
+
+
+    /*
+     * Cannot get the MBR
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::getMbr(Mbr *mbr __attribute((unused))) {
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_NO_MBR);
+    }
+
+
+    /*
+     * Integer hash used for the check words. A torn program leaves some bits that should be
+     * zero still set to one so the stored check will not match the one computed from the
+     * torn fields.
+     */
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::mix(uint32_t value) {
+
+      value^=value >> 16;
+      value*=0x85ebca6b;
+      value^=value >> 13;
+      value*=0xc2b2ae35;
+      value^=value >> 16;
+
+      return value;
+    }
+
+
+    /*
+     * Check if a buffer is all 0xFF
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::isBlank(const void *data,uint32_t size) {
+
+      const uint8_t *ptr;
+
+      for(ptr=static_cast<const uint8_t *>(data);size--;ptr++)
+        if(*ptr!=0xff)
+          return false;
+
+      return true;
+    }
+
+
+    /*
+     * Flash addresses of sectors, slot data and slot tags
+     */
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::sectorAddress(uint32_t sector) const {
+      return _baseAddress+sector*SECTOR_SIZE;
+    }
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::slotAddress(uint32_t slot) const {
+      return sectorAddress(slot/SLOTS_PER_SECTOR)+METADATA_SIZE+(slot % SLOTS_PER_SECTOR)*BLOCK_SIZE;
+    }
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::tagAddress(uint32_t slot) const {
+      return sectorAddress(slot/SLOTS_PER_SECTOR)+sizeof(SectorHeader)+(slot % SLOTS_PER_SECTOR)*sizeof(SlotTag);
+    }
+
+
+    /*
+     * Read from the flash device
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::readFlash(uint32_t address,void *data,uint32_t size) const {
+      return _flash.fastRead(address,data,size);
+    }
+
+
+    /*
+     * Check if a region of flash is erased. Reads in small chunks so that _buffer, which
+     * may be holding a block that's being moved, is not disturbed.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::isBlankFlash(uint32_t address,uint32_t size,bool& blank) const {
+
+      uint8_t chunk[32];
+
+      for(blank=true;size && blank;size-=sizeof(chunk),address+=sizeof(chunk)) {
+
+        if(!readFlash(address,chunk,sizeof(chunk)))
+          return false;
+
+        blank=isBlank(chunk,sizeof(chunk));
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Program any amount of data, split into page program operations
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::programFlash(uint32_t address,const void *data,uint32_t size) {
+
+      const uint8_t *ptr;
+      uint32_t chunk;
+
+      ptr=static_cast<const uint8_t *>(data);
+
+      while(size) {
+
+        // don't cross a page boundary
+
+        chunk=TSpiFlash::PAGE_SIZE-(address % TSpiFlash::PAGE_SIZE);
+        if(chunk>size)
+          chunk=size;
+
+        if(!_flash.writeEnable() || !_flash.pageProgram(address,ptr,chunk) || !_flash.waitForIdle())
+          return false;
+
+        address+=chunk;
+        ptr+=chunk;
+        size-=chunk;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Erase a sector and write its header with the incremented erase count. Any stale
+     * mapping into the sector must already have been removed.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::eraseSector(uint32_t sector) {
+
+      SectorHeader header;
+
+      if(!_flash.writeEnable() || !_flash.sectorErase(sectorAddress(sector)) || !_flash.waitForIdle())
+        return false;
+
+      _statistics.sectorsErased++;
+
+      header.magic=SECTOR_MAGIC;
+      header.eraseCount=_eraseCounts[sector]+1;
+      header.check=mix(header.magic ^ header.eraseCount);
+
+      if(!programFlash(sectorAddress(sector),&header,sizeof(header)))
+        return false;
+
+      if(_sectorStates[sector]==SECTOR_DIRTY)
+        _dirtySectors--;
+
+      _eraseCounts[sector]=header.eraseCount;
+      _validCounts[sector]=0;
+      _sectorStates[sector]=SECTOR_FREE;
+      _freeSectors++;
+
+      return true;
+    }
+
+
+    /*
+     * Program the data into a slot, then its tag, then update the map. The tag goes last so
+     * the slot only becomes valid once the data is complete.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::writeSlot(uint32_t slot,const void *data,uint32_t logicalBlock) {
+
+      SlotTag tag;
+      uint16_t previous;
+
+      if(!programFlash(slotAddress(slot),data,BLOCK_SIZE))
+        return false;
+
+      tag.logicalBlock=logicalBlock;
+      tag.sequence=++_sequence;
+      tag.check=mix(logicalBlock ^ mix(tag.sequence));
+
+      if(!programFlash(tagAddress(slot),&tag,sizeof(tag)))
+        return false;
+
+      // the new copy is live, the old copy (if any) is now stale
+
+      previous=_map[logicalBlock];
+
+      if(previous!=UNMAPPED)
+        _validCounts[previous/SLOTS_PER_SECTOR]--;
+
+      _map[logicalBlock]=slot;
+      _validCounts[slot/SLOTS_PER_SECTOR]++;
+      _statistics.flashBlocksWritten++;
+
+      return true;
+    }
+
+
+    /*
+     * Reset the RAM tables
+     */
+
+    template<class TSpiFlash>
+    inline void SpiFlashBlockDevice<TSpiFlash>::resetState() {
+
+      memset(_map,0xff,_logicalBlocks*sizeof(_map[0]));
+      memset(_validCounts,0,_sectorCount);
+      memset(_sectorStates,SECTOR_FULL,_sectorCount);
+
+      _activeSector=NO_SECTOR;
+      _activeSlot=0;
+      _freeSectors=0;
+      _dirtySectors=0;
+      _sequence=0;
+      _mounted=false;
+    }
+
+
+    /*
+     * Read the metadata of a sector during mount. Valid tags are added to the map. The number
+     * of used slots is the index of the first blank tag. Torn tags count as used but are not
+     * mapped so their slots will be reclaimed by the collector.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::scanSector(uint32_t sector,uint32_t& usedSlots,bool& headerValid) {
+
+      SectorMetadata metadata;
+      const SlotTag *tag;
+      uint32_t i;
+
+      if(!readFlash(sectorAddress(sector),&metadata,sizeof(metadata)))
+        return false;
+
+      headerValid=metadata.header.magic==SECTOR_MAGIC && metadata.header.check==mix(metadata.header.magic ^ metadata.header.eraseCount);
+      usedSlots=0;
+
+      if(!headerValid)
+        return true;
+
+      _eraseCounts[sector]=metadata.header.eraseCount;
+
+      for(i=0;i<SLOTS_PER_SECTOR;i++) {
+
+        tag=&metadata.tags[i];
+
+        if(isBlank(tag,sizeof(SlotTag)))
+          break;
+
+        usedSlots=i+1;
+
+        if(tag->check==mix(tag->logicalBlock ^ mix(tag->sequence)) && tag->logicalBlock<_logicalBlocks) {
+
+          if(tag->sequence>_sequence)
+            _sequence=tag->sequence;
+
+          if(!addMapping(tag->logicalBlock,sector*SLOTS_PER_SECTOR+i,tag->sequence))
+            return false;
+        }
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Map a logical block found during mount if it's newer than any copy already found
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::addMapping(uint32_t logicalBlock,uint32_t slot,uint32_t sequence) {
+
+      SlotTag existing;
+
+      if(_map[logicalBlock]!=UNMAPPED) {
+
+        if(!readFlash(tagAddress(_map[logicalBlock]),&existing,sizeof(existing)))
+          return false;
+
+        if(existing.sequence>sequence)
+          return true;
+      }
+
+      _map[logicalBlock]=slot;
+      return true;
+    }
+
+
+    /*
+     * Make the least worn free sector the active sector, or the most worn if we're moving cold
+     * data for wear levelling. The first slot is checked because an interrupted write may have
+     * left data in it before its tag was written.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::openSector() {
+
+      uint32_t i,best;
+      bool blank;
+
+      for(;;) {
+
+        best=NO_SECTOR;
+
+        for(i=0;i<_sectorCount;i++)
+          if(_sectorStates[i]==SECTOR_FREE
+              && (best==NO_SECTOR || (_coldData ? _eraseCounts[i]>_eraseCounts[best] : _eraseCounts[i]<_eraseCounts[best])))
+            best=i;
+
+        if(best==NO_SECTOR)
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_DEVICE_FULL);
+
+        _freeSectors--;
+
+        if(!isBlankFlash(slotAddress(best*SLOTS_PER_SECTOR),BLOCK_SIZE,blank))
+          return false;
+
+        if(blank) {
+          _sectorStates[best]=SECTOR_ACTIVE;
+          _activeSector=best;
+          _activeSlot=0;
+          return true;
+        }
+
+        _sectorStates[best]=SECTOR_DIRTY;
+        _dirtySectors++;
+      }
+    }
+
+
+    /*
+     * Get the next free slot, collecting garbage first if the free sectors are running low.
+     * The collector itself takes slots from here without recursing.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::allocateSlot(uint32_t& slot) {
+
+      if(_activeSector==NO_SECTOR) {
+
+        if(!_collecting && !ensureFreeSectors())
+          return false;
+
+        // the collector may have opened a sector while it was moving blocks
+
+        if(_activeSector==NO_SECTOR && !openSector())
+          return false;
+      }
+
+      slot=_activeSector*SLOTS_PER_SECTOR+_activeSlot;
+
+      if(++_activeSlot==SLOTS_PER_SECTOR) {
+        _sectorStates[_activeSector]=SECTOR_FULL;
+        _activeSector=NO_SECTOR;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Foreground collection. Erase dirty sectors and reclaim stale ones until the minimum
+     * number of free sectors is available. While free sectors are fewer than the spares there
+     * must be a full sector with at least one stale slot so this always makes progress.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::ensureFreeSectors() {
+
+      uint32_t victim;
+
+      while(_freeSectors<MIN_FREE_SECTORS) {
+
+        if(_dirtySectors>0) {
+          if(!eraseDirtySector())
+            return false;
+          continue;
+        }
+
+        victim=selectVictim();
+
+        if(victim==NO_SECTOR || _validCounts[victim]==SLOTS_PER_SECTOR)
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH_BLOCK_DEVICE,E_DEVICE_FULL);
+
+        if(!collectSector(victim))
+          return false;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Erase the first dirty sector
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::eraseDirtySector() {
+
+      uint32_t i;
+
+      for(i=0;i<_sectorCount;i++)
+        if(_sectorStates[i]==SECTOR_DIRTY)
+          return eraseSector(i);
+
+      return true;
+    }
+
+
+    /*
+     * Greedy victim selection: the full sector with the fewest live slots. Ties go to the
+     * least worn sector.
+     */
+
+    template<class TSpiFlash>
+    inline uint32_t SpiFlashBlockDevice<TSpiFlash>::selectVictim() const {
+
+      uint32_t i,best;
+
+      best=NO_SECTOR;
+
+      for(i=0;i<_sectorCount;i++) {
+
+        if(_sectorStates[i]!=SECTOR_FULL)
+          continue;
+
+        if(best==NO_SECTOR
+            || _validCounts[i]<_validCounts[best]
+            || (_validCounts[i]==_validCounts[best] && _eraseCounts[i]<_eraseCounts[best]))
+          best=i;
+      }
+
+      return best;
+    }
+
+
+    /*
+     * Move the live blocks out of a sector and then erase it. If the power fails part way
+     * through then the moved copies have higher sequence numbers and win on the next mount.
+     */
+
+    template<class TSpiFlash>
+    inline bool SpiFlashBlockDevice<TSpiFlash>::collectSector(uint32_t sector) {
+
+      SectorMetadata metadata;
+      uint32_t i,slot,newSlot;
+      bool retval;
+
+      if(!readFlash(sectorAddress(sector),&metadata,sizeof(metadata)))
+        return false;
+
+      _collecting=true;
+      retval=true;
+
+      for(i=0;i<SLOTS_PER_SECTOR && _validCounts[sector]>0;i++) {
+
+        slot=sector*SLOTS_PER_SECTOR+i;
+
+        // live only if the map still points here
+
+        if(metadata.tags[i].logicalBlock>=_logicalBlocks || _map[metadata.tags[i].logicalBlock]!=slot)
+          continue;
+
+        if(!readFlash(slotAddress(slot),_buffer,BLOCK_SIZE)
+            || !allocateSlot(newSlot)
+            || !writeSlot(newSlot,_buffer,metadata.tags[i].logicalBlock)) {
+          retval=false;
+          break;
+        }
+      }
+
+      _collecting=false;
+
+      if(!retval || !eraseSector(sector))
+        return false;
+
+      _statistics.garbageCollections++;
+      return true;
+    }
+  }
+}
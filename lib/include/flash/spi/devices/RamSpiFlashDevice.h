@@ -0,0 +1,344 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace spiflash {
+
+
+    /**
+     * A simulated SPI NOR flash device backed by a caller-supplied block of RAM. It has the
+     * same interface as the real devices so it can be used anywhere that they can, for
+     * example underneath a SpiFlashBlockDevice. NOR semantics are enforced: programming can
+     * only clear bits, erasing sets a whole 4Kb sector to 0xFF and a page program wraps
+     * around within its page. Counters are kept for the number of program and erase
+     * operations so that write amplification can be measured.
+     *
+     * A power failure can be simulated by setting the number of program/erase operations
+     * that will succeed. The one after that is half-completed and all subsequent operations
+     * fail until the counter is reset.
+     *
+     * This is not part of config/flash/spi.h. Include config/flash/spi_simulator.h in the
+     * host or test build that needs it.
+     */
+
+    class RamSpiFlashDevice : public SpiFlashDevice<RamSpiFlashDevice> {
+
+      public:
+
+        /**
+         * Error codes
+         */
+
+        enum {
+          E_WRITE_NOT_ENABLED = 2,    //!< program or erase without a preceding writeEnable()
+          E_OUT_OF_RANGE = 3,         //!< address is past the end of the device
+          E_POWER_FAILED = 4          //!< simulated power failure
+        };
+
+        /**
+         * Various constants required by the base class
+         */
+
+        enum {
+          STATUS_BUSY_BIT_MASK = 0x1,   // bitmask to get the BUSY bit from SR
+          PAGE_SIZE = 256,              // 256 byte pages
+          SECTOR_SIZE = 4096            // 4Kb erase sectors
+        };
+
+      protected:
+        uint8_t *_memory;
+        uint32_t _size;
+        bool _writeEnabled;
+        uint32_t _pagePrograms;
+        uint32_t _bytesProgrammed;
+        uint32_t _sectorErases;
+        uint32_t _operationsUntilPowerFail;
+        bool _powerFailed;
+
+      protected:
+        bool beginWriteOperation(uint32_t address);
+
+      public:
+        RamSpiFlashDevice(uint8_t *memory,uint32_t size);
+
+        bool writeEnable();
+        bool writeDisable();
+        bool readStatusRegister(uint8_t& sr) const;
+        bool pageProgram(uint32_t address,const void *data,uint32_t dataSize);
+        bool sectorErase(uint32_t address);
+        bool chipErase();
+        bool read(uint32_t address,void *data,uint32_t dataSize) const;
+        bool fastRead(uint32_t address,void *data,uint32_t dataSize) const;
+
+        uint32_t getSize() const;
+
+        uint32_t getPageProgramCount() const;
+        uint32_t getBytesProgrammed() const;
+        uint32_t getSectorEraseCount() const;
+        void resetCounters();
+
+        void setOperationsUntilPowerFail(uint32_t count);
+    };
+
+
+    /**
+     * Constructor. The memory is not initialised, call chipErase() if you want to start
+     * with an erased device.
+     * @param memory The memory that holds the flash contents. Must not go out of scope.
+     * @param size The size of the memory. Should be a multiple of SECTOR_SIZE.
+     */
+
+    inline RamSpiFlashDevice::RamSpiFlashDevice(uint8_t *memory,uint32_t size)
+      : _memory(memory),
+        _size(size),
+        _writeEnabled(false),
+        _operationsUntilPowerFail(UINT32_MAX),
+        _powerFailed(false) {
+
+      resetCounters();
+    }
+
+
+    /**
+     * Set the write enable latch
+     * @return true
+     */
+
+    inline bool RamSpiFlashDevice::writeEnable() {
+      _writeEnabled=true;
+      return true;
+    }
+
+
+    /**
+     * Clear the write enable latch
+     * @return true
+     */
+
+    inline bool RamSpiFlashDevice::writeDisable() {
+      _writeEnabled=false;
+      return true;
+    }
+
+
+    /**
+     * Read the status register. Operations complete synchronously so the device is never busy.
+     * @param sr Where to store the status register
+     * @return true
+     */
+
+    inline bool RamSpiFlashDevice::readStatusRegister(uint8_t& sr) const {
+      sr=0;
+      return true;
+    }
+
+
+    /*
+     * Common checks before a program or erase. Like the real thing the write enable latch
+     * is cleared by the operation.
+     */
+
+    inline bool RamSpiFlashDevice::beginWriteOperation(uint32_t address) {
+
+      if(!_writeEnabled)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH,E_WRITE_NOT_ENABLED);
+
+      _writeEnabled=false;
+
+      if(address>=_size)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH,E_OUT_OF_RANGE);
+
+      if(_powerFailed)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH,E_POWER_FAILED);
+
+      // count down to the failure. the operation that finds zero is the one that fails
+
+      if(_operationsUntilPowerFail==0)
+        _powerFailed=true;
+      else if(_operationsUntilPowerFail!=UINT32_MAX)
+        _operationsUntilPowerFail--;
+
+      return true;
+    }
+
+
+    /**
+     * Program up to a page of data. Bits can only be cleared and the address wraps
+     * around to the start of the page if the end of the page is reached.
+     * @param address The address to program
+     * @param data The data to program
+     * @param dataSize The number of bytes, up to PAGE_SIZE
+     * @return true if it worked
+     */
+
+    inline bool RamSpiFlashDevice::pageProgram(uint32_t address,const void *data,uint32_t dataSize) {
+
+      const uint8_t *ptr;
+      uint32_t pageStart,offset,i;
+
+      if(!beginWriteOperation(address))
+        return false;
+
+      // a power failure leaves the operation half done
+
+      if(_powerFailed)
+        dataSize/=2;
+
+      ptr=static_cast<const uint8_t *>(data);
+      pageStart=address & ~static_cast<uint32_t>(PAGE_SIZE-1);
+      offset=address-pageStart;
+
+      for(i=0;i<dataSize;i++) {
+        _memory[pageStart+offset] &= *ptr++;
+        offset=(offset+1) & (PAGE_SIZE-1);
+      }
+
+      _pagePrograms++;
+      _bytesProgrammed+=dataSize;
+
+      if(_powerFailed)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH,E_POWER_FAILED);
+
+      return true;
+    }
+
+
+    /**
+     * Erase the 4Kb sector that contains the address
+     * @param address An address within the sector
+     * @return true if it worked
+     */
+
+    inline bool RamSpiFlashDevice::sectorErase(uint32_t address) {
+
+      uint32_t sectorStart,size;
+
+      if(!beginWriteOperation(address))
+        return false;
+
+      sectorStart=address & ~static_cast<uint32_t>(SECTOR_SIZE-1);
+      size=_powerFailed ? SECTOR_SIZE/2 : SECTOR_SIZE;
+
+      memset(_memory+sectorStart,0xff,size);
+      _sectorErases++;
+
+      if(_powerFailed)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH,E_POWER_FAILED);
+
+      return true;
+    }
+
+
+    /**
+     * Erase the whole device. This is not counted as a sector erase and ignores the
+     * power failure simulation.
+     * @return true
+     */
+
+    inline bool RamSpiFlashDevice::chipErase() {
+      memset(_memory,0xff,_size);
+      _writeEnabled=false;
+      return true;
+    }
+
+
+    /**
+     * Read data from the device
+     * @param address The address to read from
+     * @param data Where to store the data
+     * @param dataSize The number of bytes to read
+     * @return true if it worked
+     */
+
+    inline bool RamSpiFlashDevice::read(uint32_t address,void *data,uint32_t dataSize) const {
+
+      if(address>_size || dataSize>_size-address)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_SPI_FLASH,E_OUT_OF_RANGE);
+
+      memcpy(data,_memory+address,dataSize);
+      return true;
+    }
+
+
+    /**
+     * Fast read is the same as read for the simulated device
+     * @param address The address to read from
+     * @param data Where to store the data
+     * @param dataSize The number of bytes to read
+     * @return true if it worked
+     */
+
+    inline bool RamSpiFlashDevice::fastRead(uint32_t address,void *data,uint32_t dataSize) const {
+      return read(address,data,dataSize);
+    }
+
+
+    /**
+     * Get the size of the device in bytes
+     * @return The size that was passed to the constructor
+     */
+
+    inline uint32_t RamSpiFlashDevice::getSize() const {
+      return _size;
+    }
+
+
+    /**
+     * Get the number of page program operations since the counters were last reset
+     * @return The page program count
+     */
+
+    inline uint32_t RamSpiFlashDevice::getPageProgramCount() const {
+      return _pagePrograms;
+    }
+
+
+    /**
+     * Get the number of bytes programmed since the counters were last reset
+     * @return The byte count
+     */
+
+    inline uint32_t RamSpiFlashDevice::getBytesProgrammed() const {
+      return _bytesProgrammed;
+    }
+
+
+    /**
+     * Get the number of sector erase operations since the counters were last reset
+     * @return The sector erase count
+     */
+
+    inline uint32_t RamSpiFlashDevice::getSectorEraseCount() const {
+      return _sectorErases;
+    }
+
+
+    /**
+     * Reset the operation counters to zero
+     */
+
+    inline void RamSpiFlashDevice::resetCounters() {
+      _pagePrograms=0;
+      _bytesProgrammed=0;
+      _sectorErases=0;
+    }
+
+
+    /**
+     * Simulate a power failure after the given number of program/erase operations. Calling
+     * this also restores power after a previous simulated failure.
+     * @param count The number of operations that will succeed. UINT32_MAX disables the simulation.
+     */
+
+    inline void RamSpiFlashDevice::setOperationsUntilPowerFail(uint32_t count) {
+      _operationsUntilPowerFail=count;
+      _powerFailed=false;
+    }
+  }
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * Output stream that hashes everything written to it. THash can be any of the hash
+   * peripheral classes, the software hashes or an Hmac. Use it as the target of a stream
+   * copy to hash a file or a network stream without holding it in memory. close()
+   * finishes the computation and the digest is then available from getDigest().
+   */
+
+  template<class THash>
+  class HashOutputStream : public OutputStream {
+
+    protected:
+      THash& _hash;
+      uint8_t _digest[THash::DIGEST_SIZE];
+
+    public:
+
+      HashOutputStream(THash& hash);
+      virtual ~HashOutputStream() {}
+
+      const uint8_t *getDigest() const;
+
+      // overrides from OutputStream
+
+      virtual bool write(uint8_t c) override;
+      virtual bool write(const void *buffer,uint32_t size) override;
+      virtual bool flush() override;
+      virtual bool close() override;
+  };
+
+
+  /**
+   * Constructor
+   * @param hash The hash class
+   */
+
+  template<class THash>
+  inline HashOutputStream<THash>::HashOutputStream(THash& hash)
+    : _hash(hash) {
+  }
+
+
+  /**
+   * Write a byte
+   * @param c The byte
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool HashOutputStream<THash>::write(uint8_t c) {
+    return _hash.update(&c,1);
+  }
+
+
+  /**
+   * Write a buffer of bytes
+   * @param buffer the buffer
+   * @param size The number of bytes
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool HashOutputStream<THash>::write(const void *buffer,uint32_t size) {
+    return _hash.update(buffer,size);
+  }
+
+
+  /**
+   * Always true.
+   * @return always true
+   */
+
+  template<class THash>
+  inline bool HashOutputStream<THash>::flush() {
+    return true;
+  }
+
+
+  /**
+   * Finish the hash computation. The digest is then available from getDigest()
+   * and the hash is reset for another message.
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool HashOutputStream<THash>::close() {
+    return _hash.finish(_digest);
+  }
+
+
+  /**
+   * Get the digest computed by the last call to close()
+   * @return A pointer to THash::DIGEST_SIZE bytes
+   */
+
+  template<class THash>
+  inline const uint8_t *HashOutputStream<THash>::getDigest() const {
+    return _digest;
+  }
+}
@@ -0,0 +1,183 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * HMAC (RFC 2104) built on top of any of the streaming hash classes. For example
+   * Hmac<SHA256HashPeripheral<>> or Hmac<SoftwareSha1>. Use it like this:
+   *
+   * 1. Construct with the key, or call setKey().
+   * 2. Call update() as many times as you like with the message data.
+   * 3. Call finish() to receive the DIGEST_SIZE byte MAC. The object is then reset and ready
+   *    for a new message with the same key.
+   *
+   * The key is kept, padded to the block size, so that the inner and outer pads can be
+   * regenerated for each message.
+   *
+   * @tparam THash The hash class. Must provide DIGEST_SIZE, BLOCK_SIZE, reset(), update() and finish().
+   */
+
+  template<class THash>
+  class Hmac {
+
+    public:
+      enum {
+        DIGEST_SIZE = THash::DIGEST_SIZE,   ///< size of the MAC in bytes
+        BLOCK_SIZE = THash::BLOCK_SIZE      ///< block size of the underlying hash
+      };
+
+    protected:
+      THash _hash;
+      uint8_t _key[BLOCK_SIZE];
+
+    protected:
+      bool updatePad(uint8_t padByte);
+
+    public:
+      Hmac();
+      Hmac(const void *key,uint32_t keySize);
+
+      bool setKey(const void *key,uint32_t keySize);
+      bool reset();
+      bool update(const void *data,uint32_t dataSize);
+      bool finish(void *mac);
+      bool hash(const void *data,uint32_t dataSize,void *mac);
+  };
+
+
+  /**
+   * Default constructor. The key is empty, call setKey() before use.
+   */
+
+  template<class THash>
+  inline Hmac<THash>::Hmac() {
+    setKey(nullptr,0);
+  }
+
+
+  /**
+   * Constructor with a key
+   * @param key The secret key
+   * @param keySize The size of the key in bytes. Keys longer than BLOCK_SIZE are hashed first.
+   */
+
+  template<class THash>
+  inline Hmac<THash>::Hmac(const void *key,uint32_t keySize) {
+    setKey(key,keySize);
+  }
+
+
+  /**
+   * Set a new key and get ready for a new message
+   * @param key The secret key
+   * @param keySize The size of the key in bytes. Keys longer than BLOCK_SIZE are hashed first.
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool Hmac<THash>::setKey(const void *key,uint32_t keySize) {
+
+    if(keySize>BLOCK_SIZE) {
+
+      _hash.reset();
+      if(!_hash.update(key,keySize) || !_hash.finish(_key))
+        return false;
+
+      keySize=DIGEST_SIZE;
+    }
+    else if(keySize)
+      memcpy(_key,key,keySize);
+
+    memset(_key+keySize,0,BLOCK_SIZE-keySize);
+
+    return reset();
+  }
+
+
+  /**
+   * Discard any message in progress and start again with the same key
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool Hmac<THash>::reset() {
+    _hash.reset();
+    return updatePad(0x36);
+  }
+
+
+  /**
+   * Add data to the MAC computation
+   * @param data The data to add
+   * @param dataSize The number of bytes in data
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool Hmac<THash>::update(const void *data,uint32_t dataSize) {
+    return _hash.update(data,dataSize);
+  }
+
+
+  /**
+   * Finish the computation and get the MAC. The object is reset afterwards.
+   * @param mac Where to write the DIGEST_SIZE byte MAC
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool Hmac<THash>::finish(void *mac) {
+
+    uint8_t inner[DIGEST_SIZE];
+
+    // H(K ^ opad || H(K ^ ipad || message))
+
+    if(!_hash.finish(inner) ||
+       !updatePad(0x5c) ||
+       !_hash.update(inner,DIGEST_SIZE) ||
+       !_hash.finish(mac))
+      return false;
+
+    return reset();
+  }
+
+
+  /**
+   * Compute the MAC of a complete message in one call. Any data previously added
+   * with update() is included.
+   * @param data The data
+   * @param dataSize The number of bytes in data
+   * @param mac Where to write the DIGEST_SIZE byte MAC
+   * @return true if it worked
+   */
+
+  template<class THash>
+  inline bool Hmac<THash>::hash(const void *data,uint32_t dataSize,void *mac) {
+    return update(data,dataSize) && finish(mac);
+  }
+
+
+  /*
+   * Feed the key XOR'd with the pad byte into the hash
+   */
+
+  template<class THash>
+  inline bool Hmac<THash>::updatePad(uint8_t padByte) {
+
+    uint8_t pad[BLOCK_SIZE];
+    uint32_t i;
+
+    for(i=0;i<BLOCK_SIZE;i++)
+      pad[i]=_key[i] ^ padByte;
+
+    return _hash.update(pad,BLOCK_SIZE);
+  }
+}
@@ -0,0 +1,283 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#if !defined(STM32PLUS_F4_HAS_CRYPTO)
+#error Incorrect MCU - this file is for the F4 devices that have hardware crypto
+#endif
+
+
+namespace stm32plus {
+
+
+  /**
+   * Streaming hash using the F4 HASH peripheral. This is the common implementation behind the
+   * SHA1 and SHA256 classes. After construction, use it like this.
+   *
+   * 1. Call update() or updateDma() as many times as you like with the message data.
+   * 2. Call finish() to receive the digest. The peripheral is then reset ready for the next message.
+   *
+   * Data is fed to the peripheral a word at a time. Any bytes that don't make a whole word are
+   * held back until the next update() or finish() so the message can be split up arbitrarily.
+   *
+   * @tparam TAlgorithm The HASH_AlgoSelection_xxx constant
+   * @tparam TDigestSize The size of the digest in bytes
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  class HardwareHash {
+
+    public:
+      enum {
+        E_TIMED_OUT = 1,          ///< The digest operation timed out
+      };
+
+      enum {
+        DIGEST_SIZE = TDigestSize,  ///< size of the digest in bytes
+        BLOCK_SIZE = 64             ///< size of a compression block in bytes
+      };
+
+    protected:
+      uint32_t _partialWord;
+      uint8_t _partialBytes;
+
+    public:
+      HardwareHash();
+      ~HardwareHash();
+
+      void reset();
+      bool update(const void *data,uint32_t dataSize);
+      bool finish(void *digest,uint32_t timeout=0);
+      bool hash(const void *data,uint32_t dataSize,void *digest,uint32_t timeout=0);
+
+      template<class TDma>
+      bool updateDma(TDma& dma,const void *data,uint32_t dataSize);
+  };
+
+
+  /**
+   * Constructor, start the peripheral clock
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  inline HardwareHash<TAlgorithm,TDigestSize>::HardwareHash() {
+
+    // clock on
+
+    ClockControl<PERIPHERAL_HASH>::On();
+
+    // reset and init
+
+    reset();
+  }
+
+
+  /**
+   * Destructor, stop the peripheral clock
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  inline HardwareHash<TAlgorithm,TDigestSize>::~HardwareHash() {
+
+    // de-init and clock off
+
+    HASH_DeInit();
+    ClockControl<PERIPHERAL_HASH>::Off();
+  }
+
+
+  /**
+   * Reset the peripheral and get it ready for a new round of hashing
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  inline void HardwareHash<TAlgorithm,TDigestSize>::reset() {
+
+    HASH_InitTypeDef hinit;
+
+    // close down the peripheral
+
+    HASH_DeInit();
+
+    // set it up
+
+    hinit.HASH_AlgoSelection=TAlgorithm;
+    hinit.HASH_AlgoMode=HASH_AlgoMode_HASH;
+    hinit.HASH_DataType=HASH_DataType_8b;
+
+    HASH_Init(&hinit);
+
+    _partialWord=0;
+    _partialBytes=0;
+  }
+
+
+  /**
+   * Add data to the hash computation. The peripheral inserts wait states if its input
+   * FIFO is full so this simply writes the words as fast as it can.
+   * @param data The data to add
+   * @param dataSize The number of bytes in data
+   * @return Always true
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  inline bool HardwareHash<TAlgorithm,TDigestSize>::update(const void *data,uint32_t dataSize) {
+
+    const uint8_t *ptr;
+    uint32_t word,i;
+
+    ptr=static_cast<const uint8_t *>(data);
+
+    // complete a word left over from last time. 8-bit data type means that the
+    // first byte in memory goes in the low byte of the word.
+
+    while(_partialBytes && dataSize) {
+
+      _partialWord|=static_cast<uint32_t>(*ptr++) << (_partialBytes*8);
+      dataSize--;
+
+      if(++_partialBytes==4) {
+        HASH->DIN=_partialWord;
+        _partialWord=0;
+        _partialBytes=0;
+      }
+    }
+
+    // whole words. the M3/M4 don't mind unaligned loads
+
+    while(dataSize>=4) {
+      memcpy(&word,ptr,sizeof(word));
+      HASH->DIN=word;
+
+      ptr+=4;
+      dataSize-=4;
+    }
+
+    // keep what's left. there can't be a partial word already if we get here with data.
+
+    if(dataSize) {
+
+      for(i=0;i<dataSize;i++)
+        _partialWord|=static_cast<uint32_t>(ptr[i]) << (i*8);
+
+      _partialBytes=dataSize;
+    }
+
+    return true;
+  }
+
+
+  /**
+   * Add data to the hash computation using DMA to feed the peripheral. The DMA channel must be
+   * a HashInDmaChannel with the HashDmaWriterFeature. This call waits for the transfer to
+   * complete. The CPU is free to service interrupts and other bus masters get a look in
+   * while it's waiting. If there are held-back bytes from a previous update() or the data is
+   * not word aligned then we fall back to update().
+   * @param dma The DMA channel
+   * @param data The data to add
+   * @param dataSize The number of bytes in data
+   * @return true if it worked, false if there was a DMA error
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  template<class TDma>
+  inline bool HardwareHash<TAlgorithm,TDigestSize>::updateDma(TDma& dma,const void *data,uint32_t dataSize) {
+
+    uint32_t count;
+
+    if(_partialBytes || (reinterpret_cast<uint32_t>(data) & 3)!=0)
+      return update(data,dataSize);
+
+    count=dataSize & ~3;
+
+    if(count) {
+
+      // don't let the end of the transfer start the digest calculation because there might be more
+
+      HASH_AutoStartDigest(DISABLE);
+
+      dma.beginWrite(data,count);
+      if(!dma.waitUntilComplete())
+        return false;
+
+      HASH_DMACmd(DISABLE);
+    }
+
+    return update(static_cast<const uint8_t *>(data)+count,dataSize-count);
+  }
+
+
+  /**
+   * Finish the computation and get the digest. The peripheral is reset afterwards.
+   * @param digest A pointer to DIGEST_SIZE bytes of memory to receive the digest
+   * @param timeout How long to wait for the computation, 0 = forever. 0 is the default.
+   * @return true if it worked, false if we timed out waiting
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  inline bool HardwareHash<TAlgorithm,TDigestSize>::finish(void *digest,uint32_t timeout) {
+
+    uint32_t start,word;
+    uint8_t i,*ptr;
+    HASH_MsgDigest md;
+
+    // tell the peripheral how much is valid in the last word
+
+    HASH_SetLastWordValidBitsNbr(_partialBytes*8);
+
+    if(_partialBytes)
+      HASH->DIN=_partialWord;
+
+    // start the digest process
+
+    HASH_StartDigest();
+
+    // wait for BUSY to go low
+
+    if(timeout)
+      start=MillisecondTimer::millis();
+
+    while(HASH_GetFlagStatus(HASH_FLAG_BUSY)!=RESET) {
+      if(timeout && MillisecondTimer::hasTimedOut(start,timeout)) {
+        reset();
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_HASH,E_TIMED_OUT);
+      }
+    }
+
+    // read the message digest. the registers hold the words of the digest and the
+    // digest is defined to be big-endian so the bytes need swapping
+
+    HASH_GetDigest(&md);
+
+    ptr=static_cast<uint8_t *>(digest);
+
+    for(i=0;i<TDigestSize/4;i++) {
+      word=__builtin_bswap32(md.Data[i]);
+      memcpy(ptr+i*4,&word,sizeof(word));
+    }
+
+    reset();
+    return true;
+  }
+
+
+  /**
+   * Hash a complete message in one call. Any data previously added with update()
+   * is included.
+   * @param data Pointer to the data to hash
+   * @param dataSize How many bytes in the 'data' pointer.
+   * @param digest A pointer to DIGEST_SIZE bytes of memory to receive the hash
+   * @param timeout How long to wait for the computation, 0 = forever. 0 is the default.
+   * @return true if it worked, false if we timed out waiting
+   */
+
+  template<uint32_t TAlgorithm,uint8_t TDigestSize>
+  inline bool HardwareHash<TAlgorithm,TDigestSize>::hash(const void *data,uint32_t dataSize,void *digest,uint32_t timeout) {
+    update(data,dataSize);
+    return finish(digest,timeout);
+  }
+}
@@ -0,0 +1,23 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#if !defined(STM32PLUS_F4_HAS_CRYPTO) || !(defined(STM32F427_437xx) || defined(STM32F429_439xx))
+#error Incorrect MCU - this file is for the F437 and F439 that have SHA256 in hardware
+#endif
+
+
+namespace stm32plus {
+
+
+  /**
+   * SHA256 implementation for the F437 and F439. See HardwareHash for usage.
+   */
+
+  class SHA256 : public HardwareHash<HASH_AlgoSelection_SHA256,32> {
+  };
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#if defined(STM32PLUS_F4) && defined(STM32PLUS_F4_HARDWARE_CRYPTO) && (defined(STM32F427_437xx) || defined(STM32F429_439xx))
+#error Incorrect MCU - this file is for devices without a hardware SHA256
+#endif
+
+
+namespace stm32plus {
+
+
+  /**
+   * SHA256 for devices that can't do it in hardware, which is all of them except the F437
+   * and F439. This has the same interface as the F4 hardware implementation so that
+   * SHA256HashPeripheral can be used in the same way on all devices. The timeout parameters
+   * are accepted for compatibility and ignored.
+   */
+
+  class SHA256 : public SoftwareSha256 {
+
+    public:
+      bool finish(void *digest,uint32_t timeout=0);
+      bool hash(const void *data,uint32_t dataSize,void *digest,uint32_t timeout=0);
+  };
+
+
+  /**
+   * Finish the computation and get the digest. The object is reset afterwards.
+   * @param digest Where to write the 32 byte digest
+   * @return Always true
+   */
+
+  inline bool SHA256::finish(void *digest,uint32_t /* timeout */) {
+    return SoftwareSha256::finish(digest);
+  }
+
+
+  /**
+   * Hash a complete message in one call. Any data previously added with update()
+   * is included.
+   * @param data Pointer to the data to hash
+   * @param dataSize How many bytes in the 'data' pointer.
+   * @param digest A pointer to at least 32 bytes of memory to receive the hash
+   * @return Always true
+   */
+
+  inline bool SHA256::hash(const void *data,uint32_t dataSize,void *digest,uint32_t /* timeout */) {
+    return SoftwareSha256::hash(data,dataSize,digest);
+  }
+}
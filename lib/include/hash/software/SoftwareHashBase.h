@@ -0,0 +1,210 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * Common base for the software implementations of the 64-byte block hashes (SHA-1, SHA-256).
+   * It takes care of breaking up a stream of data of any length into blocks for the
+   * compression function, and of the padding and length encoding at the end of the message.
+   * Full blocks are compressed directly from the caller's buffer so there's no copying in the
+   * common case of large updates. TImpl must provide a compress(const uint8_t *block) method.
+   */
+
+  template<class TImpl>
+  class SoftwareHashBase {
+
+    public:
+      enum {
+        BLOCK_SIZE = 64         ///< size of a compression block in bytes
+      };
+
+    protected:
+      uint8_t _block[BLOCK_SIZE];
+      uint32_t _blockUsed;
+      uint64_t _length;
+
+    protected:
+      SoftwareHashBase();
+
+      void resetBlock();
+      void padBlock();
+
+      static uint32_t loadBigEndian(const uint8_t *ptr);
+      static void storeBigEndian(uint8_t *ptr,uint32_t value);
+      static uint32_t rotateLeft(uint32_t value,uint8_t bits);
+      static uint32_t rotateRight(uint32_t value,uint8_t bits);
+
+    public:
+      bool update(const void *data,uint32_t dataSize);
+      uint64_t getLength() const;
+  };
+
+
+  /**
+   * Constructor
+   */
+
+  template<class TImpl>
+  inline SoftwareHashBase<TImpl>::SoftwareHashBase() {
+    resetBlock();
+  }
+
+
+  /*
+   * Forget any buffered data and the message length
+   */
+
+  template<class TImpl>
+  inline void SoftwareHashBase<TImpl>::resetBlock() {
+    _blockUsed=0;
+    _length=0;
+  }
+
+
+  /**
+   * Add data to the hash computation. This can be called as many times as you like with
+   * buffers of any size.
+   * @param data The data to add
+   * @param dataSize The number of bytes in data
+   * @return Always true
+   */
+
+  template<class TImpl>
+  inline bool SoftwareHashBase<TImpl>::update(const void *data,uint32_t dataSize) {
+
+    const uint8_t *ptr;
+    uint32_t count;
+
+    ptr=static_cast<const uint8_t *>(data);
+    _length+=dataSize;
+
+    // top up a partial block left over from the previous call
+
+    if(_blockUsed) {
+
+      count=BLOCK_SIZE-_blockUsed;
+      if(count>dataSize)
+        count=dataSize;
+
+      memcpy(_block+_blockUsed,ptr,count);
+
+      _blockUsed+=count;
+      ptr+=count;
+      dataSize-=count;
+
+      if(_blockUsed<BLOCK_SIZE)
+        return true;
+
+      static_cast<TImpl *>(this)->compress(_block);
+      _blockUsed=0;
+    }
+
+    // whole blocks go straight from the caller's buffer
+
+    while(dataSize>=BLOCK_SIZE) {
+      static_cast<TImpl *>(this)->compress(ptr);
+      ptr+=BLOCK_SIZE;
+      dataSize-=BLOCK_SIZE;
+    }
+
+    // keep the remainder for next time
+
+    if(dataSize) {
+      memcpy(_block,ptr,dataSize);
+      _blockUsed=dataSize;
+    }
+
+    return true;
+  }
+
+
+  /**
+   * Get the number of bytes that have been hashed since the last reset
+   * @return The message length so far
+   */
+
+  template<class TImpl>
+  inline uint64_t SoftwareHashBase<TImpl>::getLength() const {
+    return _length;
+  }
+
+
+  /*
+   * Append the 0x80 terminator, zero padding and the 64-bit big-endian message length
+   * in bits and compress the final block(s)
+   */
+
+  template<class TImpl>
+  inline void SoftwareHashBase<TImpl>::padBlock() {
+
+    uint64_t bits;
+
+    _block[_blockUsed++]=0x80;
+
+    // if there's no room for the length then it goes in an extra block
+
+    if(_blockUsed>BLOCK_SIZE-8) {
+      memset(_block+_blockUsed,0,BLOCK_SIZE-_blockUsed);
+      static_cast<TImpl *>(this)->compress(_block);
+      _blockUsed=0;
+    }
+
+    memset(_block+_blockUsed,0,BLOCK_SIZE-8-_blockUsed);
+
+    bits=_length << 3;
+    storeBigEndian(_block+BLOCK_SIZE-8,static_cast<uint32_t>(bits >> 32));
+    storeBigEndian(_block+BLOCK_SIZE-4,static_cast<uint32_t>(bits));
+
+    static_cast<TImpl *>(this)->compress(_block);
+  }
+
+
+  /*
+   * Load a big-endian word from a possibly unaligned address. GCC turns this into
+   * a LDR and a REV on the Cortex-M.
+   */
+
+  template<class TImpl>
+  inline uint32_t SoftwareHashBase<TImpl>::loadBigEndian(const uint8_t *ptr) {
+
+    uint32_t value;
+
+    memcpy(&value,ptr,sizeof(value));
+    return __builtin_bswap32(value);
+  }
+
+
+  /*
+   * Store a big-endian word to a possibly unaligned address
+   */
+
+  template<class TImpl>
+  inline void SoftwareHashBase<TImpl>::storeBigEndian(uint8_t *ptr,uint32_t value) {
+    value=__builtin_bswap32(value);
+    memcpy(ptr,&value,sizeof(value));
+  }
+
+
+  /*
+   * Rotations. These compile to a single ROR or fold into the operand of the next instruction.
+   */
+
+  template<class TImpl>
+  inline uint32_t SoftwareHashBase<TImpl>::rotateLeft(uint32_t value,uint8_t bits) {
+    return (value << bits) | (value >> (32-bits));
+  }
+
+
+  template<class TImpl>
+  inline uint32_t SoftwareHashBase<TImpl>::rotateRight(uint32_t value,uint8_t bits) {
+    return (value >> bits) | (value << (32-bits));
+  }
+}
@@ -0,0 +1,215 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * Streaming software implementation of SHA-1 (FIPS 180-4). Use it like this:
+   *
+   * 1. Call update() as many times as you like with the message data.
+   * 2. Call finish() to receive the 20 byte digest. The object is then reset and ready
+   *    for a new message.
+   *
+   * The 80 rounds are unrolled five at a time with the working variables rotating through the
+   * argument positions so there's no register shuffling between rounds. The message schedule is
+   * computed on the fly in a 16 word circular buffer to keep stack usage down.
+   */
+
+  class SoftwareSha1 : public SoftwareHashBase<SoftwareSha1> {
+
+    public:
+      enum {
+        DIGEST_SIZE = 20        ///< size of the digest in bytes
+      };
+
+    protected:
+      uint32_t _state[5];
+
+    protected:
+      static uint32_t schedule(uint32_t *w,uint8_t i);
+
+      static void roundChoose(uint32_t a,uint32_t& b,uint32_t c,uint32_t d,uint32_t& e,uint32_t w);
+      static void roundParity(uint32_t a,uint32_t& b,uint32_t c,uint32_t d,uint32_t& e,uint32_t w,uint32_t k);
+      static void roundMajority(uint32_t a,uint32_t& b,uint32_t c,uint32_t d,uint32_t& e,uint32_t w);
+
+      void compress(const uint8_t *block);
+
+      friend class SoftwareHashBase<SoftwareSha1>;
+
+    public:
+      SoftwareSha1();
+
+      void reset();
+      bool finish(void *digest);
+      bool hash(const void *data,uint32_t dataSize,void *digest);
+  };
+
+
+  /**
+   * Constructor
+   */
+
+  inline SoftwareSha1::SoftwareSha1() {
+    reset();
+  }
+
+
+  /**
+   * Reset ready for a new message
+   */
+
+  inline void SoftwareSha1::reset() {
+
+    resetBlock();
+
+    _state[0]=0x67452301;
+    _state[1]=0xEFCDAB89;
+    _state[2]=0x98BADCFE;
+    _state[3]=0x10325476;
+    _state[4]=0xC3D2E1F0;
+  }
+
+
+  /**
+   * Finish the computation and get the digest. The object is reset afterwards.
+   * @param digest Where to write the DIGEST_SIZE byte digest
+   * @return Always true
+   */
+
+  inline bool SoftwareSha1::finish(void *digest) {
+
+    uint8_t i,*ptr;
+
+    padBlock();
+
+    ptr=static_cast<uint8_t *>(digest);
+    for(i=0;i<5;i++)
+      storeBigEndian(ptr+i*4,_state[i]);
+
+    reset();
+    return true;
+  }
+
+
+  /**
+   * Hash a complete message in one call. Any data previously added with update()
+   * is included.
+   * @param data The data to hash
+   * @param dataSize The number of bytes in data
+   * @param digest Where to write the DIGEST_SIZE byte digest
+   * @return Always true
+   */
+
+  inline bool SoftwareSha1::hash(const void *data,uint32_t dataSize,void *digest) {
+    update(data,dataSize);
+    return finish(digest);
+  }
+
+
+  /*
+   * Get word i of the message schedule, computing it in place for i>=16
+   */
+
+  inline uint32_t SoftwareSha1::schedule(uint32_t *w,uint8_t i) {
+
+    if(i<16)
+      return w[i];
+
+    return w[i & 15]=rotateLeft(w[(i+13) & 15] ^ w[(i+8) & 15] ^ w[(i+2) & 15] ^ w[i & 15],1);
+  }
+
+
+  /*
+   * Rounds 0..19
+   */
+
+  inline void SoftwareSha1::roundChoose(uint32_t a,uint32_t& b,uint32_t c,uint32_t d,uint32_t& e,uint32_t w) {
+    e+=rotateLeft(a,5)+((b & (c ^ d)) ^ d)+0x5A827999+w;
+    b=rotateLeft(b,30);
+  }
+
+
+  /*
+   * Rounds 20..39 and 60..79
+   */
+
+  inline void SoftwareSha1::roundParity(uint32_t a,uint32_t& b,uint32_t c,uint32_t d,uint32_t& e,uint32_t w,uint32_t k) {
+    e+=rotateLeft(a,5)+(b ^ c ^ d)+k+w;
+    b=rotateLeft(b,30);
+  }
+
+
+  /*
+   * Rounds 40..59
+   */
+
+  inline void SoftwareSha1::roundMajority(uint32_t a,uint32_t& b,uint32_t c,uint32_t d,uint32_t& e,uint32_t w) {
+    e+=rotateLeft(a,5)+((b & c) | (d & (b | c)))+0x8F1BBCDC+w;
+    b=rotateLeft(b,30);
+  }
+
+
+  /*
+   * Compress one 64 byte block into the state
+   */
+
+  inline void SoftwareSha1::compress(const uint8_t *block) {
+
+    uint32_t w[16],a,b,c,d,e;
+    uint8_t i;
+
+    for(i=0;i<16;i++)
+      w[i]=loadBigEndian(block+i*4);
+
+    a=_state[0];
+    b=_state[1];
+    c=_state[2];
+    d=_state[3];
+    e=_state[4];
+
+    for(i=0;i<20;i+=5) {
+      roundChoose(a,b,c,d,e,schedule(w,i));
+      roundChoose(e,a,b,c,d,schedule(w,i+1));
+      roundChoose(d,e,a,b,c,schedule(w,i+2));
+      roundChoose(c,d,e,a,b,schedule(w,i+3));
+      roundChoose(b,c,d,e,a,schedule(w,i+4));
+    }
+
+    for(;i<40;i+=5) {
+      roundParity(a,b,c,d,e,schedule(w,i),0x6ED9EBA1);
+      roundParity(e,a,b,c,d,schedule(w,i+1),0x6ED9EBA1);
+      roundParity(d,e,a,b,c,schedule(w,i+2),0x6ED9EBA1);
+      roundParity(c,d,e,a,b,schedule(w,i+3),0x6ED9EBA1);
+      roundParity(b,c,d,e,a,schedule(w,i+4),0x6ED9EBA1);
+    }
+
+    for(;i<60;i+=5) {
+      roundMajority(a,b,c,d,e,schedule(w,i));
+      roundMajority(e,a,b,c,d,schedule(w,i+1));
+      roundMajority(d,e,a,b,c,schedule(w,i+2));
+      roundMajority(c,d,e,a,b,schedule(w,i+3));
+      roundMajority(b,c,d,e,a,schedule(w,i+4));
+    }
+
+    for(;i<80;i+=5) {
+      roundParity(a,b,c,d,e,schedule(w,i),0xCA62C1D6);
+      roundParity(e,a,b,c,d,schedule(w,i+1),0xCA62C1D6);
+      roundParity(d,e,a,b,c,schedule(w,i+2),0xCA62C1D6);
+      roundParity(c,d,e,a,b,schedule(w,i+3),0xCA62C1D6);
+      roundParity(b,c,d,e,a,schedule(w,i+4),0xCA62C1D6);
+    }
+
+    _state[0]+=a;
+    _state[1]+=b;
+    _state[2]+=c;
+    _state[3]+=d;
+    _state[4]+=e;
+  }
+}
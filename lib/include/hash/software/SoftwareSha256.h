@@ -0,0 +1,207 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * Streaming software implementation of SHA-256 (FIPS 180-4). Use it like this:
+   *
+   * 1. Call update() as many times as you like with the message data.
+   * 2. Call finish() to receive the 32 byte digest. The object is then reset and ready
+   *    for a new message.
+   *
+   * The 64 rounds are unrolled eight at a time with the working variables rotating through the
+   * argument positions so there's no register shuffling between rounds. The message schedule is
+   * computed on the fly in a 16 word circular buffer to keep stack usage down.
+   */
+
+  class SoftwareSha256 : public SoftwareHashBase<SoftwareSha256> {
+
+    public:
+      enum {
+        DIGEST_SIZE = 32        ///< size of the digest in bytes
+      };
+
+    protected:
+      uint32_t _state[8];
+
+    protected:
+      static uint32_t schedule(uint32_t *w,uint8_t i);
+
+      static void round(uint32_t a,uint32_t b,uint32_t c,uint32_t& d,
+                        uint32_t e,uint32_t f,uint32_t g,uint32_t& h,
+                        uint32_t w,uint32_t k);
+
+      void compress(const uint8_t *block);
+
+      friend class SoftwareHashBase<SoftwareSha256>;
+
+    public:
+      SoftwareSha256();
+
+      void reset();
+      bool finish(void *digest);
+      bool hash(const void *data,uint32_t dataSize,void *digest);
+  };
+
+
+  /**
+   * Constructor
+   */
+
+  inline SoftwareSha256::SoftwareSha256() {
+    reset();
+  }
+
+
+  /**
+   * Reset ready for a new message
+   */
+
+  inline void SoftwareSha256::reset() {
+
+    resetBlock();
+
+    _state[0]=0x6A09E667;
+    _state[1]=0xBB67AE85;
+    _state[2]=0x3C6EF372;
+    _state[3]=0xA54FF53A;
+    _state[4]=0x510E527F;
+    _state[5]=0x9B05688C;
+    _state[6]=0x1F83D9AB;
+    _state[7]=0x5BE0CD19;
+  }
+
+
+  /**
+   * Finish the computation and get the digest. The object is reset afterwards.
+   * @param digest Where to write the DIGEST_SIZE byte digest
+   * @return Always true
+   */
+
+  inline bool SoftwareSha256::finish(void *digest) {
+
+    uint8_t i,*ptr;
+
+    padBlock();
+
+    ptr=static_cast<uint8_t *>(digest);
+    for(i=0;i<8;i++)
+      storeBigEndian(ptr+i*4,_state[i]);
+
+    reset();
+    return true;
+  }
+
+
+  /**
+   * Hash a complete message in one call. Any data previously added with update()
+   * is included.
+   * @param data The data to hash
+   * @param dataSize The number of bytes in data
+   * @param digest Where to write the DIGEST_SIZE byte digest
+   * @return Always true
+   */
+
+  inline bool SoftwareSha256::hash(const void *data,uint32_t dataSize,void *digest) {
+    update(data,dataSize);
+    return finish(digest);
+  }
+
+
+  /*
+   * Get word i of the message schedule, computing it in place for i>=16
+   */
+
+  inline uint32_t SoftwareSha256::schedule(uint32_t *w,uint8_t i) {
+
+    uint32_t w2,w15;
+
+    if(i<16)
+      return w[i];
+
+    w2=w[(i+14) & 15];
+    w15=w[(i+1) & 15];
+
+    return w[i & 15]+=(rotateRight(w2,17) ^ rotateRight(w2,19) ^ (w2 >> 10))
+                     +w[(i+9) & 15]
+                     +(rotateRight(w15,7) ^ rotateRight(w15,18) ^ (w15 >> 3));
+  }
+
+
+  /*
+   * One round. The new 'a' is left in h and d is updated in place.
+   */
+
+  inline void SoftwareSha256::round(uint32_t a,uint32_t b,uint32_t c,uint32_t& d,
+                                    uint32_t e,uint32_t f,uint32_t g,uint32_t& h,
+                                    uint32_t w,uint32_t k) {
+
+    uint32_t t;
+
+    t=h+(rotateRight(e,6) ^ rotateRight(e,11) ^ rotateRight(e,25))+((e & (f ^ g)) ^ g)+k+w;
+    d+=t;
+    h=t+(rotateRight(a,2) ^ rotateRight(a,13) ^ rotateRight(a,22))+((a & b) | (c & (a | b)));
+  }
+
+
+  /*
+   * Compress one 64 byte block into the state
+   */
+
+  inline void SoftwareSha256::compress(const uint8_t *block) {
+
+    static const uint32_t K[64]={
+      0x428A2F98,0x71374491,0xB5C0FBCF,0xE9B5DBA5,0x3956C25B,0x59F111F1,0x923F82A4,0xAB1C5ED5,
+      0xD807AA98,0x12835B01,0x243185BE,0x550C7DC3,0x72BE5D74,0x80DEB1FE,0x9BDC06A7,0xC19BF174,
+      0xE49B69C1,0xEFBE4786,0x0FC19DC6,0x240CA1CC,0x2DE92C6F,0x4A7484AA,0x5CB0A9DC,0x76F988DA,
+      0x983E5152,0xA831C66D,0xB00327C8,0xBF597FC7,0xC6E00BF3,0xD5A79147,0x06CA6351,0x14292967,
+      0x27B70A85,0x2E1B2138,0x4D2C6DFC,0x53380D13,0x650A7354,0x766A0ABB,0x81C2C92E,0x92722C85,
+      0xA2BFE8A1,0xA81A664B,0xC24B8B70,0xC76C51A3,0xD192E819,0xD6990624,0xF40E3585,0x106AA070,
+      0x19A4C116,0x1E376C08,0x2748774C,0x34B0BCB5,0x391C0CB3,0x4ED8AA4A,0x5B9CCA4F,0x682E6FF3,
+      0x748F82EE,0x78A5636F,0x84C87814,0x8CC70208,0x90BEFFFA,0xA4506CEB,0xBEF9A3F7,0xC67178F2
+    };
+
+    uint32_t w[16],a,b,c,d,e,f,g,h;
+    uint8_t i;
+
+    for(i=0;i<16;i++)
+      w[i]=loadBigEndian(block+i*4);
+
+    a=_state[0];
+    b=_state[1];
+    c=_state[2];
+    d=_state[3];
+    e=_state[4];
+    f=_state[5];
+    g=_state[6];
+    h=_state[7];
+
+    for(i=0;i<64;i+=8) {
+      round(a,b,c,d,e,f,g,h,schedule(w,i),K[i]);
+      round(h,a,b,c,d,e,f,g,schedule(w,i+1),K[i+1]);
+      round(g,h,a,b,c,d,e,f,schedule(w,i+2),K[i+2]);
+      round(f,g,h,a,b,c,d,e,schedule(w,i+3),K[i+3]);
+      round(e,f,g,h,a,b,c,d,schedule(w,i+4),K[i+4]);
+      round(d,e,f,g,h,a,b,c,schedule(w,i+5),K[i+5]);
+      round(c,d,e,f,g,h,a,b,schedule(w,i+6),K[i+6]);
+      round(b,c,d,e,f,g,h,a,schedule(w,i+7),K[i+7]);
+    }
+
+    _state[0]+=a;
+    _state[1]+=b;
+    _state[2]+=c;
+    _state[3]+=d;
+    _state[4]+=e;
+    _state[5]+=f;
+    _state[6]+=g;
+    _state[7]+=h;
+  }
+}
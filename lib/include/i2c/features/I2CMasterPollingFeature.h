@@ -34,6 +34,8 @@ namespace stm32plus {
       bool prepareWrite(const uint8_t *address) const;
       bool writeBytes(const uint8_t *address,const uint8_t *input,uint32_t count) const;
 
+      bool isSlaveReady() const;
+
       void setSlaveAddress(uint8_t address);
   };
 
@@ -0,0 +1,367 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * Lock-free ring buffer for exactly one producer and one consumer, for example an IRQ
+   * handler writing and normal code reading, or the other way around. Unlike circular_buffer
+   * there's no need to suspend interrupts around any of the calls.
+   *
+   * The capacity is a power of two and the read and write indices run freely, wrapping at
+   * 2^32. The amount of data is always write index minus read index so there's no 'last
+   * operation' flag and no ambiguity between full and empty. Each index is written only by
+   * its owner and is published with release semantics after the data. It is read by the other
+   * side with acquire semantics.
+   *
+   * As well as the copying read() and write() methods there's a zero-copy interface. On the
+   * producer side, acquireWrite() returns the free space as up to two contiguous spans, you
+   * fill them (by DMA, a parser, whatever) and then commitWrite() the amount you wrote. On the
+   * consumer side, peekRead() returns the data as up to two spans and consumeRead() frees what
+   * you've used. There are two spans when the region wraps around the end of the buffer.
+   *
+   * T must be a type that can be copied with memcpy.
+   */
+
+  template<typename T>
+  class spsc_ring_buffer {
+
+    public:
+
+      /**
+       * A contiguous run of elements in the buffer
+       */
+
+      struct span {
+        T *data;              ///< first element
+        uint32_t size;        ///< number of elements
+      };
+
+      /**
+       * A region of the buffer. The second span is empty unless the region wraps.
+       */
+
+      struct region {
+        span first;           ///< the part up to the end of the buffer
+        span second;          ///< the part that wrapped to the start of the buffer
+
+        /**
+         * Get the total size of the region
+         * @return The number of elements in both spans
+         */
+
+        uint32_t size() const {
+          return first.size+second.size;
+        }
+      };
+
+    protected:
+      T *_buffer;
+      uint32_t _mask;
+      bool _ownsBuffer;
+
+      uint32_t _writeIndex;     // written only by the producer
+      uint32_t _readIndex;      // written only by the consumer
+
+    protected:
+      static uint32_t roundUpToPowerOfTwo(uint32_t size);
+      void getRegion(region& r,uint32_t start,uint32_t size) const;
+
+    public:
+      spsc_ring_buffer(uint32_t size);
+      spsc_ring_buffer(T *buffer,uint32_t size);
+      ~spsc_ring_buffer();
+
+      uint32_t capacity() const;
+
+      uint32_t availableToWrite() const;
+      uint32_t availableToRead() const;
+
+      // producer side
+
+      uint32_t write(const T *input,uint32_t size);
+      bool write(const T& input);
+      uint32_t acquireWrite(region& r) const;
+      void commitWrite(uint32_t size);
+
+      // consumer side
+
+      uint32_t read(T *output,uint32_t size);
+      bool read(T& output);
+      uint32_t peekRead(region& r) const;
+      void consumeRead(uint32_t size);
+  };
+
+
+  /**
+   * Constructor. Allocates the buffer on the heap.
+   * @param size The number of elements to store. Rounded up to a power of two.
+   */
+
+  template<typename T>
+  inline spsc_ring_buffer<T>::spsc_ring_buffer(uint32_t size)
+    : _ownsBuffer(true),
+      _writeIndex(0),
+      _readIndex(0) {
+
+    size=roundUpToPowerOfTwo(size);
+
+    _buffer=new T[size];
+    _mask=size-1;
+  }
+
+
+  /**
+   * Constructor. Uses memory that you supply, for example somewhere that DMA can reach.
+   * @param buffer The memory for the elements. Must not go out of scope while this object exists.
+   * @param size The number of elements in the buffer. Must be a power of two.
+   */
+
+  template<typename T>
+  inline spsc_ring_buffer<T>::spsc_ring_buffer(T *buffer,uint32_t size)
+    : _buffer(buffer),
+      _mask(size-1),
+      _ownsBuffer(false),
+      _writeIndex(0),
+      _readIndex(0) {
+  }
+
+
+  /**
+   * Destructor
+   */
+
+  template<typename T>
+  inline spsc_ring_buffer<T>::~spsc_ring_buffer() {
+    if(_ownsBuffer)
+      delete[] _buffer;
+  }
+
+
+  /**
+   * Get the number of elements that the buffer can hold
+   * @return The capacity
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::capacity() const {
+    return _mask+1;
+  }
+
+
+  /**
+   * Get the number of elements that can be written without overrunning the reader.
+   * Safe to call from either side.
+   * @return The number of free elements
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::availableToWrite() const {
+    return capacity()-availableToRead();
+  }
+
+
+  /**
+   * Get the number of elements that are waiting to be read. Safe to call from either side.
+   * @return The number of elements
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::availableToRead() const {
+    return __atomic_load_n(&_writeIndex,__ATOMIC_ACQUIRE)-__atomic_load_n(&_readIndex,__ATOMIC_ACQUIRE);
+  }
+
+
+  /**
+   * Get the free space as up to two contiguous spans that you can write into directly.
+   * Nothing is visible to the consumer until you call commitWrite(). Producer side.
+   * @param[out] r The free space
+   * @return The total free space, the same as r.size()
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::acquireWrite(region& r) const {
+
+    uint32_t size;
+
+    size=availableToWrite();
+    getRegion(r,_writeIndex,size);
+
+    return size;
+  }
+
+
+  /**
+   * Publish elements that you've written into the region returned by acquireWrite().
+   * Producer side.
+   * @param size The number of elements written. Must not be more than the region size.
+   */
+
+  template<typename T>
+  inline void spsc_ring_buffer<T>::commitWrite(uint32_t size) {
+    __atomic_store_n(&_writeIndex,_writeIndex+size,__ATOMIC_RELEASE);
+  }
+
+
+  /**
+   * Get the data waiting to be read as up to two contiguous spans. Consumer side.
+   * @param[out] r The data
+   * @return The total amount of data, the same as r.size()
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::peekRead(region& r) const {
+
+    uint32_t size;
+
+    size=availableToRead();
+    getRegion(r,_readIndex,size);
+
+    return size;
+  }
+
+
+  /**
+   * Free elements that you've finished with after a peekRead(). Consumer side.
+   * @param size The number of elements to free. Must not be more than the region size.
+   */
+
+  template<typename T>
+  inline void spsc_ring_buffer<T>::consumeRead(uint32_t size) {
+    __atomic_store_n(&_readIndex,_readIndex+size,__ATOMIC_RELEASE);
+  }
+
+
+  /**
+   * Copy elements in to the buffer. Producer side.
+   * @param input The elements to copy
+   * @param size The number of elements to copy
+   * @return The number of elements copied, which is less than size if the buffer filled up
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::write(const T *input,uint32_t size) {
+
+    region r;
+    uint32_t count;
+
+    if(size>acquireWrite(r))
+      size=r.size();
+
+    count=size<r.first.size ? size : r.first.size;
+    memcpy(r.first.data,input,count*sizeof(T));
+
+    if(size>count)
+      memcpy(r.second.data,input+count,(size-count)*sizeof(T));
+
+    commitWrite(size);
+    return size;
+  }
+
+
+  /**
+   * Write one element. Producer side.
+   * @param input The element
+   * @return false if the buffer is full
+   */
+
+  template<typename T>
+  inline bool spsc_ring_buffer<T>::write(const T& input) {
+
+    if(availableToWrite()==0)
+      return false;
+
+    _buffer[_writeIndex & _mask]=input;
+    commitWrite(1);
+    return true;
+  }
+
+
+  /**
+   * Copy elements out of the buffer. Consumer side.
+   * @param output Where to copy the elements
+   * @param size The maximum number of elements to copy
+   * @return The number of elements copied, which is less than size if the buffer ran out
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::read(T *output,uint32_t size) {
+
+    region r;
+    uint32_t count;
+
+    if(size>peekRead(r))
+      size=r.size();
+
+    count=size<r.first.size ? size : r.first.size;
+    memcpy(output,r.first.data,count*sizeof(T));
+
+    if(size>count)
+      memcpy(output+count,r.second.data,(size-count)*sizeof(T));
+
+    consumeRead(size);
+    return size;
+  }
+
+
+  /**
+   * Read one element. Consumer side.
+   * @param[out] output The element
+   * @return false if the buffer is empty
+   */
+
+  template<typename T>
+  inline bool spsc_ring_buffer<T>::read(T& output) {
+
+    if(availableToRead()==0)
+      return false;
+
+    output=_buffer[_readIndex & _mask];
+    consumeRead(1);
+    return true;
+  }
+
+
+  /*
+   * Split size elements starting at the free-running index start into the spans before
+   * and after the end of the buffer
+   */
+
+  template<typename T>
+  inline void spsc_ring_buffer<T>::getRegion(region& r,uint32_t start,uint32_t size) const {
+
+    uint32_t offset,toEnd;
+
+    offset=start & _mask;
+    toEnd=capacity()-offset;
+
+    r.first.data=_buffer+offset;
+    r.second.data=_buffer;
+
+    if(size<=toEnd) {
+      r.first.size=size;
+      r.second.size=0;
+    }
+    else {
+      r.first.size=toEnd;
+      r.second.size=size-toEnd;
+    }
+  }
+
+
+  /*
+   * Round a size up to the next power of two
+   */
+
+  template<typename T>
+  inline uint32_t spsc_ring_buffer<T>::roundUpToPowerOfTwo(uint32_t size) {
+    return size<=1 ? 1 : 1U << (32-__builtin_clz(size-1));
+  }
+}
@@ -39,6 +39,14 @@ namespace stm32plus {
      * Many of the caches and algorithms within the stack have timeouts or other
      * course-grained thresholds. This class provides the ability to subscribe to an
      * event that will call you after N seconds. The finest granularity is 1 second.
+     *
+     * The subscriptions are timers on a NetworkTimerWheel that is advanced every millisecond
+     * from the SysTick interrupt, so a subscriber costs nothing until it's due. Code that
+     * needs finer-grained, one-shot timers such as retransmissions or idle timeouts can
+     * arm its own NetworkTimer on the same wheel with armTimer(). Callbacks are IRQ code that
+     * runs inside SysTick so the millisecond timer doesn't move while they run. The blocking
+     * paths in the stack, such as waiting for an ARP reply or a free MAC descriptor, check
+     * Nvic::isAnyIrqActive() and fail rather than wait when they're called from a callback.
      */
 
     class NetworkIntervalTicker {
@@ -58,31 +66,41 @@ namespace stm32plus {
 
 
         /**
-         * Subscriber information structure.
+         * Subscriber information structure. Each subscription is its own timer on the wheel.
+         * Intervals longer than the wheel can reach are counted down in several laps.
          */
 
-        struct SubscriberInfo {
-          uint32_t nextCall;
+        struct SubscriberInfo : NetworkTimer {
           uint32_t interval;
+          uint32_t secondsLeft;
           TickIntervalSlotType delegate;
         };
 
         RtcBase *_rtc;
         RtcSecondInterruptFeature *_rtcInterruptFeature;
         std::slist<SubscriberInfo> _subscribers;
+        NetworkTimerWheel _timerWheel;
+        MillisecondTimer::TickHook _tickHook;
         bool _ready;
 
       protected:
-        void onTickF4(uint8_t extiNumber);      ///< The raw per-second ticker
-        void onTick();
+        static void onMillisecondTick(void *context);   ///< The raw per-millisecond ticker
+        void onSubscriberTimer(NetworkTimer& timer);
+        void armSubscriber(SubscriberInfo& si);
+        void armNextLap(SubscriberInfo& si);
 
       public:
+        ~NetworkIntervalTicker();
+
         bool initialise(Parameters& params);
         bool startup();
 
         void subscribeIntervalTicks(uint32_t interval,const TickIntervalSlotType& delegate);
         void updateIntervalTickSubscription(uint32_t interval,const TickIntervalSlotType& delegate);
 
+        void armTimer(NetworkTimer& timer,uint32_t delayMillis);
+        void cancelTimer(NetworkTimer& timer);
+
         const RtcBase& getRtc() const;
         RtcSecondInterruptFeature& getRtcSecondInterruptFeature() const;
     };
@@ -100,22 +118,14 @@ namespace stm32plus {
 
       _ready=false;
 
-      // remember parameters
+      // remember parameters. The RTC supplies the time in seconds that's passed to subscribers.
 
       _rtcInterruptFeature=params.base_rtc;
       _rtc=&static_cast<RtcBase&>(*_rtcInterruptFeature);
 
-      // subscribe to the interrupts. this is a bit different between the F1 and F4 because
-      // the RTC on those devices is so different.
-
-#if defined(STM32PLUS_F4)
-      _rtcInterruptFeature->ExtiInterruptEventSender.insertSubscriber(ExtiInterruptEventSourceSlot::bind(this,&NetworkIntervalTicker::onTickF4));
-#elif defined(STM32PLUS_F1_CL_E)
-      _rtcInterruptFeature->RtcSecondInterruptEventSender.insertSubscriber(RtcSecondInterruptEventSourceSlot::bind(this,&NetworkIntervalTicker::onTick));
-#else
-      #error Unsupported MCU
-#endif
+      // the wheel runs in milliseconds from the SysTick timer
 
+      _timerWheel.reset(MillisecondTimer::millis());
       return true;
     }
 
@@ -127,15 +137,29 @@ namespace stm32plus {
 
     inline bool NetworkIntervalTicker::startup() {
 
-      // start the second interrupt
+      // catch the wheel up to now and start advancing it from SysTick
+
+      _timerWheel.advance(MillisecondTimer::millis());
 
       _ready=true;
-      _rtcInterruptFeature->enableSecondInterrupt();
+
+      _tickHook.function=&NetworkIntervalTicker::onMillisecondTick;
+      _tickHook.context=this;
+      MillisecondTimer::addTickHook(_tickHook);
 
       return true;
     }
 
 
+    /**
+     * Destructor. Stop the SysTick hook from calling into a ticker that's gone.
+     */
+
+    inline NetworkIntervalTicker::~NetworkIntervalTicker() {
+      MillisecondTimer::removeTickHook(_tickHook);
+    }
+
+
     /**
      * Get the RTC base class
      * @return The RTC base
@@ -169,22 +193,19 @@ namespace stm32plus {
 
       SubscriberInfo si;
 
-      // set up the subscriber info and add to the list
+      // add to the list first so that the timer is armed at its final address
 
       si.delegate=delegate;
       si.interval=interval;
-
-      if(interval)
-        si.nextCall=interval+_rtc->getTick();
-      else
-        si.nextCall=0;
+      si.callback=NetworkTimer::CallbackType::bind(this,&NetworkIntervalTicker::onSubscriberTimer);
 
       _subscribers.push_front(si);
+      armSubscriber(_subscribers.front());
     }
 
 
     /**
-     * Update an existing subscription with a new next-tick interval.
+     * Update an existing subscription with a new next-tick interval. May be called from IRQ code.
      * @param interval The new interval, which may be zero to disable ticking.
      * @param delegate The delegate to call back (this is used as the comparator when searching for the existing subscription)
      */
@@ -198,9 +219,7 @@ namespace stm32plus {
           // found it, update values
 
           it->interval=interval;
-
-          if(interval)
-            it->nextCall=interval+_rtc->getTick();
+          armSubscriber(*it);
 
           return;
         }
@@ -209,44 +228,102 @@ namespace stm32plus {
 
 
     /**
-     * The raw per-second ticker from the RTC. This is IRQ code.
+     * Arm a one-shot timer on the network timer wheel. The timer's callback is IRQ code and
+     * may re-arm the timer. Arming a timer that's already armed moves it. May be called
+     * from IRQ code.
+     * @param timer The timer, with its callback set. Must stay in scope while it's armed.
+     * @param delayMillis Milliseconds until the callback
      */
 
-    inline void NetworkIntervalTicker::onTickF4(uint8_t /* extiNumber */) {
-      onTick();
+    inline void NetworkIntervalTicker::armTimer(NetworkTimer& timer,uint32_t delayMillis) {
+      _timerWheel.arm(timer,delayMillis);
     }
 
-    inline void NetworkIntervalTicker::onTick() {
 
-      uint32_t now;
+    /**
+     * Cancel a timer armed with armTimer(). It's fine to cancel one that isn't armed. May be
+     * called from IRQ code.
+     * @param timer The timer
+     */
 
-      // return immediately if startup() has not yet happened
+    inline void NetworkIntervalTicker::cancelTimer(NetworkTimer& timer) {
+      _timerWheel.cancel(timer);
+    }
 
-      if(!_ready)
-        return;
 
-      // get the current time
+    /*
+     * Arm or disarm the timer for a subscription according to its interval
+     */
 
-      now=_rtc->getTick();
+    inline void NetworkIntervalTicker::armSubscriber(SubscriberInfo& si) {
 
-      for(auto it=_subscribers.begin();it!=_subscribers.end();it++) {
+      IrqSuspend suspender;
 
-        // need to call?
+      si.secondsLeft=si.interval;
 
-        if(it->interval && now>=it->nextCall) {
+      if(si.interval)
+        armNextLap(si);
+      else
+        _timerWheel.cancel(si);
+    }
 
-          // call it
 
-          NetworkIntervalTickData nitd(it->interval,now);
+    /*
+     * Arm a subscription's timer for as much of the time left as the wheel can reach
+     */
 
-          it->delegate(nitd);
+    inline void NetworkIntervalTicker::armNextLap(SubscriberInfo& si) {
 
-          // this is when it'll tick next
+      uint32_t seconds;
 
-          if(it->interval)
-            it->nextCall=now+it->interval;
-        }
+      IrqSuspend suspender;
+
+      seconds=si.secondsLeft<NetworkTimerWheel::MAX_DELAY/1000 ? si.secondsLeft : NetworkTimerWheel::MAX_DELAY/1000;
+
+      si.secondsLeft-=seconds;
+      _timerWheel.arm(si,seconds*1000);
+    }
+
+
+    /**
+     * The raw per-millisecond ticker from SysTick. This is IRQ code.
+     */
+
+    inline void NetworkIntervalTicker::onMillisecondTick(void *context) {
+
+      NetworkIntervalTicker *ticker;
+
+      ticker=static_cast<NetworkIntervalTicker *>(context);
+
+      if(ticker->_ready)
+        ticker->_timerWheel.advance(MillisecondTimer::millis());
+    }
+
+
+    /*
+     * A subscription's timer has fired. Call the subscriber and go round again if it still
+     * has an interval. This is IRQ code.
+     */
+
+    inline void NetworkIntervalTicker::onSubscriberTimer(NetworkTimer& timer) {
+
+      SubscriberInfo& si(static_cast<SubscriberInfo&>(timer));
+
+      // a long interval isn't up until the last lap
+
+      if(si.secondsLeft) {
+        armNextLap(si);
+        return;
       }
+
+      NetworkIntervalTickData nitd(si.interval,_rtc->getTick());
+      si.delegate(nitd);
+
+      // the subscriber may have changed the interval, including to zero. it may also have
+      // called updateIntervalTickSubscription() which has already re-armed the timer.
+
+      if(!si.isArmed())
+        armSubscriber(si);
     }
   }
 }
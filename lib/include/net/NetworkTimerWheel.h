@@ -0,0 +1,277 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * A timer that can be armed on a NetworkTimerWheel. The timer is owned by the caller and
+     * linked into the wheel while it's armed so there's no allocation when arming or cancelling.
+     * It must not go out of scope while it's armed.
+     */
+
+    struct NetworkTimer {
+
+      typedef wink::slot<void (NetworkTimer&)> CallbackType;
+
+      NetworkTimer *next;             ///< next timer in the same wheel slot
+      NetworkTimer **pprev;           ///< the pointer that points at this timer, nullptr if not armed
+      uint32_t expiry;                ///< wheel time at which the timer fires
+      CallbackType callback;          ///< what to call when it fires
+
+      /**
+       * Constructor
+       */
+
+      NetworkTimer()
+        : pprev(nullptr) {
+      }
+
+
+      /**
+       * Check if the timer is armed
+       * @return true if it's waiting to fire
+       */
+
+      bool isArmed() const {
+        return pprev!=nullptr;
+      }
+    };
+
+
+    /**
+     * Hierarchical timer wheel. There are LEVELS wheels of SLOTS slots. A timer due within SLOTS
+     * ticks goes into the first wheel, one due within SLOTS^2 ticks into the second and so on.
+     * Each time the first wheel goes round, the next slot of the second wheel is cascaded down
+     * into the first, and so on up the levels. Arming and cancelling are O(1) and each tick
+     * costs one slot plus the occasional cascade, however many timers there are.
+     *
+     * The wheel has no clock of its own. The owner calls advance() with the current time in
+     * ticks, which makes it easy to drive from a virtual clock. Timers due later than the
+     * range of the wheel (SLOTS^LEVELS ticks) are parked in the top level and fire at the end
+     * of the range.
+     *
+     * Arming and cancelling may be done from normal code or from IRQ code. Callbacks are made
+     * from advance() with interrupts enabled and may re-arm their own timer.
+     */
+
+    class NetworkTimerWheel {
+
+      public:
+
+        /**
+         * Constants
+         */
+
+        enum {
+          SLOT_BITS = 6,                                  ///< log2 of the slots in each level
+          SLOTS = 1 << SLOT_BITS,                         ///< slots in each level
+          LEVELS = 4,                                     ///< number of levels
+          MAX_DELAY = (1 << (SLOT_BITS*LEVELS))-1         ///< furthest that a timer can be in the future
+        };
+
+      protected:
+        NetworkTimer *_slots[LEVELS][SLOTS];
+        uint32_t _now;
+
+      protected:
+        void insert(NetworkTimer& timer);
+        void cascade(uint8_t level);
+        static void unlink(NetworkTimer& timer);
+
+      public:
+        NetworkTimerWheel();
+
+        void reset(uint32_t now);
+        void advance(uint32_t now);
+
+        void arm(NetworkTimer& timer,uint32_t delay);
+        void cancel(NetworkTimer& timer);
+
+        uint32_t getNow() const;
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    inline NetworkTimerWheel::NetworkTimerWheel() {
+      reset(0);
+    }
+
+
+    /**
+     * Empty the wheel and set the current time. Armed timers are forgotten, not cancelled,
+     * so only call this before any have been armed.
+     * @param now The current time in ticks
+     */
+
+    inline void NetworkTimerWheel::reset(uint32_t now) {
+      memset(_slots,0,sizeof(_slots));
+      _now=now;
+    }
+
+
+    /**
+     * Get the time that the wheel has been advanced to
+     * @return The time in ticks
+     */
+
+    inline uint32_t NetworkTimerWheel::getNow() const {
+      return _now;
+    }
+
+
+    /**
+     * Arm a timer. If the timer is already armed then it's moved to the new time.
+     * @param timer The timer. Its callback must already be set.
+     * @param delay Ticks from now until it fires. Zero fires on the next tick.
+     */
+
+    inline void NetworkTimerWheel::arm(NetworkTimer& timer,uint32_t delay) {
+
+      IrqSuspend suspender;
+
+      if(timer.isArmed())
+        unlink(timer);
+
+      if(delay==0)
+        delay=1;
+      else if(delay>MAX_DELAY)
+        delay=MAX_DELAY;
+
+      timer.expiry=_now+delay;
+      insert(timer);
+    }
+
+
+    /**
+     * Cancel a timer. It's fine to cancel one that isn't armed.
+     * @param timer The timer
+     */
+
+    inline void NetworkTimerWheel::cancel(NetworkTimer& timer) {
+
+      IrqSuspend suspender;
+
+      if(timer.isArmed())
+        unlink(timer);
+    }
+
+
+    /**
+     * Move the wheel on to a new time, firing the timers that are due on the way. Call this
+     * regularly, for example from the SysTick interrupt.
+     * @param now The current time in ticks
+     */
+
+    inline void NetworkTimerWheel::advance(uint32_t now) {
+
+      NetworkTimer *list,*timer;
+      uint8_t index;
+
+      while(_now!=now) {
+
+        IrqSuspend::suspend();
+
+        _now++;
+        index=_now & (SLOTS-1);
+
+        // when the first level wraps, cascade the next slot of the level above, and so on
+
+        if(index==0)
+          cascade(1);
+
+        // detach the slot so that callbacks that re-arm for a whole lap don't land in it
+
+        if((list=_slots[0][index])!=nullptr)
+          list->pprev=&list;
+
+        _slots[0][index]=nullptr;
+
+        while((timer=list)!=nullptr) {
+
+          unlink(*timer);
+
+          IrqSuspend::resume();
+          timer->callback(*timer);
+          IrqSuspend::suspend();
+        }
+
+        IrqSuspend::resume();
+      }
+    }
+
+
+    /*
+     * Put an armed timer into the slot for its expiry time. Must be called with interrupts
+     * suspended.
+     */
+
+    inline void NetworkTimerWheel::insert(NetworkTimer& timer) {
+
+      uint32_t delta;
+      uint8_t level;
+      NetworkTimer **slot;
+
+      delta=timer.expiry-_now;
+
+      for(level=0;level<LEVELS-1 && delta>=(1U << (SLOT_BITS*(level+1)));level++);
+
+      slot=&_slots[level][(timer.expiry >> (SLOT_BITS*level)) & (SLOTS-1)];
+
+      if((timer.next=*slot)!=nullptr)
+        timer.next->pprev=&timer.next;
+
+      timer.pprev=slot;
+      *slot=&timer;
+    }
+
+
+    /*
+     * Move the timers from the current slot of a level down into the lower levels. If the
+     * slot index is zero then this level has gone round too and the level above is cascaded
+     * as well.
+     */
+
+    inline void NetworkTimerWheel::cascade(uint8_t level) {
+
+      uint8_t index;
+      NetworkTimer *timer,*next;
+
+      index=(_now >> (SLOT_BITS*level)) & (SLOTS-1);
+
+      timer=_slots[level][index];
+      _slots[level][index]=nullptr;
+
+      for(;timer;timer=next) {
+        next=timer->next;
+        insert(*timer);
+      }
+
+      if(index==0 && level<LEVELS-1)
+        cascade(level+1);
+    }
+
+
+    /*
+     * Take a timer out of its list
+     */
+
+    inline void NetworkTimerWheel::unlink(NetworkTimer& timer) {
+
+      if((*timer.pprev=timer.next)!=nullptr)
+        timer.next->pprev=timer.pprev;
+
+      timer.pprev=nullptr;
+    }
+  }
+}
@@ -190,7 +190,7 @@ namespace stm32plus {
       if(!dhcpClientAcquire())
         return false;
 
-      // adjust our subscription to the RTC ticker to 1 second intervals
+      // adjust our subscription to the network ticker to 1 second intervals
 
       this->updateIntervalTickSubscription(1,NetworkIntervalTicker::TickIntervalSlotType::bind(this,&DhcpClient<TTransportLayer>::onTick));
 
@@ -15,8 +15,14 @@ namespace stm32plus {
 
 
     /**
-     * Application layer feature to provide DNS client functionality
-     * for IP name resolution
+     * Application layer feature to provide DNS client functionality for IP name resolution.
+     *
+     * Queries are asynchronous. dnsHostnameQueryAsync() sends the query to all the DNS
+     * servers at once and returns. The first server to answer wins. Up to dns_maxQueries
+     * queries can be in flight together and each one is matched to its reply by the query ID.
+     * Call dnsPoll() from your main loop to collect answers, retry queries that have timed
+     * out and complete the DnsAsyncQuery handles. dnsHostnameQuery() is a synchronous wrapper
+     * that polls until its own query is complete.
      */
 
     template<class TTransportLayer>
@@ -27,12 +33,16 @@ namespace stm32plus {
 
           uint32_t dns_timeout;               ///< 10000ms is the default. don't go less than 5000 according to RFC 1123
           uint32_t dns_cacheSize;             ///< DNS cache size (default is 20)
-          uint8_t dns_retries;                ///< number of times to retry all servers (default is 5)
+          uint8_t dns_retries;                ///< number of times to query all servers (default is 5)
+          uint32_t dns_negativeCacheSeconds;  ///< seconds to remember that a name doesn't exist (default is 60, zero to disable)
+          uint8_t dns_maxQueries;             ///< number of queries that can be in flight at once (default is 4)
 
           Parameters() {
             dns_timeout=10000;
             dns_cacheSize=20;
             dns_retries=5;
+            dns_negativeCacheSeconds=60;
+            dns_maxQueries=4;
           }
         };
 
@@ -50,34 +60,60 @@ namespace stm32plus {
           E_SERVER_ERROR,                     ///< the server returned an error (cause is set)
           E_NO_ANSWERS,                       ///< the server did not return an answer
           E_NO_A_RECORD_IN_ANSWERS,           ///< server did not return an A record in the answers
-          E_OUT_OF_MEMORY                     ///< memory allocation failure
+          E_OUT_OF_MEMORY,                    ///< memory allocation failure
+          E_TOO_MANY_QUERIES                  ///< dns_maxQueries are already in flight
         };
 
       protected:
+
+        /*
+         * A query that's waiting for an answer. The reply is matched and parsed in the
+         * receive IRQ, which fills in the answer and sets the answered flag. Everything
+         * else happens in dnsPoll().
+         */
+
+        struct InFlightQuery {
+          DnsAsyncQuery *query;               // the caller's handle, nullptr if this slot is free
+          scoped_array<char> hostname;        // copy of the name being looked up
+          uint32_t sendTime;                  // millisecond time of the last send
+          uint16_t id;                        // query ID
+          uint8_t retriesLeft;                // sends left after this one
+          volatile bool answered;             // set by the receive IRQ
+          IpAddress answer;                   // the address if errorCode is zero
+          uint32_t ttl;                       // time-to-live of the answer
+          uint16_t errorCode;                 // last error from a server
+          uint32_t errorCause;                // and its cause
+
+          InFlightQuery()
+            : query(nullptr) {
+          }
+        };
+
         Parameters _params;
         uint16_t _queryId;
         uint16_t _replyPort;
         IpAddress _dnsServers[3];
         DnsCache _cache;
-
-        volatile bool _awaitingReply;
-        DnsReplyPacket volatile *_replyPacket;
+        scoped_array<InFlightQuery> _queries;
 
       protected:
         void onNotification(NetEventDescriptor& ned);
         void onReceive(UdpDatagramEvent& ned);
-        bool queryServer(const IpAddress& dnsServer,const DnsQueryPacket& packet,uint16_t querySize,IpAddress& ipAddress,uint32_t& ttl);
-        bool processQueryResponse(IpAddress& ipAddress,uint32_t& ttl);
-        void freeReplyPacket();
+        void sendQuery(InFlightQuery& ifq);
+        void freeQuery(InFlightQuery& ifq);
+        bool failQuery(DnsAsyncQuery& query,uint16_t errorCode,uint32_t errorCause=0);
+        bool processQueryResponse(DnsReplyPacket& packet,IpAddress& ipAddress,uint32_t& ttl,uint16_t& errorCode,uint32_t& errorCause);
 
       public:
         Dns();
-        ~Dns();
 
         bool initialise(const Parameters& params);
         bool startup();
 
         bool dnsHostnameQuery(const char *hostname,IpAddress& ipAddress);
+        bool dnsHostnameQueryAsync(const char *hostname,DnsAsyncQuery& query);
+        void dnsCancelQuery(DnsAsyncQuery& query);
+        void dnsPoll();
     };
 
 
@@ -90,25 +126,14 @@ namespace stm32plus {
 
       uint32_t randomNumber;
 
-      _dnsServers[0]=nullptr;
-      _replyPacket=nullptr;
-      _awaitingReply=false;
+      _dnsServers[0].invalidate();
+      _replyPort=0;
 
       this->nextRandom(randomNumber);
       _queryId=randomNumber;
     }
 
 
-    /**
-     * Destructor
-     */
-
-    template<class TTransportLayer>
-    inline Dns<TTransportLayer>::~Dns() {
-      freeReplyPacket();
-    }
-
-
     /**
      * Initialise the class
      * @param params The parameters
@@ -122,11 +147,15 @@ namespace stm32plus {
 
       _params=params;
 
-      // create the cache
+      // create the cache and the table of queries in flight
 
       if(!_cache.initialise(_params.dns_cacheSize,this->_rtc))
         return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_OUT_OF_MEMORY);
 
+      _queries.reset(new InFlightQuery[_params.dns_maxQueries]);
+      if(_queries.get()==nullptr)
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_OUT_OF_MEMORY);
+
       // subscribe to notifications and receive events
 
       this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Dns<TTransportLayer>::onNotification));
@@ -136,13 +165,13 @@ namespace stm32plus {
 
 
     /**
-     * Startup the feature
-     * @return true
+     * Startup the feature. All replies come back to one ephemeral port that's claimed here.
+     * @return true if it worked
      */
 
     template<class TTransportLayer>
     inline bool Dns<TTransportLayer>::startup() {
-      return true;
+      return this->ip_acquireEphemeralPort(_replyPort);
     }
 
 
@@ -154,7 +183,7 @@ namespace stm32plus {
     template<class TTransportLayer>
     inline void Dns<TTransportLayer>::onNotification(NetEventDescriptor& ned) {
 
-      uint8_t i;
+      uint8_t i,j;
 
       // only concerned with DNS servers
 
@@ -163,21 +192,20 @@ namespace stm32plus {
 
       IpDnsServersAnnouncementEvent& dnsevent(static_cast<IpDnsServersAnnouncementEvent&>(ned));
 
-      // copy out the valid servers from the event
+      // copy out the valid servers from the event and invalidate the others
 
-      for(i=0;i<3;i++)
-        if(dnsevent.ipDnsServers[i]!=nullptr && dnsevent.ipDnsServers[i].isValid())
-          _dnsServers[i]=*dnsevent.ipDnsServers;
+      for(i=j=0;i<3;i++)
+        if(dnsevent.ipDnsServers[i].isValid())
+          _dnsServers[j++]=dnsevent.ipDnsServers[i];
 
-      // invalidate the others
-
-      while(i!=3)
-        _dnsServers[i++].invalidate();
+      while(j!=3)
+        _dnsServers[j++].invalidate();
     }
 
 
     /**
-     * This is the basic host namet to IP address lookup functionality
+     * This is the basic host name to IP address lookup functionality. It starts an
+     * asynchronous query and polls until it's complete.
      * @param hostname The host to lookup
      * @param[out] ipAddress The IP address of the host
      * @return true if it worked
@@ -186,165 +214,326 @@ namespace stm32plus {
     template<class TTransportLayer>
     inline bool Dns<TTransportLayer>::dnsHostnameQuery(const char *hostname,IpAddress& ipAddress) {
 
-      uint16_t querySize;
-      uint32_t ttl;
-      uint8_t i,retry;
+      DnsAsyncQuery query;
+
+      if(!dnsHostnameQueryAsync(hostname,query))
+        return false;
+
+      while(!query.isComplete())
+        dnsPoll();
+
+      // the error has already been set if it failed
+
+      if(!query.hasSucceeded())
+        return false;
+
+      ipAddress=query.ipAddress;
+      return true;
+    }
+
+
+    /**
+     * Start an asynchronous host name lookup. The query is sent to all the configured
+     * servers at once. If the answer is cached, or the query can't be started, then the
+     * handle is completed before this method returns.
+     * @param hostname The host to lookup. It's copied so it doesn't need to stay in scope.
+     * @param query The handle that receives the result. Must stay in scope until it's complete.
+     * @return false if the query failed without being sent
+     */
+
+    template<class TTransportLayer>
+    inline bool Dns<TTransportLayer>::dnsHostnameQueryAsync(const char *hostname,DnsAsyncQuery& query) {
+
+      InFlightQuery *ifq;
+      uint8_t i;
+
+      query.status=DnsAsyncQuery::Status::PENDING;
+      query.errorCode=0;
+      query.errorCause=0;
 
       // special case for localhost
 
       if(!strcasecmp(hostname,"localhost")) {
-        ipAddress.setLocalhost();
+        query.ipAddress.setLocalhost();
+        query.status=DnsAsyncQuery::Status::SUCCEEDED;
         return true;
       }
 
-      // is the association cached?
+      // is the association cached? a cached name that doesn't exist fails with the error
+      // that the server gave us the first time.
+
+      if(_cache.lookup(hostname,query.ipAddress)) {
 
-      if(_cache.lookup(hostname,ipAddress))
+        if(!query.ipAddress.isValid())
+          return failQuery(query,E_SERVER_ERROR,DnsPacketHeader::NAME_ERROR);
+
+        query.status=DnsAsyncQuery::Status::SUCCEEDED;
         return true;
+      }
 
       // must have at least one server
 
-      if(_dnsServers[0]==nullptr)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_UNCONFIGURED);
+      if(!_dnsServers[0].isValid())
+        return failQuery(query,E_UNCONFIGURED);
 
-      // the size of the query is the hostname+2+header+4
+      // find a free slot
 
-      querySize=DnsPacketHeader::getPacketHeaderSize()+
-                strlen(hostname)+2+
-                4;
+      for(i=0;i<_params.dns_maxQueries && _queries[i].query!=nullptr;i++);
 
-      // allocate the query
+      if(i==_params.dns_maxQueries)
+        return failQuery(query,E_TOO_MANY_QUERIES);
 
-      scoped_array<uint8_t> packetData(new uint8_t[querySize]);
-      if(packetData.get()==nullptr)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_OUT_OF_MEMORY);
+      ifq=&_queries[i];
 
-      // create the header and data
+      // copy the name
 
-      DnsQueryPacket& packet=reinterpret_cast<DnsQueryPacket&>(*(packetData.get()));
+      ifq->hostname.reset(new char[strlen(hostname)+1]);
+      if(ifq->hostname.get()==nullptr)
+        return failQuery(query,E_OUT_OF_MEMORY);
 
-      freeReplyPacket();
-      _queryId++;
-      packet.createQuery(hostname,_queryId);
+      strcpy(ifq->hostname.get(),hostname);
 
-      // retry for the configured number of times
+      // set up the slot. the receive IRQ starts looking at it when the handle is set.
 
-      for(retry=0;retry<_params.dns_retries;retry++) {
+      {
+        IrqSuspend suspender;
 
-        // run through the list of servers
+        ifq->id=++_queryId;
+        ifq->retriesLeft=_params.dns_retries ? _params.dns_retries-1 : 0;
+        ifq->answered=false;
+        ifq->errorCode=0;
+        ifq->query=&query;
+      }
 
-        for(i=0;i<3 && _dnsServers[i].isValid();i++) {
-          if(queryServer(_dnsServers[i],packet,querySize,ipAddress,ttl)) {
-            _cache.add(hostname,ipAddress,ttl);
-            return true;
-          }
+      sendQuery(*ifq);
+      return true;
+    }
+
+
+    /**
+     * Cancel an asynchronous query. A reply that arrives later is ignored. The handle goes
+     * back to the IDLE state and can go out of scope.
+     * @param query The query to cancel
+     */
+
+    template<class TTransportLayer>
+    inline void Dns<TTransportLayer>::dnsCancelQuery(DnsAsyncQuery& query) {
+
+      uint8_t i;
+
+      for(i=0;i<_params.dns_maxQueries;i++) {
+        if(_queries[i].query==&query) {
+          freeQuery(_queries[i]);
+          break;
         }
       }
 
-      // they all failed, preserve error returned by the last one
+      query.status=DnsAsyncQuery::Status::IDLE;
+    }
+
+
+    /**
+     * Move the asynchronous queries on. Answers that have arrived are put in the cache and
+     * their handles are completed. Queries that have timed out are sent again, or failed if
+     * they have run out of retries. Call this from the main loop, not from an IRQ.
+     */
+
+    template<class TTransportLayer>
+    inline void Dns<TTransportLayer>::dnsPoll() {
+
+      uint8_t i;
+      InFlightQuery *ifq;
+      DnsAsyncQuery *query;
+
+      for(i=0;i<_params.dns_maxQueries;i++) {
+
+        ifq=&_queries[i];
 
-      return false;
+        if((query=ifq->query)==nullptr)
+          continue;
+
+        if(ifq->answered) {
+
+          // the IRQ won't touch the slot again. a name error is the only failure that's an answer.
+
+          if(ifq->errorCode==0) {
+
+            _cache.add(ifq->hostname.get(),ifq->answer,ifq->ttl);
+
+            query->ipAddress=ifq->answer;
+            query->status=DnsAsyncQuery::Status::SUCCEEDED;
+          }
+          else {
+
+            if(_params.dns_negativeCacheSeconds)
+              _cache.addNegative(ifq->hostname.get(),_params.dns_negativeCacheSeconds);
+
+            failQuery(*query,ifq->errorCode,ifq->errorCause);
+          }
+
+          freeQuery(*ifq);
+        }
+        else if(MillisecondTimer::hasTimedOut(ifq->sendTime,_params.dns_timeout)) {
+
+          if(ifq->retriesLeft) {
+            ifq->retriesLeft--;
+            sendQuery(*ifq);
+          }
+          else {
+
+            // preserve the error returned by the last server to fail, if there was one
+
+            if(ifq->errorCode)
+              failQuery(*query,ifq->errorCode,ifq->errorCause);
+            else
+              failQuery(*query,E_TIMED_OUT);
+
+            freeQuery(*ifq);
+          }
+        }
+      }
     }
 
 
     /**
-     * Query the server and wait for a response
-     * @param packet The packet to send
-     * @param querySize The size of the packet
-     * @param[out] ipAddress The returned IP address mapping
-     * @param[out] ttl The time-to-live of the entry in seconds
-     * @return true if it worked
+     * Send a query to all the servers. A failure to send to a server is treated like a
+     * lost packet and the query will be sent again when it times out.
+     * @param ifq The query
      */
 
     template<class TTransportLayer>
-    inline bool Dns<TTransportLayer>::queryServer(const IpAddress& dnsServer,
-                                                   const DnsQueryPacket& packet,
-                                                   uint16_t querySize,
-                                                   IpAddress& ipAddress,
-                                                   uint32_t& ttl) {
+    inline void Dns<TTransportLayer>::sendQuery(InFlightQuery& ifq) {
 
-      uint32_t now;
-      bool retval;
+      uint16_t querySize;
+      uint8_t i;
 
-      // claim an ephemeral port for the reply
+      ifq.sendTime=MillisecondTimer::millis();
 
-      if(!this->ip_acquireEphemeralPort(_replyPort))
-        return false;
+      // the size of the query is the hostname+2+header+4
 
-      // send the packet asynchronously over UDP to the DHCP server
+      querySize=DnsPacketHeader::getPacketHeaderSize()+
+                strlen(ifq.hostname.get())+2+
+                4;
 
-      _awaitingReply=true;
+      // allocate the query
 
-      if(!this->udpSend(dnsServer,                                  // server to send to
-                        _replyPort,                                 // source port
-                        IpPorts::PORT_DNS_REQUEST,                  // destination port,
-                        reinterpret_cast<const uint8_t *>(&packet), // data
-                        querySize,                                  // data size
-                        true,                                       // asynchronous flag
-                        0)) {                                       // n/a for async
-        this->ip_releaseEphemeralPort(_replyPort);
-        return false;         // should not happen, async always returns true
+      scoped_array<uint8_t> packetData(new uint8_t[querySize]);
+      if(packetData.get()==nullptr) {
+        this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_OUT_OF_MEMORY);
+        return;
       }
 
-      // await a response
+      // create the header and data
 
-      now=MillisecondTimer::millis();
-      while(_awaitingReply) {
-        if(MillisecondTimer::hasTimedOut(now,_params.dns_timeout)) {
-          this->ip_releaseEphemeralPort(_replyPort);
-          return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_TIMED_OUT);
-        }
+      DnsQueryPacket& packet=reinterpret_cast<DnsQueryPacket&>(*(packetData.get()));
+      packet.createQuery(ifq.hostname.get(),ifq.id);
+
+      // send it asynchronously over UDP to every server. the data is copied so the packet
+      // can go out of scope.
+
+      for(i=0;i<3 && _dnsServers[i].isValid();i++) {
+        this->udpSend(_dnsServers[i],                             // server to send to
+                      _replyPort,                                 // source port
+                      IpPorts::PORT_DNS_REQUEST,                  // destination port,
+                      packetData.get(),                           // data
+                      querySize,                                  // data size
+                      true,                                       // asynchronous flag
+                      0);                                         // n/a for async
       }
+    }
+
 
-      retval=processQueryResponse(ipAddress,ttl);
+    /**
+     * Free a query slot
+     * @param ifq The slot
+     */
 
-      freeReplyPacket();
-      this->ip_releaseEphemeralPort(_replyPort);
-      return retval;
+    template<class TTransportLayer>
+    inline void Dns<TTransportLayer>::freeQuery(InFlightQuery& ifq) {
+
+      {
+        IrqSuspend suspender;
+        ifq.query=nullptr;
+      }
+
+      ifq.hostname.reset();
+    }
+
+
+    /**
+     * Complete a query with an error and set the error
+     * @param query The query
+     * @param errorCode The error code
+     * @param errorCause The error cause
+     * @return false
+     */
+
+    template<class TTransportLayer>
+    inline bool Dns<TTransportLayer>::failQuery(DnsAsyncQuery& query,uint16_t errorCode,uint32_t errorCause) {
+
+      query.errorCode=errorCode;
+      query.errorCause=errorCause;
+      query.status=DnsAsyncQuery::Status::FAILED;
+
+      return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,errorCode,errorCause);
     }
 
 
     /**
-     * Process the response from the server
+     * Process the response from the server. This runs in the IRQ so failures are returned
+     * to the caller rather than raised on the error provider. dnsPoll() raises them later.
+     * @param packet The response
      * @param[out] ipAddress The response IP address
      * @param[out] ttl The time-to-live of the entry in seconds
+     * @param[out] errorCode The error code if it failed
+     * @param[out] errorCause The error cause if it failed
      * @return true if it worked
      */
 
     template<class TTransportLayer>
-    inline bool Dns<TTransportLayer>::processQueryResponse(IpAddress& ipAddress,uint32_t& ttl) {
+    inline bool Dns<TTransportLayer>::processQueryResponse(DnsReplyPacket& packet,IpAddress& ipAddress,uint32_t& ttl,uint16_t& errorCode,uint32_t& errorCause) {
 
-      uint16_t flags=NetUtil::ntohs(_replyPacket->dns_flags);
+      uint16_t flags=NetUtil::ntohs(packet.dns_flags);
       uint8_t *answers,*record;
 
+      errorCause=0;
+
       // the flags must not have an error (unknown host is picked up here as cause=3)
 
-      if((flags & 0xf)!=0)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_SERVER_ERROR,flags & 0xf);
+      if((flags & 0xf)!=0) {
+        errorCode=E_SERVER_ERROR;
+        errorCause=flags & 0xf;
+        return false;
+      }
 
       // the flags must not indicate truncation
 
-      if((flags & DnsPacketHeader::TRUNCATED)!=0)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_TRUNCATED_REPLY);
+      if((flags & DnsPacketHeader::TRUNCATED)!=0) {
+        errorCode=E_TRUNCATED_REPLY;
+        return false;
+      }
 
       // there must be at least one answer
 
-      if(NetUtil::ntohs(_replyPacket->dns_numberOfAnswerRrs)==0)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_NO_ANSWERS);
+      if(NetUtil::ntohs(packet.dns_numberOfAnswerRrs)==0) {
+        errorCode=E_NO_ANSWERS;
+        return false;
+      }
 
       // find the answers
 
-      DnsReplyPacket *packet(const_cast<DnsReplyPacket *>(_replyPacket));
-      answers=packet->findAnswers();
+      answers=packet.findAnswers();
 
       // find the first A record
 
-      if((record=packet->findRecord(answers,DnsPacketHeader::RecordType::A))==nullptr)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_NO_A_RECORD_IN_ANSWERS);
+      if((record=packet.findRecord(answers,DnsPacketHeader::RecordType::A))==nullptr) {
+        errorCode=E_NO_A_RECORD_IN_ANSWERS;
+        return false;
+      }
 
       // step over the name (should possibly verify that it's the answer to our question here)
 
-      record=packet->stepOverName(record);
+      record=packet.stepOverName(record);
 
       // pull out the IP address and ttl from the record
 
@@ -356,63 +545,61 @@ namespace stm32plus {
 
 
     /**
-     * Receive event notification from the stack
+     * Receive event notification from the stack. This is IRQ code. A reply is parsed here
+     * and the answer is left in the query slot for dnsPoll() to collect.
      * @param upe The UDP packet event descriptor
      */
 
     template<class TTransportLayer>
     inline void Dns<TTransportLayer>::onReceive(UdpDatagramEvent& upe) {
 
+      uint16_t id;
+      uint8_t i;
+      InFlightQuery *ifq;
+
       // must be for our reply port
 
-      if(NetUtil::ntohs(upe.udpDatagram.udp_destinationPort)!=_replyPort)
+      if(_replyPort==0 || NetUtil::ntohs(upe.udpDatagram.udp_destinationPort)!=_replyPort)
         return;
 
       // it's considered handled now
 
       upe.handled=true;
 
-      // handle UDP packets when we're waiting
-
-      if(!_awaitingReply || _replyPacket!=nullptr)
-        return;
-
       // must be a valid packet on the DNS port
 
       if(NetUtil::ntohs(upe.udpDatagram.udp_sourcePort)!=IpPorts::PORT_DNS_REQUEST ||
          NetUtil::ntohs(upe.udpDatagram.udp_length)<DnsPacketHeader::getPacketHeaderSize())
         return;
 
-      DnsQueryPacket *reply(reinterpret_cast<DnsQueryPacket *>(upe.udpDatagram.udp_data));
+      DnsReplyPacket *reply(reinterpret_cast<DnsReplyPacket *>(upe.udpDatagram.udp_data));
 
-      // must be our DNS packet. there is no fixed magic number to indicate that this packet is
-      // a DNS response. we only have our ID to go on
+      // there is no fixed magic number to indicate that this packet is a DNS response.
+      // we only have the ID to go on. the first answer to a query wins.
 
-      if(NetUtil::ntohs(reply->dns_identification)!=_queryId)
-        return;
+      id=NetUtil::ntohs(reply->dns_identification);
 
-      // it's for us
+      for(i=0;i<_params.dns_maxQueries;i++) {
 
-      _replyPacket=(DnsReplyPacket *)malloc(upe.udpDatagram.udp_length);
-      memcpy(const_cast<DnsReplyPacket *>(_replyPacket),upe.udpDatagram.udp_data,upe.udpDatagram.udp_length);
+        ifq=&_queries[i];
 
-      // wake up the caller
+        if(ifq->query!=nullptr && !ifq->answered && ifq->id==id) {
 
-      _awaitingReply=false;
-    }
+          if(processQueryResponse(*reply,ifq->answer,ifq->ttl,ifq->errorCode,ifq->errorCause)) {
+            ifq->errorCode=0;
+            ifq->answered=true;
+          }
+          else {
 
+            // a name error is authoritative. other errors might not be shared by the
+            // other servers so we keep waiting for them.
 
-    /**
-     * Free the reply packet
-     */
-
-    template<class TTransportLayer>
-    inline void Dns<TTransportLayer>::freeReplyPacket() {
+            if(ifq->errorCode==E_SERVER_ERROR && ifq->errorCause==DnsPacketHeader::NAME_ERROR)
+              ifq->answered=true;
+          }
 
-      if(_replyPacket) {
-        free((void *)_replyPacket);
-        _replyPacket=nullptr;
-        _awaitingReply=false;
+          return;
+        }
       }
     }
   }
@@ -0,0 +1,67 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * Handle for an asynchronous DNS query started with Dns::dnsHostnameQueryAsync(). The
+     * handle belongs to the caller and must stay in scope until the query is complete or
+     * has been cancelled with Dns::dnsCancelQuery(). Call Dns::dnsPoll() from the main loop
+     * to move the query on and check isComplete() to find out when it's finished.
+     */
+
+    struct DnsAsyncQuery {
+
+      /**
+       * Possible states of the query
+       */
+
+      enum class Status : uint8_t {
+        IDLE,             ///< not started
+        PENDING,          ///< waiting for a server to answer
+        SUCCEEDED,        ///< ipAddress holds the answer
+        FAILED            ///< errorCode and errorCause say why
+      };
+
+      Status status;              ///< the state of the query
+      IpAddress ipAddress;        ///< the answer when the status is SUCCEEDED
+      uint16_t errorCode;         ///< a Dns E_xxx error code when the status is FAILED
+      uint32_t errorCause;        ///< the cause that goes with the error code
+
+      DnsAsyncQuery()
+        : status(Status::IDLE),
+          errorCode(0),
+          errorCause(0) {
+      }
+
+
+      /**
+       * Check if the query has finished, one way or the other
+       * @return true if it has succeeded or failed
+       */
+
+      bool isComplete() const {
+        return status==Status::SUCCEEDED || status==Status::FAILED;
+      }
+
+
+      /**
+       * Check if the query succeeded
+       * @return true if ipAddress holds the answer
+       */
+
+      bool hasSucceeded() const {
+        return status==Status::SUCCEEDED;
+      }
+    };
+  }
+}
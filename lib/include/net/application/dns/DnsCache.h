@@ -13,11 +13,16 @@ namespace stm32plus {
 
 
     /**
-     * Simple DNS cache of hostname to IP address with TTL. A full pass through the cache is
-     * required for add and lookup so this is not intended for high volumes, not that you'd
-     * have the SRAM for that anyway. A pessimistic average domain name length of 25 characters
-     * with 20 entries would use around (26*20)+(12*20) = 760 bytes of SRAM in the cache.
-     * Whatever, parsing 20 entries per lookup is massively cheaper than a network DNS lookup.
+     * DNS cache of hostname to IP address with TTL. Lookups go through an open-addressed
+     * hash index of the case-folded hostname so the cost of a lookup doesn't depend on the
+     * size of the cache. The index has at least twice as many slots as there are entries.
+     *
+     * Names that the server said do not exist are cached as negative entries with an
+     * invalid address so that repeated lookups of a bad name don't go to the network.
+     *
+     * Expired entries are removed lazily when they're looked up. When the cache is full the
+     * least recently used entry is evicted. A pessimistic average domain name length of 25
+     * characters with 20 entries would use around (26*20)+(20*20)+(2*64) = 1048 bytes of SRAM.
      */
 
     class DnsCache {
@@ -25,27 +30,43 @@ namespace stm32plus {
       protected:
 
         /**
-         * Constant to indicate the cache entry is free
+         * Constant to indicate no entry
          */
 
         enum {
-          NO_ENTRY = 0xffffffff       //!< The cache entry is free
+          NO_ENTRY = 0xffff           //!< End of a list or an empty index slot
         };
 
         struct Entry {
           scoped_array<char> _hostname;
           uint32_t expiryTicks;
-          IpAddress address;
+          uint32_t hash;              //!< hash of the case-folded hostname
+          IpAddress address;          //!< invalid for a negative entry
+          uint16_t next;              //!< next in the LRU list or the free list
+          uint16_t previous;          //!< previous in the LRU list
         };
 
         scoped_array<Entry> _entries;
+        scoped_array<uint16_t> _index;
         uint32_t _maxEntries;
+        uint32_t _indexMask;
+        uint16_t _first;              //!< most recently used
+        uint16_t _last;               //!< least recently used
+        uint16_t _free;               //!< first unused entry
         RtcBase *_rtc;
 
+      protected:
+        static uint32_t hashHostname(const char *hostname);
+        uint32_t findPosition(const char *hostname,uint32_t hash) const;
+        void remove(uint16_t index);
+        void unlink(uint16_t index);
+        void insertFront(uint16_t index);
+
       public:
         bool initialise(uint32_t cacheSize,RtcBase *rtc);
 
         void add(const char *hostname,const IpAddress& address,uint32_t expiry);
+        void addNegative(const char *hostname,uint32_t expiry);
         bool lookup(const char *hostname,IpAddress& address);
     };
   }
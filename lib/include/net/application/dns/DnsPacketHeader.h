@@ -32,6 +32,20 @@ namespace stm32plus {
       };
 
 
+      /**
+       * Response codes in the bottom 4 bits of the flags
+       */
+
+      enum ResponseCode {
+        NO_ERROR              = 0,
+        FORMAT_ERROR          = 1,
+        SERVER_FAILURE        = 2,
+        NAME_ERROR            = 3,      //!< the name does not exist (NXDOMAIN)
+        NOT_IMPLEMENTED       = 4,
+        REFUSED               = 5
+      };
+
+
       /**
        * Common types
        */
@@ -363,7 +363,8 @@ namespace stm32plus {
 
 
     /**
-     * Add a new constant string to the output
+     * Add a new constant string to the output. Responses can be added from handleCallback() so
+     * tell the connection array that there's something to write.
      * @param str constant string to add excluding "\r\n"
      */
 
@@ -380,6 +381,8 @@ namespace stm32plus {
             newstr,true),
             true
           );
+
+      signalReady(TcpWaitState::WRITE);
     }
 
 
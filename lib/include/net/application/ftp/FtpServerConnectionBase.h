@@ -20,14 +20,18 @@ namespace stm32plus {
       public:
 
         /**
-         * Parameters for this class
+         * Parameters for this class. Each data connection takes ftp_dataConnectionSendBufferSize
+         * bytes of heap for its send buffer, its receive buffer (see
+         * FtpServerDataConnection::Parameters) and ftp_uploadBufferSize more while uploading.
+         * That's 12Kb for an upload on the F4 with the defaults.
          */
 
         struct Parameters : TcpConnection::Parameters {
 
           uint16_t ftp_maxRequestLineLength;            ///< size includes the verb, and all parameters. Default is 200
           uint16_t ftp_outputStreamBufferMaxSize;       ///< buffer size of the stream-of-streams class. Default is 256
-          uint16_t ftp_dataConnectionSendBufferSize;    ///< data connection send buffer size. Default is 2920 (2*MTU for ethernet)
+          uint16_t ftp_dataConnectionSendBufferSize;    ///< data connection send buffer size. Keep it a multiple of the sector size (512) so that file reads are whole sectors. Default is 4096
+          uint16_t ftp_uploadBufferSize;                ///< uploads are written to the file in blocks of this size, rounded down to a multiple of the sector size (512). Default is 4096
 
           /**
            * Constructor
@@ -36,7 +40,8 @@ namespace stm32plus {
           Parameters() {
             ftp_maxRequestLineLength=200;
             ftp_outputStreamBufferMaxSize=256;
-            ftp_dataConnectionSendBufferSize=2918;
+            ftp_dataConnectionSendBufferSize=4096;
+            ftp_uploadBufferSize=4096;
           }
         };
 
@@ -57,6 +62,7 @@ namespace stm32plus {
         std::string _user;
         uint32_t _sendStartPosition;
         uint32_t _lastActiveTime;
+        FtpServerStatistics _statistics;
 
       public:
         FtpServerConnectionBase(const Parameters& params);
@@ -64,6 +70,8 @@ namespace stm32plus {
 
         void clearDataConnection();       ///< this is a callback for the data connection server to clear itself
         uint16_t getDataConnectionSendBufferSize() const;
+        uint16_t getUploadBufferSize() const;
+        const FtpServerStatistics& getStatistics() const;
         void updateLastActiveTime();
     };
 
@@ -115,13 +123,40 @@ namespace stm32plus {
 
 
     /**
-     * Free the data connection
+     * Free the data connection. The transfer it was doing is added to the statistics first and
+     * counted as a failure if it didn't finish. A data connection that was never given a
+     * transfer, such as one replaced by another PASV, isn't counted.
      */
 
     inline void FtpServerConnectionBase::freeDataConnection() {
 
-      if(_dataConnection)
+      if(_dataConnection) {
+
+        if(_dataConnection->getDirection()!=FtpServerDataConnection::Direction::NOT_STARTED) {
+
+          if(!_dataConnection->finished())
+            _statistics.failedTransfers++;
+
+          if(_dataConnection->getDirection()==FtpServerDataConnection::Direction::UPLOAD) {
+
+            _statistics.uploadedBytes+=_dataConnection->getBytesTransferred();
+            _statistics.uploadMillis+=_dataConnection->getTransferMillis();
+
+            if(_dataConnection->finished())
+              _statistics.uploads++;
+          }
+          else {
+
+            _statistics.downloadedBytes+=_dataConnection->getBytesTransferred();
+            _statistics.downloadMillis+=_dataConnection->getTransferMillis();
+
+            if(_dataConnection->finished())
+              _statistics.downloads++;
+          }
+        }
+
         delete _dataConnection;   // this will cause a callback to clear the pointer
+      }
     }
 
 
@@ -143,6 +178,25 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get the upload buffer size
+     */
+
+    inline uint16_t FtpServerConnectionBase::getUploadBufferSize() const {
+      return _params.ftp_uploadBufferSize;
+    }
+
+
+    /**
+     * Get the transfer statistics for this session
+     * @return A reference to the statistics
+     */
+
+    inline const FtpServerStatistics& FtpServerConnectionBase::getStatistics() const {
+      return _statistics;
+    }
+
+
     /**
      * Update the last active time
      */
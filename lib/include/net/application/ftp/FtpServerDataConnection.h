@@ -37,12 +37,15 @@ namespace stm32plus {
          */
 
         enum {
-          UPLOAD_TRANSFER_BUFFER_SIZE = 512   // amount read from receive buffer and written to output stream (512b matches SD Card sector size)
+          SECTOR_SIZE = 512             // uploads are written to the stream in whole multiples of this (the SD card sector size)
         };
 
 
         /**
-         * Data connection parameters
+         * Data connection parameters. On the F4 the receive buffer is 4Kb so that an upload can
+         * keep a few full sized segments in flight. That's 4Kb of heap for every data connection
+         * so the F1 connectivity line, with a quarter of the RAM, stays at 1Kb. Set
+         * tcp_receiveBufferSize to opt in to the larger buffer there.
          */
 
         struct Parameters : TcpConnection::Parameters {
@@ -52,7 +55,11 @@ namespace stm32plus {
            */
 
           Parameters() {
-            tcp_receiveBufferSize=1024;       // for uploads, increase the receive buffer to 1Kb
+#if defined(STM32PLUS_F4)
+            tcp_receiveBufferSize=4096;
+#else
+            tcp_receiveBufferSize=1024;
+#endif
           }
         };
 
@@ -61,12 +68,22 @@ namespace stm32plus {
         TcpOutputStreamOfStreams _outputStreams;
         Direction _direction;
         scoped_ptr<OutputStream> _uploadStream;
+        scoped_array<uint8_t> _uploadBuffer;    // upload data is staged here until there's a whole buffer to write
+        uint32_t _uploadBufferSize;
+        uint32_t _uploadBufferUsed;
+        uint32_t _bytesTransferred;
+        uint32_t _startTime;
+        uint32_t _lastActiveTime;
 
         enum class State : uint8_t {
           NOT_STARTED,
           RUNNING
         } _state;
 
+      protected:
+        bool writeUploadBuffer();
+        void countTransferred(uint32_t count);
+
       public:
         FtpServerDataConnection(const Parameters& params,FtpServerConnectionBase *serverbase);
         ~FtpServerDataConnection();
@@ -82,16 +99,20 @@ namespace stm32plus {
         void setUploadStream(OutputStream *stream);
         void setDirection(Direction dir);
         Direction getDirection() const;
+
+        uint32_t getBytesTransferred() const;
+        uint32_t getTransferMillis() const;
     };
 
 
     /**
-     * Set the direction
+     * Set the direction. This is the start of the transfer as far as the statistics go.
      * @param dir
      */
 
     inline void FtpServerDataConnection::setDirection(Direction dir) {
       _direction=dir;
+      _startTime=_lastActiveTime=MillisecondTimer::millis();
     }
 
 
@@ -106,12 +127,32 @@ namespace stm32plus {
 
 
     /**
-     * Set a new upload stream
-     * @param stream The upload stream
+     * Get the number of bytes moved over this data connection
+     * @return The byte count
+     */
+
+    inline uint32_t FtpServerDataConnection::getBytesTransferred() const {
+      return _bytesTransferred;
+    }
+
+
+    /**
+     * Get the time from setting the direction to the last byte moved
+     * @return The time in milliseconds
+     */
+
+    inline uint32_t FtpServerDataConnection::getTransferMillis() const {
+      return _lastActiveTime-_startTime;
+    }
+
+
+    /*
+     * Add to the byte count and note the time
      */
 
-    inline void FtpServerDataConnection::setUploadStream(OutputStream *stream) {
-      _uploadStream.reset(stream);
+    inline void FtpServerDataConnection::countTransferred(uint32_t count) {
+      _bytesTransferred+=count;
+      _lastActiveTime=MillisecondTimer::millis();
     }
   }
 }
@@ -0,0 +1,62 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * Transfer statistics for one FTP session. The command connection adds to these each
+     * time a data connection is released. A transfer is timed from the command that started
+     * it to the last byte moved over the data connection. Directory listings are counted as
+     * downloads.
+     */
+
+    struct FtpServerStatistics {
+
+      uint32_t uploadedBytes;         ///< bytes received over data connections
+      uint32_t uploadMillis;          ///< time spent receiving them
+      uint32_t downloadedBytes;       ///< bytes sent over data connections
+      uint32_t downloadMillis;        ///< time spent sending them
+      uint16_t uploads;               ///< uploads that completed
+      uint16_t downloads;             ///< downloads and listings that completed
+      uint16_t failedTransfers;       ///< transfers that were aborted or failed
+
+      FtpServerStatistics()
+        : uploadedBytes(0),
+          uploadMillis(0),
+          downloadedBytes(0),
+          downloadMillis(0),
+          uploads(0),
+          downloads(0),
+          failedTransfers(0) {
+      }
+
+
+      /**
+       * Get the average upload rate
+       * @return bytes per second, or zero if nothing has been timed
+       */
+
+      uint32_t getUploadRate() const {
+        return uploadMillis ? static_cast<uint64_t>(uploadedBytes)*1000/uploadMillis : 0;
+      }
+
+
+      /**
+       * Get the average download rate
+       * @return bytes per second, or zero if nothing has been timed
+       */
+
+      uint32_t getDownloadRate() const {
+        return downloadMillis ? static_cast<uint64_t>(downloadedBytes)*1000/downloadMillis : 0;
+      }
+    };
+  }
+}
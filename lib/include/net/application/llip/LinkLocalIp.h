@@ -123,7 +123,7 @@ namespace stm32plus {
 
       this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&LinkLocalIp<TTransportLayer>::onNotification));
 
-      // set up our RTC ticker, initially disabled
+      // set up our network ticker, initially disabled
 
       this->subscribeIntervalTicks(0,NetworkIntervalTicker::TickIntervalSlotType::bind(this,&LinkLocalIp<TTransportLayer>::onTick));
       return true;
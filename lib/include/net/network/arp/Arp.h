@@ -17,6 +17,13 @@ namespace stm32plus {
      * Network layer feature that implements the Address Resolution Protocol (ARP)
      * ARP is used as to convert one address form into another. In our implementation
      * we will support converting MAC addresses into IP addresses.
+     *
+     * Lookups do not block when the IP layer supplies the packet that it wants to send. A
+     * packet for a neighbour that isn't in the cache is parked in a bounded queue and an ARP
+     * request is broadcast. The queue is flushed when the reply comes in. Requests are repeated
+     * every arp_replyTimeout (rounded up to whole seconds) and the packets are dropped after
+     * arp_retries attempts. Cache entries that are in use are refreshed with a unicast request
+     * arp_refreshSeconds before they expire.
      */
 
     template<class TDatalinkLayer>
@@ -34,7 +41,8 @@ namespace stm32plus {
           E_UNCONFIGURED,               ///< Our MAC/IP are not configured
           E_REQUEST_NOT_PERMITTED,      ///< not permitted to do a request due to IRQ context
           E_IP_ADDRESS_CLASH,           ///< Another station on the net has our IP address
-          E_TIMED_OUT                   ///< timed out waiting for a response
+          E_TIMED_OUT,                  ///< timed out waiting for a response
+          E_QUEUE_FULL                  ///< no room to queue a packet until the reply arrives
         };
 
         /**
@@ -48,13 +56,19 @@ namespace stm32plus {
           uint32_t arp_cacheExpirySeconds;  ///< The max seconds to keep an ARP cache entry, default is 600
           uint32_t arp_replyTimeout;        ///< how long in ms to wait for an ARP reply, default is 5000
           uint8_t arp_retries;              ///< number of times to retry, default is 5
+          uint8_t arp_queueSize;            ///< packets that can wait for ARP replies, default is 8
+          uint8_t arp_queuePerDestination;  ///< packets that can wait for one neighbour, default is 4
+          uint32_t arp_refreshSeconds;      ///< refresh a cache entry this long before it expires, default is 60. Zero to disable.
 
           Parameters() {
             arp_startupBroadcast=true;
-            arp_cacheSize=10;               ///< 10 bytes/entry, 10 entries = 100 bytes.
+            arp_cacheSize=10;               ///< about 20 bytes/entry with the index, 10 entries = 200 bytes.
             arp_replyTimeout=5000;          ///< 5 seconds for an ARP timeout
             arp_cacheExpirySeconds=600;     ///< 10 minute default cache lifetime
             arp_retries=5;                  ///< 5 times to retry
+            arp_queueSize=8;                ///< 16 bytes/entry, 8 entries = 128 bytes.
+            arp_queuePerDestination=4;      ///< one dead host can only take half the queue
+            arp_refreshSeconds=60;          ///< 1 minute before expiry
           }
         };
 
@@ -67,6 +81,7 @@ namespace stm32plus {
         IpSubnetMask _mySubnetMask;
         MacAddress _myMacAddress;
         ArpCache _arpCache;
+        ArpPendingQueue _pendingQueue;
 
       protected:
         void handleIpAddressAnnouncement(IpAddressAnnouncementEvent& event);
@@ -76,9 +91,12 @@ namespace stm32plus {
         void handleNewAddressMapping(IpAddressMappingEvent& event);
         bool handleAddressMappingRequest(ArpMappingRequestEvent& event);
         bool handleIncomingFrame(const DatalinkFrame& frame);
+        bool queuePacket(NetBuffer *nb,IpAddress& ip);
+        void sendQueuedPackets(const MacAddress& mac,const IpAddress& ip);
 
         void onReceive(NetEventDescriptor& ned);
         void onNotification(NetEventDescriptor& ned);
+        void onTick(NetworkIntervalTickData& nitd);
 
       public:
         bool initialise(const Parameters&);
@@ -86,6 +104,7 @@ namespace stm32plus {
 
         void arpBroadcastMyAddress();
         void arpSendRequest(IpAddress& ipaddress);
+        void arpSendRequest(IpAddress& ipaddress,const MacAddress& destination);
         void arpSendProbe(IpAddress& ipaddress);
     };
 
@@ -103,15 +122,26 @@ namespace stm32plus {
 
       _params=params;
 
-      // initialise the cache
+      // initialise the cache and the queue of packets waiting for replies. the queue
+      // retries on the second ticker so the reply timeout is rounded up to whole seconds
 
-      _arpCache.initialise(params.arp_cacheSize,params.arp_cacheExpirySeconds,this->_rtc);
+      _arpCache.initialise(params.arp_cacheSize,params.arp_cacheExpirySeconds,params.arp_refreshSeconds,this->_rtc);
+
+      _pendingQueue.initialise(params.arp_queueSize,
+                               params.arp_queuePerDestination,
+                               params.arp_retries,
+                               std::max<uint32_t>(1,(params.arp_replyTimeout+999)/1000),
+                               this->_rtc);
 
       // subscribe to receive notification and receive events
 
       this->NetworkReceiveEventSender.insertSubscriber(NetworkReceiveEventSourceSlot::bind(this,&Arp<TDatalinkLayer>::onReceive));
       this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Arp<TDatalinkLayer>::onNotification));
 
+      // subscribe to the second ticker for retrying queued lookups
+
+      this->subscribeIntervalTicks(1,NetworkIntervalTicker::TickIntervalSlotType::bind(this,&Arp<TDatalinkLayer>::onTick));
+
       return true;
     }
 
@@ -230,8 +260,10 @@ namespace stm32plus {
 
         if(afd->arp_senderProtocolAddress==_myIpAddress)
           return this->setError(ErrorProvider::ERROR_PROVIDER_NET_ARP,E_IP_ADDRESS_CLASH);
-        else
+        else {
           _arpCache.insert(afd->arp_senderHardwareAddress,afd->arp_senderProtocolAddress);
+          sendQueuedPackets(afd->arp_senderHardwareAddress,afd->arp_senderProtocolAddress);
+        }
       }
 
       // send an event to anyone that's interested
@@ -310,7 +342,8 @@ namespace stm32plus {
     /**
      * Handle an ARP mapping request. If the requested IP address is covered by the subnet mask
      * then that's the MAC address we'll be looking for, otherwise we'll be trying to find the
-     * MAC address of the default gateway.
+     * MAC address of the default gateway. If the address is not cached and the event carries
+     * a packet then the packet is queued and we return without waiting for the reply.
      * @param event The event that describes the request
      */
 
@@ -319,6 +352,7 @@ namespace stm32plus {
 
       IpAddress ip;
       uint8_t retry;
+      bool refreshNeeded;
 
       // can handle requests for 255.255.255.255 with no configuration information
 
@@ -359,10 +393,21 @@ namespace stm32plus {
       else
         ip=_defaultGatewayAddress;      // a remote IP address
 
-      // first check the cache and return if found or we cannot do a lookup
+      // first check the cache and return if found. if the entry is about to expire then ask
+      // the neighbour directly so that the reply renews it before it goes.
+
+      if((event.found=_arpCache.findMacAddress(ip,event.macAddress,refreshNeeded))) {
+
+        if(refreshNeeded)
+          arpSendRequest(ip,event.macAddress);
 
-      if((event.found=_arpCache.findMacAddress(ip,event.macAddress)))
         return true;
+      }
+
+      // if there's a packet then it can wait in the queue for the reply
+
+      if(event.networkBuffer)
+        return (event.queued=queuePacket(event.networkBuffer,ip));
 
       // if we're in an IRQ then we can't continue because we'd need to do a tx/rx
 
@@ -388,12 +433,90 @@ namespace stm32plus {
 
 
     /**
-     * Send an ARP request.
+     * Queue a packet until the reply to an ARP request arrives. The request is sent if this
+     * is the first packet waiting for this neighbour.
+     * @param nb The packet. Ownership passes to the queue if this method succeeds.
+     * @param ip The neighbour to look up
+     * @return false if the queue is full
+     */
+
+    template<class TDatalinkLayer>
+    inline bool Arp<TDatalinkLayer>::queuePacket(NetBuffer *nb,IpAddress& ip) {
+
+      bool requestNeeded;
+
+      if(!_pendingQueue.park(nb,ip,requestNeeded))
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_ARP,E_QUEUE_FULL);
+
+      if(requestNeeded)
+        arpSendRequest(ip);
+
+      return true;
+    }
+
+
+    /**
+     * Transmit the packets that were waiting for a neighbour's MAC address. This is IRQ code
+     * when the reply has just been received.
+     * @param mac The neighbour's MAC address
+     * @param ip The neighbour's IP address
+     */
+
+    template<class TDatalinkLayer>
+    inline void Arp<TDatalinkLayer>::sendQueuedPackets(const MacAddress& mac,const IpAddress& ip) {
+
+      NetBuffer *nb;
+
+      // the packets are complete IP packets that were not fragmented
+
+      while((nb=_pendingQueue.release(ip))!=nullptr)
+        this->NetworkSendEventSender.raiseEvent(
+              EthernetTransmitRequestEvent(nb,mac,EtherType::IP,DatalinkChecksum::IP_HEADER_AND_PROTOCOL));
+    }
+
+
+    /**
+     * Second ticker. Drop queued packets that have run out of retries and repeat the
+     * request for neighbours that have not replied yet. This is IRQ code.
+     * @param nitd The tick data
+     */
+
+    template<class TDatalinkLayer>
+    inline void Arp<TDatalinkLayer>::onTick(NetworkIntervalTickData& nitd) {
+
+      NetBuffer *nb;
+      IpAddress ip;
+
+      while((nb=_pendingQueue.releaseExpired(nitd.timeNow))!=nullptr) {
+        delete nb;
+        this->setError(ErrorProvider::ERROR_PROVIDER_NET_ARP,E_TIMED_OUT);
+      }
+
+      while(_pendingQueue.getRetry(nitd.timeNow,ip))
+        arpSendRequest(ip);
+    }
+
+
+    /**
+     * Send an ARP request to everyone.
      * @param ipaddress the IP address to include in the query
      */
 
     template<class TDatalinkLayer>
     inline void Arp<TDatalinkLayer>::arpSendRequest(IpAddress& ipaddress) {
+      arpSendRequest(ipaddress,MacAddress::createBroadcastAddress());
+    }
+
+
+    /**
+     * Send an ARP request to a particular station. A request sent directly to the station that
+     * we think owns the address is used to refresh a cache entry without bothering everyone else.
+     * @param ipaddress the IP address to include in the query
+     * @param destination the MAC address to send the request to
+     */
+
+    template<class TDatalinkLayer>
+    inline void Arp<TDatalinkLayer>::arpSendRequest(IpAddress& ipaddress,const MacAddress& destination) {
 
       NetBuffer *nb;
       ArpFrameData *afd;
@@ -416,7 +539,7 @@ namespace stm32plus {
       // raise a transmit event for the datalink layer to pick up
 
       this->NetworkSendEventSender.raiseEvent(
-            EthernetTransmitRequestEvent(nb,MacAddress::createBroadcastAddress(),EtherType::ARP,DatalinkChecksum::IP_HEADER_AND_PROTOCOL));
+            EthernetTransmitRequestEvent(nb,destination,EtherType::ARP,DatalinkChecksum::IP_HEADER_AND_PROTOCOL));
     }
 
 
@@ -466,10 +589,14 @@ namespace stm32plus {
         // insert the association 'as reported' if the host is on this subnet
         // otherwise the association is between the default gateway and this IP address
 
-        if(_mySubnetMask.matches(event.ipAddress,_defaultGatewayAddress))
+        if(_mySubnetMask.matches(event.ipAddress,_defaultGatewayAddress)) {
           _arpCache.insert(event.macAddress,event.ipAddress);
-        else
+          sendQueuedPackets(event.macAddress,event.ipAddress);
+        }
+        else {
           _arpCache.insert(event.macAddress,_defaultGatewayAddress);
+          sendQueuedPackets(event.macAddress,_defaultGatewayAddress);
+        }
       }
     }
 
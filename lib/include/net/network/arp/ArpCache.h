@@ -11,12 +11,21 @@ namespace stm32plus {
   namespace net {
 
     /**
-     * Simple LRU cache for an ARP mapping of IP address to MAC address. Implemented as
-     * a compact doubly linked list with a fixed maximum number of entries. The list
+     * LRU cache for an ARP mapping of IP address to MAC address. The entries are held in a
+     * fixed array and threaded onto a compact doubly linked list in order of use. The list
      * entry overhead is just 2 bytes and no dynamic memory allocation is required after
-     * initialisation. Searching is a linear operation from the MRU to the LRU so the
-     * number of entries should be kept low. The maximum number of entries is 255.
-     * Index #255 is reserved.
+     * initialisation. The maximum number of entries is 255. Index #255 is reserved.
+     *
+     * Lookups go through an open-addressed hash index of IP address to array index. The
+     * index has at least twice as many slots as there are entries and uses linear probing
+     * so a lookup costs the same however big the cache is. Entries are removed from the
+     * index by shifting back the entries that follow them so there are no tombstones.
+     * Expired entries are removed lazily when they are looked up. When the cache is full
+     * the least recently inserted entry is evicted.
+     *
+     * If a refresh time is set then findMacAddress() tells the caller once when an entry is
+     * that close to expiry so that it can send an ARP request while the entry is still
+     * valid. The reply renews the entry and traffic never has to wait for a lookup.
      */
 
     class ArpCache {
@@ -28,25 +37,31 @@ namespace stm32plus {
          */
 
         enum {
-          NO_ENTRY = 0xff                 ///< used as a next/prev marker to say 'none'
+          NO_ENTRY = 0xff                 ///< used as a next/prev/index marker to say 'none'
         };
 
         struct CacheEntry {
-          uint8_t next;                   ///< next index in the list (or NO_ENTRY)
+          uint8_t next;                   ///< next index in the list or free list (or NO_ENTRY)
           uint8_t previous;               ///< previous index in the list (or NO_ENTRY)
           MacAddress macAddress;          ///< mac address held here
           IpAddress ipAddress;            ///< ip address held here
           uint32_t expiryTime;            ///< RTC time after which this entry is invalid
+          bool refreshed;                 ///< true if the caller has been told to refresh this entry
         } __attribute__((packed));
 
         uint8_t _first;                   ///< first index in the list (or NO_ENTRY if empty)
         uint8_t _last;                    ///< last index in the list (or NO_ENTRY if empty)
-        uint8_t _insertionPoint;          ///< next free array slot for new entries (or _maxEntries-1 if full)
+        uint8_t _free;                    ///< first removed entry available for re-use (or NO_ENTRY)
+        uint8_t _insertionPoint;          ///< next never-used array slot for new entries (or _maxEntries if full)
         uint8_t _maxEntries;              ///< total entries allowed
+        uint16_t _indexMask;              ///< number of index slots minus one
+        uint8_t _indexShift;              ///< 32 minus log2 of the number of index slots
         uint32_t _expirySeconds;          ///< seconds to keep in a cache
+        uint32_t _refreshSeconds;         ///< seconds before expiry that an entry should be refreshed
         RtcBase *_rtc;                    ///< Pointer to the RTC
 
         scoped_array<CacheEntry> _array;  ///< the array of CacheEntry structures
+        scoped_array<uint8_t> _index;     ///< hash index of IP address to array index (or NO_ENTRY)
 
         volatile bool _watchFlag;         ///< set to true when _watchIp is inserted
         IpAddress _watchIp;             ///< an IP to watch for
@@ -54,15 +69,18 @@ namespace stm32plus {
 
       protected:
         void internalInsert(const MacAddress& mac,const IpAddress& ip);
+        void remove(uint8_t index);
         void unlink(uint8_t index);
         void insertFront(uint8_t index);
         bool hasExpired(uint8_t index) const;
+        uint16_t hash(const IpAddress& ip) const;
+        uint16_t findPosition(const IpAddress& ip) const;
 
       public:
-        bool initialise(uint8_t numEntries,uint32_t expirySeconds,RtcBase *rtc);
+        bool initialise(uint8_t numEntries,uint32_t expirySeconds,uint32_t refreshSeconds,RtcBase *rtc);
 
         void insert(const MacAddress& mac,const IpAddress& ip);
-        bool findMacAddress(const IpAddress& ip,MacAddress& found);
+        bool findMacAddress(const IpAddress& ip,MacAddress& found,bool& refreshNeeded);
 
         void setWatchIp(const IpAddress& ip,MacAddress *foundMac);
         bool waitForWatch(uint32_t timeout);
@@ -76,24 +94,42 @@ namespace stm32plus {
      * @param numEntries The maximum number of entries
      * @param expirySeconds Max time to keep an entry in the cache. An entry will still be
      *   evicted if it's the LRU and a new entry comes in to a full cache.
+     * @param refreshSeconds How long before expiry findMacAddress() asks for an entry to be
+     *   refreshed. Zero disables refreshing.
      * @param rtc A pointer to the RTC used to get the current time
      * @return true if it works
      */
 
-    inline bool ArpCache::initialise(uint8_t numEntries,uint32_t expirySeconds,RtcBase *rtc) {
+    inline bool ArpCache::initialise(uint8_t numEntries,uint32_t expirySeconds,uint32_t refreshSeconds,RtcBase *rtc) {
+
+      uint16_t indexSize;
+      uint8_t indexShift;
+
+      // the index is the next power of 2 that's at least double the number of entries
+
+      for(indexSize=2,indexShift=31;indexSize<numEntries*2;indexSize<<=1,indexShift--);
 
       _array.reset(new CacheEntry[numEntries]);
+      _index.reset(new uint8_t[indexSize]);
+
+      if(_array.get()==nullptr || _index.get()==nullptr)
+        return false;
+
+      memset(_index.get(),NO_ENTRY,indexSize);
 
       // initialise internal variables
 
-      _first=_last=NO_ENTRY;
+      _first=_last=_free=NO_ENTRY;
       _insertionPoint=0;
       _maxEntries=numEntries;
+      _indexMask=indexSize-1;
+      _indexShift=indexShift;
       _expirySeconds=expirySeconds;
+      _refreshSeconds=refreshSeconds;
       _rtc=rtc;
       _watchFlag=false;
 
-      return _array.get()!=nullptr;
+      return true;
     }
 
 
@@ -113,8 +149,7 @@ namespace stm32plus {
 
     inline void ArpCache::internalInsert(const MacAddress& mac,const IpAddress& ip) {
 
-      uint8_t i,found,unused;
-      uint32_t timeNow;
+      uint8_t i;
       CacheEntry *ptr;
 
       // can we release a watcher when this IRQ finishes?
@@ -124,90 +159,39 @@ namespace stm32plus {
         _watchFlag=false;
       }
 
-      // don't care for the link order here, just walk the array. If a matching
-      // cache entry is found then get out right away. We also need to take care
-      // of a change of association so we also try to find matches by IP and MAC
-      // but not both
+      // if the IP address is already cached then the mapping has been confirmed or the
+      // address has moved to another MAC. either way the entry is updated and renewed.
 
-      ptr=_array.get();
-      found=unused=NO_ENTRY;
-      timeNow=_rtc->getTick();
+      if((i=_index[findPosition(ip)])==NO_ENTRY) {
 
-      for(i=0;i<_insertionPoint;i++) {
+        // a new entry is needed. re-use a removed one, then a never-used one and
+        // finally evict the LRU entry at the end of the list
 
-        if(ptr->next==NO_ENTRY && ptr->previous==NO_ENTRY && i!=_first)
-          unused=i;
+        if(_free==NO_ENTRY && _insertionPoint!=_maxEntries)
+          i=_insertionPoint++;
         else {
 
-          // if expired then remove it
-
-          if(timeNow>ptr->expiryTime) {
-            unlink(i);
-            unused=i;
-          }
-          else if(ptr->ipAddress==ip) {
-
-            if(ptr->macAddress==mac)
-              found=i;        // found an exact match that hasn't expired
-            else {
+          if(_free==NO_ENTRY)
+            remove(_last);
 
-              // IP address is cached but has been assigned to another MAC
-              // this cache entry must be expunged
-
-              unlink(i);
-              unused=i;
-            }
-          }
-          else if(ptr->macAddress==mac) {
-
-            // MAC address is in the cache but has a different IP address
-            // the cache entry is not valid any more
-
-            unlink(i);
-            unused=i;
-          }
+          i=_free;
+          _free=_array[i].next;
         }
-        ptr++;
-      }
-
-      // so what happened? if an unexpired match was found then it needs to come to the front
-
-      if(found!=NO_ENTRY) {
-
-        // take the entry out of the list and put it back at the front
-
-        unlink(found);
-        insertFront(found);
-
-        return;
-      }
-
-      // a new entry needs to be created. can we place it in a previously
-      // used position?
-
-      if(unused!=NO_ENTRY)
-        i=unused;
-      else if(_insertionPoint!=_maxEntries) {
 
-        // there is space to put it on the end
+        // the eviction may have moved things in the index so look again for the empty slot
 
-        i=_insertionPoint;
-        _insertionPoint++;
-      }
-      else {
-
-        // there is no space, evict the LRU entry at the end of the cache
-
-        i=_last;
-        unlink(_last);
+        _index[findPosition(ip)]=i;
+        _array[i].ipAddress=ip;
       }
+      else
+        unlink(i);
 
       // enter our details
 
       ptr=&_array[i];
       ptr->macAddress=mac;
-      ptr->ipAddress=ip;
       ptr->expiryTime=_rtc->getTick()+_expirySeconds;
+      ptr->refreshed=false;
 
       // we are the most recent, insert at front
 
@@ -217,34 +201,47 @@ namespace stm32plus {
 
     /**
      * Find the MAC address given an IP address. The cached address must not have
-     * expired. Expired entries are intentionally not cleaned here to keep the
-     * performance to a maximum. Expired entries are detected and recycled in the
-     * insert() method.
+     * expired. An expired entry that's found is removed so that its slot can be
+     * re-used.
      * @param ip The IP address to find
      * @param found The found mac address
+     * @param[out] refreshNeeded true if the entry is close to expiry and the caller should send
+     *   an ARP request to refresh it. This is only returned once for each entry.
      * @return true if found
      */
 
-    inline bool ArpCache::findMacAddress(const IpAddress& ip,MacAddress& found) {
+    inline bool ArpCache::findMacAddress(const IpAddress& ip,MacAddress& found,bool& refreshNeeded) {
 
       uint8_t i;
-      bool ret;
+      CacheEntry *ptr;
 
-      ret=false;
+      refreshNeeded=false;
 
       // protect ourselves from re-entrancy
 
       IrqSuspend suspender;
 
-      for(i=_first;i!=NO_ENTRY;i=_array[i].next) {
-        if(_array[i].ipAddress==ip && !hasExpired(i)) {
-          found=_array[i].macAddress;
-          ret=true;
-          break;
-        }
+      if((i=_index[findPosition(ip)])==NO_ENTRY)
+        return false;
+
+      // expired entries are removed when they're found
+
+      if(hasExpired(i)) {
+        remove(i);
+        return false;
       }
 
-      return ret;
+      ptr=&_array[i];
+      found=ptr->macAddress;
+
+      // ask for a refresh if the entry is about to expire
+
+      if(_refreshSeconds && !ptr->refreshed && _rtc->getTick()+_refreshSeconds>ptr->expiryTime) {
+        ptr->refreshed=true;
+        refreshNeeded=true;
+      }
+
+      return true;
     }
 
 
@@ -294,6 +291,81 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Remove an entry from the cache. It's taken out of the index and the list and put
+     * on the free list.
+     * @param index The entry to remove
+     */
+
+    inline void ArpCache::remove(uint8_t index) {
+
+      uint16_t pos,next,home;
+
+      // linear probing can't just empty the slot because that would break the probe
+      // sequence of later entries. move back each later entry in the run that can go
+      // into the hole, leaving the hole at the end of the run.
+
+      pos=findPosition(_array[index].ipAddress);
+      next=pos;
+
+      for(;;) {
+
+        next=(next+1) & _indexMask;
+
+        if(_index[next]==NO_ENTRY)
+          break;
+
+        // the entry at next can fill the hole if its home slot is not cyclically in (pos,next]
+
+        home=hash(_array[_index[next]].ipAddress);
+
+        if(((next-home) & _indexMask)>=((next-pos) & _indexMask)) {
+          _index[pos]=_index[next];
+          pos=next;
+        }
+      }
+
+      _index[pos]=NO_ENTRY;
+
+      // take it out of the list and on to the free list
+
+      unlink(index);
+
+      _array[index].next=_free;
+      _free=index;
+    }
+
+
+    /**
+     * Get the home slot in the index for an IP address. The top bits of a multiplicative
+     * hash are used because they depend on all the bits of the address. The hosts on a
+     * subnet differ only in the last byte, which is the top byte of the stored address.
+     * @param ip The IP address
+     * @return The index slot
+     */
+
+    inline uint16_t ArpCache::hash(const IpAddress& ip) const {
+      return (ip.ipAddress*2654435761U) >> _indexShift;
+    }
+
+
+    /**
+     * Find the index slot that holds an IP address or the empty slot where it would go.
+     * The index is never more than half full so there is always an empty slot.
+     * @param ip The IP address
+     * @return The index slot
+     */
+
+    inline uint16_t ArpCache::findPosition(const IpAddress& ip) const {
+
+      uint16_t pos;
+      uint8_t i;
+
+      for(pos=hash(ip);(i=_index[pos])!=NO_ENTRY && !(_array[i].ipAddress==ip);pos=(pos+1) & _indexMask);
+      return pos;
+    }
+
+
     /**
      * Unlink an entry from the list
      * @param index The entry to unlink
@@ -12,7 +12,9 @@ namespace stm32plus {
   namespace net {
 
     /**
-     * Request an ARP mapping (get MAC from IP)
+     * Request an ARP mapping (get MAC from IP). If the sender supplies a complete IP packet
+     * then the ARP layer can take ownership of it instead of waiting for the reply. The packet
+     * is queued and transmitted when the reply arrives and the sender is told that it was queued.
      */
 
     struct ArpMappingRequestEvent : NetEventDescriptor {
@@ -22,10 +24,15 @@ namespace stm32plus {
       MacAddress macAddress;              ///< the returned MAC or nullptr
       bool found;
 
-      ArpMappingRequestEvent(const IpAddress& address)
+      NetBuffer *networkBuffer;           ///< optional packet to queue if the MAC is not known
+      bool queued;                        ///< true if networkBuffer was queued and now belongs to the ARP layer
+
+      ArpMappingRequestEvent(const IpAddress& address,NetBuffer *nb=nullptr)
         : NetEventDescriptor(NetEventType::ARP_MAPPING_REQUEST),
           ipAddress(address),
-          found(false) {
+          found(false),
+          networkBuffer(nb),
+          queued(false) {
       }
     };
   }
@@ -0,0 +1,280 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Bounded queue of outgoing packets that are waiting for an ARP reply. When the IP layer
+     * sends to a neighbour that isn't in the ARP cache the packet is parked here and an ARP
+     * request goes out. When the reply arrives the packets for that neighbour are released
+     * in the order that they were parked.
+     *
+     * The queue is a fixed array allocated at initialisation. It's kept compact so that the
+     * order of the array is the order of arrival. Each neighbour can have at most
+     * maxPerDestination packets parked so that one unreachable host cannot take all the
+     * space. All the packets parked for a neighbour share the same retry state so there is
+     * only one outstanding ARP request per neighbour.
+     *
+     * The queue is modified from normal code, the ethernet IRQ and the network ticker IRQ so all
+     * access is done with interrupts suspended. NetBuffers are handed back to the caller
+     * one at a time so that they can be transmitted with interrupts enabled.
+     */
+
+    class ArpPendingQueue {
+
+      protected:
+
+        struct PendingPacket {
+          NetBuffer *networkBuffer;       ///< the packet, complete with its IP header
+          IpAddress nextHop;              ///< the neighbour whose MAC we need
+          uint32_t retryTime;             ///< RTC time of the next ARP request
+          uint8_t retriesLeft;            ///< ARP requests left before giving up
+        };
+
+        uint8_t _maxEntries;              ///< total packets allowed
+        uint8_t _maxPerDestination;       ///< packets allowed for each neighbour
+        uint8_t _used;                    ///< number of packets parked
+        uint8_t _retries;                 ///< number of ARP requests before giving up
+        uint32_t _retrySeconds;           ///< seconds between ARP requests
+        RtcBase *_rtc;                    ///< Pointer to the RTC
+
+        scoped_array<PendingPacket> _array;   ///< the parked packets, oldest first
+
+      protected:
+        void remove(uint8_t index);
+
+      public:
+        ArpPendingQueue();
+        ~ArpPendingQueue();
+
+        bool initialise(uint8_t maxEntries,uint8_t maxPerDestination,uint8_t retries,uint32_t retrySeconds,RtcBase *rtc);
+
+        bool park(NetBuffer *nb,const IpAddress& nextHop,bool& requestNeeded);
+        NetBuffer *release(const IpAddress& nextHop);
+        NetBuffer *releaseExpired(uint32_t timeNow);
+        bool getRetry(uint32_t timeNow,IpAddress& nextHop);
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    inline ArpPendingQueue::ArpPendingQueue()
+      : _used(0) {
+    }
+
+
+    /**
+     * Destructor. Packets that are still parked are deleted.
+     */
+
+    inline ArpPendingQueue::~ArpPendingQueue() {
+
+      uint8_t i;
+
+      for(i=0;i<_used;i++)
+        delete _array[i].networkBuffer;
+    }
+
+
+    /**
+     * Initialise the queue. The array is created up front so that there's no heap
+     * churn while packets are being parked.
+     * @param maxEntries The maximum number of packets parked for all neighbours
+     * @param maxPerDestination The maximum number of packets parked for one neighbour
+     * @param retries The number of ARP requests to send before giving up
+     * @param retrySeconds The number of seconds between each ARP request
+     * @param rtc A pointer to the RTC used to get the current time
+     * @return true if it works
+     */
+
+    inline bool ArpPendingQueue::initialise(uint8_t maxEntries,uint8_t maxPerDestination,uint8_t retries,uint32_t retrySeconds,RtcBase *rtc) {
+
+      _array.reset(new PendingPacket[maxEntries]);
+
+      _maxEntries=maxEntries;
+      _maxPerDestination=maxPerDestination;
+      _used=0;
+      _retries=retries;
+      _retrySeconds=retrySeconds;
+      _rtc=rtc;
+
+      return _array.get()!=nullptr;
+    }
+
+
+    /**
+     * Park a packet until the MAC address of the neighbour is known. The queue takes
+     * ownership of the NetBuffer if this method succeeds.
+     * @param nb The packet to park
+     * @param nextHop The neighbour that the packet must be sent to
+     * @param[out] requestNeeded true if this is the first packet for the neighbour and the
+     *   caller must send an ARP request
+     * @return false if there's no room for the packet
+     */
+
+    inline bool ArpPendingQueue::park(NetBuffer *nb,const IpAddress& nextHop,bool& requestNeeded) {
+
+      uint8_t i,count;
+      PendingPacket *ptr,*existing;
+
+      IrqSuspend suspender;
+
+      if(_used==_maxEntries)
+        return false;
+
+      // count the packets already waiting for this neighbour
+
+      count=0;
+      existing=nullptr;
+
+      for(i=0;i<_used;i++) {
+        if(_array[i].nextHop==nextHop) {
+          existing=&_array[i];
+          count++;
+        }
+      }
+
+      if(count==_maxPerDestination)
+        return false;
+
+      // add to the end, sharing the retry state of packets already waiting
+
+      ptr=&_array[_used++];
+
+      ptr->networkBuffer=nb;
+      ptr->nextHop=nextHop;
+
+      if(existing) {
+        ptr->retryTime=existing->retryTime;
+        ptr->retriesLeft=existing->retriesLeft;
+        requestNeeded=false;
+      }
+      else {
+        ptr->retryTime=_rtc->getTick()+_retrySeconds;
+        ptr->retriesLeft=_retries ? _retries-1 : 0;
+        requestNeeded=true;
+      }
+
+      return true;
+    }
+
+
+    /**
+     * Take the oldest packet for a neighbour out of the queue. Call this until it returns
+     * nullptr when the MAC address of the neighbour becomes known. Ownership of the
+     * NetBuffer passes to the caller.
+     * @param nextHop The neighbour
+     * @return The packet, or nullptr if there are none left for this neighbour
+     */
+
+    inline NetBuffer *ArpPendingQueue::release(const IpAddress& nextHop) {
+
+      uint8_t i;
+      NetBuffer *nb;
+
+      IrqSuspend suspender;
+
+      for(i=0;i<_used;i++) {
+
+        if(_array[i].nextHop==nextHop) {
+          nb=_array[i].networkBuffer;
+          remove(i);
+          return nb;
+        }
+      }
+
+      return nullptr;
+    }
+
+
+    /**
+     * Take the oldest packet that has run out of retries out of the queue. Ownership of the
+     * NetBuffer passes to the caller, who should delete it.
+     * @param timeNow The current RTC time
+     * @return The packet, or nullptr if there are none that have expired
+     */
+
+    inline NetBuffer *ArpPendingQueue::releaseExpired(uint32_t timeNow) {
+
+      uint8_t i;
+      NetBuffer *nb;
+
+      IrqSuspend suspender;
+
+      for(i=0;i<_used;i++) {
+
+        if(_array[i].retriesLeft==0 && timeNow>=_array[i].retryTime) {
+          nb=_array[i].networkBuffer;
+          remove(i);
+          return nb;
+        }
+      }
+
+      return nullptr;
+    }
+
+
+    /**
+     * Get a neighbour that is due another ARP request. The retry state of all the packets
+     * waiting for that neighbour is moved on so call this until it returns false, sending
+     * a request each time. Call releaseExpired() first so that neighbours that have run out
+     * of retries are not returned.
+     * @param timeNow The current RTC time
+     * @param[out] nextHop The neighbour to send the request to
+     * @return true if a neighbour was returned
+     */
+
+    inline bool ArpPendingQueue::getRetry(uint32_t timeNow,IpAddress& nextHop) {
+
+      uint8_t i;
+      bool found;
+
+      IrqSuspend suspender;
+
+      found=false;
+
+      for(i=0;i<_used;i++) {
+
+        if(!found) {
+
+          if(_array[i].retriesLeft && timeNow>=_array[i].retryTime) {
+            nextHop=_array[i].nextHop;
+            found=true;
+          }
+        }
+
+        // later packets for the same neighbour share the state
+
+        if(found && _array[i].nextHop==nextHop) {
+          _array[i].retryTime=timeNow+_retrySeconds;
+          _array[i].retriesLeft--;
+        }
+      }
+
+      return found;
+    }
+
+
+    /**
+     * Remove an entry from the array, keeping the rest in order
+     * @param index The entry to remove
+     */
+
+    inline void ArpPendingQueue::remove(uint8_t index) {
+
+      _used--;
+
+      for(;index<_used;index++)
+        _array[index]=_array[index+1];
+    }
+  }
+}
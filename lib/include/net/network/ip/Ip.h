@@ -71,6 +71,7 @@ namespace stm32plus {
         void onNotification(NetEventDescriptor& ned);
 
         void setCommonTransmitHeaderValues(IpPacketHeader& header,IpTransmitRequestEvent& txevent);
+        void createIpHeader(IpTransmitRequestEvent& txevent);
         void sendToLocalhost(IpTransmitRequestEvent& txevent);
 
       public:
@@ -332,6 +333,7 @@ namespace stm32plus {
     inline void Ip<TDatalinkLayer,Features...>::onSend(NetEventDescriptor& ned) {
 
       uint16_t packetSize;
+      bool canQueue;
 
       // must be a send event
 
@@ -363,14 +365,33 @@ namespace stm32plus {
         return;
       }
 
+      // get the total IP packet size and check if we must fragment
+
+      packetSize=getIpTransmitHeaderSize()+txevent.networkBuffer->getSizeFromWritePointerToEnd()+txevent.networkBuffer->getUserBufferSize();
+
+      // a packet that fits in one frame and doesn't reference the caller's memory can wait in the ARP
+      // layer for the reply. build its IP header now so that it can go straight out when the reply comes.
+
+      canQueue=packetSize<=this->getDatalinkMtuSize() && txevent.networkBuffer->getUserBufferSize()==0;
+
+      if(canQueue)
+        createIpHeader(txevent);
+
       // we need the MAC address of the destination. if we came here from an IRQ (a received frame)
       // then it will already have been put into the ARP cache on the way up the stack. as well as
       // being efficient this is necessary because we cannot do tx-wait-rx while in an ethernet rx IRQ.
 
-      ArpMappingRequestEvent arpRequest(txevent.destinationIpAddress);
+      ArpMappingRequestEvent arpRequest(txevent.destinationIpAddress,canQueue ? txevent.networkBuffer : nullptr);
 
       this->NetworkNotificationEventSender.raiseEvent(arpRequest);
 
+      // if the ARP layer has queued the packet then it's accepted
+
+      if(arpRequest.queued) {
+        txevent.succeeded=true;
+        return;
+      }
+
       // did it work?
 
       if(!arpRequest.found) {
@@ -378,9 +399,8 @@ namespace stm32plus {
         return;
       }
 
-      // get the total IP packet size and check if we must fragment
+      // fragment the packet if it's too big for one frame
 
-      packetSize=getIpTransmitHeaderSize()+txevent.networkBuffer->getSizeFromWritePointerToEnd()+txevent.networkBuffer->getUserBufferSize();
       if(packetSize>this->getDatalinkMtuSize()) {
 
         NetBuffer **outputBuffers;
@@ -433,17 +453,10 @@ namespace stm32plus {
       }
       else {
 
-        // create the IP header in the netbuffer
-
-        IpPacketHeader *header=reinterpret_cast<IpPacketHeader *>(txevent.networkBuffer->moveWritePointerBack(getIpTransmitHeaderSize()));
+        // create the IP header in the netbuffer if it wasn't done before the lookup
 
-        setCommonTransmitHeaderValues(*header,txevent);
-
-        // these values are not common between fragmented and non-fragmented
-
-        header->ip_hdr_length=NetUtil::htons(static_cast<uint16_t>(txevent.networkBuffer->getSizeFromWritePointerToEnd()+txevent.networkBuffer->getUserBufferSize()));
-        header->ip_hdr_identification=0;
-        header->ip_hdr_flagsAndOffset=0;                                  // we will not fragment
+        if(!canQueue)
+          createIpHeader(txevent);
 
         // cool, now we have enough info to ask the datalink layer to send the packet
 
@@ -533,6 +546,27 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Create the IP header in front of the data in the netbuffer for a packet that will
+     * not be fragmented
+     * @param txevent The transmit event
+     */
+
+    template<class TDatalinkLayer,class... Features>
+    inline void Ip<TDatalinkLayer,Features...>::createIpHeader(IpTransmitRequestEvent& txevent) {
+
+      IpPacketHeader *header=reinterpret_cast<IpPacketHeader *>(txevent.networkBuffer->moveWritePointerBack(getIpTransmitHeaderSize()));
+
+      setCommonTransmitHeaderValues(*header,txevent);
+
+      // these values are not common between fragmented and non-fragmented
+
+      header->ip_hdr_length=NetUtil::htons(static_cast<uint16_t>(txevent.networkBuffer->getSizeFromWritePointerToEnd()+txevent.networkBuffer->getUserBufferSize()));
+      header->ip_hdr_identification=0;
+      header->ip_hdr_flagsAndOffset=0;                                  // we will not fragment
+    }
+
+
     /**
      * Set the common values in the IP header for a transmitted packet. Common means common to fragmented
      * and non-fragmented packets
@@ -12,7 +12,8 @@ namespace stm32plus {
 
 
     /**
-     * Linked list entry for a fragmented packet
+     * A slot in the reassembler arena that holds a packet being reassembled. The packet
+     * buffer is a fixed part of the arena so nothing is allocated as fragments arrive.
      */
 
     struct IpFragmentedPacket {
@@ -67,14 +68,14 @@ namespace stm32plus {
 
       PacketId identifier;
 
-      uint16_t packetLength;
-      uint8_t *packet;
+      uint16_t packetLength;      ///< highest byte received so far, the full length when complete
+      uint8_t *packet;            ///< the buffer in the arena
       uint16_t firstHole;
-      uint32_t expiryTime;
-
-      IpFragmentedPacket(PacketId pid);
-      ~IpFragmentedPacket();
+      NetworkTimer expiryTimer;   ///< drops the packet if it's not complete in time
+      uint8_t next;               ///< next slot in the hash chain or the free list
+      bool inUse;                 ///< true if the slot holds a packet
 
+      void reset(const PacketId& pid);
       void handleHoleList(const IpPacket& packet);
       void createHole(uint16_t first,uint16_t last);
       void unlinkHole(uint16_t holeToUnlink);
@@ -83,17 +84,18 @@ namespace stm32plus {
 
 
     /**
-     * Fragmented packet: constructor
-     * Set the identifier and set up the first hole in a buffer 8 bytes long
+     * Start reassembling a new packet in this slot. Set the identifier and set up the
+     * first hole, which covers the whole packet. The packet buffer must already be set.
+     * @param pid The identifier of the new packet
      */
 
-    inline IpFragmentedPacket::IpFragmentedPacket(PacketId pid) {
+    inline void IpFragmentedPacket::reset(const PacketId& pid) {
 
       Hole *ptr;
 
       identifier=pid;
-      packetLength=8;
-      packet=reinterpret_cast<uint8_t *>(malloc(8));
+      packetLength=0;
+      inUse=true;
 
       firstHole=0;
       ptr=Hole::getPointer(packet,0);
@@ -103,14 +105,6 @@ namespace stm32plus {
       ptr->next_hole=UINT16_MAX;
     }
 
-    /**
-     * FragmentedPacket: destructor
-     */
-
-    inline IpFragmentedPacket::~IpFragmentedPacket() {
-      free(packet);
-    }
-
 
     /**
      * Create a new hole and link it in. The hole actually lives in the packet data space
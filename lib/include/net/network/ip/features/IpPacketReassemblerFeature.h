@@ -12,10 +12,17 @@ namespace stm32plus {
 
 
     /**
-     * Handler for fragmented IPv4 packets. Fragmented packets are held in a linked list until either
-     * the full packet arrives or one of the parameterised limits is hit. Management of the incoming
-     * packets is done according to the algorithm described in RFC815 with the 'hole' descriptors
-     * existing inside the holes themselves.
+     * Handler for fragmented IPv4 packets. Management of the incoming packets is done according
+     * to the algorithm described in RFC815 with the 'hole' descriptors existing inside the holes
+     * themselves.
+     *
+     * Packets are reassembled in a fixed arena of ip_maxInProgressFragmentedPackets slots that
+     * is allocated at initialisation. Each slot can hold a packet of ip_maxPacketLength bytes
+     * so there is no heap activity while fragments are arriving and a flood of fragments cannot
+     * fragment the heap. The slot for a fragment is found through a small chained hash table
+     * keyed on the source address, identification and protocol. Each slot has a timer on the
+     * network timer wheel that drops the packet if it's not complete in time. The reasons for
+     * dropping fragments are counted and can be read with getStatistics().
      */
 
     class IpPacketReassemblerFeature {
@@ -29,17 +36,15 @@ namespace stm32plus {
         enum {
           E_TOO_MANY_FRAGMENTED_PACKETS = 1,
           E_PACKET_TOO_BIG,
-          E_MEMORY_LIMIT_EXCEEDED,
+          E_MALFORMED_FRAGMENT,
           E_OUT_OF_MEMORY
         };
 
         struct Parameters {
 
           uint16_t ip_maxPacketLength;                    //<! max length of any packet. default is 2048 bytes
-          uint16_t ip_maxInProgressFragmentedPackets;   //<! max incoming packets that can be fragmented and incompletely assembled in memory. The default is 2.
-          uint32_t ip_maxFragmentedPacketMemoryUsage;   //<! similar to ip_maxInProgressFragmentedPackets, but restricts overall memory usage of the fragment reassembler. The default is 4096.
-          uint8_t ip_fragmentExpirySeconds;             //<! seconds after which partially reassembled packets are dropped (default is 15)
-          uint8_t ip_fragmentExpiryIntervalCheckSeconds;  //<! how often to wake up and check for expired fragments
+          uint16_t ip_maxInProgressFragmentedPackets;   //<! max incoming packets that can be fragmented and incompletely assembled in memory. Each one has an arena slot of ip_maxPacketLength bytes. The default is 2, the maximum is 254.
+          uint8_t ip_fragmentExpirySeconds;             //<! seconds after the last fragment after which a partially reassembled packet is dropped (default is 15)
 
           /**
            * Constructor, set the default parameters
@@ -48,33 +53,60 @@ namespace stm32plus {
           Parameters() {
             ip_maxPacketLength=2048;
             ip_maxInProgressFragmentedPackets=2;
-            ip_maxFragmentedPacketMemoryUsage=4096;
             ip_fragmentExpirySeconds=15;
-            ip_fragmentExpiryIntervalCheckSeconds=23;
           }
         };
 
+        /**
+         * Counters for the fragments and packets that have been dropped, by reason
+         */
+
+        struct Statistics {
+          uint32_t packetsReassembled;    //<! packets that were completed and passed up
+          uint32_t noFreeSlot;            //<! fragments of a new packet dropped because the arena was full
+          uint32_t tooBig;                //<! packets dropped because they exceeded ip_maxPacketLength
+          uint32_t malformed;             //<! packets dropped because a fragment was not a multiple of 8 bytes
+          uint32_t expired;               //<! packets dropped because they were not complete in time
+        };
+
       private:
+
+        /**
+         * Constant for no slot in a hash chain or the free list
+         */
+
+        enum {
+          NO_SLOT = 0xff
+        };
+
         Parameters _params;
-        std::slist<IpFragmentedPacket *> _frags;
-        uint32_t _totalFragmentSize;
-        uint32_t _inFlightPacketCount;
+        Statistics _statistics;
         NetworkUtilityObjects *_utilityObjects;
 
+        uint8_t _slotCount;
+        uint8_t _free;                                ///< first free slot (or NO_SLOT)
+        uint8_t _bucketMask;                          ///< number of hash buckets minus one
+        uint8_t _bucketShift;                         ///< 32 minus log2 of the number of hash buckets
+        scoped_array<IpFragmentedPacket> _slots;      ///< the packets being reassembled
+        scoped_array<uint8_t> _buckets;               ///< first slot in each hash chain (or NO_SLOT)
+        scoped_array<uint8_t> _arena;                 ///< the packet buffers for all the slots
+
       private:
         bool internalHandleFragment(const IpPacket& packet,IpFragmentedPacket*& fp);
         IpFragmentedPacket *findFragment(const IpFragmentedPacket::PacketId& pid) const;
-        bool createNewFragment(IpFragmentedPacket::PacketId pid,IpFragmentedPacket *&fp);
-        void expireOldEntries(NetworkIntervalTickData& nitd);
+        bool createNewFragment(const IpFragmentedPacket::PacketId& pid,IpFragmentedPacket *&fp);
+        void releaseSlot(IpFragmentedPacket *fp);
+        void onExpiryTimer(NetworkTimer& timer);
+        uint8_t hash(const IpFragmentedPacket::PacketId& pid) const;
 
       public:
-        ~IpPacketReassemblerFeature();
-
         bool initialise(const Parameters& params,NetworkUtilityObjects& utilityObjects);
         bool startup();
 
         bool ip_handleFragment(const IpPacket& packet,IpFragmentedPacket*& fp);
         void ip_freePacket(IpFragmentedPacket *packetToFree);
+
+        const Statistics& getStatistics() const;
     };
   }
 }
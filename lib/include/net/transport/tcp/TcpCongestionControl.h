@@ -0,0 +1,81 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * @brief Congestion control algorithm for a TcpConnection
+     *
+     * The connection asks for the congestion window before it sends and never has more
+     * than that amount of data unacknowledged. It tells the algorithm about ACKs,
+     * duplicate ACKs and retransmission timeouts so that the window can be adjusted.
+     *
+     * onAck() and onDuplicateAck() are called from the ethernet IRQ. The other methods are
+     * called from normal code with interrupts suspended.
+     *
+     * Each connection needs its own instance. Congestion control is off unless the
+     * tcp_congestionControl parameter is set, and then TcpNewReno is used. To use
+     * something else, call TcpConnection::setCongestionControl() before the connection is
+     * established.
+     */
+
+    class TcpCongestionControl {
+
+      public:
+        virtual ~TcpCongestionControl() {}
+
+        /**
+         * Reset the state for a newly established connection
+         * @param mss The most data that we put in one segment
+         * @param initialWindow The starting congestion window in bytes
+         * @param sequenceNumber The initial send sequence number (ISS)
+         */
+
+        virtual void initialise(uint32_t mss,uint32_t initialWindow,uint32_t sequenceNumber)=0;
+
+        /**
+         * Get the congestion window
+         * @return The most bytes that may be unacknowledged
+         */
+
+        virtual uint32_t getWindow() const=0;
+
+        /**
+         * An ACK has acknowledged new data
+         * @param ackNumber The ACK number in the segment
+         * @param bytesAcked The number of newly acknowledged bytes
+         * @param flightSize The bytes still unacknowledged after this ACK
+         * @return true if the first unacknowledged segment should be retransmitted now
+         */
+
+        virtual bool onAck(uint32_t ackNumber,uint32_t bytesAcked,uint32_t flightSize)=0;
+
+        /**
+         * A duplicate ACK has arrived. It acknowledges nothing new, carries no data, does not
+         * change the window and there is data outstanding.
+         * @param ackNumber The ACK number in the segment
+         * @param flightSize The bytes that are unacknowledged
+         * @param sendMax The sequence number after the highest byte ever sent
+         * @return true if the first unacknowledged segment should be retransmitted now
+         */
+
+        virtual bool onDuplicateAck(uint32_t ackNumber,uint32_t flightSize,uint32_t sendMax)=0;
+
+        /**
+         * The retransmission timer has expired
+         * @param flightSize The bytes that are unacknowledged
+         * @param sendMax The sequence number after the highest byte ever sent
+         */
+
+        virtual void onTimeout(uint32_t flightSize,uint32_t sendMax)=0;
+    };
+  }
+}
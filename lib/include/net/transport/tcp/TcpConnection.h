@@ -19,6 +19,7 @@ namespace stm32plus {
 
     DECLARE_EVENT_SIGNATURE(TcpConnectionClosed,void (TcpConnectionClosedEvent&));
     DECLARE_EVENT_SIGNATURE(TcpConnectionDataReady,void (TcpConnectionDataReadyEvent&));
+    DECLARE_EVENT_SIGNATURE(TcpConnectionReady,void (TcpConnectionReadyEvent&));
 
     class TcpConnection {
 
@@ -41,11 +42,18 @@ namespace stm32plus {
 
       struct Parameters {
 
-        uint16_t tcp_receiveBufferSize;     ///< per-connection receive buffer size. Default is 256 bytes.
-        uint32_t tcp_initialResendDelay;    ///< first delay to resend an un-acked segment. Default is 4 seconds.
+        uint32_t tcp_receiveBufferSize;     ///< per-connection receive buffer size. Default is 256 bytes. More than 65535 needs tcp_windowScaling.
+        uint32_t tcp_transmitBufferSize;    ///< per-connection transmit buffer size, rounded up to a power of 2. If non-zero then send() copies into it and returns at once. Default is 0 (send() blocks).
+        uint32_t tcp_transmitLinger;        ///< millis that deleting a connection waits for its transmit buffer to be acknowledged. Unacknowledged data after that resets the connection. Default is 0 (no wait). Call flush() before deleting to wait longer.
+        uint32_t tcp_initialResendDelay;    ///< first delay to resend an un-acked segment, until the round trip time has been measured. Default is 4 seconds.
         uint32_t tcp_maxResendDelay;        ///< the resend delay exponential backoff is capped at this value. default is 60 (1 minute)
+        uint16_t tcp_delayedAckTimeout;     ///< millis to hold back the ACK for a data segment waiting for a second segment or data to send. Zero ACKs every segment. Default is 100.
         bool tcp_push;                      ///< if true, set the PSH flag in sent segments. Default is false.
         bool tcp_nagleAvoidance;            ///< if true, single packet sends are broken into 2 to force the receiver's Nagle algorithm to generate an ACK without delay. Default is true.
+        bool tcp_windowScaling;             ///< if true, offer RFC7323 window scaling so that receive buffers over 64Kb can be advertised. Default is true.
+        bool tcp_timestamps;                ///< if true, offer the RFC7323 timestamps option for round trip time measurement on every ACK. Default is false.
+        bool tcp_congestionControl;         ///< if true, limit the data in flight with a congestion window. Default is false.
+        uint8_t tcp_initialCongestionWindow; ///< the congestion window in segments when a connection starts. Default is 4.
 
         /**
          * Constructor
@@ -53,10 +61,17 @@ namespace stm32plus {
 
         Parameters() {
           tcp_receiveBufferSize=256;
+          tcp_transmitBufferSize=0;
+          tcp_transmitLinger=0;
           tcp_maxResendDelay=60000;
           tcp_initialResendDelay=4000;
+          tcp_delayedAckTimeout=100;
           tcp_nagleAvoidance=true;
           tcp_push=false;
+          tcp_windowScaling=true;
+          tcp_timestamps=false;
+          tcp_congestionControl=false;
+          tcp_initialCongestionWindow=4;
         }
       };
 
@@ -72,6 +87,22 @@ namespace stm32plus {
         uint32_t _zeroWindowPollDelay;
         uint32_t _lastActiveTime;                   // from the millisecond timer
         TcpConnectionState _state;
+        TcpResendDelayCalculator _resendDelayCalculator;
+        NetworkTimer _delayedAckTimer;
+        TcpNewReno _newReno;
+        TcpCongestionControl *_congestionControl;
+        volatile uint32_t _sendMax;                 // sequence number after the highest byte sent
+        volatile bool _retransmitRequested;         // set by the congestion control for a fast retransmit
+        spsc_ring_buffer<uint8_t> *_transmitBuffer;  // nullptr unless tcp_transmitBufferSize is set
+        NetworkTimer _resendTimer;                  // retransmission timer for the transmit buffer
+        volatile uint32_t _bufferedSequence;        // sequence number of the first byte in the transmit buffer
+        uint32_t _nextToSend;                       // sequence number of the next byte to go out of the transmit buffer
+        volatile uint32_t _resendDelay;             // current retransmission timeout, with backoff
+        uint32_t _timedSequence;                    // the ACK that ends the RTT measurement
+        volatile bool _transmitting;                // something is running transmitFromBuffer()
+        volatile bool _transmitAgain;               // the window moved while it was running
+        volatile bool _resendTimedOut;              // the retransmission timer has fired
+        uint32_t _totalBytesSent;                   // bytes accepted by send()
         const Parameters& _params;
         bool _receiveWindowIsClosed;
 
@@ -81,6 +112,8 @@ namespace stm32plus {
 
         void handleIncomingSynAck(const TcpHeader& header);
         void handleIncomingAck(const TcpHeader& header,bool hasData);
+        void handleIncomingTimestamp(const TcpHeader& header);
+        void handleSynOptions(const TcpHeader& header);
         void handleIncomingFin(TcpSegmentEvent& event);
         void handleIncomingRst();
         void handleIncomingData(const TcpSegmentEvent& event);
@@ -88,10 +121,27 @@ namespace stm32plus {
         void initialise(const IpAddress& remoteAddress,uint16_t remotePort,uint16_t localPort);
         void handleFindConnectionEvent(TcpFindConnectionNotificationEvent& tfcne);
 
-        bool sendSynAck();
-
-        uint16_t getReceiveBufferSpaceAvailable() const;
-        uint16_t sillyWindowAvoidance();
+        bool sendSynAck(bool windowScale);
+        bool sendSynSegment(TcpHeaderFlags flags,uint32_t ackNumber,bool windowScale,bool timestamps);
+        uint8_t getWindowShiftForBuffer() const;
+        void onDelayedAckTimer(NetworkTimer& timer);
+        uint16_t getSegmentSize() const;
+        void initialiseTransmitter();
+        uint32_t getSendLimit() const;
+        uint32_t getFlightSize() const;
+        TcpHeaderFlags getDataHeaderFlags() const;
+        bool sendSegment(const void *data,uint32_t sequenceNumber,uint32_t size,TcpHeaderFlags headerFlags);
+        bool transmitSegment(NetBuffer *nb,uint32_t sequenceNumber,uint32_t size,TcpHeaderFlags headerFlags);
+
+        bool sendBuffered(const void *data,uint32_t dataSize,uint32_t& actuallySent);
+        void releaseAcknowledged(uint32_t ackNumber);
+        void transmitFromBuffer();
+        void transmitPass();
+        bool sendBufferedSegment(const spsc_ring_buffer<uint8_t>::region& r,uint32_t offset,uint32_t sequenceNumber,uint32_t size);
+        void onResendTimer(NetworkTimer& timer);
+
+        uint32_t getReceiveBufferSpaceAvailable() const;
+        uint32_t sillyWindowAvoidance();
         bool receiveWindowCanBeOpened() const;
 
       public:
@@ -120,19 +170,30 @@ namespace stm32plus {
 
         bool receive(void *data,uint32_t dataSize,uint32_t& actuallyReceived,uint32_t timeoutMillis=0);
         bool send(const void *data,uint32_t dataSize,uint32_t& actuallySent,uint32_t timeoutMillis=0);
+        bool flush(uint32_t timeoutMillis=0);
         bool abort();
 
         bool isRemoteEndClosed() const;
         bool isLocalEndClosed() const;
         bool waitForStateChange(TcpState oldState,uint32_t timeoutMillis) const;
 
-        uint16_t getTransmitWindowSize() const;
-        uint16_t getDataAvailable() const;
+        uint32_t getTransmitWindowSize() const;
+        uint32_t getTransmitBufferSpace() const;
+        uint32_t getTransmitBufferPending() const;
+        uint32_t getTotalBytesSent() const;
+        uint32_t getDataAvailable() const;
+        uint32_t getSmoothedRtt() const;
+
+        void setCongestionControl(TcpCongestionControl *congestionControl);
+        TcpCongestionControl *getCongestionControl() const;
 
         uint32_t getLastActiveTime() const;
 
+        void signalReady(TcpWaitState states);
+
         DECLARE_EVENT_SOURCE(TcpConnectionClosed);
         DECLARE_EVENT_SOURCE(TcpConnectionDataReady);
+        DECLARE_EVENT_SOURCE(TcpConnectionReady);
     };
 
 
@@ -151,7 +212,10 @@ namespace stm32plus {
      */
 
     inline TcpConnection::TcpConnection(const Parameters& params)
-      : _params(params) {
+      : _congestionControl(params.tcp_congestionControl ? &_newReno : nullptr),
+        _transmitBuffer(nullptr),
+        _totalBytesSent(0),
+        _params(params) {
     }
 
 
@@ -247,7 +311,7 @@ namespace stm32plus {
      * @return The transmit window size
      */
 
-    inline uint16_t TcpConnection::getTransmitWindowSize() const {
+    inline uint32_t TcpConnection::getTransmitWindowSize() const {
       return _state.txWindow.sendWindow;
     }
 
@@ -258,11 +322,111 @@ namespace stm32plus {
      * tcp_receiveBufferSize configuration parameter.
      */
 
-    inline uint16_t TcpConnection::getDataAvailable() const {
+    inline uint32_t TcpConnection::getDataAvailable() const {
       return _receiveBuffer->availableToRead();
     }
 
 
+    /**
+     * Get the free space in the transmit buffer. This is how much the next call to send()
+     * can accept without blocking.
+     * @return The free space in bytes, zero if there's no transmit buffer
+     */
+
+    inline uint32_t TcpConnection::getTransmitBufferSpace() const {
+      return _transmitBuffer ? _transmitBuffer->availableToWrite() : 0;
+    }
+
+
+    /**
+     * Get the amount of data in the transmit buffer that has not been acknowledged yet
+     * @return The amount in bytes, zero if there's no transmit buffer
+     */
+
+    inline uint32_t TcpConnection::getTransmitBufferPending() const {
+      return _transmitBuffer ? _transmitBuffer->availableToRead() : 0;
+    }
+
+
+    /**
+     * Get the total number of bytes that send() has accepted over the life of the connection.
+     * Without a transmit buffer this is the number that have been acknowledged.
+     * @return The number of bytes
+     */
+
+    inline uint32_t TcpConnection::getTotalBytesSent() const {
+      return _totalBytesSent;
+    }
+
+
+    /**
+     * Get the header flags for a data segment
+     * @return ACK, plus PSH if tcp_push is set
+     */
+
+    inline TcpHeaderFlags TcpConnection::getDataHeaderFlags() const {
+      return _params.tcp_push ? TcpHeaderFlags::ACK | TcpHeaderFlags::PSH : TcpHeaderFlags::ACK;
+    }
+
+
+    /**
+     * Get the smoothed round trip time to the other end. This is measured from the timestamps
+     * option if the other end agreed to it, otherwise from the ACKs for data sent with send().
+     * @return The round trip time in milliseconds, or zero if it's not been measured yet.
+     */
+
+    inline uint32_t TcpConnection::getSmoothedRtt() const {
+      return _resendDelayCalculator.getSmoothedRtt();
+    }
+
+
+    /**
+     * Replace the congestion control algorithm. Call this before the connection is established,
+     * for example from the constructor of your derivation of TcpConnection.
+     * @param congestionControl The algorithm. It must stay in scope for the lifetime of this
+     *   connection. nullptr turns congestion control off.
+     */
+
+    inline void TcpConnection::setCongestionControl(TcpCongestionControl *congestionControl) {
+      _congestionControl=congestionControl;
+    }
+
+
+    /**
+     * Get the congestion control algorithm
+     * @return The algorithm, or nullptr if there is none
+     */
+
+    inline TcpCongestionControl *TcpConnection::getCongestionControl() const {
+      return _congestionControl;
+    }
+
+
+    /**
+     * Get the most data that we put in one segment. The remote MSS covers the options that we
+     * add to every segment.
+     * @return The segment size
+     */
+
+    inline uint16_t TcpConnection::getSegmentSize() const {
+      return _remoteMss-(_state.getHeaderSize()-TcpHeader::getNoOptionsHeaderSize());
+    }
+
+
+    /**
+     * Get the amount of data that has been sent and not acknowledged
+     * @return The flight size in bytes
+     */
+
+    inline uint32_t TcpConnection::getFlightSize() const {
+
+      uint32_t size;
+
+      size=_sendMax-_state.txWindow.sendUnacknowledged;
+      return static_cast<int32_t>(size)>0 ? size : 0;
+    }
+
+
     /**
      * Try to abort this connection by sending an RST to the other end.
      * @return true if it was in an abortable state and an RST has been sent
@@ -275,6 +439,7 @@ namespace stm32plus {
         case TcpState::SYN_RCVD:
         case TcpState::SYN_SENT:
         case TcpState::ESTABLISHED:
+        case TcpState::CLOSE_WAIT:
           _state.sendRstAck(*_networkUtilityObjects,0);
           return true;
 
@@ -289,7 +454,7 @@ namespace stm32plus {
      * @return The amount of space
      */
 
-    inline uint16_t TcpConnection::getReceiveBufferSpaceAvailable() const {
+    inline uint32_t TcpConnection::getReceiveBufferSpaceAvailable() const {
       return _receiveBuffer->availableToWrite();
     }
 
@@ -315,13 +480,39 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Tell subscribers such as TcpConnectionArray that this connection may be ready. The stack
+     * calls this when segments arrive. Call it yourself when you have queued data to write
+     * from outside of a TcpConnectionArray handler so that handleWrite() gets called.
+     * @param states The states that may have become possible
+     */
+
+    inline void TcpConnection::signalReady(TcpWaitState states) {
+      TcpConnectionReadyEventSender.raiseEvent(TcpConnectionReadyEvent(*this,states));
+    }
+
+
     /**
      * Return true if the receive window advertised in an ACK can be opened
      * @return true if the current receive window can be advertised
      */
 
     inline bool TcpConnection::receiveWindowCanBeOpened() const {
-      return _state.rxWindow.receiveWindow>=std::min(_params.tcp_receiveBufferSize/2,(int)_segmentSizeLimit);
+      return _state.rxWindow.receiveWindow>=std::min<uint32_t>(_params.tcp_receiveBufferSize/2,_segmentSizeLimit);
+    }
+
+
+    /**
+     * Get the window scale shift that lets us advertise the whole receive buffer
+     * @return The shift, 0 to 14
+     */
+
+    inline uint8_t TcpConnection::getWindowShiftForBuffer() const {
+
+      uint8_t shift;
+
+      for(shift=0;shift<14 && (_params.tcp_receiveBufferSize >> shift)>UINT16_MAX;shift++);
+      return shift;
     }
 
 
@@ -354,7 +545,7 @@ namespace stm32plus {
      * @return The window size.
      */
 
-    inline uint16_t TcpConnection::sillyWindowAvoidance() {
+    inline uint32_t TcpConnection::sillyWindowAvoidance() {
 
       if(receiveWindowCanBeOpened()) {
         _receiveWindowIsClosed=false;
@@ -18,8 +18,15 @@ namespace stm32plus {
      * would be sized to be equal to the configured maximum number of connections that
      * the server has been configured to simultaneously accept.
      *
+     * wait() is driven by readiness. Each connection raises a TcpConnectionReadyEvent when a
+     * segment arrives that changes something and the array marks it in a bitmap. wait() only
+     * services the connections that are marked and sleeps with WFI when there are none. A
+     * connection stays marked while its handlers are making progress: handleRead() consumed
+     * some data or handleWrite() sent some. Idle connections are found by a timer for each
+     * connection on the network timer wheel rather than checking every connection on every pass.
+     *
      * The memory required for an instance of this class is sizeof(TcpConnectionArray)
-     * plus 4*connection-count
+     * plus (5+sizeof(NetworkTimer))*connection-count plus 12 bytes for every 32 connections.
      */
 
     template<class TConnection>
@@ -34,26 +41,54 @@ namespace stm32plus {
         enum {
           E_FULL = 1,             ///< no more slots available
           E_NOT_FOUND,            ///< connection not found
-          E_ALREADY_SUBSCRIBED    ///< cannot subscribed to accept events twice
+          E_ALREADY_SUBSCRIBED,   ///< cannot subscribed to accept events twice
+          E_OUT_OF_MEMORY         ///< the array could not be allocated
         };
 
       protected:
+
+        /**
+         * Constants
+         */
+
+        enum {
+          MAX_IDLE_PASSES = 2     ///< passes without progress before a connection stops being serviced
+        };
+
         NetworkUtilityObjects& _networkUtilityObjects;
         TConnection **_connections;
         uint16_t _connectionCount;
         uint16_t _lastFree;
-        uint16_t _index;
+        uint16_t _words;                  // number of 32-bit words in a bitmap
         TcpServerBase *_subscribedServer;
         uint32_t _idleTimeout;
 
+        uint32_t *_ready;                 // bitmap of connections that need servicing
+        uint32_t *_pending;               // the connections being serviced by this pass of wait()
+        uint32_t *_idleDue;               // bitmap of connections whose idle timer has fired
+        uint8_t *_idlePasses;             // passes that each connection has made no progress
+        NetworkTimer *_idleTimers;        // an idle timer for each connection
+
       protected:
         void initialise();
         bool handleFail(TConnection *conn,TcpWaitState state,TConnection **outputConnection,TcpWaitState *outputState) const;
+        bool service(uint16_t index,TcpWaitState states,TConnection **outputConnection,TcpWaitState *outputState);
 
         void onNotification(NetEventDescriptor& ned);
         void onAccept(TcpAcceptEvent& event);
+        void onConnectionReady(TcpConnectionReadyEvent& event);
         void unsubscribeServer();
 
+        void setReady(uint16_t index);
+        bool takeReady();
+        void requeuePending(uint16_t word,uint32_t bits);
+        void sleep() const;
+
+        void startIdleTimer(uint16_t index,uint32_t lastActiveTime);
+        void stopIdleTimer(uint16_t index);
+        void onIdleTimer(NetworkTimer& timer);
+        void checkIdleTimers();
+
       public:
         TcpConnectionArray(TcpServerBase& server);
         TcpConnectionArray(NetworkUtilityObjects& netUtils,uint16_t count);
@@ -107,13 +142,54 @@ namespace stm32plus {
     template<class TConnection>
     inline void TcpConnectionArray<TConnection>::initialise() {
 
-      _connections=reinterpret_cast<TConnection **>(malloc(sizeof(TConnection *)*_connectionCount));
+      uint16_t i;
 
-      memset(_connections,0,sizeof(TConnection *)*_connectionCount);
       _lastFree=0;
-      _index=0;
       _idleTimeout=0;
 
+      // the ready, pending and idle bitmaps share one block
+
+      _words=(_connectionCount+31)/32;
+
+      _connections=reinterpret_cast<TConnection **>(malloc(sizeof(TConnection *)*_connectionCount));
+      _ready=reinterpret_cast<uint32_t *>(malloc(sizeof(uint32_t)*_words*3));
+      _idlePasses=reinterpret_cast<uint8_t *>(malloc(_connectionCount));
+      _idleTimers=reinterpret_cast<NetworkTimer *>(malloc(sizeof(NetworkTimer)*_connectionCount));
+
+      if(_connections==nullptr || _ready==nullptr || _idlePasses==nullptr || _idleTimers==nullptr) {
+
+        // leave an empty array behind. add() fails and there's nothing for anything else to do.
+
+        free(_connections);
+        free(_ready);
+        free(_idlePasses);
+        free(_idleTimers);
+
+        _connections=nullptr;
+        _ready=_pending=_idleDue=nullptr;
+        _idlePasses=nullptr;
+        _idleTimers=nullptr;
+        _connectionCount=_words=0;
+
+        errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION_ARRAY,E_OUT_OF_MEMORY);
+      }
+      else {
+
+        _pending=_ready+_words;
+        _idleDue=_pending+_words;
+
+        memset(_connections,0,sizeof(TConnection *)*_connectionCount);
+        memset(_ready,0,sizeof(uint32_t)*_words*3);
+        memset(_idlePasses,0,_connectionCount);
+
+        // the idle timers all call back to us and are told apart by their address
+
+        for(i=0;i<_connectionCount;i++) {
+          new(&_idleTimers[i]) NetworkTimer;
+          _idleTimers[i].callback=NetworkTimer::CallbackType::bind(this,&TcpConnectionArray<TConnection>::onIdleTimer);
+        }
+      }
+
       // we're not subscribed to a server yet
 
       _subscribedServer=nullptr;
@@ -133,6 +209,8 @@ namespace stm32plus {
     template<class TConnection>
     inline TcpConnectionArray<TConnection>::~TcpConnectionArray() {
 
+      uint16_t i;
+
       // if we are subscribed to a server then unsubscribe
 
       unsubscribeServer();
@@ -142,9 +220,17 @@ namespace stm32plus {
       _networkUtilityObjects.NetworkNotificationEventSender.removeSubscriber(
           NetworkNotificationEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onNotification));
 
+      // the timers must be off the wheel before they go
+
+      for(i=0;i<_connectionCount;i++)
+        stopIdleTimer(i);
+
       // release the connections
 
       free(_connections);
+      free(_ready);
+      free(_idlePasses);
+      free(_idleTimers);
     }
 
 
@@ -155,12 +241,17 @@ namespace stm32plus {
     template<class TConnection>
     inline void TcpConnectionArray<TConnection>::unsubscribeServer() {
 
+      uint16_t i;
+
       if(_subscribedServer)
         _subscribedServer->TcpAcceptEventSender.removeSubscriber(
             TcpAcceptEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onAccept));
 
       _subscribedServer=nullptr;
       _idleTimeout=0;
+
+      for(i=0;i<_connectionCount;i++)
+        stopIdleTimer(i);
     }
 
 
@@ -177,6 +268,8 @@ namespace stm32plus {
     template<class TConnection>
     inline bool TcpConnectionArray<TConnection>::autoAdd(TcpServerBase& server) {
 
+      uint16_t i;
+
       // cannot be already subscribed
 
       if(_subscribedServer!=nullptr)
@@ -185,6 +278,11 @@ namespace stm32plus {
       _subscribedServer=&server;
       _idleTimeout=server.getParameters().tcp_idleConnectionTimeout;
 
+      if(_idleTimeout)
+        for(i=0;i<_connectionCount;i++)
+          if(_connections[i])
+            startIdleTimer(i,_connections[i]->getLastActiveTime());
+
       // subscribe to accept events from the server
 
       server.TcpAcceptEventSender.insertSubscriber(
@@ -260,6 +358,9 @@ namespace stm32plus {
 
       IrqSuspend suspender;
 
+      if(_connections==nullptr)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION_ARRAY,E_OUT_OF_MEMORY);
+
       i=start=_lastFree;
 
       for(;;) {
@@ -283,6 +384,17 @@ namespace stm32plus {
           if(++_lastFree==_connectionCount)
             _lastFree=0;
 
+          // get told when it's ready and service it once to start with
+
+          conn.TcpConnectionReadyEventSender.insertSubscriber(
+              TcpConnectionReadyEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onConnectionReady));
+
+          _idlePasses[i]=0;
+          setReady(i);
+
+          if(_idleTimeout)
+            startIdleTimer(i,conn.getLastActiveTime());
+
           return true;
         }
       }
@@ -311,9 +423,15 @@ namespace stm32plus {
 
           // found it. remove it and make a note of a guaranteed empty slot
 
+          _connections[i]->TcpConnectionReadyEventSender.removeSubscriber(
+              TcpConnectionReadyEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onConnectionReady));
+
           _connections[i]=nullptr;
           _lastFree=i;
 
+          _ready[i/32]&=~(1U << (i%32));
+          stopIdleTimer(i);
+
           return true;
         }
       }
@@ -323,11 +441,37 @@ namespace stm32plus {
 
 
     /**
-     * wait() will go around the connections in round-robin fashion looking for connections
-     * that are ready for (read/write) or closed, the desired states are passed in via the states parameter.
-     * If a connection matches the required state then its handleRead() handleWrite() or handleClosed() method
-     * is called and we move around the rest of the connections in the array in round-robin fashion until
-     * the timeout expires. A zero value for the timeout means that it never expires.
+     * A connection has told us that it may be ready. Mark it in the bitmap so that wait()
+     * services it. This is IRQ code.
+     * @param event The ready event
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::onConnectionReady(TcpConnectionReadyEvent& event) {
+
+      uint16_t i;
+
+      for(i=0;i<_connectionCount;i++) {
+
+        if(_connections[i]==&event.connection) {
+          _idlePasses[i]=0;
+          setReady(i);
+          return;
+        }
+      }
+    }
+
+
+    /**
+     * wait() services the connections that are ready for (read/write) or closed, the desired states are
+     * passed in via the states parameter. If a connection matches the required state then its handleRead()
+     * handleWrite() or handleClosed() method is called. Connections are ready when the TCP layer has told
+     * us that something has happened to them, or when their handlers made progress on the last pass. When no
+     * connection is ready the CPU sleeps until the next interrupt. This goes on until the timeout expires.
+     * A zero value for the timeout means that it never expires.
+     *
+     * handleCallback() is called for every connection each time that wait() wakes up, whether or not the
+     * connection is ready.
      *
      * If a handleXXXX method returns false then this function returns false immediately and the connection
      * in question is returned in the outputConnection parameter and the state that returned false is returned
@@ -346,7 +490,8 @@ namespace stm32plus {
                                                       TcpWaitState *outputState) {
 
 
-      uint32_t now;
+      uint32_t now,bits;
+      uint16_t i,word;
       TConnection *conn;
 
       // get the current time
@@ -365,49 +510,270 @@ namespace stm32plus {
         if(timeout && MillisecondTimer::hasTimedOut(now,timeout))
           return true;
 
-        // increment the search pointer
+        // close connections that have been idle for too long
 
-        if(_index==_connectionCount-1)
-          _index=0;
-        else
-          _index++;
+        if(_idleTimeout)
+          checkIdleTimers();
 
-        // read is possible when there is some data in the buffer
+        // service the connections that are ready
 
-        if((conn=_connections[_index])!=nullptr && (states & TcpWaitState::READ)!=TcpWaitState::NONE && conn->getDataAvailable()>0) {
-          if(!conn->handleRead())
-            return handleFail(conn,TcpWaitState::READ,outputConnection,outputState);
-        }
+        if(takeReady()) {
+
+          for(word=0;word<_words;word++) {
 
-        // write is possible when the connection is ESTABLISHED (zero bytes may be written in a zero-window state)
+            for(bits=_pending[word];bits;bits&=bits-1) {
 
-        if((conn=_connections[_index])!=nullptr && (states & TcpWaitState::WRITE)!=TcpWaitState::NONE && conn->getConnectionState().state==TcpState::ESTABLISHED) {
-          if(!conn->handleWrite())
-            return handleFail(conn,TcpWaitState::WRITE,outputConnection,outputState);
+              i=word*32+__builtin_ctz(bits);
+
+              if(!service(i,states,outputConnection,outputState)) {
+                requeuePending(word,bits);
+                return false;
+              }
+            }
+          }
         }
 
         // callback is possible at any time
 
-        if((conn=_connections[_index])!=nullptr && (states & TcpWaitState::CALLBACK)!=TcpWaitState::NONE) {
-          if(!conn->handleCallback())
-            return handleFail(conn,TcpWaitState::CALLBACK,outputConnection,outputState);
+        if((states & TcpWaitState::CALLBACK)!=TcpWaitState::NONE) {
+
+          for(i=0;i<_connectionCount;i++) {
+
+            if((conn=_connections[i])!=nullptr && !conn->handleCallback())
+              return handleFail(conn,TcpWaitState::CALLBACK,outputConnection,outputState);
+          }
         }
 
-        // closed is called when local or remote end is closed
+        // nothing to do until an interrupt arrives
+
+        sleep();
+      }
+    }
+
+
+    /*
+     * Service one ready connection. The connection stays ready if a handler made progress.
+     */
+
+    template<class TConnection>
+    inline bool TcpConnectionArray<TConnection>::service(uint16_t index,
+                                                         TcpWaitState states,
+                                                         TConnection **outputConnection,
+                                                         TcpWaitState *outputState) {
+
+      TConnection *conn;
+      uint32_t available,totalBytesSent;
+      bool progress;
+
+      progress=false;
+
+      // read is possible when there is some data in the buffer
+
+      if((conn=_connections[index])!=nullptr && (states & TcpWaitState::READ)!=TcpWaitState::NONE && (available=conn->getDataAvailable())>0) {
+
+        if(!conn->handleRead())
+          return handleFail(conn,TcpWaitState::READ,outputConnection,outputState);
+
+        if((conn=_connections[index])!=nullptr && conn->getDataAvailable()!=available)
+          progress=true;
+      }
+
+      // write is possible when the connection is ESTABLISHED (zero bytes may be written in a zero-window state)
+
+      if((conn=_connections[index])!=nullptr && (states & TcpWaitState::WRITE)!=TcpWaitState::NONE && conn->getConnectionState().state==TcpState::ESTABLISHED) {
+
+        totalBytesSent=conn->getTotalBytesSent();
+
+        if(!conn->handleWrite())
+          return handleFail(conn,TcpWaitState::WRITE,outputConnection,outputState);
+
+        if((conn=_connections[index])!=nullptr && conn->getTotalBytesSent()!=totalBytesSent)
+          progress=true;
+      }
+
+      // closed is called when local or remote end is closed
+
+      if((conn=_connections[index])!=nullptr && (states & TcpWaitState::CLOSED)!=TcpWaitState::NONE && (conn->isRemoteEndClosed() || conn->isLocalEndClosed())) {
+        if(!conn->handleClosed())
+          return handleFail(conn,TcpWaitState::WRITE,outputConnection,outputState);
+      }
+
+      // keep it ready while the handlers make progress. a handler can change its own state without
+      // sending or reading anything so a connection gets a few passes before it's dropped.
+
+      if(_connections[index]!=nullptr) {
+
+        if(progress)
+          _idlePasses[index]=0;
+
+        if(progress || ++_idlePasses[index]<MAX_IDLE_PASSES)
+          setReady(index);
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Mark a connection as ready
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::setReady(uint16_t index) {
+
+      IrqSuspend suspender;
+      _ready[index/32]|=1U << (index%32);
+    }
+
+
+    /*
+     * Move the ready bitmap into the pending bitmap and clear it so that connections marked
+     * from now on are serviced on the next pass
+     */
+
+    template<class TConnection>
+    inline bool TcpConnectionArray<TConnection>::takeReady() {
+
+      uint16_t i;
+      uint32_t any;
+
+      IrqSuspend suspender;
+
+      for(i=any=0;i<_words;i++) {
+        any|=_pending[i]=_ready[i];
+        _ready[i]=0;
+      }
+
+      return any!=0;
+    }
+
+
+    /*
+     * Put the connections that this pass of wait() didn't finish back in the ready bitmap so
+     * that the next call services them.
+     * @param word The word of the pending bitmap that was being serviced
+     * @param bits What's left of it, including the connection that was being serviced
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::requeuePending(uint16_t word,uint32_t bits) {
+
+      IrqSuspend suspender;
+
+      _ready[word]|=bits;
+
+      while(++word<_words)
+        _ready[word]|=_pending[word];
+    }
+
+
+    /*
+     * Sleep until the next interrupt if no connection is ready. Interrupts are suspended while
+     * checking so that one can't mark a connection between the check and the WFI. WFI still wakes
+     * up for an interrupt that's pending while they're suspended.
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::sleep() const {
 
-        if((conn=_connections[_index])!=nullptr && (states & TcpWaitState::CLOSED)!=TcpWaitState::NONE && (conn->isRemoteEndClosed() || conn->isLocalEndClosed())) {
-          if(!conn->handleClosed())
-            return handleFail(conn,TcpWaitState::WRITE,outputConnection,outputState);
+      uint16_t i;
+
+      IrqSuspend suspender;
+
+      for(i=0;i<_words;i++)
+        if(_ready[i] || _idleDue[i])
+          return;
+
+      __WFI();
+    }
+
+
+    /*
+     * Arm a connection's idle timer to fire when it will have been idle for the timeout
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::startIdleTimer(uint16_t index,uint32_t lastActiveTime) {
+
+      uint32_t elapsed;
+
+      elapsed=MillisecondTimer::millis()-lastActiveTime;
+      _networkUtilityObjects.armTimer(_idleTimers[index],elapsed>=_idleTimeout ? 1 : _idleTimeout-elapsed+1);
+    }
+
+
+    /*
+     * Disarm a connection's idle timer
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::stopIdleTimer(uint16_t index) {
+
+      IrqSuspend suspender;
+
+      _networkUtilityObjects.cancelTimer(_idleTimers[index]);
+      _idleDue[index/32]&=~(1U << (index%32));
+    }
+
+
+    /*
+     * An idle timer has fired. Mark the connection so that wait() checks it. This is IRQ code.
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::onIdleTimer(NetworkTimer& timer) {
+
+      uint16_t index;
+
+      index=&timer-_idleTimers;
+      _idleDue[index/32]|=1U << (index%32);
+    }
+
+
+    /*
+     * Check the connections whose idle timers have fired. They have either been idle for the
+     * timeout and are closed, or have been active since the timer was armed and it's re-armed
+     * for their new deadline.
+     */
+
+    template<class TConnection>
+    inline void TcpConnectionArray<TConnection>::checkIdleTimers() {
+
+      uint32_t bits;
+      uint16_t i,word;
+      TConnection *conn;
+
+      for(word=0;word<_words;word++) {
+
+        {
+          IrqSuspend suspender;
+
+          bits=_idleDue[word];
+          _idleDue[word]=0;
         }
 
-        // has the connection timed out?
+        for(;bits;bits&=bits-1) {
+
+          i=word*32+__builtin_ctz(bits);
+
+          if((conn=_connections[i])!=nullptr) {
+
+            if(MillisecondTimer::hasTimedOut(conn->getLastActiveTime(),_idleTimeout)) {
+
+              // the other end has stopped taking data if any is still buffered. reset the
+              // connection so that the destructor doesn't linger for it.
 
-        if(_idleTimeout && (conn=_connections[_index])!=nullptr && MillisecondTimer::hasTimedOut(conn->getLastActiveTime(),_idleTimeout)) {
+              if(conn->getTransmitBufferPending())
+                conn->abort();
 
-          // we'll get a callback via our connection-released notification subscription
-          // and we'll remove it from the array automatically
+              // we'll get a callback via our connection-released notification subscription
+              // and we'll remove it from the array automatically
 
-          delete conn;
+              delete conn;
+            }
+            else
+              startIdleTimer(i,conn->getLastActiveTime());
+          }
         }
       }
     }
@@ -0,0 +1,50 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * TCP connection ready event. This event signifies that something has happened to the
+     * connection that the application may want to act on: data has arrived, the remote window
+     * has opened or the connection state has changed. TcpConnectionArray uses it to find the
+     * connections that need servicing without polling all of them.
+     */
+
+    class TcpConnection;
+
+    struct TcpConnectionReadyEvent : NetEventDescriptor {
+
+      /**
+       * Reference to the TCP connection object.
+       */
+
+      TcpConnection& connection;
+
+      /**
+       * What may have become possible. A hint only, the receiver should check the connection.
+       */
+
+      TcpWaitState states;
+
+      /**
+       * Constructor
+       * @param The connection reference
+       * @param s The states that may have become possible
+       */
+
+      TcpConnectionReadyEvent(TcpConnection& c,TcpWaitState s)
+        : NetEventDescriptor(NetEventDescriptor::NetEventType::TCP_CONNECTION_READY),
+          connection(c),
+          states(s) {
+      }
+    };
+  }
+}
@@ -28,14 +28,25 @@ namespace stm32plus {
       volatile TcpState state;                    ///< the state of the connection
       volatile TcpTransmitWindow txWindow;        ///< the transmit window state
       volatile TcpReceiveWindow rxWindow;         ///< the receive window state
-      volatile bool pendingDataAck;               ///< true if there's a pending data ACK
+      volatile bool pendingDataAck;               ///< true if there's a delayed ACK waiting to go
+      uint8_t sendWindowShift;                    ///< window scale applied to the windows that the peer advertises
+      uint8_t receiveWindowShift;                 ///< window scale applied to the windows that we advertise
+      bool timestampsEnabled;                     ///< true if both ends agreed to send timestamps
+      volatile uint32_t timestampRecent;          ///< the peer's timestamp that we echo back (TS.Recent)
+      volatile uint32_t lastAckSent;              ///< the last ACK number that we sent (Last.ACK.sent)
 
       /*
        * Constructor
        */
 
       TcpConnectionState()
-        : state(TcpState::NONE) {
+        : state(TcpState::NONE),
+          pendingDataAck(false),
+          sendWindowShift(0),
+          receiveWindowShift(0),
+          timestampsEnabled(false),
+          timestampRecent(0),
+          lastAckSent(0) {
       }
 
       /**
@@ -54,6 +65,11 @@ namespace stm32plus {
         remotePort=src.remotePort;
         state=src.state;
         pendingDataAck=src.pendingDataAck;
+        sendWindowShift=src.sendWindowShift;
+        receiveWindowShift=src.receiveWindowShift;
+        timestampsEnabled=src.timestampsEnabled;
+        timestampRecent=src.timestampRecent;
+        lastAckSent=src.lastAckSent;
 
         // OK to cast off the volatile qualifier because by the time this operator is used
         // these variables are no longer volatile
@@ -72,7 +88,7 @@ namespace stm32plus {
        * @return true if it was sent
        */
 
-      bool sendAck(NetworkUtilityObjects& netutils,uint16_t windowSize) {
+      bool sendAck(NetworkUtilityObjects& netutils,uint32_t windowSize) {
         return sendHeaderOnly(netutils,TcpHeaderFlags::ACK,windowSize);
       }
 
@@ -84,7 +100,7 @@ namespace stm32plus {
        * @return true if it was sent
        */
 
-      bool sendFinAck(NetworkUtilityObjects& netutils,uint16_t windowSize) {
+      bool sendFinAck(NetworkUtilityObjects& netutils,uint32_t windowSize) {
         return sendHeaderOnly(netutils,TcpHeaderFlags::FIN | TcpHeaderFlags::ACK,windowSize);
       }
 
@@ -97,7 +113,7 @@ namespace stm32plus {
        * @return true if it was sent
        */
 
-      bool sendRstAck(NetworkUtilityObjects& netutils,uint16_t windowSize) {
+      bool sendRstAck(NetworkUtilityObjects& netutils,uint32_t windowSize) {
         changeState(netutils,TcpState::CLOSED);
         return sendHeaderOnly(netutils,TcpHeaderFlags::RST | TcpHeaderFlags::ACK,windowSize);
       }
@@ -113,22 +129,19 @@ namespace stm32plus {
 
       bool sendHeaderOnly(NetworkUtilityObjects& netutils,
                           TcpHeaderFlags flags,
-                          uint16_t windowSize) {
+                          uint32_t windowSize) {
 
         // create a NetBuffer to hold the RST segment
 
-        NetBuffer *nb=new NetBuffer(additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),0);
+        NetBuffer *nb=new NetBuffer(additionalHeaderSize+getHeaderSize(),0);
 
         // construct the header
 
-        TcpHeader *header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
-
-        header->initialise(localPort,
-                           remotePort,
-                           txWindow.sendNext,           // where we are sending from
-                           (flags & TcpHeaderFlags::ACK)==0 ? 0 : rxWindow.receiveNext, //  ack up to receiveNext
-                           windowSize,                  // data space available
-                           flags);
+        writeHeader(nb,
+                    txWindow.sendNext,           // where we are sending from
+                    (flags & TcpHeaderFlags::ACK)==0 ? 0 : rxWindow.receiveNext, //  ack up to receiveNext
+                    windowSize,                  // data space available
+                    flags);
 
         // ask the IP layer to send the packet
 
@@ -142,6 +155,80 @@ namespace stm32plus {
       }
 
 
+      /**
+       * Get the size of the TCP header, including the options, on segments other than SYNs
+       * @return The header size in bytes
+       */
+
+      uint16_t getHeaderSize() const {
+        return TcpHeader::getNoOptionsHeaderSize()+(timestampsEnabled ? 2+TcpOptionTimestamps::getSize() : 0);
+      }
+
+
+      /**
+       * Scale a receive window to the value that goes in the window field of a header. Not for SYNs.
+       * @param windowSize The window in bytes
+       * @return The value for the header
+       */
+
+      uint16_t getAdvertisedWindow(uint32_t windowSize) const {
+
+        windowSize>>=receiveWindowShift;
+        return windowSize>UINT16_MAX ? UINT16_MAX : windowSize;
+      }
+
+
+      /**
+       * Write the TCP header and options in front of the data in a NetBuffer. There must be
+       * getHeaderSize() bytes of space before the write pointer. Not for SYNs.
+       * @param nb The NetBuffer
+       * @param sequenceNumber The sequence number of the first byte
+       * @param ackNumber The ACK number, ignored if the flags don't have ACK
+       * @param windowSize Our receive window in bytes
+       * @param flags The header flags
+       * @return The header
+       */
+
+      TcpHeader *writeHeader(NetBuffer *nb,uint32_t sequenceNumber,uint32_t ackNumber,uint32_t windowSize,TcpHeaderFlags flags) {
+
+        TcpHeader *header;
+        TcpOption *nop;
+
+        // the timestamp option goes behind two NOPs so that it's word aligned
+
+        if(timestampsEnabled) {
+
+          reinterpret_cast<TcpOptionTimestamps *>(nb->moveWritePointerBack(TcpOptionTimestamps::getSize()))->initialise(
+              MillisecondTimer::millis(),
+              timestampRecent);
+
+          nop=reinterpret_cast<TcpOption *>(nb->moveWritePointerBack(2));
+          nop[0].initialise(TcpOptionKind::NOP);
+          nop[1].initialise(TcpOptionKind::NOP);
+        }
+
+        header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
+
+        header->initialise(localPort,
+                           remotePort,
+                           sequenceNumber,
+                           ackNumber,
+                           getAdvertisedWindow(windowSize),
+                           flags);
+
+        header->setSize(getHeaderSize());
+
+        // any segment with an ACK satisfies a delayed ACK
+
+        if((flags & TcpHeaderFlags::ACK)!=0) {
+          lastAckSent=ackNumber;
+          pendingDataAck=false;
+        }
+
+        return header;
+      }
+
+
       /**
        * Change the state of this connection and notify subscribers
        * @param netutils The network utility objects
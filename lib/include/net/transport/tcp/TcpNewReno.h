@@ -0,0 +1,225 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * @brief NewReno congestion control (RFC5681 and RFC6582)
+     *
+     * Slow start grows the window exponentially up to the slow start threshold. After that,
+     * congestion avoidance adds one segment per window of acknowledged data. Both use
+     * byte counting (RFC3465), so a receiver that delays its ACKs doesn't slow the growth.
+     *
+     * Three duplicate ACKs trigger a fast retransmit. The threshold is set to half the data
+     * in flight and the connection enters fast recovery until everything outstanding at
+     * that time has been acknowledged. Each partial ACK during recovery retransmits the next
+     * hole. A retransmission timeout drops the window to one segment and starts slow start
+     * again.
+     */
+
+    class TcpNewReno : public TcpCongestionControl {
+
+      protected:
+        uint32_t _mss;
+        uint32_t _cwnd;                 // congestion window
+        uint32_t _ssthresh;             // slow start threshold
+        uint32_t _recover;              // highest sequence sent when recovery started
+        uint32_t _bytesAcked;           // byte counter for congestion avoidance
+        uint8_t _duplicateAcks;
+        bool _inRecovery;
+
+      public:
+        TcpNewReno();
+        virtual ~TcpNewReno() {}
+
+        // overrides from TcpCongestionControl
+
+        virtual void initialise(uint32_t mss,uint32_t initialWindow,uint32_t sequenceNumber) override;
+        virtual uint32_t getWindow() const override;
+        virtual bool onAck(uint32_t ackNumber,uint32_t bytesAcked,uint32_t flightSize) override;
+        virtual bool onDuplicateAck(uint32_t ackNumber,uint32_t flightSize,uint32_t sendMax) override;
+        virtual void onTimeout(uint32_t flightSize,uint32_t sendMax) override;
+
+        uint32_t getSlowStartThreshold() const;
+        bool isInRecovery() const;
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    inline TcpNewReno::TcpNewReno() {
+      initialise(536,536,0);
+    }
+
+
+    /**
+     * Reset the state for a new connection. The slow start threshold starts out unlimited and
+     * the recovery point is the ISS so that a loss of the first segment can be fast retransmitted
+     * (RFC6582 section 3.2).
+     * @param mss The most data in one segment
+     * @param initialWindow The starting congestion window in bytes
+     * @param sequenceNumber The initial send sequence number (ISS)
+     */
+
+    inline void TcpNewReno::initialise(uint32_t mss,uint32_t initialWindow,uint32_t sequenceNumber) {
+
+      _mss=mss;
+      _cwnd=std::max(initialWindow,mss);
+      _ssthresh=UINT32_MAX;
+      _recover=sequenceNumber;
+      _bytesAcked=0;
+      _duplicateAcks=0;
+      _inRecovery=false;
+    }
+
+
+    /**
+     * Get the congestion window
+     * @return The window in bytes
+     */
+
+    inline uint32_t TcpNewReno::getWindow() const {
+      return _cwnd;
+    }
+
+
+    /**
+     * Get the slow start threshold
+     * @return The threshold in bytes
+     */
+
+    inline uint32_t TcpNewReno::getSlowStartThreshold() const {
+      return _ssthresh;
+    }
+
+
+    /**
+     * Check if we're in fast recovery
+     * @return true if we are
+     */
+
+    inline bool TcpNewReno::isInRecovery() const {
+      return _inRecovery;
+    }
+
+
+    /**
+     * New data has been acknowledged
+     * @param ackNumber The ACK number
+     * @param bytesAcked The number of newly acknowledged bytes
+     * @param flightSize The bytes still unacknowledged
+     * @return true if the next hole should be retransmitted
+     */
+
+    inline bool TcpNewReno::onAck(uint32_t ackNumber,uint32_t bytesAcked,uint32_t flightSize) {
+
+      _duplicateAcks=0;
+
+      if(_inRecovery) {
+
+        // a full ACK ends recovery and deflates the window
+
+        if(static_cast<int32_t>(ackNumber-_recover)>=0) {
+          _inRecovery=false;
+          _cwnd=std::min(_ssthresh,std::max(flightSize,_mss)+_mss);
+          return false;
+        }
+
+        // a partial ACK means the segment after it was lost too. deflate the window by the
+        // amount acknowledged, add back one segment and retransmit.
+
+        _cwnd=bytesAcked<_cwnd ? _cwnd-bytesAcked : 0;
+
+        if(bytesAcked>=_mss)
+          _cwnd+=_mss;
+
+        _cwnd=std::max(_cwnd,_mss);
+        return true;
+      }
+
+      if(_cwnd<_ssthresh) {
+
+        // slow start, limited to 2 segments per ACK (RFC3465)
+
+        _cwnd+=std::min(bytesAcked,2*_mss);
+      }
+      else {
+
+        // congestion avoidance, one segment per window of data acknowledged
+
+        _bytesAcked+=bytesAcked;
+
+        if(_bytesAcked>=_cwnd) {
+          _bytesAcked-=_cwnd;
+          _cwnd+=_mss;
+        }
+      }
+
+      return false;
+    }
+
+
+    /**
+     * A duplicate ACK has arrived
+     * @param ackNumber The ACK number
+     * @param flightSize The bytes that are unacknowledged
+     * @param sendMax The sequence number after the highest byte sent
+     * @return true if the first unacknowledged segment should be retransmitted
+     */
+
+    inline bool TcpNewReno::onDuplicateAck(uint32_t ackNumber,uint32_t flightSize,uint32_t sendMax) {
+
+      // in recovery each duplicate means another segment has left the network
+
+      if(_inRecovery) {
+        _cwnd+=_mss;
+        return false;
+      }
+
+      if(++_duplicateAcks<3)
+        return false;
+
+      _duplicateAcks=0;
+
+      // don't start another recovery for losses from before the last one or from before a
+      // timeout (RFC6582 section 3.2)
+
+      if(static_cast<int32_t>(ackNumber-_recover)<=0)
+        return false;
+
+      _ssthresh=std::max(flightSize/2,2*_mss);
+      _cwnd=_ssthresh+3*_mss;
+      _recover=sendMax;
+      _inRecovery=true;
+
+      return true;
+    }
+
+
+    /**
+     * The retransmission timer has expired. Back to one segment and slow start.
+     * @param flightSize The bytes that are unacknowledged
+     * @param sendMax The sequence number after the highest byte sent
+     */
+
+    inline void TcpNewReno::onTimeout(uint32_t flightSize,uint32_t sendMax) {
+
+      _ssthresh=std::max(flightSize/2,2*_mss);
+      _cwnd=_mss;
+      _recover=sendMax;
+      _bytesAcked=0;
+      _duplicateAcks=0;
+      _inRecovery=false;
+    }
+  }
+}
@@ -18,7 +18,9 @@ namespace stm32plus {
     enum class TcpOptionKind : uint8_t {
       END_OF_OPTIONS       = 0x00,                      ///< no more options in the header
       NOP                  = 0x01,                      ///< padding option
-      MAXIMUM_SEGMENT_SIZE = 0x02                       ///< MSS
+      MAXIMUM_SEGMENT_SIZE = 0x02,                      ///< MSS
+      WINDOW_SCALE         = 0x03,                      ///< window scale shift (RFC7323)
+      TIMESTAMPS           = 0x08                       ///< timestamp value and echo (RFC7323)
     };
 
 
@@ -106,5 +108,56 @@ namespace stm32plus {
         return TcpOptionKind::MAXIMUM_SEGMENT_SIZE;
       }
     } __attribute__((packed));
+
+
+    /**
+     * Window scale. Only sent on a SYN. The window fields of all the other segments are
+     * shifted left by tcp_optionShift to get the real window.
+     */
+
+    struct TcpOptionWindowScale : TcpVariableLengthOption {
+
+      uint8_t tcp_optionShift;
+
+      void initialise(uint8_t shift) {
+        TcpVariableLengthOption::initialise(TcpOptionKind::WINDOW_SCALE,3);
+        tcp_optionShift=shift;
+      }
+
+      constexpr static uint16_t getSize() {
+        return 3;
+      }
+
+      constexpr static TcpOptionKind getOptionKind() {
+        return TcpOptionKind::WINDOW_SCALE;
+      }
+    } __attribute__((packed));
+
+
+    /**
+     * Timestamps. Sent on every segment once both sides have agreed to it on the SYN. We
+     * always send it with two leading NOPs so that the values are word aligned and the
+     * header stays a multiple of 4 bytes.
+     */
+
+    struct TcpOptionTimestamps : TcpVariableLengthOption {
+
+      uint32_t tcp_optionValue;
+      uint32_t tcp_optionEchoReply;
+
+      void initialise(uint32_t value,uint32_t echoReply) {
+        TcpVariableLengthOption::initialise(TcpOptionKind::TIMESTAMPS,10);
+        tcp_optionValue=NetUtil::htonl(value);
+        tcp_optionEchoReply=NetUtil::htonl(echoReply);
+      }
+
+      constexpr static uint16_t getSize() {
+        return 10;
+      }
+
+      constexpr static TcpOptionKind getOptionKind() {
+        return TcpOptionKind::TIMESTAMPS;
+      }
+    } __attribute__((packed));
   }
 }
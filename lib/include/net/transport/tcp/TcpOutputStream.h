@@ -14,6 +14,8 @@ namespace stm32plus {
     /**
      * An input stream for writing to a TCP connection. The stream is unbuffered which makes
      * it quite inefficient for the network if small data items are repeatedly pushed to it.
+     * Use writev() to send a header, payload and trailer together. Small buffers are gathered
+     * so they go out in the same segments instead of waiting for an ACK each.
      */
 
     class TcpOutputStream : public OutputStream {
@@ -23,6 +25,10 @@ namespace stm32plus {
           E_CONNECTION_CLOSED = 1      ///< The connection was closed while we were writing to it
         };
 
+        enum {
+          WRITEV_BUFFER_SIZE = 256     ///< Size of the stack buffer that writev() gathers into
+        };
+
       protected:
         TcpConnection& _conn;
 
@@ -33,6 +39,7 @@ namespace stm32plus {
 
         virtual bool write(uint8_t c) override;
         virtual bool write(const void *buffer,uint32_t size) override;
+        virtual bool writev(const IoVector *vectors,uint32_t count) override;
         virtual bool flush() override;
         virtual bool close() override;
     };
@@ -92,6 +99,22 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Write a list of buffers. They are gathered into a WRITEV_BUFFER_SIZE stack buffer that
+     * is sent to the connection each time it fills. The middle of a larger buffer is sent in
+     * place and its head and tail share sends with its neighbours.
+     * @param vectors The buffers to write
+     * @param count The number of buffers
+     * @return true if it worked
+     */
+
+    inline bool TcpOutputStream::writev(const IoVector *vectors,uint32_t count) {
+
+      uint8_t buffer[WRITEV_BUFFER_SIZE];
+      return writevBuffered(vectors,count,buffer,sizeof(buffer));
+    }
+
+
     /**
      * Cannot flush, not an error either
      * @return true
@@ -12,23 +12,26 @@ namespace stm32plus {
 
 
     /**
-     * Simple wrapper for the circular buffer used for received data that ensures
-     * IRQ-safe access to the methods.
+     * Wrapper for the ring buffer used for received data. The IRQ-driven receive path is the
+     * only writer and the user's receive() call is the only reader so the lock-free
+     * spsc_ring_buffer is used and interrupts don't need to be suspended. The ring is a power
+     * of two in size but no more than the configured size is ever advertised as free.
      */
 
     class TcpReceiveBuffer {
 
       protected:
-        volatile circular_buffer<uint8_t> _receiveBuffer;
+        spsc_ring_buffer<uint8_t> _receiveBuffer;
+        uint32_t _size;
 
       public:
         TcpReceiveBuffer(uint32_t size);
 
-        void read(uint8_t *output,uint32_t size) volatile;
-        void write(const uint8_t *input,uint32_t size) volatile;
+        void read(uint8_t *output,uint32_t size);
+        void write(const uint8_t *input,uint32_t size);
 
-        uint32_t availableToWrite() const volatile;
-        uint32_t availableToRead() const volatile;
+        uint32_t availableToWrite() const;
+        uint32_t availableToRead() const;
     };
 
 
@@ -38,29 +41,29 @@ namespace stm32plus {
      */
 
     inline TcpReceiveBuffer::TcpReceiveBuffer(uint32_t size)
-      : _receiveBuffer(size) {
+      : _receiveBuffer(size),
+        _size(size) {
     }
 
-    inline void TcpReceiveBuffer::read(uint8_t *output,uint32_t size) volatile {
-      IrqSuspend suspender;
+    inline void TcpReceiveBuffer::read(uint8_t *output,uint32_t size) {
       _receiveBuffer.read(output,size);
     }
 
 
-    inline void TcpReceiveBuffer::write(const uint8_t *input,uint32_t size) volatile {
-      IrqSuspend suspender;
+    inline void TcpReceiveBuffer::write(const uint8_t *input,uint32_t size) {
       _receiveBuffer.write(input,size);
     }
 
-    inline uint32_t TcpReceiveBuffer::availableToWrite() const volatile {
-      IrqSuspend suspend;
-      return _receiveBuffer.availableToWrite();
+    inline uint32_t TcpReceiveBuffer::availableToWrite() const {
+
+      uint32_t used;
+
+      used=_receiveBuffer.availableToRead();
+      return used>=_size ? 0 : _size-used;
     }
 
-    inline uint32_t TcpReceiveBuffer::availableToRead() const volatile {
-      IrqSuspend suspend;
+    inline uint32_t TcpReceiveBuffer::availableToRead() const {
       return _receiveBuffer.availableToRead();
     }
   }
 }
-
@@ -24,7 +24,7 @@ namespace stm32plus {
 
     struct TcpReceiveWindow {
       uint32_t receiveNext;           ///< seq num of next byte expected to arrive
-      uint16_t receiveWindow;         ///< the number of bytes that we are currently prepared to receive
+      uint32_t receiveWindow;         ///< the number of bytes that we are currently prepared to receive
     };
   }
 }
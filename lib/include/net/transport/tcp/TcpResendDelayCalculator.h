@@ -12,43 +12,69 @@ namespace stm32plus {
 
 
     /**
-     * State management for the resend algorithm. This implements the algorithm in RFC2988 as
+     * State management for the resend algorithm. This implements the algorithm in RFC6298 as
      * best we can here. Round-trip times are used to calculate an adaptive value that defines
      * how long to wait before a packet is considered lost and should be retransmitted for the
      * first time.
+     *
+     * Samples come from the timestamps option when the other end supports it, because then
+     * every ACK gives an accurate sample even for retransmitted data. Otherwise one segment at
+     * a time is timed with startTimer() and stopTimer() and retransmitted segments are not
+     * timed (Karn's algorithm). All times are in milliseconds.
      */
 
     class TcpResendDelayCalculator {
 
+      public:
+
+        /**
+         * Constants
+         */
+
+        enum {
+          MIN_DELAY = 200         ///< lower limit for the delay. RFC6298 says 1s but that's for the internet.
+        };
+
       protected:
-        uint16_t _initialDelay;
-        uint16_t _maxDelay;
+        uint32_t _initialDelay;
+        uint32_t _maxDelay;
 
         uint32_t _srtt;
         uint32_t _rttvar;
         uint32_t _timerStart;
         bool _first;
+        bool _timing;
 
       public:
-        bool initialise(uint16_t initialDelay,uint16_t maxDelay);
+        bool initialise(uint32_t initialDelay,uint32_t maxDelay);
 
         void startTimer();
         void stopTimer();
+        void cancelTimer();
+        bool isTiming() const;
+
+        void addSample(uint32_t rtt);
 
-        uint16_t getResendDelay() const;
+        uint32_t getResendDelay() const;
+        uint32_t getSmoothedRtt() const;
     };
 
 
     /**
      * Initialise the class
-     * @param initialDelay The first delay seconds
-     * @param maxDelay The maximum delay seconds
+     * @param initialDelay The delay in milliseconds until the first sample arrives
+     * @param maxDelay The maximum delay in milliseconds
      * @return true
      */
 
-    inline bool TcpResendDelayCalculator::initialise(uint16_t initialDelay,uint16_t maxDelay) {
+    inline bool TcpResendDelayCalculator::initialise(uint32_t initialDelay,uint32_t maxDelay) {
+
       _initialDelay=initialDelay;
       _maxDelay=maxDelay;
+      _first=true;
+      _timing=false;
+      _srtt=_rttvar=0;
+
       return true;
     }
 
@@ -59,18 +85,49 @@ namespace stm32plus {
 
     inline void TcpResendDelayCalculator::startTimer() {
       _timerStart=MillisecondTimer::millis();
+      _timing=true;
     }
 
 
     /**
-     * Stop the RTT timer and calculate the state variables
+     * Stop the RTT timer and take a sample
      */
 
     inline void TcpResendDelayCalculator::stopTimer() {
 
-      uint32_t r;
+      if(_timing) {
+        _timing=false;
+        addSample(MillisecondTimer::difference(_timerStart));
+      }
+    }
+
+
+    /**
+     * Stop the RTT timer without taking a sample. Use this when the timed segment is
+     * retransmitted because the ACK would be ambiguous.
+     */
+
+    inline void TcpResendDelayCalculator::cancelTimer() {
+      _timing=false;
+    }
+
+
+    /**
+     * Check if the RTT timer is running
+     * @return true if it is
+     */
 
-      r=MillisecondTimer::difference(_timerStart);
+    inline bool TcpResendDelayCalculator::isTiming() const {
+      return _timing;
+    }
+
+
+    /**
+     * Add a round trip time sample and calculate the state variables
+     * @param r The round trip time in milliseconds
+     */
+
+    inline void TcpResendDelayCalculator::addSample(uint32_t r) {
 
       if(_first) {
         _srtt=r;
@@ -86,15 +143,32 @@ namespace stm32plus {
 
     /**
      * Get the current resend delay, calculated from the state variables
-     * @return the current resend delay
+     * @return the current resend delay in milliseconds
      */
 
-    inline uint16_t TcpResendDelayCalculator::getResendDelay() const {
+    inline uint32_t TcpResendDelayCalculator::getResendDelay() const {
+
+      uint32_t delay;
 
       if(_first)
         return _initialDelay;
 
-      return std::min((uint32_t)_maxDelay,(_srtt+std::max(1ul,4*_rttvar))/1000);
+      delay=_srtt+std::max<uint32_t>(1,4*_rttvar);
+
+      if(delay<MIN_DELAY)
+        return MIN_DELAY;
+
+      return std::min(_maxDelay,delay);
+    }
+
+
+    /**
+     * Get the smoothed round trip time
+     * @return The smoothed RTT in milliseconds, zero if there are no samples yet
+     */
+
+    inline uint32_t TcpResendDelayCalculator::getSmoothedRtt() const {
+      return _srtt;
     }
   }
 }
@@ -25,7 +25,7 @@ namespace stm32plus {
     struct TcpTransmitWindow {
       uint32_t sendUnacknowledged;      ///< seq num of first byte of data sent but not acked
       uint32_t sendNext;                ///< seq num of next byte of data to be sent
-      uint16_t sendWindow;              ///< send window (starts at _sendUnacknowledged)
+      uint32_t sendWindow;              ///< send window (starts at _sendUnacknowledged), already scaled
     };
   }
 }
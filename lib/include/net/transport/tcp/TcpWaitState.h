@@ -16,9 +16,9 @@ namespace stm32plus {
     enum class TcpWaitState : uint8_t {
       NONE     = 0,         ///< nothing (used in comparisons)
       READ     = 0x1,       ///< ready to read (rx buffer has data)
-      WRITE    = 0x2,       ///< ready to tx (ESTABLISHED and remote window>0)
+      WRITE    = 0x2,       ///< ready to tx (ESTABLISHED and remote window>0, or space freed in the transmit buffer)
       CLOSED   = 0x4,       ///< closed or reset (either end)
-      CALLBACK = 0x8        ///< implement handleCallback() to get a round-robin callback regardless of connection state
+      CALLBACK = 0x8        ///< implement handleCallback() to get a callback each time TcpConnectionArray::wait() wakes up, regardless of connection state
     };
 
 
@@ -82,11 +82,14 @@ namespace stm32plus {
 
 
   /**
-   * Return true if any IRQ is currently active
+   * Return true if any IRQ is currently active. The core exceptions such as SysTick and PendSV
+   * don't show up in the NVIC active bits so the vector that's executing is checked as well.
+   * Code that would wait on MillisecondTimer must not do so when this returns true.
    */
 
   inline bool Nvic::isAnyIrqActive() {
-    return NVIC->IABR[0]!=0 ||
+    return (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk)!=0 ||
+           NVIC->IABR[0]!=0 ||
            NVIC->IABR[1]!=0 ||
            NVIC->IABR[2]!=0 ||
            NVIC->IABR[3]!=0 ||
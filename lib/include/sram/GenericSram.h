@@ -42,6 +42,7 @@ namespace stm32plus {
       virtual bool readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) override;
       virtual bool writeBlock(const void *src,uint32_t blockIndex) override;
       virtual bool writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) override;
+      virtual bool canTransferDirect(const void *buffer) override;
       virtual formatType getFormatType() override;
       virtual bool getMbr(Mbr *mbr) override;
 
@@ -124,6 +125,16 @@ namespace stm32plus {
   }
 
 
+  /*
+   * Blocks are copied with memcpy so any buffer will do
+   */
+
+  template<class TFsmc>
+  inline bool GenericSram<TFsmc>::canTransferDirect(const void * /* buffer */) {
+    return true;
+  }
+
+
   /*
    * Get the format type - no MBR
    */
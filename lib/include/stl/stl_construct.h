@@ -32,6 +32,7 @@
 #define __SGI_STL_INTERNAL_CONSTRUCT_H
 
 #include <new>
+#include <stl_move.h>
 
 __STL_BEGIN_NAMESPACE
 
@@ -59,6 +60,11 @@ inline void _Construct(_T1* __p) {
   new ((void*) __p) _T1();
 }
 
+template <class _T1, class... _Args>
+inline void _Construct_forward(_T1* __p, _Args&&... __args) {
+  new ((void*) __p) _T1(__STD::forward<_Args>(__args)...);
+}
+
 template <class _Tp>
 inline void _Destroy(_Tp* __pointer) {
   __pointer->~_Tp();
@@ -316,6 +316,17 @@ protected:
     return __p;
   }
 
+  template <class... _Args>
+  _Node* _M_create_node_forward(_Args&&... __args)
+  {
+    _Node* __p = _M_get_node();
+    __STL_TRY {
+      _Construct_forward(&__p->_M_data, __STD::forward<_Args>(__args)...);
+    }
+    __STL_UNWIND(_M_put_node(__p));
+    return __p;
+  }
+
   _Node* _M_create_node()
   {
     _Node* __p = _M_get_node();
@@ -369,6 +380,19 @@ public:
     return __tmp;
   }
   iterator insert(iterator __position) { return insert(__position, _Tp()); }
+  iterator insert(iterator __position, _Tp&& __x)
+    { return emplace(__position, __STD::move(__x)); }
+
+  // construct a new element in place before __position
+  template <class... _Args>
+  iterator emplace(iterator __position, _Args&&... __args) {
+    _Node* __tmp = _M_create_node_forward(__STD::forward<_Args>(__args)...);
+    __tmp->_M_next = __position._M_node;
+    __tmp->_M_prev = __position._M_node->_M_prev;
+    __position._M_node->_M_prev->_M_next = __tmp;
+    __position._M_node->_M_prev = __tmp;
+    return __tmp;
+  }
 #ifdef __STL_MEMBER_TEMPLATES
   // Check whether it's an integral type.  If so, it's not an iterator.
 
@@ -402,6 +426,15 @@ public:
   void push_front() {insert(begin());}
   void push_back(const _Tp& __x) { insert(end(), __x); }
   void push_back() {insert(end());}
+  void push_front(_Tp&& __x) { emplace(begin(), __STD::move(__x)); }
+  void push_back(_Tp&& __x) { emplace(end(), __STD::move(__x)); }
+
+  template <class... _Args>
+  void emplace_front(_Args&&... __args)
+    { emplace(begin(), __STD::forward<_Args>(__args)...); }
+  template <class... _Args>
+  void emplace_back(_Args&&... __args)
+    { emplace(end(), __STD::forward<_Args>(__args)...); }
 
   iterator erase(iterator __position) {
     _List_node_base* __next_node = __position._M_node->_M_next;
@@ -457,10 +490,22 @@ public:
   list(const list<_Tp, _Alloc>& __x) : _Base(__x.get_allocator())
     { insert(begin(), __x.begin(), __x.end()); }
 
+  // the nodes of __x are taken over by swapping sentinels, __x is left empty
+  list(list<_Tp, _Alloc>&& __x) : _Base(__x.get_allocator())
+    { this->swap(__x); }
+
   ~list() { }
 
   list<_Tp, _Alloc>& operator=(const list<_Tp, _Alloc>& __x);
 
+  list<_Tp, _Alloc>& operator=(list<_Tp, _Alloc>&& __x) {
+    if (&__x != this) {
+      clear();
+      this->swap(__x);
+    }
+    return *this;
+  }
+
 public:
   // assign(), a generalized assignment member function.  Two
   // versions: one that takes a count, and one that takes a range.
@@ -0,0 +1,51 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/* NOTE: This is an internal header file, included by other STL headers.
+ *   You should not attempt to use it directly.
+ */
+
+#ifndef __SGI_STL_INTERNAL_MOVE_H
+#define __SGI_STL_INTERNAL_MOVE_H
+
+// The SGI STL predates rvalue references so it has no std::move or std::forward. These are the
+// minimal C++11 versions needed by the move constructors and emplace members of the containers.
+// If the compiler's own <bits/move.h> has already been seen then that is used instead. The
+// reference stripping trait has a private name so that it doesn't clash with the standard one
+// when <type_traits> is included as well, in either order.
+
+#ifndef _MOVE_H
+
+__STL_BEGIN_NAMESPACE
+
+template <class _Tp> struct _Stl_remove_reference { typedef _Tp type; };
+template <class _Tp> struct _Stl_remove_reference<_Tp&> { typedef _Tp type; };
+template <class _Tp> struct _Stl_remove_reference<_Tp&&> { typedef _Tp type; };
+
+template <class _Tp>
+inline typename _Stl_remove_reference<_Tp>::type&& move(_Tp&& __t) noexcept {
+  return static_cast<typename _Stl_remove_reference<_Tp>::type&&>(__t);
+}
+
+template <class _Tp>
+inline _Tp&& forward(typename _Stl_remove_reference<_Tp>::type& __t) noexcept {
+  return static_cast<_Tp&&>(__t);
+}
+
+template <class _Tp>
+inline _Tp&& forward(typename _Stl_remove_reference<_Tp>::type&& __t) noexcept {
+  return static_cast<_Tp&&>(__t);
+}
+
+__STL_END_NAMESPACE
+
+#endif /* _MOVE_H */
+
+#endif /* __SGI_STL_INTERNAL_MOVE_H */
+
+// Local Variables:
+// mode:C++
+// End:
@@ -94,6 +94,53 @@ uninitialized_copy(const wchar_t* __first, const wchar_t* __last,
   return __result + (__last - __first);
 }
 
+// __uninitialized_move (not part of the C++ standard)
+// Used when a container reallocates. Element types that aren't POD are move constructed into
+// the new storage so that their own buffers are handed over rather than duplicated. The
+// source elements are left in their moved-from state and still have to be destroyed.
+
+template <class _InputIter, class _ForwardIter>
+inline _ForwardIter
+__uninitialized_move_aux(_InputIter __first, _InputIter __last,
+                         _ForwardIter __result,
+                         __true_type)
+{
+  return uninitialized_copy(__first, __last, __result);
+}
+
+template <class _InputIter, class _ForwardIter>
+_ForwardIter
+__uninitialized_move_aux(_InputIter __first, _InputIter __last,
+                         _ForwardIter __result,
+                         __false_type)
+{
+  _ForwardIter __cur = __result;
+  __STL_TRY {
+    for ( ; __first != __last; ++__first, ++__cur)
+      _Construct_forward(&*__cur, __STD::move(*__first));
+    return __cur;
+  }
+  __STL_UNWIND(_Destroy(__result, __cur));
+}
+
+template <class _InputIter, class _ForwardIter, class _Tp>
+inline _ForwardIter
+__uninitialized_move(_InputIter __first, _InputIter __last,
+                     _ForwardIter __result, _Tp*)
+{
+  typedef typename __type_traits<_Tp>::is_POD_type _Is_POD;
+  return __uninitialized_move_aux(__first, __last, __result, _Is_POD());
+}
+
+template <class _InputIter, class _ForwardIter>
+inline _ForwardIter
+__uninitialized_move(_InputIter __first, _InputIter __last,
+                     _ForwardIter __result)
+{
+  return __uninitialized_move(__first, __last, __result,
+                              __VALUE_TYPE(__result));
+}
+
 // uninitialized_copy_n (not part of the C++ standard)
 
 template <class _InputIter, class _Size, class _ForwardIter>
@@ -196,6 +196,34 @@ protected:
 protected:
   void _M_insert_aux(iterator __position, const _Tp& __x);
   void _M_insert_aux(iterator __position);
+  template <class... _Args> void _M_emplace_back_aux(_Args&&... __args);
+
+  // The capacity to reallocate to when there's no room for another __n
+  // elements. Growth is from the current capacity so that space set aside
+  // with reserve() is not forgotten.
+  size_type _M_next_capacity(size_type __n) const {
+#ifdef STM32PLUS_BUILD
+    const size_type __len = capacity() != 0 ? stm32plus::Stm32VectorAllocAhead<_Tp>(capacity()) : 1;
+#else
+    const size_type __len = capacity() != 0 ? 2 * capacity() : 1;
+#endif
+    return max(__len, size() + __n);
+  }
+
+  // Move the contents into a new block of __n elements
+  void _M_reallocate(size_type __n) {
+    const size_type __old_size = size();
+    iterator __tmp = _M_allocate(__n);
+    __STL_TRY {
+      __uninitialized_move(_M_start, _M_finish, __tmp);
+    }
+    __STL_UNWIND(_M_deallocate(__tmp, __n));
+    destroy(_M_start, _M_finish);
+    _M_deallocate(_M_start, _M_end_of_storage - _M_start);
+    _M_start = __tmp;
+    _M_finish = __tmp + __old_size;
+    _M_end_of_storage = _M_start + __n;
+  }
 
 public:
   iterator begin() { return _M_start; }
@@ -252,6 +280,11 @@ public:
     : _Base(__x.size(), __x.get_allocator())
     { _M_finish = uninitialized_copy(__x.begin(), __x.end(), _M_start); }
 
+  // take over the storage of __x, which is left empty
+  vector(vector<_Tp, _Alloc>&& __x) noexcept
+    : _Base(__x.get_allocator())
+    { this->swap(__x); }
+
 #ifdef __STL_MEMBER_TEMPLATES
   // Check whether it's an integral type.  If so, it's not an iterator.
   template <class _InputIterator>
@@ -284,16 +317,19 @@ public:
   ~vector() { destroy(_M_start, _M_finish); }
 
   vector<_Tp, _Alloc>& operator=(const vector<_Tp, _Alloc>& __x);
-  void reserve(size_type __n) {
-    if (capacity() < __n) {
-      const size_type __old_size = size();
-      iterator __tmp = _M_allocate_and_copy(__n, _M_start, _M_finish);
-      destroy(_M_start, _M_finish);
-      _M_deallocate(_M_start, _M_end_of_storage - _M_start);
-      _M_start = __tmp;
-      _M_finish = __tmp + __old_size;
-      _M_end_of_storage = _M_start + __n;
+
+  // swap storage with __x which then releases our old contents
+  vector<_Tp, _Alloc>& operator=(vector<_Tp, _Alloc>&& __x) noexcept {
+    if (&__x != this) {
+      clear();
+      this->swap(__x);
     }
+    return *this;
+  }
+
+  void reserve(size_type __n) {
+    if (capacity() < __n)
+      _M_reallocate(__n);
   }
 
   // assign(), a generalized assignment member function.  Two
@@ -351,6 +387,18 @@ public:
     else
       _M_insert_aux(end());
   }
+  void push_back(_Tp&& __x) { emplace_back(__STD::move(__x)); }
+
+  // construct a new element in place at the end from the given arguments
+  template <class... _Args>
+  void emplace_back(_Args&&... __args) {
+    if (_M_finish != _M_end_of_storage) {
+      _Construct_forward(_M_finish, __STD::forward<_Args>(__args)...);
+      ++_M_finish;
+    }
+    else
+      _M_emplace_back_aux(__STD::forward<_Args>(__args)...);
+  }
   void swap(vector<_Tp, _Alloc>& __x) {
     __STD::swap(_M_start, __x._M_start);
     __STD::swap(_M_finish, __x._M_finish);
@@ -641,22 +689,22 @@ vector<_Tp, _Alloc>::_M_insert_aux(iterator __position, const _Tp& __x)
     *__position = __x_copy;
   }
   else {
-    const size_type __old_size = size();
-
-#ifdef STM32PLUS_BUILD
-    const size_type __len = __old_size != 0 ? stm32plus::Stm32VectorAllocAhead<_Tp>(__old_size) : 1;
-#else
-    const size_type __len = __old_size != 0 ? 2 * __old_size : 1;
-#endif
+    // __x may refer to an element of this vector so it's copied into its final
+    // slot before anything is moved out from under it
+    const size_type __len = _M_next_capacity(1);
+    const size_type __elems_before = __position - _M_start;
     iterator __new_start = _M_allocate(__len);
     iterator __new_finish = __new_start;
     __STL_TRY {
-      __new_finish = uninitialized_copy(_M_start, __position, __new_start);
-      construct(__new_finish, __x);
+      construct(__new_start + __elems_before, __x);
+    }
+    __STL_UNWIND(_M_deallocate(__new_start,__len));
+    __STL_TRY {
+      __new_finish = __uninitialized_move(_M_start, __position, __new_start);
       ++__new_finish;
-      __new_finish = uninitialized_copy(__position, _M_finish, __new_finish);
+      __new_finish = __uninitialized_move(__position, _M_finish, __new_finish);
     }
-    __STL_UNWIND((destroy(__new_start,__new_finish), 
+    __STL_UNWIND((destroy(__new_start + __elems_before),
                   _M_deallocate(__new_start,__len)));
     destroy(begin(), end());
     _M_deallocate(_M_start, _M_end_of_storage - _M_start);
@@ -677,20 +725,14 @@ vector<_Tp, _Alloc>::_M_insert_aux(iterator __position)
     *__position = _Tp();
   }
   else {
-    const size_type __old_size = size();
-
-#ifdef STM32PLUS_BUILD
-    const size_type __len = __old_size != 0 ? stm32plus::Stm32VectorAllocAhead<_Tp>(__old_size) : 1;
-#else
-    const size_type __len = __old_size != 0 ? 2 * __old_size : 1;
-#endif
+    const size_type __len = _M_next_capacity(1);
     iterator __new_start = _M_allocate(__len);
     iterator __new_finish = __new_start;
     __STL_TRY {
-      __new_finish = uninitialized_copy(_M_start, __position, __new_start);
+      __new_finish = __uninitialized_move(_M_start, __position, __new_start);
       construct(__new_finish);
       ++__new_finish;
-      __new_finish = uninitialized_copy(__position, _M_finish, __new_finish);
+      __new_finish = __uninitialized_move(__position, _M_finish, __new_finish);
     }
     __STL_UNWIND((destroy(__new_start,__new_finish), 
                   _M_deallocate(__new_start,__len)));
@@ -702,6 +744,29 @@ vector<_Tp, _Alloc>::_M_insert_aux(iterator __position)
   }
 }
 
+template <class _Tp, class _Alloc> template <class... _Args>
+void 
+vector<_Tp, _Alloc>::_M_emplace_back_aux(_Args&&... __args)
+{
+  const size_type __old_size = size();
+  const size_type __len = _M_next_capacity(1);
+  iterator __new_start = _M_allocate(__len);
+  __STL_TRY {
+    _Construct_forward(__new_start + __old_size, __STD::forward<_Args>(__args)...);
+  }
+  __STL_UNWIND(_M_deallocate(__new_start,__len));
+  __STL_TRY {
+    __uninitialized_move(_M_start, _M_finish, __new_start);
+  }
+  __STL_UNWIND((destroy(__new_start + __old_size), 
+                _M_deallocate(__new_start,__len)));
+  destroy(begin(), end());
+  _M_deallocate(_M_start, _M_end_of_storage - _M_start);
+  _M_start = __new_start;
+  _M_finish = __new_start + __old_size + 1;
+  _M_end_of_storage = __new_start + __len;
+}
+
 template <class _Tp, class _Alloc>
 void vector<_Tp, _Alloc>::_M_fill_insert(iterator __position, size_type __n, 
                                          const _Tp& __x)
@@ -726,17 +791,23 @@ void vector<_Tp, _Alloc>::_M_fill_insert(iterator __position, size_type __n,
       }
     }
     else {
-      const size_type __old_size = size();        
-      const size_type __len = __old_size + max(__old_size, __n);
+      // fill the gap first as __x may refer to an element of this vector
+      const size_type __len = _M_next_capacity(__n);
+      const size_type __elems_before = __position - _M_start;
       iterator __new_start = _M_allocate(__len);
       iterator __new_finish = __new_start;
       __STL_TRY {
-        __new_finish = uninitialized_copy(_M_start, __position, __new_start);
-        __new_finish = uninitialized_fill_n(__new_finish, __n, __x);
+        uninitialized_fill_n(__new_start + __elems_before, __n, __x);
+      }
+      __STL_UNWIND(_M_deallocate(__new_start,__len));
+      __STL_TRY {
+        __new_finish = __uninitialized_move(_M_start, __position, __new_start);
+        __new_finish += __n;
         __new_finish
-          = uninitialized_copy(__position, _M_finish, __new_finish);
+          = __uninitialized_move(__position, _M_finish, __new_finish);
       }
-      __STL_UNWIND((destroy(__new_start,__new_finish), 
+      __STL_UNWIND((destroy(__new_start + __elems_before,
+                            __new_start + __elems_before + __n),
                     _M_deallocate(__new_start,__len)));
       destroy(_M_start, _M_finish);
       _M_deallocate(_M_start, _M_end_of_storage - _M_start);
@@ -792,15 +863,14 @@ vector<_Tp, _Alloc>::_M_range_insert(iterator __position,
       }
     }
     else {
-      const size_type __old_size = size();
-      const size_type __len = __old_size + max(__old_size, __n);
+      const size_type __len = _M_next_capacity(__n);
       iterator __new_start = _M_allocate(__len);
       iterator __new_finish = __new_start;
       __STL_TRY {
-        __new_finish = uninitialized_copy(_M_start, __position, __new_start);
+        __new_finish = __uninitialized_move(_M_start, __position, __new_start);
         __new_finish = uninitialized_copy(__first, __last, __new_finish);
         __new_finish
-          = uninitialized_copy(__position, _M_finish, __new_finish);
+          = __uninitialized_move(__position, _M_finish, __new_finish);
       }
       __STL_UNWIND((destroy(__new_start,__new_finish), 
                     _M_deallocate(__new_start,__len)));
@@ -842,15 +912,14 @@ vector<_Tp, _Alloc>::insert(iterator __position,
       }
     }
     else {
-      const size_type __old_size = size();
-      const size_type __len = __old_size + max(__old_size, __n);
+      const size_type __len = _M_next_capacity(__n);
       iterator __new_start = _M_allocate(__len);
       iterator __new_finish = __new_start;
       __STL_TRY {
-        __new_finish = uninitialized_copy(_M_start, __position, __new_start);
+        __new_finish = __uninitialized_move(_M_start, __position, __new_start);
         __new_finish = uninitialized_copy(__first, __last, __new_finish);
         __new_finish
-          = uninitialized_copy(__position, _M_finish, __new_finish);
+          = __uninitialized_move(__position, _M_finish, __new_finish);
       }
       __STL_UNWIND((destroy(__new_start,__new_finish),
                     _M_deallocate(__new_start,__len)));
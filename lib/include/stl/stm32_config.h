@@ -14,25 +14,36 @@
 
 namespace stm32plus {
 
-// default alloc-ahead for vectors. quoting from the SGI docs:
+// Growth policy for vectors and strings. Quoting from the SGI docs:
 //
 //   "It is crucial that the amount of growth is proportional to the current capacity(),
 //    rather than a fixed constant: in the former case inserting a series of elements
 //    into a vector is a linear time operation, and in the latter case it is quadratic."
 //
-// If this advice pertains to you, then uncomment the first line and comment out the second.
-// The default here on the stm32 is to assume that memory is scarce.
+// The default policy is geometric with a factor of 1.5, which keeps appends linear without
+// the 2x overshoot of the SGI default. The increment never drops below 20 elements so small
+// containers grow exactly as they always have done. If memory is so scarce that you'd rather
+// have quadratic appends than any overshoot then define STM32PLUS_STL_ADDITIVE_GROWTH in your
+// build to go back to a fixed increment of 20.
+//
+// Growth is calculated from the current capacity, so space put aside with reserve() is not
+// forgotten when the container next has to reallocate.
 
-//  template<typename T> size_t Stm32VectorAllocAhead(size_t oldSize_) { return 2*oldSize_; }
-  template<typename T> size_t Stm32VectorAllocAhead(size_t oldSize_) { return 20+oldSize_; }
-//  template<> size_t Stm32VectorAllocAhead<char>(size_t oldSize_) { return 20+oldSize_; }     // sample specialization for char
+#if defined(STM32PLUS_STL_ADDITIVE_GROWTH)
 
-// minimum buffer size allocated ahead by a deque
+  template<typename T> size_t Stm32VectorAllocAhead(size_t oldCapacity_) { return 20+oldCapacity_; }
+  template<typename T> size_t Stm32StringAllocAheadIncrement(size_t) { return 20; }
 
-  inline size_t Stm32DequeBufferSize() { return 20; }
+#else
 
-// alloc-ahead additional memory increment for strings. The default SGI implementation will add
-// the old size, doubling memory each time. We don't have memory to burn, so add 20 types each time
+  template<typename T> size_t Stm32VectorAllocAhead(size_t oldCapacity_) { return oldCapacity_+(oldCapacity_/2>20 ? oldCapacity_/2 : 20); }
+  template<typename T> size_t Stm32StringAllocAheadIncrement(size_t oldCapacity_) { return oldCapacity_/2>20 ? oldCapacity_/2 : 20; }
 
-  template<typename T> size_t Stm32StringAllocAheadIncrement(size_t) { return 20; }
+#endif
+
+//  template<> size_t Stm32VectorAllocAhead<char>(size_t oldCapacity_) { return 20+oldCapacity_; }     // sample specialization for char
+
+// minimum buffer size allocated ahead by a deque
+
+  inline size_t Stm32DequeBufferSize() { return 20; }
 }
@@ -38,6 +38,7 @@ namespace stm32plus {
 
       virtual bool write(uint8_t c) override;
       virtual bool write(const void *buffer,uint32_t size) override;
+      virtual bool writev(const IoVector *vectors,uint32_t count) override;
       virtual bool close() override;
       virtual bool flush() override;
   };
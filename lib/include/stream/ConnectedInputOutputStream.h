@@ -13,7 +13,8 @@ namespace stm32plus {
    * @brief Plumbing class to connect together an input and output stream.
    *
    * This class connects an input stream to an output stream. Data is read from the input
-   * stream and written to the output stream
+   * stream and written to the output stream. The read and the write don't overlap. See
+   * StreamPump for a double-buffered alternative.
    */
 
   class ConnectedInputOutputStream {
@@ -86,5 +86,18 @@ namespace stm32plus {
        */
 
       virtual bool reset()=0;
+
+      /**
+       * Read a sequence of bytes into a list of buffers. Each buffer is filled before moving
+       * on to the next. This default implementation calls read() for each buffer and stops
+       * after the first one that isn't filled completely.
+       *
+       * @param[in] vectors The buffers to read into.
+       * @param[in] count The number of buffers.
+       * @param[out] actuallyRead The total number of bytes read into all the buffers.
+       * @return false if the read fails.
+       */
+
+      virtual bool readv(const IoVector *vectors,uint32_t count,uint32_t& actuallyRead);
   };
 }
@@ -0,0 +1,36 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /**
+   * @brief One buffer in a scatter/gather list for InputStream::readv() and OutputStream::writev()
+   *
+   * The same structure is used for reading and writing. writev() never writes through the
+   * data pointer so it's safe to describe const data using the const constructor.
+   */
+
+  struct IoVector {
+
+    void *data;           ///< the buffer
+    uint32_t size;        ///< size of the buffer in bytes
+
+    IoVector() {}
+
+    IoVector(void *d,uint32_t s)
+      : data(d),
+        size(s) {
+    }
+
+    IoVector(const void *d,uint32_t s)
+      : data(const_cast<void *>(d)),
+        size(s) {
+    }
+  };
+}
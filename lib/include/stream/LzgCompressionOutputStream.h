@@ -0,0 +1,143 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * @brief Compress bytes to LZG format using a caller-supplied work area
+   *
+   * LzgCompressionOutputStream acts as a filter, taking uncompressed bytes written to it
+   * and writing them to an output stream that you supply in LZG-compressed format.
+   *
+   * An LZG header must contain the sizes and checksum of the data and the marker symbols
+   * that were chosen for it, so the data is collected into blocks. Each full block (or partial
+   * block when flush() or close() is called) is compressed and written out as a complete LZG
+   * stream. Each of them can be decompressed with LzgWindowDecompressionStream or with
+   * LZG_Decode() in liblzg. Where there's more than one, the decompressor reads exactly one
+   * block's worth from its input, so construct a new decompressor on the same input for
+   * the next block. A block that doesn't compress is stored.
+   *
+   * Matches are found using hash chains that are bounded by the block. The level from 1 to
+   * 9 sets how many candidates are examined at each position, trading speed for ratio in
+   * the same way as liblzg. Matches are limited to the window size so that the decompressor
+   * needs no more than that for its own window. The default of 2056 can be decompressed
+   * with LzgDecompressionStream.
+   *
+   * The work area must be getWorkAreaSize() bytes and 2-byte aligned. It holds the input
+   * block, the compressed block and the hash tables.
+   */
+
+  class LzgCompressionOutputStream : public OutputStream {
+
+    public:
+
+      /**
+       * Constants
+       */
+
+      enum {
+        HEADER_SIZE = 16,                   ///< the LZG header
+        MAX_BLOCK_SIZE = 65535,             ///< positions in the block are 16 bit
+        DEFAULT_WINDOW_SIZE = 2056,         ///< largest offset that LzgDecompressionStream can handle
+        DEFAULT_LEVEL = 5                   ///< compression level if you don't specify one
+      };
+
+    protected:
+      OutputStream& _output;
+
+      uint8_t *_input;                      // uncompressed block
+      uint8_t *_encoded;                    // compressed block (markers + data)
+      uint16_t *_chain;                     // previous position with the same hash, plus one
+      uint16_t *_head;                      // most recent position for each hash, plus one
+
+      uint32_t _blockSize;
+      uint32_t _blockUsed;
+      uint32_t _windowSize;
+      uint8_t _hashBits;
+      uint16_t _maxCandidates;
+      uint8_t _goodLength;
+
+      uint8_t _markers[4];
+      bool _isMarkerSymbolLUT[256];
+
+    protected:
+      bool writeBlock();
+      void chooseMarkers();
+      uint32_t encodeBlock();
+      uint32_t hash(const uint8_t *ptr) const;
+      void insert(uint32_t position);
+      uint32_t findMatch(uint32_t position,uint32_t symbolCost,uint32_t& offset) const;
+
+    public:
+      LzgCompressionOutputStream(OutputStream& output,
+                                 void *workArea,
+                                 uint32_t blockSize,
+                                 uint8_t hashBits,
+                                 uint32_t windowSize=DEFAULT_WINDOW_SIZE,
+                                 uint8_t level=DEFAULT_LEVEL);
+
+      virtual ~LzgCompressionOutputStream() {}
+
+      void setLevel(uint8_t level);
+
+      /**
+       * Get the size of the work area needed for the given parameters
+       * @param blockSize The block size, up to MAX_BLOCK_SIZE
+       * @param hashBits log2 of the number of hash chains
+       * @return The work area size in bytes
+       */
+
+      static constexpr uint32_t getWorkAreaSize(uint32_t blockSize,uint8_t hashBits) {
+        return blockSize*4+(2 << hashBits);
+      }
+
+      // overrides from OutputStream
+
+      virtual bool write(uint8_t c) override;
+      virtual bool write(const void *buffer,uint32_t size) override;
+      virtual bool flush() override;
+      virtual bool close() override;
+  };
+
+
+  /**
+   * @brief Compress bytes to LZG format using a work area that's a member of this class
+   *
+   * The RAM used is four times the block size plus two bytes per hash chain. The defaults
+   * need 18Kb. Make sure you can afford it if this is a local variable.
+   *
+   * @tparam TBlockSize The block size. Larger blocks cost RAM and give a better ratio.
+   * @tparam THashBits log2 of the number of hash chains.
+   */
+
+  template<uint32_t TBlockSize=4096,uint8_t THashBits=10>
+  class LzgInternalBufferCompressionOutputStream : public LzgCompressionOutputStream {
+
+    static_assert(TBlockSize>0 && TBlockSize<=MAX_BLOCK_SIZE,"The block size must be 1..65535");
+
+    protected:
+      uint32_t _workArea[(getWorkAreaSize(TBlockSize,THashBits)+3)/4];
+
+    public:
+
+      /**
+       * Constructor
+       * @param output Where to write the compressed data
+       * @param windowSize The largest match offset. The decompressor needs a window at least this big.
+       * @param level The compression level, 1 (fastest) to 9 (best)
+       */
+
+      LzgInternalBufferCompressionOutputStream(OutputStream& output,
+                                               uint32_t windowSize=DEFAULT_WINDOW_SIZE,
+                                               uint8_t level=DEFAULT_LEVEL)
+        : LzgCompressionOutputStream(output,_workArea,TBlockSize,THashBits,windowSize,level) {
+      }
+  };
+}
@@ -11,41 +11,94 @@ namespace stm32plus {
 
 
   /**
-   * @brief Decompress LZG-compressed bytes
+   * @brief Decompress LZG-compressed bytes using a caller-supplied history window
    *
-   * LzgDecompressionInputStream acts as a filter, taking LZG-compressed bytes from an
+   * LzgWindowDecompressionStream acts as a filter, taking LZG-compressed bytes from an
    * input stream that you supply and making them available as an uncompressed stream
    * through this class's own implementation of InputStream.
+   *
+   * Copies in the LZG stream refer back to previously decompressed data so the decoder keeps
+   * the most recent output in a circular window. The window must be at least as large as the
+   * window that the compressor used. Compression level 1 uses 2Kb and can be decoded with the
+   * 2056 byte window built in to LzgDecompressionStream. The higher levels use up to 512Kb and
+   * need a window that you supply, for example in external SRAM attached via FsmcSram.
+   * A copy that reaches further back than the window fails with E_UNSUPPORTED_COMPRESSED_DATA.
+   *
+   * Decoding is block oriented. Compressed data is read from the input stream in bulk,
+   * runs of literals are copied with memcpy and matches are copied in chunks where they don't
+   * overlap their own output. The checksum in the LZG header is verified when the last byte
+   * has been decompressed.
    */
 
-  class LzgDecompressionStream : public InputStream {
+  class LzgWindowDecompressionStream : public InputStream {
 
     public:
+
+      /**
+       * Error codes
+       */
+
+      enum {
+        E_UNSUPPORTED_COMPRESSED_DATA = 1,  ///< unknown method, or a copy too far back for the window
+        E_CORRUPT_DATA = 2,                 ///< the header or the compressed data is invalid
+        E_CHECKSUM_MISMATCH = 3             ///< the decompressed data failed the checksum
+      };
+
+      /**
+       * Constants
+       */
+
       enum {
-        E_UNSUPPORTED_COMPRESSED_DATA = 1
+        HEADER_SIZE = 16,                   ///< the LZG header
+        INPUT_BUFFER_SIZE = 64,             ///< bytes read from the input stream at a time
+        DEFAULT_WINDOW_SIZE = 2056          ///< enough for the medium copy and level 1 compression
       };
 
     protected:
+
+      enum {
+        METHOD_COPY = 0,
+        METHOD_LZG1 = 1
+      };
+
       InputStream& _input;
-      uint32_t _compressedSize;
 
-      uint32_t _compressedDataAvailable;
-      uint8_t _circbuf[2056];               // note the size of this - ensure you can afford it
-      uint8_t *_dst,*_dstEnd;
-      char _isMarkerSymbolLUT[256];
-      uint8_t _marker1,_marker2,_marker3,_marker4;
+      uint8_t *_window;
+      uint32_t _windowSize;
+      uint32_t _windowPosition;
+
+      uint32_t _decodedRemaining;           // bytes of output still to come
+      uint32_t _decodedSoFar;               // for validating copy offsets
+      uint32_t _encodedRemaining;           // bytes still to be read from _input
+      uint32_t _checksum;
+      uint16_t _checksumA,_checksumB;
+      uint8_t _method;
+
+      uint32_t _copyPosition;               // window index of an unfinished copy
+      uint32_t _copyRemaining;              // bytes left in the copy
 
-      uint8_t *_historyCopyPosition;
-      uint32_t _historyCopyDataAvailable;
+      uint8_t _inputBuffer[INPUT_BUFFER_SIZE];
+      uint8_t _inputPosition;
+      uint8_t _inputAvailable;
+
+      bool _isMarkerSymbolLUT[256];
+      uint8_t _marker1,_marker2,_marker3,_marker4;
 
     protected:
-      bool readNextUncompressedByte(uint8_t& nextByte);
-      bool nextByteFromStream(uint8_t& nextByte);
-      uint8_t getByteFromHistoryCopy();
+      bool fillInput(uint8_t required);
+      uint32_t decode(uint8_t *ptr,uint32_t size);
+      uint32_t decodeLiterals(uint8_t *ptr,uint32_t size);
+      uint32_t decodeCopy(uint8_t *ptr,uint32_t size);
+      bool decodeMarker(uint8_t *ptr,uint32_t& produced);
+      void addToWindow(const uint8_t *ptr,uint32_t size);
+      void addToChecksum(const uint8_t *ptr,uint32_t size);
+      bool fail(uint32_t errorCode);
 
     public:
-      LzgDecompressionStream(InputStream& input,uint32_t compressedSize);
-      virtual ~LzgDecompressionStream() {}
+      LzgWindowDecompressionStream(InputStream& input,uint32_t compressedSize,uint8_t *window,uint32_t windowSize);
+      virtual ~LzgWindowDecompressionStream() {}
+
+      uint32_t getDecompressedSize() const;
 
       // overrides from InputStream
 
@@ -56,4 +109,41 @@ namespace stm32plus {
       virtual bool available() override;
       virtual bool reset() override;
   };
+
+
+  /**
+   * @brief Decompress LZG-compressed bytes using a window that's a member of this class
+   *
+   * The window is in the same memory as the rest of the object, so if this is a local
+   * variable then the window is on the stack. Make sure you can afford it.
+   *
+   * @tparam TWindowSize The size of the history window
+   */
+
+  template<uint32_t TWindowSize>
+  class LzgInternalWindowDecompressionStream : public LzgWindowDecompressionStream {
+
+    protected:
+      uint8_t _internalWindow[TWindowSize];
+
+    public:
+
+      /**
+       * Constructor
+       * @param input The source of compressed bytes
+       * @param compressedSize the number of bytes of compressed data, including the header
+       */
+
+      LzgInternalWindowDecompressionStream(InputStream& input,uint32_t compressedSize)
+        : LzgWindowDecompressionStream(input,compressedSize,_internalWindow,TWindowSize) {
+      }
+  };
+
+
+  /**
+   * The original decompression stream with the 2056 byte window that'll handle LZG data
+   * compressed at level 1.
+   */
+
+  typedef LzgInternalWindowDecompressionStream<LzgWindowDecompressionStream::DEFAULT_WINDOW_SIZE> LzgDecompressionStream;
 }
@@ -20,6 +20,7 @@ namespace stm32plus {
 
     protected:
       OutputStream& opWrite(void *buffer,uint32_t bufferSize);
+      bool writevBuffered(const IoVector *vectors,uint32_t count,uint8_t *buffer,uint32_t bufferSize);
 
     public:
       virtual ~OutputStream() {}
@@ -58,5 +59,17 @@ namespace stm32plus {
        */
 
       virtual bool flush()=0;
+
+      /**
+       * Write a list of buffers to the stream as if they were one contiguous buffer. This
+       * default implementation calls write() for each buffer. Streams that do something
+       * expensive for each write() override it to emit the data in one operation.
+       *
+       * @param[in] vectors The buffers to write.
+       * @param[in] count The number of buffers.
+       * @return false if the write fails.
+       */
+
+      virtual bool writev(const IoVector *vectors,uint32_t count);
   };
 }
@@ -0,0 +1,369 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+
+  /**
+   * @brief Where a StreamPump gets its data from
+   *
+   * A read is started with beginRead() and then polled with pollRead() until it completes.
+   * A synchronous source does all the work in beginRead(). An asynchronous source such
+   * as a DMA channel starts the transfer and returns.
+   */
+
+  class StreamPumpSource {
+
+    public:
+      virtual ~StreamPumpSource() {}
+
+      /**
+       * Start reading into a buffer
+       * @param buffer Where to put the data
+       * @param size The maximum number of bytes to read
+       * @return false if it failed
+       */
+
+      virtual bool beginRead(void *buffer,uint32_t size)=0;
+
+      /**
+       * Check on the read started by beginRead()
+       * @param[out] complete true if the read has completed
+       * @param[out] actuallyRead When complete, the number of bytes read. Zero means the end of the input.
+       * @return false if it failed
+       */
+
+      virtual bool pollRead(bool& complete,uint32_t& actuallyRead)=0;
+  };
+
+
+  /**
+   * @brief Where a StreamPump sends its data to
+   *
+   * A write is started with beginWrite() and then polled with pollWrite() until it completes.
+   */
+
+  class StreamPumpSink {
+
+    public:
+      virtual ~StreamPumpSink() {}
+
+      /**
+       * Start writing a buffer. The buffer is not touched until the write is complete.
+       * @param buffer The data
+       * @param size The number of bytes
+       * @return false if it failed
+       */
+
+      virtual bool beginWrite(const void *buffer,uint32_t size)=0;
+
+      /**
+       * Check on the write started by beginWrite()
+       * @param[out] complete true if the write has completed
+       * @return false if it failed
+       */
+
+      virtual bool pollWrite(bool& complete)=0;
+  };
+
+
+  /**
+   * @brief Move data from a source to a sink through a ring of buffers
+   *
+   * ConnectedInputOutputStream reads and then writes through a single buffer so the two never
+   * overlap. StreamPump has two or more buffers. The source fills a free buffer while the sink
+   * drains one that was filled earlier. The pump doesn't block. Call poll() from your main loop
+   * or call run() to poll until the transfer is complete.
+   *
+   * Overlap needs at least one end to be asynchronous. For example, a file read through
+   * InputStreamPumpSource can take place while DmaPumpSink is sending the previous buffer out
+   * of a USART. If both ends are synchronous then the pump works like ConnectedInputOutputStream
+   * with bigger buffers.
+   *
+   * The buffers are supplied by the caller as one block of bufferCount*bufferSize bytes.
+   * Statistics are kept so you can see which end is holding up the transfer.
+   */
+
+  class StreamPump {
+
+    public:
+
+      /**
+       * Constants
+       */
+
+      enum {
+        MAX_BUFFERS = 8         ///< the most buffers that can be used
+      };
+
+    protected:
+      StreamPumpSource& _source;
+      StreamPumpSink& _sink;
+
+      uint8_t *_buffers;
+      uint32_t _bufferSize;
+      uint32_t _lengths[MAX_BUFFERS];
+      uint8_t _bufferCount;
+
+      uint8_t _readIndex;       // buffer being filled or the next one to fill
+      uint8_t _writeIndex;      // buffer being drained or the next one to drain
+      uint8_t _filled;          // buffers filled and not yet drained, including the one being drained
+
+      bool _reading;
+      bool _writing;
+      bool _endOfInput;
+      bool _sourceWaiting;
+      bool _sinkWaiting;
+
+      uint32_t _remaining;
+      uint32_t _bytesRead;
+      uint32_t _bytesWritten;
+      uint32_t _sourceStalls;
+      uint32_t _sinkStalls;
+      uint32_t _startTime;
+      uint32_t _endTime;
+
+    protected:
+      uint8_t *getBuffer(uint8_t index) const;
+      uint8_t nextIndex(uint8_t index) const;
+
+    public:
+      StreamPump(StreamPumpSource& source,StreamPumpSink& sink,void *buffers,uint32_t bufferSize,uint8_t bufferCount);
+
+      void reset(uint32_t limit=UINT32_MAX);
+
+      bool poll();
+      bool run();
+      bool isComplete() const;
+
+      uint32_t getBytesRead() const;
+      uint32_t getBytesWritten() const;
+      uint32_t getElapsedMillis() const;
+      uint32_t getBytesPerSecond() const;
+      uint32_t getSourceStalls() const;
+      uint32_t getSinkStalls() const;
+  };
+
+
+  /**
+   * @brief A StreamPumpSource that reads from an InputStream
+   *
+   * The read takes place synchronously in beginRead(). A read that returns no data is taken
+   * to be the end of the input.
+   */
+
+  class InputStreamPumpSource : public StreamPumpSource {
+
+    protected:
+      InputStream& _input;
+      uint32_t _actuallyRead;
+
+    public:
+
+      /**
+       * Constructor
+       * @param input The stream to read from
+       */
+
+      InputStreamPumpSource(InputStream& input)
+        : _input(input) {
+      }
+
+      virtual ~InputStreamPumpSource() {}
+
+      /**
+       * Read from the stream
+       * @param buffer Where to put the data
+       * @param size The maximum number of bytes to read
+       * @return false if the stream failed
+       */
+
+      virtual bool beginRead(void *buffer,uint32_t size) override {
+        return _input.read(buffer,size,_actuallyRead);
+      }
+
+      /**
+       * The read is always complete
+       * @param[out] complete Always true
+       * @param[out] actuallyRead The number of bytes read
+       * @return true
+       */
+
+      virtual bool pollRead(bool& complete,uint32_t& actuallyRead) override {
+        complete=true;
+        actuallyRead=_actuallyRead;
+        return true;
+      }
+  };
+
+
+  /**
+   * @brief A StreamPumpSink that writes to an OutputStream
+   *
+   * The write takes place synchronously in beginWrite().
+   */
+
+  class OutputStreamPumpSink : public StreamPumpSink {
+
+    protected:
+      OutputStream& _output;
+
+    public:
+
+      /**
+       * Constructor
+       * @param output The stream to write to
+       */
+
+      OutputStreamPumpSink(OutputStream& output)
+        : _output(output) {
+      }
+
+      virtual ~OutputStreamPumpSink() {}
+
+      /**
+       * Write to the stream
+       * @param buffer The data
+       * @param size The number of bytes
+       * @return false if the stream failed
+       */
+
+      virtual bool beginWrite(const void *buffer,uint32_t size) override {
+        return _output.write(buffer,size);
+      }
+
+      /**
+       * The write is always complete
+       * @param[out] complete Always true
+       * @return true
+       */
+
+      virtual bool pollWrite(bool& complete) override {
+        complete=true;
+        return true;
+      }
+  };
+
+
+  /**
+   * @brief A StreamPumpSource that reads using a DMA channel with a reader feature
+   *
+   * For example, a UsartDmaReaderFeature or SpiDmaReaderFeature channel. Every read fills
+   * the buffer so set a limit on the pump with StreamPump::reset().
+   *
+   * @tparam TDma The DMA channel class
+   */
+
+  template<class TDma>
+  class DmaPumpSource : public StreamPumpSource {
+
+    protected:
+      TDma& _dma;
+      uint32_t _size;
+
+    public:
+
+      /**
+       * Constructor
+       * @param dma The DMA channel
+       */
+
+      DmaPumpSource(TDma& dma)
+        : _dma(dma) {
+      }
+
+      virtual ~DmaPumpSource() {}
+
+      /**
+       * Start the DMA transfer
+       * @param buffer Where to put the data
+       * @param size The number of bytes to read
+       * @return true
+       */
+
+      virtual bool beginRead(void *buffer,uint32_t size) override {
+        _size=size;
+        _dma.beginRead(buffer,size);
+        return true;
+      }
+
+      /**
+       * Check the DMA channel for completion
+       * @param[out] complete true if the transfer is complete
+       * @param[out] actuallyRead The size of the transfer
+       * @return false if there was a DMA error
+       */
+
+      virtual bool pollRead(bool& complete,uint32_t& actuallyRead) override {
+
+        if(_dma.isError())
+          return false;
+
+        complete=_dma.isComplete();
+        actuallyRead=_size;
+        return true;
+      }
+  };
+
+
+  /**
+   * @brief A StreamPumpSink that writes using a DMA channel with a writer feature
+   *
+   * For example, a UsartDmaWriterFeature or SpiDmaWriterFeature channel.
+   *
+   * @tparam TDma The DMA channel class
+   */
+
+  template<class TDma>
+  class DmaPumpSink : public StreamPumpSink {
+
+    protected:
+      TDma& _dma;
+
+    public:
+
+      /**
+       * Constructor
+       * @param dma The DMA channel
+       */
+
+      DmaPumpSink(TDma& dma)
+        : _dma(dma) {
+      }
+
+      virtual ~DmaPumpSink() {}
+
+      /**
+       * Start the DMA transfer
+       * @param buffer The data
+       * @param size The number of bytes
+       * @return true
+       */
+
+      virtual bool beginWrite(const void *buffer,uint32_t size) override {
+        _dma.beginWrite(buffer,size);
+        return true;
+      }
+
+      /**
+       * Check the DMA channel for completion
+       * @param[out] complete true if the transfer is complete
+       * @return false if there was a DMA error
+       */
+
+      virtual bool pollWrite(bool& complete) override {
+
+        if(_dma.isError())
+          return false;
+
+        complete=_dma.isComplete();
+        return true;
+      }
+  };
+}
@@ -20,10 +20,25 @@ namespace stm32plus {
   class MillisecondTimer {
 
     public:
+
+      /**
+       * A function to be called from the SysTick interrupt. The caller owns the storage and it
+       * must stay in scope while it's added.
+       */
+
+      struct TickHook {
+        void (*function)(void *context);
+        void *context;
+        TickHook * volatile next;
+      };
+
       volatile static uint32_t _counter;
+      static TickHook * volatile _tickHooks;
 
     public:
       static void initialise();
+      static void addTickHook(TickHook& hook);
+      static void removeTickHook(TickHook& hook);
       static void __attribute__ ((weak)) delay(uint32_t millis_);
       static uint32_t millis();
       static void reset();
@@ -42,6 +57,46 @@ namespace stm32plus {
   }
 
 
+  /**
+   * Add a function to be called from the SysTick interrupt after the counter has been
+   * incremented. Any number of hooks can be added. The network stack uses one to drive its
+   * timers. Hooks are called with SysTick active so they must not wait on this timer. Not
+   * for IRQ code.
+   * @param hook The hook, with its function and context set
+   */
+
+  inline void MillisecondTimer::addTickHook(TickHook& hook) {
+
+    // the interrupt sees either the old list or the new one
+
+    hook.next=_tickHooks;
+    _tickHooks=&hook;
+  }
+
+
+  /**
+   * Remove a hook added with addTickHook(). It's fine to remove one that isn't there. Not
+   * for IRQ code.
+   * @param hook The hook to remove
+   */
+
+  inline void MillisecondTimer::removeTickHook(TickHook& hook) {
+
+    TickHook * volatile *link;
+
+    for(link=&_tickHooks;*link;link=&(*link)->next) {
+
+      if(*link==&hook) {
+
+        // a single store unlinks it. an interrupt that's already holding it can still follow its next pointer.
+
+        *link=hook.next;
+        return;
+      }
+    }
+  }
+
+
   /**
    * Reset the counter to zero
    */
@@ -56,6 +56,35 @@ namespace stm32plus {
    */
 
   bool BlockDeviceOutputStream::write(const void *buffer,uint32_t size) {
+    return copyIn(buffer,size,!_buffered);
+  }
+
+
+  /**
+   * Write a list of buffers. An unbuffered stream writes back the current block once
+   * at the end instead of once per buffer.
+   * @param vectors The buffers to write
+   * @param count The number of buffers
+   */
+
+  bool BlockDeviceOutputStream::writev(const IoVector *vectors,uint32_t count) {
+
+    uint32_t i;
+
+    for(i=0;i<count;i++)
+      if(!copyIn(vectors[i].data,vectors[i].size,false))
+        return false;
+
+    return _buffered || flush();
+  }
+
+
+  /*
+   * Copy data into the block buffer, writing back full blocks. If writeThrough is true then
+   * the current block is written back even if it's not full.
+   */
+
+  bool BlockDeviceOutputStream::copyIn(const void *buffer,uint32_t size,bool writeThrough) {
 
     uint32_t maxToWrite,toWrite;
     const uint8_t *ptr;
@@ -82,7 +111,7 @@ namespace stm32plus {
       _indexInBlock+=toWrite;
       size-=toWrite;
 
-      if(!checkFlush())
+      if(!checkFlush(writeThrough))
         return false;
     }
 
@@ -93,12 +122,13 @@ namespace stm32plus {
   /**
    * Check if the device must now be flushed given the user preference
    * and the current position of the write pointer
+   * @param writeThrough true to write back the block even if it's not full
    * @return false if the device fails
    */
 
-  bool BlockDeviceOutputStream::checkFlush() {
+  bool BlockDeviceOutputStream::checkFlush(bool writeThrough) {
 
-    if(!_buffered || _indexInBlock==_device.getBlockSizeInBytes()) {
+    if(writeThrough || _indexInBlock==_device.getBlockSizeInBytes()) {
 
       // user wants us to flush, or we've run out of space in the block
 
@@ -189,9 +189,13 @@ namespace stm32plus {
   }
 
   /*
-   * pass through to device
+   * pass through to device. Misses are read into the caller's buffer by the device.
    */
 
+  bool CachedBlockDevice::canTransferDirect(const void *buffer) {
+    return _device.canTransferDirect(buffer);
+  }
+
   BlockDevice::formatType CachedBlockDevice::getFormatType() {
     return _device.getFormatType();
   }
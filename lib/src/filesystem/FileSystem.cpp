@@ -118,6 +118,69 @@ namespace stm32plus {
     return _blockDevice.writeBlock(buffer,blockIndex);
   }
 
+  /**
+   * Read consecutive sectors from the file system. Where the block size is the sector size this
+   * is a single multi-block read from the device directly into the caller's buffer.
+   *
+   * @param[in] sectorIndex The first sector index on the file system to read.
+   * @param[in,out] buffer Caller supplied buffer large enough to hold sectorCount sectors.
+   * @param[in] sectorCount The number of sectors to read.
+   * @return false if it fails.
+   */
+
+  bool FileSystem::readSectors(uint32_t sectorIndex,void *buffer,uint32_t sectorCount) {
+
+    uint8_t *ptr;
+
+    if(_blockDevice.getBlockSizeInBytes() == getSectorSizeInBytes())
+      return _blockDevice.readBlocks(buffer,sectorIndexToBlockIndex(_firstSectorIndex + sectorIndex),sectorCount);
+
+    // sectors are smaller than blocks, fall back to one at a time
+
+    for(ptr=static_cast<uint8_t *> (buffer);sectorCount--;ptr+=getSectorSizeInBytes())
+      if(!readSector(sectorIndex++,ptr))
+        return false;
+
+    return true;
+  }
+
+  /**
+   * Write consecutive sectors to the file system as a single multi-block write.
+   *
+   * @param[in] sectorIndex The first sector index on the file system to write.
+   * @param[in] buffer Buffer that holds sectorCount sectors of data to write.
+   * @param[in] sectorCount The number of sectors to write.
+   * @return false if it fails.
+   */
+
+  bool FileSystem::writeSectors(uint32_t sectorIndex,const void *buffer,uint32_t sectorCount) {
+
+    errorProvider.clear();
+
+    // not supporting non-aligned block/sector sizes for now
+
+    if(_blockDevice.getBlockSizeInBytes() != getSectorSizeInBytes())
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_FILESYSTEM,E_UNEQUAL_BLOCK_SECTOR_SIZES);
+
+    return _blockDevice.writeBlocks(buffer,sectorIndexToBlockIndex(_firstSectorIndex + sectorIndex),sectorCount);
+  }
+
+  /**
+   * Check if readSectors() and writeSectors() can use a caller's buffer directly. The buffer
+   * must be word aligned, sectors must be whole blocks and the device must accept the buffer.
+   * Otherwise the caller should go a sector at a time through its own sector buffer.
+   *
+   * @param[in] buffer The caller's buffer.
+   * @return true if the buffer can be passed to readSectors() and writeSectors().
+   */
+
+  bool FileSystem::canTransferSectorsDirect(const void *buffer) {
+
+    return (reinterpret_cast<uintptr_t>(buffer) & 3)==0 &&
+           _blockDevice.getBlockSizeInBytes() == getSectorSizeInBytes() &&
+           _blockDevice.canTransferDirect(buffer);
+  }
+
   /*
    * Convert a sector index to a block index
    */
@@ -35,7 +35,7 @@ namespace stm32plus {
     bool FatFile::read(void *ptr_,uint32_t size_,uint32_t& actuallyRead_) {
 
       uint32_t sectorSize=_fs.getSectorSizeInBytes();
-      uint32_t fileLength,sectorOffset,copySize,available,remainingInFile;
+      uint32_t fileLength,sectorOffset,copySize,available,remainingInFile,sectorCount;
       uint8_t *current;
 
       fileLength=getLength();
@@ -66,20 +66,35 @@ namespace stm32plus {
         if(_offset % sectorSize == 0 && !_iterator.next())
           return false;
 
-        // read a sector
+        remainingInFile=fileLength - _offset;
 
-        if(!_iterator.readSector(_sectorBuffer))
-          return false;
+        if(sectorOffset == 0 && size_ >= sectorSize && remainingInFile >= sectorSize && _fs.canTransferSectorsDirect(current)) {
 
-        // calculate the copy size
+          // whole sectors go straight into the caller's buffer, as many as are left in this cluster
 
-        remainingInFile=fileLength - _offset;
-        available=remainingInFile < sectorSize - sectorOffset ? remainingInFile : sectorSize - sectorOffset;
-        copySize=size_ < available ? size_ : available;
+          sectorCount=std::min(std::min(size_,remainingInFile) / sectorSize,_iterator.getSectorsLeftInCluster());
+
+          if(!_iterator.readSectors(current,sectorCount))
+            return false;
+
+          copySize=sectorCount * sectorSize;
+        }
+        else {
+
+          // read a sector
+
+          if(!_iterator.readSector(_sectorBuffer))
+            return false;
+
+          // calculate the copy size
+
+          available=remainingInFile < sectorSize - sectorOffset ? remainingInFile : sectorSize - sectorOffset;
+          copySize=size_ < available ? size_ : available;
 
-        // copy out
+          // copy out
 
-        memcpy(current,_sectorBuffer + sectorOffset,copySize);
+          memcpy(current,_sectorBuffer + sectorOffset,copySize);
+        }
 
         size_-=copySize;
         current+=copySize;
@@ -106,7 +121,7 @@ namespace stm32plus {
       uint16_t d,t;
       const uint8_t *current=static_cast<const uint8_t *> (ptr_);
       DirectoryEntry& dirent=_dirent.Dirent;
-      uint32_t sectorOffset,amountToCopy,sectorSize=_fs.getSectorSizeInBytes();
+      uint32_t sectorOffset,amountToCopy,sectorCount,sectorSize=_fs.getSectorSizeInBytes();
 
       // need to get the file pointer on to a sector boundary
 
@@ -162,28 +177,42 @@ namespace stm32plus {
           dirent.sdir.DIR_FstClusHI=_iterator.getClusterNumber() >> 16;
         }
 
-        if(size_ < sectorSize && getLength() != _offset) {
+        if(size_ >= sectorSize && _fs.canTransferSectorsDirect(current)) {
 
-          // must be the last part to write, and we are not at the end of the file
-          // therefore we need to merge what's left to write with the existing content
+          // whole sectors go straight from the caller's buffer, as many as are left in this cluster
 
-          if(!_iterator.readSector(_sectorBuffer))
+          sectorCount=std::min(size_ / sectorSize,_iterator.getSectorsLeftInCluster());
+
+          if(!_iterator.writeSectors(current,sectorCount))
             return false;
 
-          amountToCopy=size_;
-        } else {
-          amountToCopy=sectorSize; // we will overwrite the whole sector...
+          amountToCopy=sectorCount * sectorSize;
+        }
+        else {
+
+          if(size_ < sectorSize && getLength() != _offset) {
+
+            // must be the last part to write, and we are not at the end of the file
+            // therefore we need to merge what's left to write with the existing content
+
+            if(!_iterator.readSector(_sectorBuffer))
+              return false;
 
-          if(amountToCopy > size_) // ...except when we don't have enough to do that
             amountToCopy=size_;
-        }
+          } else {
+            amountToCopy=sectorSize; // we will overwrite the whole sector...
 
-        memcpy(_sectorBuffer,current,amountToCopy);
+            if(amountToCopy > size_) // ...except when we don't have enough to do that
+              amountToCopy=size_;
+          }
 
-        // write the sector full of data
+          memcpy(_sectorBuffer,current,amountToCopy);
 
-        if(!_iterator.writeSector(_sectorBuffer))
-          return false;
+          // write the sector full of data
+
+          if(!_iterator.writeSector(_sectorBuffer))
+            return false;
+        }
 
         // update pointers
 
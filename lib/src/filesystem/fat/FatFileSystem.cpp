@@ -162,6 +162,32 @@ namespace stm32plus {
       return writeSector(sectorIndex,buffer);
     }
 
+    /**
+     * Read consecutive sectors from a cluster in a file.
+     * @param[in] clusterIndex The cluster index of the first sector.
+     * @param[in] sectorIndexInCluster The first sector index in the cluster, with zero being the first sector in the cluster.
+     * @param[in] buffer The buffer to receive the sector data. Must be large enough.
+     * @param[in] sectorCount The number of sectors. They must all be in this cluster.
+     * @return false if it fails.
+     */
+
+    bool FatFileSystem::readSectorsFromCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,void *buffer,uint32_t sectorCount) {
+      return readSectors(sectorIndexInCluster + clusterToSector(clusterIndex),buffer,sectorCount);
+    }
+
+    /**
+     * Write consecutive sectors to a cluster.
+     * @param[in] clusterIndex The cluster index of the first sector.
+     * @param[in] sectorIndexInCluster The first sector index in the cluster, with zero being the first sector in the cluster.
+     * @param[in] buffer The buffer that holds the sector data to write.
+     * @param[in] sectorCount The number of sectors. They must all be in this cluster.
+     * @return false if it fails.
+     */
+
+    bool FatFileSystem::writeSectorsToCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,const void *buffer,uint32_t sectorCount) {
+      return writeSectors(sectorIndexInCluster + clusterToSector(clusterIndex),buffer,sectorCount);
+    }
+
     /**
      * Read a fat entry for a cluster.
      * @param[in] clusterNumber The cluster number to read from.
@@ -91,6 +91,52 @@ namespace stm32plus {
     }
 
 
+  /**
+   * Read consecutive sectors starting at the current one. They must all be in the current
+   * cluster. The iterator is left on the last sector read.
+   * @param buffer_ A caller-supplied buffer that will receive the sector data.
+   * @param sectorCount_ The number of sectors, no more than getSectorsLeftInCluster().
+   * @return false if the read fails.
+   */
+
+    bool FileSectorIterator::readSectors(void *buffer_,uint32_t sectorCount_) {
+
+      if(!_fs.readSectorsFromCluster(_iterator.current(),_sectorIndexInCluster,buffer_,sectorCount_))
+        return false;
+
+      _sectorIndexInCluster+=sectorCount_-1;
+      return true;
+    }
+
+
+  /**
+   * Write consecutive sectors starting at the current one. They must all be in the current
+   * cluster. The iterator is left on the last sector written.
+   * @param buffer_ A caller supplied buffer that holds the sector data to write.
+   * @param sectorCount_ The number of sectors, no more than getSectorsLeftInCluster().
+   * @return false if the write fails.
+   */
+
+    bool FileSectorIterator::writeSectors(const void *buffer_,uint32_t sectorCount_) {
+
+      if(!_fs.writeSectorsToCluster(_iterator.current(),_sectorIndexInCluster,buffer_,sectorCount_))
+        return false;
+
+      _sectorIndexInCluster+=sectorCount_-1;
+      return true;
+    }
+
+
+  /**
+   * Get the number of sectors from the current one to the end of the current cluster.
+   * @return The sector count, including the current sector.
+   */
+
+    uint32_t FileSectorIterator::getSectorsLeftInCluster() const {
+      return _sectorsPerCluster-_sectorIndexInCluster;
+    }
+
+
   /**
    * Return the current sector number.
    * @return The number of the current sector (a linear sequence from the start of the device).
@@ -229,6 +229,36 @@ namespace stm32plus {
   }
 
 
+  /**
+   * Address the slave and see if it acknowledges. Nothing else is transferred. Devices
+   * such as serial EEPROMs do not acknowledge while they are busy with an internal write
+   * cycle so this can be used to find out when that's finished (acknowledge polling).
+   * @return true if the slave acknowledged. false if it did not or there was a bus timeout.
+   */
+
+  bool I2CMasterPollingFeature::isSlaveReady() const {
+
+    bool acknowledged;
+
+    // a zero length write in automatic end mode. the STOP follows the address phase
+    // whether it's acknowledged or not
+
+    I2C_TransferHandling(_i2c,_slaveAddress,0,I2C_AutoEnd_Mode,I2C_Generate_Start_Write);
+
+    // wait for STOPF
+
+    if(!checkEvent(I2C_ISR_STOPF))
+      return false;
+
+    acknowledged=I2C_GetFlagStatus(_i2c,I2C_ISR_NACKF)==0;
+
+    // clear STOPF and NACKF
+
+    I2C_ClearFlag(_i2c,I2C_ICR_STOPCF | I2C_ICR_NACKCF);
+    return acknowledged;
+  }
+
+
   /**
    * Check that an event has occurred, or timeout
    * @param eventId The event to check
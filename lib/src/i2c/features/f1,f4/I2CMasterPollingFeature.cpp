@@ -209,6 +209,57 @@ namespace stm32plus {
   }
 
 
+  /**
+   * Address the slave and see if it acknowledges. Nothing else is transferred. Devices
+   * such as serial EEPROMs do not acknowledge while they are busy with an internal write
+   * cycle so this can be used to find out when that's finished (acknowledge polling).
+   * @return true if the slave acknowledged. false if it did not or there was a bus timeout.
+   */
+
+  bool I2CMasterPollingFeature::isSlaveReady() const {
+
+    uint32_t timeoutStart;
+    uint16_t sr1;
+
+    // generate the start condition
+
+    I2C_GenerateSTART(_i2c,ENABLE);
+
+    // Test on I2C EV5 and clear it
+
+    if(!checkEvent(I2C_EVENT_MASTER_MODE_SELECT))
+      return false;
+
+    // send the slave address
+
+    I2C_Send7bitAddress(_i2c,_slaveAddress,I2C_Direction_Transmitter);
+
+    // wait for the address to be acknowledged (ADDR) or not (AF)
+
+    timeoutStart=MillisecondTimer::millis();
+
+    while(((sr1=I2C_ReadRegister(_i2c,I2C_Register_SR1)) & (I2C_SR1_ADDR | I2C_SR1_AF))==0) {
+
+      if(MillisecondTimer::millis()-timeoutStart>_timeout) {
+        I2C_GenerateSTOP(_i2c,ENABLE);
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_I2C,I2C::E_I2C_TIMEOUT);
+      }
+    }
+
+    // reading SR2 after SR1 clears ADDR. AF has to be cleared by hand.
+
+    I2C_ReadRegister(_i2c,I2C_Register_SR2);
+    I2C_GenerateSTOP(_i2c,ENABLE);
+
+    if(sr1 & I2C_SR1_AF) {
+      I2C_ClearFlag(_i2c,I2C_FLAG_AF);
+      return false;
+    }
+
+    return true;
+  }
+
+
   /**
    * Check that an event has occurred, or timeout
    * @param eventId The event to check
@@ -18,122 +18,283 @@ namespace stm32plus {
 
     /**
      * Initialise the cache
-     * @param cacheSize The maximum entries in the cache
+     * @param cacheSize The maximum entries in the cache, up to 32768
      * @param rtc pointer to the RTC
      * @return true if it worked
      */
 
     bool DnsCache::initialise(uint32_t cacheSize,RtcBase *rtc) {
 
-      uint32_t i;
+      uint32_t i,indexSize;
+
+      if(cacheSize>32768)
+        cacheSize=32768;
 
       _maxEntries=cacheSize;
       _rtc=rtc;
 
-      // allocate the entries
+      // the index is the next power of 2 that's at least double the number of entries
+
+      for(indexSize=2;indexSize<cacheSize*2;indexSize<<=1);
+
+      _indexMask=indexSize-1;
+
+      // allocate the entries and the index
 
       _entries.reset(new Entry[cacheSize]);
-      if(_entries.get()==nullptr)
+      _index.reset(new uint16_t[indexSize]);
+
+      if(_entries.get()==nullptr || _index.get()==nullptr)
         return false;
 
-      // mark all as unused
+      for(i=0;i<indexSize;i++)
+        _index[i]=NO_ENTRY;
+
+      // all entries start on the free list
 
       for(i=0;i<_maxEntries;i++)
-        _entries[i].expiryTicks=NO_ENTRY;
+        _entries[i].next=i+1;
+
+      if(_maxEntries) {
+        _entries[_maxEntries-1].next=NO_ENTRY;
+        _free=0;
+      }
+      else
+        _free=NO_ENTRY;
+      _first=_last=NO_ENTRY;
 
       return true;
     }
 
 
     /**
-     * Add a new entry to the cache. An exact match updates the expiry time. Otherwise
-     * unused entries are preferred. If no unused entry is found then the entry that's
-     * closest to its expiry time is evicted.
+     * Add a new entry to the cache. An exact match updates the address and expiry time.
+     * Otherwise an unused entry is taken. If there isn't one then the least recently used
+     * entry is evicted.
      * @param hostname The host to add
-     * @param address The corresponding address
+     * @param address The corresponding address. Invalid for a name that doesn't exist.
      * @param ttl Number of seconds that this address is valid for
      */
 
     void DnsCache::add(const char *hostname,const IpAddress& address,uint32_t ttl) {
 
-      uint32_t i,unused,closest,closestTicks,now;
-      uint16_t hostlen;
+      uint32_t hash,pos;
+      uint16_t i,hostlen;
       Entry *ptr;
 
-      unused=closest=NO_ENTRY;
-      closestTicks=UINT32_MAX;
-      now=_rtc->getTick();
-      ptr=_entries.get();
+      if(_maxEntries==0)
+        return;
+
+      hash=hashHostname(hostname);
+      pos=findPosition(hostname,hash);
+
+      if((i=_index[pos])!=NO_ENTRY)
+        unlink(i);
+      else {
 
-      for(i=0;i<_maxEntries;i++,ptr++) {
+        // a new entry is needed. evict the LRU if there are none free.
 
-        if(unused==NO_ENTRY && _entries[i].expiryTicks==NO_ENTRY)
-          unused=i;
-        else if(!strcasecmp(hostname,ptr->_hostname.get())) {
+        if(_free==NO_ENTRY)
+          remove(_last);
 
-          // found an exact match, update host and expiry and return
+        i=_free;
+        ptr=&_entries[i];
 
-          ptr->address=address;
-          ptr->expiryTicks=ttl+now;
+        hostlen=strlen(hostname);
+        ptr->_hostname.reset(new char[hostlen+1]);
 
+        if(ptr->_hostname.get()==nullptr)
           return;
-        }
-        else {
 
-          if(ptr->expiryTicks<now) {
+        strcpy(ptr->_hostname.get(),hostname);
+        ptr->hash=hash;
 
-            // this entry has expired, remove it
+        _free=ptr->next;
 
-            ptr->expiryTicks=NO_ENTRY;
-            ptr->_hostname.reset();
-          }
-          else if(ptr->expiryTicks-now<closestTicks) {
-            closest=i;
-            closestTicks=ptr->expiryTicks-now;
-          }
-        }
+        // the eviction may have moved things in the index so look again for the empty slot
+
+        _index[findPosition(hostname,hash)]=i;
       }
 
-      // if we have an unused entry then use it, otherwise evict.
+      // set up the entry
 
-      if(unused!=NO_ENTRY)
-        i=unused;
-      else
-        i=closest;
+      ptr=&_entries[i];
+      ptr->expiryTicks=ttl+_rtc->getTick();
+      ptr->address=address;
 
-      // set up the entry
+      insertFront(i);
+    }
+
+
+    /**
+     * Add a negative entry that says the hostname doesn't exist
+     * @param hostname The host that doesn't exist
+     * @param ttl Number of seconds to remember that it doesn't exist
+     */
 
-      hostlen=strlen(hostname);
-      _entries[i]._hostname.reset(new char[hostlen+1]);
-      strcpy(_entries[i]._hostname.get(),hostname);
-      _entries[i].expiryTicks=ttl+now;
-      _entries[i].address=address;
+    void DnsCache::addNegative(const char *hostname,uint32_t ttl) {
+      add(hostname,IpAddress(),ttl);
     }
 
 
     /**
-     * Lookup an entry in the cache
-     * @param hostname
-     * @param address
-     * @return
+     * Lookup an entry in the cache. A negative entry is found with an invalid address.
+     * @param hostname The host to look up
+     * @param[out] address The address of the host, or an invalid address if the host is known
+     *   not to exist
+     * @return true if the host is in the cache
      */
 
     bool DnsCache::lookup(const char *hostname,IpAddress& address) {
 
-      uint32_t i;
+      uint16_t i;
+
+      if(_maxEntries==0 || (i=_index[findPosition(hostname,hashHostname(hostname))])==NO_ENTRY)
+        return false;
+
+      // expired entries are removed when they're found
+
+      if(_entries[i].expiryTicks<=_rtc->getTick()) {
+        remove(i);
+        return false;
+      }
+
+      // it's now the most recently used
+
+      unlink(i);
+      insertFront(i);
+
+      address=_entries[i].address;
+      return true;
+    }
+
+
+    /*
+     * Hash a hostname ignoring case (FNV-1a)
+     */
+
+    uint32_t DnsCache::hashHostname(const char *hostname) {
+
+      uint32_t hash;
+      uint8_t c;
+
+      hash=2166136261U;
+
+      while((c=*hostname++)!='\0') {
+
+        if(c>='A' && c<='Z')
+          c+='a'-'A';
+
+        hash=(hash ^ c)*16777619U;
+      }
+
+      return hash;
+    }
+
+
+    /*
+     * Find the index slot that holds a hostname or the empty slot where it would go. The
+     * index is never more than half full so there is always an empty slot.
+     */
+
+    uint32_t DnsCache::findPosition(const char *hostname,uint32_t hash) const {
+
+      uint32_t pos;
+      uint16_t i;
+
+      for(pos=hash & _indexMask;(i=_index[pos])!=NO_ENTRY;pos=(pos+1) & _indexMask)
+        if(_entries[i].hash==hash && !strcasecmp(hostname,_entries[i]._hostname.get()))
+          break;
+
+      return pos;
+    }
+
+
+    /*
+     * Remove an entry. Linear probing can't just empty the index slot because that would break
+     * the probe sequence of later entries, so each later entry in the run that can go into the
+     * hole is moved back. The entry goes on to the free list.
+     */
+
+    void DnsCache::remove(uint16_t index) {
+
+      uint32_t pos,next,home;
       Entry *ptr;
-      uint32_t now;
 
-      now=_rtc->getTick();
+      ptr=&_entries[index];
+      pos=findPosition(ptr->_hostname.get(),ptr->hash);
+      next=pos;
+
+      for(;;) {
+
+        next=(next+1) & _indexMask;
+
+        if(_index[next]==NO_ENTRY)
+          break;
 
-      for(ptr=_entries.get(),i=0;i<_maxEntries;i++,ptr++) {
-        if(ptr->expiryTicks!=NO_ENTRY && ptr->expiryTicks>now && !strcasecmp(hostname,ptr->_hostname.get())) {
-          address=ptr->address;
-          return true;
+        // the entry at next can fill the hole if its home slot is not cyclically in (pos,next]
+
+        home=_entries[_index[next]].hash & _indexMask;
+
+        if(((next-home) & _indexMask)>=((next-pos) & _indexMask)) {
+          _index[pos]=_index[next];
+          pos=next;
         }
       }
 
-      return false;
+      _index[pos]=NO_ENTRY;
+
+      unlink(index);
+      ptr->_hostname.reset();
+
+      ptr->next=_free;
+      _free=index;
+    }
+
+
+    /*
+     * Unlink an entry from the LRU list
+     */
+
+    void DnsCache::unlink(uint16_t index) {
+
+      Entry *ptr;
+
+      ptr=&_entries[index];
+
+      if(_first==index)
+        _first=ptr->next;
+
+      if(_last==index)
+        _last=ptr->previous;
+
+      if(ptr->previous!=NO_ENTRY)
+        _entries[ptr->previous].next=ptr->next;
+
+      if(ptr->next!=NO_ENTRY)
+        _entries[ptr->next].previous=ptr->previous;
+
+      ptr->next=NO_ENTRY;
+      ptr->previous=NO_ENTRY;
+    }
+
+
+    /*
+     * Link an entry into the front of the LRU list
+     */
+
+    void DnsCache::insertFront(uint16_t index) {
+
+      if(_first!=NO_ENTRY)
+        _entries[_first].previous=index;
+
+      _entries[index].previous=NO_ENTRY;
+      _entries[index].next=_first;
+
+      if(_last==NO_ENTRY)
+        _last=index;
+
+      _first=index;
     }
   }
 }
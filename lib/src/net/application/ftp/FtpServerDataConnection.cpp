@@ -19,9 +19,9 @@ namespace stm32plus {
 
     /**
      * Constructor. As this is the data connection and most activity is likely to be downloading
-     * we will boost the output streams buffer size to 2*MTU so that the delayed ACK avoidance
-     * algorithm that sends size/2 bytes-per send will result in MTU bytes being sent per segment.
-     * Typically this will result in a buffer size of 1460*2 = 2920 bytes per data connection.
+     * we will boost the output streams buffer size. The default of 4096 bytes is a whole number
+     * of sectors so that file reads start and end on sector boundaries and go straight from the
+     * card into the buffer, and it's big enough for several full sized segments per send.
      * @param params The TCP parameters
      * @param serverbase The command connection that we belong to
      */
@@ -31,19 +31,48 @@ namespace stm32plus {
         _commandConnection(serverbase),
         _outputStreams(*this,serverbase->getDataConnectionSendBufferSize()),
         _direction(Direction::NOT_STARTED),
+        _uploadBufferSize(0),
+        _uploadBufferUsed(0),
+        _bytesTransferred(0),
+        _startTime(0),
+        _lastActiveTime(0),
         _state(State::NOT_STARTED) {
     }
 
 
     /**
-     * Destructor
+     * Destructor. If an upload is cut short then the data that's staged is still written
+     * so that the file holds everything that arrived.
      */
 
     FtpServerDataConnection::~FtpServerDataConnection() {
+
+      if(_uploadBufferUsed)
+        writeUploadBuffer();
+
       _commandConnection->clearDataConnection();
     }
 
 
+    /**
+     * Set a new upload stream and create the staging buffer for it. The buffer size comes from
+     * the command connection parameters and is rounded down to a whole number of sectors.
+     * @param stream The upload stream
+     */
+
+    void FtpServerDataConnection::setUploadStream(OutputStream *stream) {
+
+      _uploadStream.reset(stream);
+
+      _uploadBufferSize=_commandConnection->getUploadBufferSize() & ~(SECTOR_SIZE-1);
+      if(_uploadBufferSize<SECTOR_SIZE)
+        _uploadBufferSize=SECTOR_SIZE;
+
+      _uploadBuffer.reset(new uint8_t[_uploadBufferSize]);
+      _uploadBufferUsed=0;
+    }
+
+
     /**
      * Handle the possibility of a write
      * @return true if there were no errors
@@ -65,8 +94,10 @@ namespace stm32plus {
         if(!_outputStreams.writeDataToConnection(actuallySent))
           return false;
 
-        if(actuallySent)
+        if(actuallySent) {
+          countTransferred(actuallySent);
           _commandConnection->updateLastActiveTime();
+        }
       }
 
       return true;
@@ -74,43 +105,67 @@ namespace stm32plus {
 
 
     /**
-     * Handle the possibility of a read. Read out the received data in chunks until
-     * we've got it all. A chunk size is 512b which matches the SD card sector size
-     * though it's likely we'll fragment somewhere during the transfer and end up straddling
-     * sectors.
+     * Handle the possibility of a read. Received data is gathered in the upload buffer and
+     * only written to the stream when the buffer is full. Segments arrive in whatever sizes
+     * the client chooses, but the file only ever sees writes that are a whole number of
+     * sectors long, starting on a sector boundary. The file system can send those straight
+     * to the card without reading back partly filled sectors. The part-filled buffer at the
+     * end is written when the client closes its end.
      * @return true if there were no errors (being closed is not an error)
      */
 
     bool FtpServerDataConnection::handleRead() {
 
       uint32_t actuallyRead,totalRead;
-      uint8_t transferBuffer[UPLOAD_TRANSFER_BUFFER_SIZE];      // default is 512 bytes
 
       // transfer out all data
 
       totalRead=0;
       while(getDataAvailable()>0) {
 
-        // receive any data available
+        // receive as much as fits in the buffer
 
-        if(!receive(transferBuffer,UPLOAD_TRANSFER_BUFFER_SIZE,actuallyRead))
+        if(!receive(&_uploadBuffer[_uploadBufferUsed],_uploadBufferSize-_uploadBufferUsed,actuallyRead))
           return false;
 
-        // write back to the stream
+        _uploadBufferUsed+=actuallyRead;
+        totalRead+=actuallyRead;
 
-        if(actuallyRead>0 && !_uploadStream->write(transferBuffer,actuallyRead))
-          return false;
+        // write it out when it's full
 
-        totalRead+=actuallyRead;
+        if(_uploadBufferUsed==_uploadBufferSize && !writeUploadBuffer())
+          return false;
       }
 
-      if(totalRead)
+      // nothing else is coming if the remote end has closed
+
+      if(_uploadBufferUsed && isRemoteEndClosed() && !writeUploadBuffer())
+        return false;
+
+      if(totalRead) {
+        countTransferred(totalRead);
         _commandConnection->updateLastActiveTime();
+      }
 
       return true;
     }
 
 
+    /*
+     * Write the staged upload data to the stream and empty the buffer
+     */
+
+    bool FtpServerDataConnection::writeUploadBuffer() {
+
+      uint32_t size;
+
+      size=_uploadBufferUsed;
+      _uploadBufferUsed=0;
+
+      return _uploadStream->write(_uploadBuffer.get(),size);
+    }
+
+
     /**
      * Flush all pending data when reading
      * @return true if it worked
@@ -143,7 +198,7 @@ namespace stm32plus {
       if(_direction==Direction::DOWNLOAD)
         return _state==State::RUNNING && _outputStreams.completed();
       else if(_direction==Direction::UPLOAD)
-        return getDataAvailable()==0 && isRemoteEndClosed();
+        return getDataAvailable()==0 && _uploadBufferUsed==0 && isRemoteEndClosed();
       else
         return false;
     }
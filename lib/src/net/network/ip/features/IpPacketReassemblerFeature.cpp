@@ -16,57 +16,68 @@ namespace stm32plus {
 
 
     /**
-     * Initialise the class
+     * Initialise the class. The arena, the slots and the hash table are all allocated here.
      * @param params The IP parameters class that holds the limits
      * @param utilityObjects The network utilities
-     * @return true;
+     * @return true if it worked
      */
 
     bool IpPacketReassemblerFeature::initialise(const Parameters& params,NetworkUtilityObjects& utilityObjects) {
 
+      uint16_t i,bucketCount;
+      uint32_t slotSize;
+      uint8_t bucketShift;
+
       // save variables
 
       _params=params;
-      _totalFragmentSize=0;
-      _inFlightPacketCount=0;
       _utilityObjects=&utilityObjects;
+      memset(&_statistics,0,sizeof(_statistics));
 
-      // subscribe to ticks for the expiry
+      _slotCount=params.ip_maxInProgressFragmentedPackets<NO_SLOT ? params.ip_maxInProgressFragmentedPackets : NO_SLOT-1;
 
-      utilityObjects.subscribeIntervalTicks(
-          _params.ip_fragmentExpiryIntervalCheckSeconds,
-          NetworkIntervalTicker::TickIntervalSlotType::bind(this,&IpPacketReassemblerFeature::expireOldEntries)
-        );
+      // each slot is a multiple of 8 bytes with room on the end for the hole descriptor that
+      // follows the highest fragment received so far. that's more than 16 bits for the largest
+      // packet lengths.
 
-      return true;
-    }
+      slotSize=((static_cast<uint32_t>(params.ip_maxPacketLength)+7) & ~7)+8;
 
+      // the number of buckets is the next power of 2 that's at least double the number of slots
 
-    /**
-     * Startup (does nothing)
-     */
+      for(bucketCount=2,bucketShift=31;bucketCount<_slotCount*2;bucketCount<<=1,bucketShift--);
 
-    bool IpPacketReassemblerFeature::startup() {
-      return true;
-    }
+      _slots.reset(new IpFragmentedPacket[_slotCount]);
+      _buckets.reset(new uint8_t[bucketCount]);
+      _arena.reset(new uint8_t[static_cast<uint32_t>(_slotCount)*slotSize]);
 
+      if(_slots.get()==nullptr || _buckets.get()==nullptr || _arena.get()==nullptr)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_OUT_OF_MEMORY);
 
-    /**
-     * Destructor, free all
-     */
+      memset(_buckets.get(),NO_SLOT,bucketCount);
 
-    IpPacketReassemblerFeature::~IpPacketReassemblerFeature() {
+      _bucketMask=bucketCount-1;
+      _bucketShift=bucketShift;
 
-      // ensure we cannot be interrupted here
+      // give each slot its buffer and expiry timer and put them all on the free list
 
-      IrqSuspend suspender;
+      for(i=0;i<_slotCount;i++) {
+        _slots[i].packet=&_arena[i*slotSize];
+        _slots[i].inUse=false;
+        _slots[i].next=i+1<_slotCount ? i+1 : NO_SLOT;
+        _slots[i].expiryTimer.callback=NetworkTimer::CallbackType::bind(this,&IpPacketReassemblerFeature::onExpiryTimer);
+      }
 
-      // clear the list
+      _free=_slotCount ? 0 : NO_SLOT;
+      return true;
+    }
 
-      while(!_frags.empty()) {
-        delete _frags.front();
-        _frags.pop_front();
-      }
+
+    /**
+     * Startup (does nothing)
+     */
+
+    bool IpPacketReassemblerFeature::startup() {
+      return true;
     }
 
 
@@ -92,7 +103,8 @@ namespace stm32plus {
 
     bool IpPacketReassemblerFeature::internalHandleFragment(const IpPacket& packet,IpFragmentedPacket*& fp) {
 
-      uint16_t offset,extendedLength,extra;
+      uint16_t offset;
+      uint32_t extendedLength;
       IpFragmentedPacket::PacketId pid;
 
       // get the packet identifier. the combination of id, source address,
@@ -109,55 +121,31 @@ namespace stm32plus {
         if(!createNewFragment(pid,fp))
           return false;
 
-      // update the expiry time
-
-      fp->expiryTime=_utilityObjects->getRtc().getTick()+_params.ip_fragmentExpirySeconds;
-
-      // get the fragment offset
+      // get the fragment offset. the extended length is 32 bits so that a large offset
+      // cannot wrap around.
 
       offset=packet.getFragmentOffset();
-      extendedLength=offset+packet.payloadLength;
-
-      // if the memory buffer holding the packet being assembled is too small
-      // then increase it
-
-      if(extendedLength>fp->packetLength) {
+      extendedLength=static_cast<uint32_t>(offset)+packet.payloadLength;
 
-        // can we handle it based on the max packet length restriction
+      // can we handle it based on the max packet length restriction
 
-        if(extendedLength>_params.ip_maxPacketLength) {
-          ip_freePacket(fp);
-          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_PACKET_TOO_BIG);
-        }
-
-        // can we handle it based on the overal memory usage cap
-
-        if(_totalFragmentSize-fp->packetLength+extendedLength>_params.ip_maxFragmentedPacketMemoryUsage) {
-          ip_freePacket(fp);
-          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_MEMORY_LIMIT_EXCEEDED);
-        }
-
-        // if this is not the last fragment then we allocate an extra 8 bytes on the end for
-        // the hole descriptor that will inevitably be required to describe the packet fragment
-        // that must eventually land there.
-
-        extra=packet.isLastFragment() ? 0 : 8;
-
-        // increase the size of the fragment
-
-        if((fp->packet=reinterpret_cast<uint8_t *>(realloc(fp->packet,extendedLength+extra)))==nullptr) {
-          ip_freePacket(fp);
-          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_OUT_OF_MEMORY);
-        }
-
-        // update the new total size (take off the old known size and add back on the new known size)
+      if(extendedLength>_params.ip_maxPacketLength) {
+        _statistics.tooBig++;
+        releaseSlot(fp);
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_PACKET_TOO_BIG);
+      }
 
-        _totalFragmentSize=_totalFragmentSize-fp->packetLength+extendedLength;
+      // every fragment but the last must be a multiple of 8 bytes (RFC791). the hole descriptors
+      // rely on this to stay clear of the data.
 
-        // set the new fragment length
+      if(packet.hasMoreFragments() && (packet.payloadLength & 7)!=0) {
+        _statistics.malformed++;
+        releaseSlot(fp);
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_MALFORMED_FRAGMENT);
+      }
 
+      if(extendedLength>fp->packetLength)
         fp->packetLength=extendedLength;
-      }
 
       // deal with the hole list
 
@@ -167,43 +155,51 @@ namespace stm32plus {
       // to indicate that the fragment is complete
 
       memcpy(&fp->packet[offset],packet.payload,packet.payloadLength);
+
+      // a complete packet belongs to the caller until it's freed so it must not expire.
+      // otherwise the clock starts again from this fragment.
+
+      if(fp->isComplete()) {
+        _statistics.packetsReassembled++;
+        _utilityObjects->cancelTimer(fp->expiryTimer);
+      }
+      else
+        _utilityObjects->armTimer(fp->expiryTimer,static_cast<uint32_t>(_params.ip_fragmentExpirySeconds)*1000);
+
       return true;
     }
 
 
     /**
-     * Expire old entries that have timed out. Always called on the RTC tick IRQ handler. Never
-     * call this on non-IRQ code because the critical section won't work.
-     * @param nitd Network interval data
+     * The expiry timer of a partly assembled packet has fired. Drop the packet. This is IRQ code.
+     * @param timer The timer, which is a member of one of the slots
      */
 
-    void IpPacketReassemblerFeature::expireOldEntries(NetworkIntervalTickData& nitd) {
+    void IpPacketReassemblerFeature::onExpiryTimer(NetworkTimer& timer) {
+
+      uint8_t i;
 
       // ensure any higher priority IRQs can't come along and pre-empt us
 
       IrqSuspend suspender;
 
-      // check each entry and delete if expired
+      for(i=0;i<_slotCount;i++) {
 
-      for(auto it=_frags.begin();it!=_frags.end();) {
+        if(&_slots[i].expiryTimer==&timer) {
 
-        if(nitd.timeNow>(*it)->expiryTime) {
+          if(_slots[i].inUse && !_slots[i].expiryTimer.isArmed()) {
+            _statistics.expired++;
+            releaseSlot(&_slots[i]);
+          }
 
-          _totalFragmentSize-=(*it)->packetLength;
-          _inFlightPacketCount--;
-
-          delete *it;
-          it=_frags.erase(it);
+          return;
         }
-        else
-          it++;
       }
     }
 
 
     /**
-     * Free a packet and take it out of the linked list and update
-     * all statuses
+     * Free a packet and give its slot back to the arena
      * @param fp The packet to free
      */
 
@@ -212,72 +208,110 @@ namespace stm32plus {
       // ensure we cannot be interrupted
 
       IrqSuspend suspender;
+      releaseSlot(packetToFree);
+    }
 
-      // find and free the packet
 
-      for(auto it=_frags.begin();it!=_frags.end();it++) {
-        if(*it==packetToFree) {
-          _frags.erase(it);
-          break;
-        }
-      }
+    /**
+     * Get the counters of reassembled and dropped packets
+     * @return A reference to the counters
+     */
+
+    const IpPacketReassemblerFeature::Statistics& IpPacketReassemblerFeature::getStatistics() const {
+      return _statistics;
+    }
+
 
-      // free the data, update counts
+    /*
+     * Take a slot out of its hash chain and put it on the free list. Must be called with
+     * interrupts suspended.
+     */
+
+    void IpPacketReassemblerFeature::releaseSlot(IpFragmentedPacket *fp) {
+
+      uint8_t index,*link;
+
+      if(!fp->inUse)
+        return;
 
-      _totalFragmentSize-=packetToFree->packetLength;
-      _inFlightPacketCount--;
+      index=fp-_slots.get();
 
-      // free packet structure
+      // find the link that points to this slot and bypass it
 
-      delete packetToFree;
+      for(link=&_buckets[hash(fp->identifier)];*link!=index;link=&_slots[*link].next);
+      *link=fp->next;
+
+      _utilityObjects->cancelTimer(fp->expiryTimer);
+
+      fp->inUse=false;
+      fp->next=_free;
+      _free=index;
     }
 
 
     /**
-     * Find a fragmented packet in the list of in-progress fragments
+     * Find a fragmented packet in the hash table of in-progress fragments
      * @param pid the id of the packet to find
      * @return the fragments so far or nullptr
      */
 
     IpFragmentedPacket *IpPacketReassemblerFeature::findFragment(const IpFragmentedPacket::PacketId& pid) const {
 
-      for(auto it=_frags.begin();it!=_frags.end();it++)
-        if((*it)->identifier==pid)
-          return *it;
+      uint8_t index;
+
+      for(index=_buckets[hash(pid)];index!=NO_SLOT;index=_slots[index].next)
+        if(_slots[index].identifier==pid)
+          return &_slots[index];
 
       return nullptr;
     }
 
 
     /**
-     * Create a new fragment, add to the list and return the FragmentedPacket structure
+     * Take a slot from the free list for a new packet and link it into the hash table
      * @param pid The packet id
      * @param[out] fp The new FragmentedPacket structure
-     * @return true if it works, false if a limit is exceeded
+     * @return true if it works, false if there are no free slots
      */
 
-    bool IpPacketReassemblerFeature::createNewFragment(IpFragmentedPacket::PacketId pid,IpFragmentedPacket *&fp) {
+    bool IpPacketReassemblerFeature::createNewFragment(const IpFragmentedPacket::PacketId& pid,IpFragmentedPacket *&fp) {
 
-      // check for the maximum fragmented packets
+      uint8_t index,bucket;
 
-      if(_frags.size()==_params.ip_maxInProgressFragmentedPackets)
+      if(_free==NO_SLOT) {
+        _statistics.noFreeSlot++;
         return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_IP_PACKET_REASSEMBLER,E_TOO_MANY_FRAGMENTED_PACKETS);
+      }
 
-      // create the new entry (expiry time is not set here)
-
-      fp=new IpFragmentedPacket(pid);
+      // take from the free list (the expiry timer is armed when the fragment is stored)
 
-      // link it in at the front
+      index=_free;
+      fp=&_slots[index];
+      _free=fp->next;
 
-      _frags.push_front(fp);
+      fp->reset(pid);
 
-      // update the inflight count and memory usage
+      // link it in at the front of its chain
 
-      _inFlightPacketCount++;
-      _totalFragmentSize+=fp->packetLength;
+      bucket=hash(pid);
+      fp->next=_buckets[bucket];
+      _buckets[bucket]=index;
 
       return true;
     }
+
+
+    /*
+     * Hash the source address, identification and protocol of a packet to a bucket
+     */
+
+    uint8_t IpPacketReassemblerFeature::hash(const IpFragmentedPacket::PacketId& pid) const {
+
+      uint32_t key;
+
+      key=pid.sourceAddress.ipAddress ^ (static_cast<uint32_t>(pid.identification) << 8) ^ static_cast<uint32_t>(pid.protocol);
+      return ((key*2654435761U) >> _bucketShift) & _bucketMask;
+    }
   }
 }
 
@@ -31,6 +31,7 @@ namespace stm32plus {
                                    uint16_t additionalHeaderSize) {
 
       const TcpOptionMaximumSegmentSize *mss;
+      bool windowScale;
 
       // remember parameters
 
@@ -50,7 +51,7 @@ namespace stm32plus {
                  segmentEvent.sourcePort,
                  segmentEvent.destinationPort);
 
-      // pull out the state variables from the remote side
+      // pull out the state variables from the remote side. the window in a SYN is never scaled.
 
       _state.rxWindow.receiveNext=NetUtil::ntohl(segmentEvent.tcpHeader.tcp_sequenceNumber);
       _state.txWindow.sendWindow=NetUtil::ntohs(segmentEvent.tcpHeader.tcp_windowSize);
@@ -62,12 +63,18 @@ namespace stm32plus {
       else
         _remoteMss=NetUtil::ntohs(mss->tcp_optionMss);
 
+      // agree to window scaling and timestamps if the client offered them. we may only
+      // send the window scale option in the SYN-ACK if the client sent one.
+
+      handleSynOptions(segmentEvent.tcpHeader);
+      windowScale=_params.tcp_windowScaling && segmentEvent.tcpHeader.findOption<TcpOptionWindowScale>()!=nullptr;
+
       // this is an incoming client connection to our server. we need to send a SYN-ACK
 
       _state.localPortIsEphemeral=false;
       _state.changeState(*_networkUtilityObjects,TcpState::SYN_RCVD);
 
-      return sendSynAck();
+      return sendSynAck(windowScale);
     }
 
 
@@ -123,6 +130,16 @@ namespace stm32plus {
 
     TcpConnection::~TcpConnection() {
 
+      // waiting here for the transmit buffer would hold up everything else in the main loop so
+      // we wait no more than the linger time. a FIN would tell the other end that it has all the
+      // data so if some is still unacknowledged we reset the connection instead.
+
+      if(_transmitBuffer &&
+         _transmitBuffer->availableToRead() &&
+         (_state.state==TcpState::ESTABLISHED || _state.state==TcpState::CLOSE_WAIT) &&
+         (_params.tcp_transmitLinger==0 || !flush(_params.tcp_transmitLinger)))
+        _state.sendRstAck(*_networkUtilityObjects,0);
+
       // unsubscribe from notification events
 
       _networkUtilityObjects->NetworkNotificationEventSender.removeSubscriber(NetworkNotificationEventSourceSlot::bind(this,&TcpConnection::onNotification));
@@ -131,14 +148,20 @@ namespace stm32plus {
 
       _tcpEvents->TcpReceiveEventSender.removeSubscriber(TcpReceiveEventSourceSlot::bind(this,&TcpConnection::onReceive));
 
+      // incoming segments can't arm the timers any more so they can be stopped
+
+      _networkUtilityObjects->cancelTimer(_delayedAckTimer);
+      _networkUtilityObjects->cancelTimer(_resendTimer);
+
       // notify that we've been released. depending on our state, the connection may be moved into the
       // closing handler
 
       _networkUtilityObjects->NetworkNotificationEventSender.raiseEvent(TcpConnectionReleasedEvent(*this));
 
-      // delete the receive buffer
+      // delete the buffers
 
       delete _receiveBuffer;
+      delete _transmitBuffer;
     }
 
 
@@ -162,6 +185,11 @@ namespace stm32plus {
 
       _receiveWindowIsClosed=false;
 
+      // no round trip times yet and no ACK being held back
+
+      _resendDelayCalculator.initialise(_params.tcp_initialResendDelay,_params.tcp_maxResendDelay);
+      _delayedAckTimer.callback=NetworkTimer::CallbackType::bind(this,&TcpConnection::onDelayedAckTimer);
+
       // set the last active time to now
 
       _lastActiveTime=MillisecondTimer::millis();
@@ -175,6 +203,18 @@ namespace stm32plus {
       _state.txWindow.sendUnacknowledged=_state.txWindow.sendNext;
       _state.rxWindow.receiveWindow=_receiveBuffer->availableToWrite();
 
+      _sendMax=_state.txWindow.sendNext;
+      _retransmitRequested=false;
+
+      // create the optional transmit buffer
+
+      if(_params.tcp_transmitBufferSize) {
+        _transmitBuffer=new spsc_ring_buffer<uint8_t>(_params.tcp_transmitBufferSize);
+        _resendTimer.callback=NetworkTimer::CallbackType::bind(this,&TcpConnection::onResendTimer);
+      }
+
+      _transmitting=_transmitAgain=_resendTimedOut=false;
+
       // subscribe to notification events
 
       _networkUtilityObjects->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&TcpConnection::onNotification));
@@ -204,6 +244,10 @@ namespace stm32plus {
 
     void TcpConnection::onReceive(TcpSegmentEvent& event) {
 
+      TcpState oldState;
+      uint32_t oldSendUnacknowledged,oldSendWindow;
+      TcpWaitState states;
+
       // must be for this connection
 
       if(event.ipPacket.header->ip_sourceAddress!=_state.remoteAddress ||
@@ -215,6 +259,12 @@ namespace stm32plus {
 
       event.handled=true;
 
+      // remember what we had so that we can tell if anything has become possible
+
+      oldState=_state.state;
+      oldSendUnacknowledged=_state.txWindow.sendUnacknowledged;
+      oldSendWindow=_state.txWindow.sendWindow;
+
       // see what we've been sent
 
       if(event.tcpHeader.hasRst())
@@ -227,6 +277,9 @@ namespace stm32plus {
           handleIncomingSynAck(event.tcpHeader);
         else {
 
+          if(_state.timestampsEnabled)
+            handleIncomingTimestamp(event.tcpHeader);
+
           if(event.tcpHeader.hasAck())
             handleIncomingAck(event.tcpHeader,event.payloadLength!=0);
 
@@ -237,10 +290,36 @@ namespace stm32plus {
             handleIncomingFin(event);
         }
 
-        // store the latest sender window size - it can change on any incoming segment
+        // store the latest sender window size - it can change on any incoming segment. it's
+        // scaled unless this is a SYN.
 
         _state.txWindow.sendWindow=NetUtil::ntohs(event.tcpHeader.tcp_windowSize);
+
+        if(!event.tcpHeader.hasSyn())
+          _state.txWindow.sendWindow<<=_state.sendWindowShift;
       }
+
+      // tell subscribers what may have become possible: data to read, sent data acknowledged or
+      // the remote window opened, or a change of state
+
+      states=TcpWaitState::NONE;
+
+      if(event.payloadLength>0 && _receiveBuffer->availableToRead()>0)
+        states=states | TcpWaitState::READ;
+
+      if(_state.txWindow.sendUnacknowledged!=oldSendUnacknowledged || _state.txWindow.sendWindow>oldSendWindow)
+        states=states | TcpWaitState::WRITE;
+
+      if(_state.state!=oldState)
+        states=states | TcpWaitState::WRITE | TcpWaitState::CLOSED;
+
+      // an ACK or a window update may let more of the transmit buffer go out
+
+      if(_transmitBuffer && ((states & TcpWaitState::WRITE)!=TcpWaitState::NONE || _retransmitRequested))
+        transmitFromBuffer();
+
+      if(states!=TcpWaitState::NONE)
+        signalReady(states);
     }
 
 
@@ -285,10 +364,12 @@ namespace stm32plus {
     void TcpConnection::handleIncomingData(const TcpSegmentEvent& event) {
 
       uint32_t rxnext;
+      bool inOrder;
 
       // we've become active
 
       _lastActiveTime=MillisecondTimer::millis();
+      inOrder=false;
 
       // we can only handle sequential data. if the sequence number on the incoming packet is
       // not what we expect then we drop the segment because an earlier segment has either got
@@ -311,12 +392,25 @@ namespace stm32plus {
 
           _state.rxWindow.receiveNext+=event.payloadLength;
           _state.rxWindow.receiveWindow=_receiveBuffer->availableToWrite();
+
+          inOrder=true;
         }
       }
 
-      // ack the current state
+      // ack the current state. the ACK for the first in-order segment is held back in case a
+      // second arrives or we send something that can carry it. out of order segments are
+      // ACKed straight away so that the sender sees the duplicate ACKs.
 
-      _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
+      {
+        IrqSuspend suspender;
+
+        if(inOrder && _params.tcp_delayedAckTimeout && !_state.pendingDataAck) {
+          _state.pendingDataAck=true;
+          _networkUtilityObjects->armTimer(_delayedAckTimer,_params.tcp_delayedAckTimeout);
+        }
+        else
+          _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
+      }
 
       // notify if there is some data to read
 
@@ -335,11 +429,14 @@ namespace stm32plus {
 
     void TcpConnection::handleIncomingAck(const TcpHeader& header,bool hasData) {
 
-      uint32_t newSuna;
+      uint32_t newSuna,acked,flightSize,window;
+      bool established;
 
       // if the current state is SYN_RCVD then we can move to established
 
-      if(_state.state==TcpState::SYN_RCVD)
+      established=_state.state==TcpState::SYN_RCVD;
+
+      if(established)
         _state.changeState(*_networkUtilityObjects,TcpState::ESTABLISHED);
 
       // the gotcha here is to cater for 32-bit overflow while checking that the new s.una
@@ -348,14 +445,47 @@ namespace stm32plus {
       // of 2^31 between the pointers is sufficient to indicate a wrap.
 
       newSuna=NetUtil::ntohl(header.tcp_ackNumber);
-      if((newSuna>_state.txWindow.sendUnacknowledged || _state.txWindow.sendUnacknowledged-newSuna>0x80000000))
+      if((newSuna>_state.txWindow.sendUnacknowledged || _state.txWindow.sendUnacknowledged-newSuna>0x80000000)) {
+
+        acked=newSuna-_state.txWindow.sendUnacknowledged;
         _state.txWindow.sendUnacknowledged=newSuna;
+
+        // the ACK that completes the handshake starts the congestion control, later ones
+        // open the congestion window and free up the transmit buffer
+
+        if(established)
+          initialiseTransmitter();
+        else {
+
+          if(_congestionControl && _congestionControl->onAck(newSuna,acked,getFlightSize()))
+            _retransmitRequested=true;
+
+          if(_transmitBuffer)
+            releaseAcknowledged(newSuna);
+        }
+      }
       else {
 
+        // a duplicate ACK with data outstanding means that the other end has received a
+        // segment after a hole. the congestion control counts them.
+
+        window=static_cast<uint32_t>(NetUtil::ntohs(header.tcp_windowSize)) << _state.sendWindowShift;
+
+        if(_congestionControl &&
+           newSuna==_state.txWindow.sendUnacknowledged &&
+           !hasData &&
+           !header.hasFin() &&
+           window==_state.txWindow.sendWindow &&
+           (flightSize=getFlightSize())>0) {
+
+          if(_congestionControl->onDuplicateAck(newSuna,flightSize,_sendMax))
+            _retransmitRequested=true;
+        }
+
         // if the ACK has no data and did not move the window then re-ack our current state
         // possibly opening our window
 
-        if(!hasData)
+        else if(!hasData)
           _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
       }
     }
@@ -370,17 +500,19 @@ namespace stm32plus {
     void TcpConnection::handleIncomingSynAck(const TcpHeader& header) {
 
       const TcpOptionMaximumSegmentSize *mss;
+      const TcpOptionTimestamps *ts;
 
       // the only legal state is SYN_SENT
 
       if(_state.state!=TcpState::SYN_SENT)
         return;
 
-      // that SYN cost us a sequence number
+      // that SYN cost us a sequence number and this segment acknowledges it
 
       _state.txWindow.sendNext++;
+      _state.txWindow.sendUnacknowledged=_state.txWindow.sendNext;
 
-      // pull out the state variables from the remote side
+      // pull out the state variables from the remote side. the window in a SYN is never scaled.
 
       _state.rxWindow.receiveNext=NetUtil::ntohl(header.tcp_sequenceNumber)+1;
       _state.txWindow.sendWindow=NetUtil::ntohs(header.tcp_windowSize);
@@ -392,6 +524,16 @@ namespace stm32plus {
       else
         _remoteMss=NetUtil::ntohs(mss->tcp_optionMss);
 
+      // the server has accepted or refused the options that we offered. if it accepted
+      // timestamps then the echo gives us the first round trip time.
+
+      handleSynOptions(header);
+
+      if(_state.timestampsEnabled && (ts=header.findOption<TcpOptionTimestamps>())!=nullptr)
+        _resendDelayCalculator.addSample(MillisecondTimer::millis()-NetUtil::ntohl(ts->tcp_optionEchoReply));
+
+      initialiseTransmitter();
+
       // we're established, as far as we know
 
       _state.changeState(*_networkUtilityObjects,TcpState::ESTABLISHED);
@@ -402,39 +544,226 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Handle the options on an incoming SYN or SYN-ACK. Window scaling and timestamps are
+     * only used if both ends offer them.
+     * @param header The TCP header
+     */
+
+    void TcpConnection::handleSynOptions(const TcpHeader& header) {
+
+      const TcpOptionWindowScale *ws;
+      const TcpOptionTimestamps *ts;
+
+      // RFC7323 caps the shift at 14
+
+      if(_params.tcp_windowScaling && (ws=header.findOption<TcpOptionWindowScale>())!=nullptr) {
+        _state.sendWindowShift=std::min<uint8_t>(ws->tcp_optionShift,14);
+        _state.receiveWindowShift=getWindowShiftForBuffer();
+      }
+      else
+        _state.sendWindowShift=_state.receiveWindowShift=0;
+
+      if(_params.tcp_timestamps && (ts=header.findOption<TcpOptionTimestamps>())!=nullptr) {
+        _state.timestampsEnabled=true;
+        _state.timestampRecent=NetUtil::ntohl(ts->tcp_optionValue);
+      }
+      else
+        _state.timestampsEnabled=false;
+    }
+
+
+    /**
+     * Handle the timestamps option on an incoming segment. The timestamp is remembered for echoing
+     * back if the segment starts at or before the last ACK that we sent, which makes the echo
+     * reflect the oldest segment that an ACK covers. If the segment acknowledges new data then
+     * the echo of our own timestamp is a round trip time sample.
+     * This is IRQ code.
+     * @param header The TCP header
+     */
+
+    void TcpConnection::handleIncomingTimestamp(const TcpHeader& header) {
+
+      const TcpOptionTimestamps *ts;
+      uint32_t value,ack;
+
+      if((ts=header.findOption<TcpOptionTimestamps>())==nullptr)
+        return;
+
+      // update TS.Recent. the comparisons cater for 32-bit wrap.
+
+      value=NetUtil::ntohl(ts->tcp_optionValue);
+
+      if(static_cast<int32_t>(NetUtil::ntohl(header.tcp_sequenceNumber)-_state.lastAckSent)<=0 &&
+         static_cast<int32_t>(value-_state.timestampRecent)>=0)
+        _state.timestampRecent=value;
+
+      // an ACK that moves sendUnacknowledged forward gives an RTT sample
+
+      if(header.hasAck()) {
+
+        ack=NetUtil::ntohl(header.tcp_ackNumber);
+
+        if(static_cast<int32_t>(ack-_state.txWindow.sendUnacknowledged)>0 && ts->tcp_optionEchoReply!=0)
+          _resendDelayCalculator.addSample(MillisecondTimer::millis()-NetUtil::ntohl(ts->tcp_optionEchoReply));
+      }
+    }
+
+
+    /**
+     * The delayed ACK timer has expired. Send the ACK if nothing else has carried it.
+     * This is IRQ code.
+     * @param timer The timer
+     */
+
+    void TcpConnection::onDelayedAckTimer(NetworkTimer& /* timer */) {
+
+      IrqSuspend suspender;
+
+      if(_state.pendingDataAck)
+        _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
+    }
+
+
+    /**
+     * The connection is established. Start the congestion control off with the initial window
+     * and line the transmit buffer up with the first data sequence number. The SYN took the
+     * sequence number before that one, which is the ISS that the congestion control wants.
+     */
+
+    void TcpConnection::initialiseTransmitter() {
+
+      uint16_t mss;
+
+      _sendMax=_bufferedSequence=_nextToSend=_state.txWindow.sendNext;
+      _resendDelay=_resendDelayCalculator.getResendDelay();
+
+      if(_congestionControl) {
+        mss=getSegmentSize();
+        _congestionControl->initialise(mss,_params.tcp_initialCongestionWindow*mss,_state.txWindow.sendNext-1);
+      }
+    }
+
+
+    /**
+     * Get the amount of data that can be unacknowledged. This is the lower of the remote
+     * receive window and the congestion window.
+     * @return The limit in bytes
+     */
+
+    uint32_t TcpConnection::getSendLimit() const {
+
+      uint32_t limit;
+
+      limit=_state.txWindow.sendWindow;
+
+      if(_congestionControl)
+        limit=std::min(limit,_congestionControl->getWindow());
+
+      return limit;
+    }
+
+
     /**
      * Send a SYN segment to the server. This segment has no data. It contains the SYN flag plus our receive buffer
-     * size and the MSS option.
+     * size and the MSS option. Window scaling and timestamps are offered if they're enabled.
      * @return true if it was sent
      */
 
     bool TcpConnection::sendSyn() {
+      return sendSynSegment(TcpHeaderFlags::SYN,0,_params.tcp_windowScaling,_params.tcp_timestamps);
+    }
+
 
-      // create a NetBuffer to hold the SYN segment
+    /**
+     * Send a SYN-ACK segment back to our client. This segment has no data. It contains the SYN
+     * and ACK flags plus our receive buffer size and the MSS option, and the window scale and
+     * timestamps options if the client offered them and we agreed.
+     * @param windowScale true to send the window scale option
+     * @return true if it worked
+     */
 
-      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),4);
+    bool TcpConnection::sendSynAck(bool windowScale) {
+
+      // we're acking the SYN, which costs the sender 1 sequence number
+
+      _state.rxWindow.receiveNext++;
+
+      if(!sendSynSegment(TcpHeaderFlags::SYN | TcpHeaderFlags::ACK,_state.rxWindow.receiveNext,windowScale,_state.timestampsEnabled))
+        return false;
+
+      // increment our sequence number
+
+      _state.txWindow.sendNext++;
+      return true;
+    }
+
+
+    /**
+     * Send a SYN or a SYN-ACK. The options are the MSS, then the window scale and timestamps
+     * if wanted, each padded out to a word boundary with NOPs.
+     * @param flags The header flags
+     * @param ackNumber The ACK number, ignored if there's no ACK flag
+     * @param windowScale true to send the window scale option
+     * @param timestamps true to send the timestamps option
+     * @return true if it was sent
+     */
+
+    bool TcpConnection::sendSynSegment(TcpHeaderFlags flags,uint32_t ackNumber,bool windowScale,bool timestamps) {
+
+      uint16_t optionsSize;
+      TcpOption *nop;
+
+      optionsSize=TcpOptionMaximumSegmentSize::getSize();
+
+      if(windowScale)
+        optionsSize+=1+TcpOptionWindowScale::getSize();
+
+      if(timestamps)
+        optionsSize+=2+TcpOptionTimestamps::getSize();
+
+      // create a NetBuffer to hold the segment. it's built backwards from the last option.
+
+      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),optionsSize);
+
+      if(timestamps) {
+
+        reinterpret_cast<TcpOptionTimestamps *>(nb->moveWritePointerBack(TcpOptionTimestamps::getSize()))->initialise(
+            MillisecondTimer::millis(),
+            _state.timestampRecent);
+
+        nop=reinterpret_cast<TcpOption *>(nb->moveWritePointerBack(2));
+        nop[0].initialise(TcpOptionKind::NOP);
+        nop[1].initialise(TcpOptionKind::NOP);
+      }
+
+      if(windowScale) {
+        reinterpret_cast<TcpOptionWindowScale *>(nb->moveWritePointerBack(TcpOptionWindowScale::getSize()))->initialise(getWindowShiftForBuffer());
+        reinterpret_cast<TcpOption *>(nb->moveWritePointerBack(1))->initialise(TcpOptionKind::NOP);
+      }
 
       // set up MSS (maximum segment size) option
 
-      TcpOptionMaximumSegmentSize *mssOption=reinterpret_cast<TcpOptionMaximumSegmentSize *>(nb->moveWritePointerBack(4));
+      TcpOptionMaximumSegmentSize *mssOption=reinterpret_cast<TcpOptionMaximumSegmentSize *>(nb->moveWritePointerBack(TcpOptionMaximumSegmentSize::getSize()));
       mssOption->initialise(_segmentSizeLimit);
 
-      // construct the header
+      // construct the header. the window in a SYN is never scaled.
 
       TcpHeader *header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
 
-      // we're acking the SYN, which costs the sender 1 sequence number
-
       header->initialise(_state.localPort,                          // ports
                          _state.remotePort,
                          _state.txWindow.sendNext,                  // initial sequence number
-                         0,                                         // nothing to ACK
-                         getReceiveBufferSpaceAvailable(),          // data space available
-                         TcpHeaderFlags::SYN);
+                         ackNumber,
+                         std::min<uint32_t>(getReceiveBufferSpaceAvailable(),UINT16_MAX),   // data space available
+                         flags);
 
       // this header is larger than the minimum
 
-      header->setSize(TcpHeader::getNoOptionsHeaderSize()+TcpOptionMaximumSegmentSize::getSize());
+      header->setSize(TcpHeader::getNoOptionsHeaderSize()+optionsSize);
+
+      if((flags & TcpHeaderFlags::ACK)!=0)
+        _state.lastAckSent=ackNumber;
 
       // ask the IP layer to send the packet
 
@@ -449,45 +778,50 @@ namespace stm32plus {
 
 
     /**
-     * Send a SYN-ACK segment back to our client. This segment has no data. It contains the SYN
-     * and ACK flags plus our receive buffer size and the MSS option.
-     * @return true if it worked
+     * Send a segment of user data. The data is transmitted in-place.
+     * @param data The data
+     * @param sequenceNumber The sequence number of the first byte
+     * @param size The number of bytes
+     * @param headerFlags The header flags
+     * @return true if it was sent
      */
 
-    bool TcpConnection::sendSynAck() {
-
-      // create a NetBuffer to hold the SYN-ACK segment. we're dealing with an incoming
-      // SYN segment from an IRQ
+    bool TcpConnection::sendSegment(const void *data,uint32_t sequenceNumber,uint32_t size,TcpHeaderFlags headerFlags) {
 
-      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),4);
+      // create a netbuffer for the user data - only the header space is alloc'd
 
-      // set up MSS (maximum segment size) option
-
-      TcpOptionMaximumSegmentSize *mssOption=reinterpret_cast<TcpOptionMaximumSegmentSize *>(nb->moveWritePointerBack(4));
-      mssOption->initialise(_segmentSizeLimit);
+      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+_state.getHeaderSize(),
+                                  0,
+                                  reinterpret_cast<const uint8_t *>(data),
+                                  size);
 
-      // construct the header
-
-      TcpHeader *header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
+      return transmitSegment(nb,sequenceNumber,size,headerFlags);
+    }
 
-      // we're acking the SYN, which costs the sender 1 sequence number
 
-      _state.rxWindow.receiveNext++;
+    /**
+     * Add the header to a NetBuffer that holds a data segment and send it
+     * @param nb The NetBuffer, with space for the header
+     * @param sequenceNumber The sequence number of the first byte
+     * @param size The number of bytes of data
+     * @param headerFlags The header flags
+     * @return true if it was sent
+     */
 
-      header->initialise(_state.localPort,                          // ports
-                         _state.remotePort,
-                         _state.txWindow.sendNext,                  // initial sequence number
-                         _state.rxWindow.receiveNext,               // ack the SYN (the SYN consumes a sequence number)
-                         getReceiveBufferSpaceAvailable(),          // data space available
-                         TcpHeaderFlags::SYN | TcpHeaderFlags::ACK);
+    bool TcpConnection::transmitSegment(NetBuffer *nb,uint32_t sequenceNumber,uint32_t size,TcpHeaderFlags headerFlags) {
 
-      // this header is larger than the minimum
+      // create the header. the ACK that it carries satisfies any delayed ACK.
 
-      header->setSize(TcpHeader::getNoOptionsHeaderSize()+TcpOptionMaximumSegmentSize::getSize());
+      _state.writeHeader(nb,
+                         sequenceNumber,                 // where we are sending from
+                         _state.rxWindow.receiveNext,    //  ack up to receiveNext
+                         _state.rxWindow.receiveWindow,  // current window size
+                         headerFlags);
 
-      // increment our sequence number
+      // the IRQ code needs the highest sequence number sent for the flight size
 
-      _state.txWindow.sendNext++;
+      if(static_cast<int32_t>(sequenceNumber+size-_sendMax)>0)
+        _sendMax=sequenceNumber+size;
 
       // ask the IP layer to send the packet
 
@@ -506,20 +840,27 @@ namespace stm32plus {
      * then this is effectively a blocking call that will not return until success or a network
      * error occurs.
      *
-     * Data is sent in segments to the other side. The size of each segment is bounded by the lower
-     * of our MTU and the last known receive window of the recipient. actuallySent is updated to
-     * hold the amount of data acknowledged by the other end when this function returns.
+     * Data is sent in segments to the other side. The size of each segment is bounded by the remote
+     * MSS. The amount of data unacknowledged at any time is bounded by the lower of the last known
+     * receive window of the recipient and the congestion window. New segments go out as ACKs open
+     * up the window. actuallySent is updated to hold the amount of data acknowledged by the other
+     * end when this function returns.
+     *
+     * If the retransmission timer expires then everything from the first unacknowledged byte is
+     * sent again as the window allows. The congestion control may also ask for a fast retransmit
+     * of the first unacknowledged segment when duplicate ACKs show that it was lost.
+     *
+     * If tcp_transmitBufferSize is set then none of the above applies. The data is copied into
+     * the transmit buffer and this method returns at once. actuallySent is the amount that fitted
+     * and timeoutMillis only applies to waiting for a SYN_RCVD connection to be established.
+     * The network stack sends the buffered data as the windows allow. TcpWaitState::WRITE is
+     * signalled when ACKs free up space in the buffer.
      *
      * If tcp_nagleAvoidance is true (the default) then this method tries to send at least two
      * packets per call to force the remote to ACK immediately. If only one packet were to go out
      * per call then we may have to wait up to 200ms for the remote end's Nagle algorithm timer
      * to expire and send us our ACK.
      *
-     * The timeout, if non zero, is applied in full to each segment that we send. It means
-     * that we will wait for that many milliseconds after we send a segment to receiving an ACK
-     * before we give up. There will be an interplay between this timeout and the tcp_sendRetry*
-     * configuration parameters.
-     *
      * @param data The buffer of data to transmit
      * @param datasize How many bytes of data to transmit
      * @param[out] actuallySent How many bytes we sent and have been acknowledged, updated on success or failure.
@@ -529,9 +870,10 @@ namespace stm32plus {
 
     bool TcpConnection::send(const void *data,uint32_t datasize,uint32_t& actuallySent,uint32_t timeoutMillis) {
 
-      uint32_t bufpos,expectsuna,batchpos,batchbufpos,now,resendtimeout,startwait;
-      uint16_t batchwin,batchsendcap;
+      uint32_t start,end,nextToSend,acknowledged,unacknowledged,window,inFlight,tosend;
+      uint32_t now,resendtimeout,startwait,segmentcap,timedseq;
       TcpHeaderFlags headerFlags;
+      bool timing;
 
       actuallySent=0;
       now=MillisecondTimer::millis();
@@ -551,6 +893,11 @@ namespace stm32plus {
       if(_state.state!=TcpState::ESTABLISHED)
         return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_INVALID_STATE);
 
+      // with a transmit buffer we copy and go
+
+      if(_transmitBuffer)
+        return sendBuffered(data,datasize,actuallySent);
+
       // we need to handle the zero window case. don't try to send if the window is at zero
       // for a defined interval.
 
@@ -572,132 +919,135 @@ namespace stm32plus {
       else
         _lastZeroWindowPollTime=0;          // non-zero window, cancel the poll time
 
-      // bufpos is the index into the user's data of the current batch being sent
-      // batchwin is current sender receive window
+      // the data occupies the sequence numbers from start to end. nextToSend is where the next
+      // segment goes from and acknowledged is how far the other end has got.
+
+      start=nextToSend=acknowledged=_state.txWindow.sendNext;
+      end=start+datasize;
 
-      bufpos=0;
-      batchwin=_state.txWindow.sendWindow;
-      resendtimeout=_params.tcp_initialResendDelay;
+      resendtimeout=_resendDelayCalculator.getResendDelay();
+      startwait=now;
+      timing=false;
+      timedseq=0;
 
       // if the data would be sent in one go and nagle avoidance is enabled then force the send
       // to be 2 packets so that the recipient will generate an ACK immediately.
 
-      if(datasize<=batchwin && _params.tcp_nagleAvoidance && datasize>1)
-        batchsendcap=(datasize/2)+1;
+      if(datasize<=getSendLimit() && _params.tcp_nagleAvoidance && datasize>1)
+        segmentcap=(datasize/2)+1;
       else
-        batchsendcap=UINT16_MAX;
+        segmentcap=UINT32_MAX;
+
+      segmentcap=std::min<uint32_t>(segmentcap,getSegmentSize());
 
       // set up the header flags
 
-      headerFlags=TcpHeaderFlags::ACK;
-      if(_params.tcp_push)
-        headerFlags=headerFlags | TcpHeaderFlags::PSH;
+      headerFlags=getDataHeaderFlags();
 
-      // keep going while there is data and the connection is open
+      // keep going until it's all acknowledged or the connection is closed
 
-      while(datasize>0 && !isLocalEndClosed()) {
+      while(!isLocalEndClosed()) {
 
-        uint16_t batchsize,batchremaining;
-        bool resend;
+        // collect the ACKs that have arrived since we last looked
 
-        // a batch is how much we push out without waiting for ACKs. We always try to send 1 byte even when the sender
-        // window is closed, this effectively polls the sender for window updates if they've been advertising
-        // a zero window to us.
+        unacknowledged=_state.txWindow.sendUnacknowledged;
 
-        batchsize=std::max(1UL,std::min(datasize,static_cast<uint32_t>(batchwin)));
-        batchremaining=batchsize;
-        batchpos=_state.txWindow.sendNext;
-        batchbufpos=bufpos;
+        if(static_cast<int32_t>(unacknowledged-acknowledged)>0) {
 
-        // expectsuna is the ACK number that we'll be expecting when this batch is done
+          if(static_cast<int32_t>(unacknowledged-end)>0)
+            unacknowledged=end;
 
-        expectsuna=_state.txWindow.sendNext+batchsize;
+          _totalBytesSent+=unacknowledged-acknowledged;
+          acknowledged=unacknowledged;
 
-        // keep transmitting segments for this batch or until the local end is closed
+          _state.txWindow.sendNext=acknowledged;      // it's very important that sendNext and actuallySent move in sync
+          actuallySent=acknowledged-start;
 
-        while(batchremaining>0 && !isLocalEndClosed()) {
+          // an ACK for the timed segment is a round trip time sample
 
-          uint16_t tosend;
+          if(timing && static_cast<int32_t>(acknowledged-timedseq)>=0) {
+            _resendDelayCalculator.stopTimer();
+            timing=false;
+          }
 
-          // send up to the remote MSS in one segment
+          // new data acknowledged restarts the retransmission timer
 
-          tosend=std::min(std::min(batchsendcap,batchremaining),_remoteMss);
+          resendtimeout=_resendDelayCalculator.getResendDelay();
+          startwait=MillisecondTimer::millis();
 
-          // send this segment if it's not been ACK'd already (can happen if this is a resend)
+          // after a timeout we may be resending data that's now been acknowledged
 
-          if(batchpos+tosend>=_state.txWindow.sendUnacknowledged) {
+          if(static_cast<int32_t>(nextToSend-acknowledged)<0)
+            nextToSend=acknowledged;
+        }
 
-            // create a netbuffer for the user data - only the header space is alloc'd. the user data
-            // is transmitted in-place.
+        if(acknowledged==end)
+          break;
 
-            NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),
-                                        0,
-                                        reinterpret_cast<const uint8_t *>(data)+batchbufpos,
-                                        tosend);
+        // check for user timeout, measured from the beginning of the call
 
-            // create the header
+        if(timeoutMillis && MillisecondTimer::hasTimedOut(now,timeoutMillis))
+          return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_TIMED_OUT);
 
-            TcpHeader *header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
+        // check for the retransmission timeout. go back to the first unacknowledged byte.
 
-            header->initialise(_state.localPort,
-                               _state.remotePort,
-                                batchpos,                       // where we are sending from
-                                _state.rxWindow.receiveNext,    //  ack up to receiveNext
-                                _state.rxWindow.receiveWindow,  // current window size
-                                headerFlags);                   // always ACK
+        if(MillisecondTimer::hasTimedOut(startwait,resendtimeout)) {
 
-            // ask the IP layer to send the packet
+          {
+            IrqSuspend suspender;
 
-            IpTransmitRequestEvent iptre(
-                  nb,
-                  _state.remoteAddress,
-                  IpProtocol::TCP);
+            if(_congestionControl)
+              _congestionControl->onTimeout(getFlightSize(),_sendMax);
 
-            _networkUtilityObjects->NetworkSendEventSender.raiseEvent(iptre);
-            if(!iptre.succeeded)
-              return false;
+            _retransmitRequested=false;
           }
 
-          // update the sequence number (batchpos) and the user buffer position (batchbufpos)
+          nextToSend=acknowledged;
+          resendtimeout=std::min<uint32_t>(_params.tcp_maxResendDelay,resendtimeout*2);
+          startwait=MillisecondTimer::millis();
 
-          batchpos+=tosend;
-          batchbufpos+=tosend;
-          batchremaining-=tosend;
+          _resendDelayCalculator.cancelTimer();
+          timing=false;
         }
 
-        // reset the resend flag
+        // the congestion control may want the first unacknowledged segment sent again
 
-        resend=false;
-        startwait=MillisecondTimer::millis();
+        if(_retransmitRequested) {
 
-        // wait for the ACKs on that last batch to come back
+          _retransmitRequested=false;
 
-        while(expectsuna!=_state.txWindow.sendUnacknowledged && !isLocalEndClosed()) {
+          tosend=std::min(segmentcap,end-acknowledged);
 
-          // check for user timeout, measured from the beginning of the call
+          if(!sendSegment(reinterpret_cast<const uint8_t *>(data)+(acknowledged-start),acknowledged,tosend,headerFlags))
+            return false;
 
-          if(timeoutMillis && MillisecondTimer::hasTimedOut(now,timeoutMillis))
-            return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_TIMED_OUT);
+          _resendDelayCalculator.cancelTimer();
+          timing=false;
+        }
 
-          // check for resend timeout for this batch
+        // send new segments while the window allows. We always allow 1 byte in flight even when
+        // the window is closed, this effectively polls the other end for window updates if
+        // they've been advertising a zero window to us.
 
-          if(MillisecondTimer::hasTimedOut(startwait,resendtimeout)) {
-            resend=true;
-            resendtimeout=std::min(_params.tcp_maxResendDelay,resendtimeout*2);
-            break;
+        window=std::max<uint32_t>(1,getSendLimit());
+
+        while(nextToSend!=end && (inFlight=nextToSend-acknowledged)<window) {
+
+          tosend=std::min(std::min(segmentcap,end-nextToSend),window-inFlight);
+
+          // time the first segment sent for the first time if timestamps aren't doing it for us.
+          // retransmitted segments are never timed (Karn's algorithm).
+
+          if(!timing && !_state.timestampsEnabled && static_cast<int32_t>(nextToSend-_sendMax)>=0) {
+            _resendDelayCalculator.startTimer();
+            timedseq=nextToSend+tosend;
+            timing=true;
           }
-        }
 
-        // if we're not about to go into a resend of this batch then update the batch position
-        // for the next run
+          if(!sendSegment(reinterpret_cast<const uint8_t *>(data)+(nextToSend-start),nextToSend,tosend,headerFlags))
+            return false;
 
-        if(!resend) {
-          resendtimeout=_params.tcp_initialResendDelay;
-          bufpos=batchbufpos;
-          _state.txWindow.sendNext=batchpos;      // it's very important that sendNext and actuallySent move in sync
-          actuallySent+=batchsize;
-          datasize-=batchsize;
-          batchwin=_state.txWindow.sendWindow;
+          nextToSend+=tosend;
         }
       }
 
@@ -710,6 +1060,277 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Copy data into the transmit buffer and start sending it
+     * @param data The data
+     * @param dataSize The amount of data
+     * @param[out] actuallySent The amount that fitted in the buffer
+     * @return true
+     */
+
+    bool TcpConnection::sendBuffered(const void *data,uint32_t dataSize,uint32_t& actuallySent) {
+
+      actuallySent=_transmitBuffer->write(reinterpret_cast<const uint8_t *>(data),dataSize);
+      _totalBytesSent+=actuallySent;
+
+      if(actuallySent)
+        transmitFromBuffer();
+
+      return true;
+    }
+
+
+    /**
+     * Wait for everything in the transmit buffer to be acknowledged. Returns at once if there is
+     * no transmit buffer.
+     * @param timeoutMillis How long to wait, or zero to wait forever
+     * @return false if it timed out or the connection was closed first
+     */
+
+    bool TcpConnection::flush(uint32_t timeoutMillis) {
+
+      uint32_t start;
+
+      if(!_transmitBuffer)
+        return true;
+
+      start=MillisecondTimer::millis();
+
+      while(_transmitBuffer->availableToRead()) {
+
+        if(isLocalEndClosed())
+          return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_CONNECTION_RESET);
+
+        if(timeoutMillis && MillisecondTimer::hasTimedOut(start,timeoutMillis))
+          return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_TIMED_OUT);
+      }
+
+      return true;
+    }
+
+
+    /**
+     * An ACK has moved sendUnacknowledged forward. Free up the data that it covers and restart
+     * the retransmission timer for the rest.
+     * This is IRQ code.
+     * @param ackNumber The new sendUnacknowledged
+     */
+
+    void TcpConnection::releaseAcknowledged(uint32_t ackNumber) {
+
+      uint32_t acked;
+
+      // the ACK may cover a FIN as well as the data
+
+      acked=ackNumber-_bufferedSequence;
+
+      if(static_cast<int32_t>(acked)<=0)
+        return;
+
+      acked=std::min(acked,_transmitBuffer->availableToRead());
+
+      _transmitBuffer->consumeRead(acked);
+      _bufferedSequence+=acked;
+      _state.txWindow.sendNext=_bufferedSequence;
+
+      // an ACK for the timed segment is a round trip time sample
+
+      if(_resendDelayCalculator.isTiming() && static_cast<int32_t>(_bufferedSequence-_timedSequence)>=0)
+        _resendDelayCalculator.stopTimer();
+
+      // new data acknowledged restarts the retransmission timer and ends the backoff
+
+      _resendDelay=_resendDelayCalculator.getResendDelay();
+
+      if(_bufferedSequence!=_sendMax)
+        _networkUtilityObjects->armTimer(_resendTimer,_resendDelay);
+      else
+        _networkUtilityObjects->cancelTimer(_resendTimer);
+    }
+
+
+    /**
+     * The retransmission timer has expired. The resend happens in transmitPass().
+     * This is IRQ code.
+     * @param timer The timer
+     */
+
+    void TcpConnection::onResendTimer(NetworkTimer& /* timer */) {
+      _resendTimedOut=true;
+      transmitFromBuffer();
+    }
+
+
+    /**
+     * Send what we can from the transmit buffer. This is called from send(), from the ethernet
+     * IRQ when an ACK arrives and from the retransmission timer. Only one caller at a time does
+     * the work. Others that come in while it's running ask it to go round again. Interrupts
+     * can't be suspended for the whole thing because the MAC needs its IRQ to free up transmit
+     * descriptors.
+     */
+
+    void TcpConnection::transmitFromBuffer() {
+
+      {
+        IrqSuspend suspender;
+
+        if(_transmitting) {
+          _transmitAgain=true;
+          return;
+        }
+
+        _transmitting=true;
+      }
+
+      for(;;) {
+
+        transmitPass();
+
+        IrqSuspend suspender;
+
+        if(!_transmitAgain) {
+          _transmitting=false;
+          return;
+        }
+
+        _transmitAgain=false;
+      }
+    }
+
+
+    /*
+     * Deal with a timeout or a fast retransmit request and then send new segments from the
+     * transmit buffer while the window allows
+     */
+
+    void TcpConnection::transmitPass() {
+
+      spsc_ring_buffer<uint8_t>::region r;
+      uint32_t start,end,window,inFlight,tosend,segmentSize;
+      bool retransmit;
+
+      if(isLocalEndClosed() || _state.state==TcpState::SYN_RCVD || _state.state==TcpState::SYN_SENT)
+        return;
+
+      {
+        IrqSuspend suspender;
+
+        // the buffer starts at the first unacknowledged byte
+
+        start=_bufferedSequence;
+        end=start+_transmitBuffer->peekRead(r);
+
+        // a timeout goes back to the first unacknowledged byte with a doubled timeout. Nothing
+        // that's been sent is timed any more (Karn's algorithm).
+
+        if(_resendTimedOut) {
+
+          _resendTimedOut=false;
+
+          if(start!=_sendMax) {
+
+            if(_congestionControl)
+              _congestionControl->onTimeout(getFlightSize(),_sendMax);
+
+            _nextToSend=start;
+            _retransmitRequested=false;
+            _resendDelay=std::min<uint32_t>(_params.tcp_maxResendDelay,_resendDelay*2);
+            _resendDelayCalculator.cancelTimer();
+          }
+        }
+
+        retransmit=_retransmitRequested;
+        _retransmitRequested=false;
+
+        if(static_cast<int32_t>(_nextToSend-start)<0)
+          _nextToSend=start;
+      }
+
+      segmentSize=getSegmentSize();
+
+      // the congestion control may want the first unacknowledged segment sent again
+
+      if(retransmit && start!=end) {
+
+        _resendDelayCalculator.cancelTimer();
+
+        if(!sendBufferedSegment(r,0,start,std::min(segmentSize,end-start)))
+          return;
+      }
+
+      // send new segments while the window allows. We always allow 1 byte in flight even when
+      // the window is closed so that the other end is polled for window updates.
+
+      window=std::max<uint32_t>(1,getSendLimit());
+
+      while(_nextToSend!=end && (inFlight=_nextToSend-start)<window) {
+
+        tosend=std::min(std::min(segmentSize,end-_nextToSend),window-inFlight);
+
+        // time the first segment sent for the first time if timestamps aren't doing it for us
+
+        if(!_state.timestampsEnabled && static_cast<int32_t>(_nextToSend-_sendMax)>=0) {
+
+          IrqSuspend suspender;
+
+          if(!_resendDelayCalculator.isTiming()) {
+            _resendDelayCalculator.startTimer();
+            _timedSequence=_nextToSend+tosend;
+          }
+        }
+
+        // if the MAC is busy then stop here. The next ACK or the timer will bring us back.
+
+        if(!sendBufferedSegment(r,inFlight,_nextToSend,tosend))
+          break;
+
+        _nextToSend+=tosend;
+      }
+
+      // there must be a timer running while there's data outstanding or waiting to go. If the
+      // MAC was too busy to take a segment then the timer is what brings us back.
+
+      if(start!=end && !_resendTimer.isArmed())
+        _networkUtilityObjects->armTimer(_resendTimer,_resendDelay);
+    }
+
+
+    /**
+     * Copy a segment out of the transmit buffer and send it. The data is copied because the
+     * space in the buffer can be reused as soon as it's acknowledged, which may be before a
+     * retransmitted copy has left the MAC.
+     * @param r The buffered data, starting at the first unacknowledged byte
+     * @param offset The offset of the segment into r
+     * @param sequenceNumber The sequence number of the first byte
+     * @param size The number of bytes
+     * @return true if it was sent
+     */
+
+    bool TcpConnection::sendBufferedSegment(const spsc_ring_buffer<uint8_t>::region& r,uint32_t offset,uint32_t sequenceNumber,uint32_t size) {
+
+      uint8_t *ptr;
+      uint32_t count;
+
+      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+_state.getHeaderSize(),size);
+      ptr=reinterpret_cast<uint8_t *>(nb->moveWritePointerBack(size));
+
+      // the segment may straddle the wrap point of the buffer
+
+      if(offset<r.first.size) {
+
+        count=std::min(size,r.first.size-offset);
+        memcpy(ptr,r.first.data+offset,count);
+
+        if(size>count)
+          memcpy(ptr+count,r.second.data,size-count);
+      }
+      else
+        memcpy(ptr,r.second.data+(offset-r.first.size),size);
+
+      return transmitSegment(nb,sequenceNumber,size,getDataHeaderFlags());
+    }
+
+
     /**
      * Receive some data from the remote client. If the timeout is zero then this is a blocking call that will
      * not return until success, the other end closes, or a network error occurs. actuallyReceived will be filled
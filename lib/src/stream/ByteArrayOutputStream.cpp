@@ -88,6 +88,29 @@ namespace stm32plus {
   }
 
 
+  /*
+   * Write a list of buffers to the stream. The memory block is grown at most once.
+   */
+
+  bool ByteArrayOutputStream::writev(const IoVector *vectors,uint32_t count) {
+
+    uint32_t i,size;
+
+    for(i=size=0;i<count;i++)
+      size+=vectors[i].size;
+
+    if(_currentUsage+size>_memblock.getSize())
+      _memblock.reallocate(_currentUsage+size+_resizeAmount);
+
+    for(i=0;i<count;i++) {
+      memcpy(_memblock.getData()+_currentUsage,vectors[i].data,vectors[i].size);
+      _currentUsage+=vectors[i].size;
+    }
+
+    return true;
+  }
+
+
   /*
    * Can't close
    */
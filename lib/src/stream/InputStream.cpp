@@ -81,4 +81,34 @@ namespace stm32plus {
     read(buffer_,bufferSize_,actuallyRead);
     return *this;
   }
+
+
+  /**
+   * Read into a list of buffers by calling read() for each one. Stops early if a buffer
+   * isn't filled completely, for example at the end of the stream.
+   * @param[in] vectors The buffers to read into.
+   * @param[in] count The number of buffers.
+   * @param[out] actuallyRead The total number of bytes read.
+   * @return false if the read fails.
+   */
+
+  bool InputStream::readv(const IoVector *vectors,uint32_t count,uint32_t& actuallyRead) {
+
+    uint32_t i,thisRead;
+
+    actuallyRead=0;
+
+    for(i=0;i<count;i++) {
+
+      if(!read(vectors[i].data,vectors[i].size,thisRead))
+        return false;
+
+      actuallyRead+=thisRead;
+
+      if(thisRead<vectors[i].size)
+        break;
+    }
+
+    return true;
+  }
 }
@@ -0,0 +1,491 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+#include "config/stream.h"
+
+
+/*
+ * Search effort for levels 1..9: the number of candidates examined at each position and the
+ * match length that's good enough to stop looking. These follow the liblzg tuning table.
+ */
+
+static const struct {
+  uint16_t maxCandidates;
+  uint8_t goodLength;
+} LZG_LEVELS[9]= {
+  { 30,35 },{ 40,48 },{ 50,72 },{ 60,72 },{ 70,72 },{ 80,72 },{ 150,128 },{ 250,128 },{ 65535,128 }
+};
+
+
+namespace stm32plus {
+
+
+  /*
+   * LZG can only encode some match lengths. Round a length down to one that can be encoded.
+   */
+
+  static inline uint32_t lzgQuantizeLength(uint32_t length) {
+
+    if(length<30)
+      return length;
+    if(length<35)
+      return 29;
+    if(length<48)
+      return 35;
+    if(length<72)
+      return 48;
+    if(length<128)
+      return 72;
+    return 128;
+  }
+
+
+  /*
+   * Get the 5-bit encoding of a quantized length (2..29,35,48,72,128 -> 0..31)
+   */
+
+  static inline uint8_t lzgEncodeLength(uint32_t length) {
+
+    switch(length) {
+      case 35:  return 30-2;
+      case 48:  return 31-2;
+      case 72:  return 32-2;
+      case 128: return 33-2;
+      default:  return length-2;
+    }
+  }
+
+
+  /**
+   * Constructor
+   * @param output Where to write the compressed data
+   * @param workArea getWorkAreaSize(blockSize,hashBits) bytes, 2-byte aligned. Must not go out of scope while this object exists.
+   * @param blockSize The number of uncompressed bytes in each LZG block, up to MAX_BLOCK_SIZE
+   * @param hashBits log2 of the number of hash chains. 10 to 12 are sensible values.
+   * @param windowSize The largest match offset. The decompressor needs a window at least this big.
+   * @param level The compression level, 1 (fastest) to 9 (best)
+   */
+
+  LzgCompressionOutputStream::LzgCompressionOutputStream(OutputStream& output,
+                                                         void *workArea,
+                                                         uint32_t blockSize,
+                                                         uint8_t hashBits,
+                                                         uint32_t windowSize,
+                                                         uint8_t level)
+    : _output(output),
+      _blockSize(blockSize),
+      _blockUsed(0),
+      _windowSize(windowSize),
+      _hashBits(hashBits) {
+
+    _input=static_cast<uint8_t *>(workArea);
+    _encoded=_input+blockSize;
+    _chain=reinterpret_cast<uint16_t *>(_encoded+blockSize);
+    _head=_chain+blockSize;
+
+    setLevel(level);
+  }
+
+
+  /**
+   * Set the compression level. It takes effect from the next block.
+   * @param level 1 (fastest) to 9 (best). Out of range values are clamped.
+   */
+
+  void LzgCompressionOutputStream::setLevel(uint8_t level) {
+
+    if(level<1)
+      level=1;
+    else if(level>9)
+      level=9;
+
+    _maxCandidates=LZG_LEVELS[level-1].maxCandidates;
+    _goodLength=LZG_LEVELS[level-1].goodLength;
+  }
+
+
+  /**
+   * Write a byte. A block is compressed and written out when it's full.
+   * @param c The byte
+   * @return true if it worked
+   */
+
+  bool LzgCompressionOutputStream::write(uint8_t c) {
+
+    _input[_blockUsed++]=c;
+
+    if(_blockUsed==_blockSize)
+      return writeBlock();
+
+    return true;
+  }
+
+
+  /**
+   * Write a buffer of bytes. Blocks are compressed and written out as they fill up.
+   * @param buffer the buffer
+   * @param size The number of bytes
+   * @return true if it worked
+   */
+
+  bool LzgCompressionOutputStream::write(const void *buffer,uint32_t size) {
+
+    const uint8_t *ptr;
+    uint32_t chunk;
+
+    ptr=static_cast<const uint8_t *>(buffer);
+
+    while(size) {
+
+      chunk=_blockSize-_blockUsed;
+      if(chunk>size)
+        chunk=size;
+
+      memcpy(_input+_blockUsed,ptr,chunk);
+
+      ptr+=chunk;
+      size-=chunk;
+
+      if((_blockUsed+=chunk)==_blockSize && !writeBlock())
+        return false;
+    }
+
+    return true;
+  }
+
+
+  /**
+   * Compress and write out the partial block, then flush the output stream. Each flush
+   * starts a new LZG block so flushing often will cost compression ratio.
+   * @return true if it worked
+   */
+
+  bool LzgCompressionOutputStream::flush() {
+    return writeBlock() && _output.flush();
+  }
+
+
+  /**
+   * Compress and write out the partial block and flush the output stream. The output
+   * stream is not closed because it belongs to the caller.
+   * @return true if it worked
+   */
+
+  bool LzgCompressionOutputStream::close() {
+    return flush();
+  }
+
+
+  /*
+   * Compress the buffered block and write it out as a complete LZG stream. Nothing happens
+   * if the block is empty.
+   */
+
+  bool LzgCompressionOutputStream::writeBlock() {
+
+    uint8_t header[HEADER_SIZE];
+    const uint8_t *data;
+    uint32_t encodedSize,i;
+    uint16_t a,b;
+
+    if(_blockUsed==0)
+      return true;
+
+    // compress, falling back to storing the block if it doesn't get smaller
+
+    if((encodedSize=encodeBlock())!=0) {
+      data=_encoded;
+      header[15]=1;         // METHOD_LZG1
+    }
+    else {
+      data=_input;
+      encodedSize=_blockUsed;
+      header[15]=0;         // METHOD_COPY
+    }
+
+    // checksum the encoded data
+
+    a=1;
+    b=0;
+
+    for(i=0;i<encodedSize;i++) {
+      a+=data[i];
+      b+=a;
+    }
+
+    // big-endian header
+
+    header[0]='L';
+    header[1]='Z';
+    header[2]='G';
+
+    header[3]=_blockUsed >> 24;
+    header[4]=_blockUsed >> 16;
+    header[5]=_blockUsed >> 8;
+    header[6]=_blockUsed;
+
+    header[7]=encodedSize >> 24;
+    header[8]=encodedSize >> 16;
+    header[9]=encodedSize >> 8;
+    header[10]=encodedSize;
+
+    header[11]=b >> 8;
+    header[12]=b;
+    header[13]=a >> 8;
+    header[14]=a;
+
+    _blockUsed=0;
+
+    return _output.write(header,sizeof(header)) && _output.write(data,encodedSize);
+  }
+
+
+  /*
+   * Choose the four least common bytes in the block as the markers. Ties go to the lower
+   * byte value, the same as liblzg.
+   */
+
+  void LzgCompressionOutputStream::chooseMarkers() {
+
+    uint16_t histogram[256];
+    uint32_t i,j,best;
+
+    memset(histogram,0,sizeof(histogram));
+
+    for(i=0;i<_blockUsed;i++)
+      histogram[_input[i]]++;
+
+    memset(_isMarkerSymbolLUT,0,sizeof(_isMarkerSymbolLUT));
+
+    for(i=0;i<4;i++) {
+
+      best=256;
+
+      for(j=0;j<256;j++)
+        if(!_isMarkerSymbolLUT[j] && (best==256 || histogram[j]<histogram[best]))
+          best=j;
+
+      _markers[i]=best;
+      _isMarkerSymbolLUT[best]=true;
+    }
+  }
+
+
+  /*
+   * Hash the three bytes at ptr to a chain index
+   */
+
+  inline uint32_t LzgCompressionOutputStream::hash(const uint8_t *ptr) const {
+    return ((ptr[0] << 16 | ptr[1] << 8 | ptr[2])*2654435761U) >> (32-_hashBits);
+  }
+
+
+  /*
+   * Add a position to its hash chain. There must be three bytes available at the position.
+   */
+
+  inline void LzgCompressionOutputStream::insert(uint32_t position) {
+
+    uint32_t h;
+
+    h=hash(_input+position);
+
+    _chain[position]=_head[h];
+    _head[h]=position+1;
+  }
+
+
+  /*
+   * Search the hash chain for the match at position that gives the biggest saving over
+   * encoding the literal, which costs symbolCost bytes. The position must not yet have been
+   * inserted. Returns the quantized match length and sets offset, or returns zero if
+   * nothing is worth encoding as a match.
+   */
+
+  uint32_t LzgCompressionOutputStream::findMatch(uint32_t position,uint32_t symbolCost,uint32_t& offset) const {
+
+    const uint8_t *pos,*pos2,*end;
+    uint32_t candidate,maxLength,length,bestLength,distance,remaining;
+    int32_t win,bestWin;
+
+    pos=_input+position;
+
+    maxLength=_blockUsed-position;
+    if(maxLength>128)
+      maxLength=128;
+
+    end=pos+maxLength;
+    bestLength=2;
+    bestWin=0;
+    offset=0;
+
+    candidate=_head[hash(pos)];
+    remaining=_maxCandidates;
+
+    while(candidate && remaining--) {
+
+      pos2=_input+candidate-1;
+      if((distance=pos-pos2)>_windowSize)
+        break;
+
+      // if it doesn't match at bestLength then it can't be longer
+
+      if(pos[bestLength]==pos2[bestLength]) {
+
+        for(length=0;pos+length<end && pos[length]==pos2[length];length++);
+
+        if((length=lzgQuantizeLength(length))>bestLength) {
+
+          // work out the saving that this match would give
+
+          if(distance<=8 || (length<=6 && distance<=71))
+            win=length+symbolCost-3;
+          else {
+            win=length+symbolCost-4;
+            if(distance>=2056)
+              win--;
+          }
+
+          if(win>bestWin) {
+
+            bestWin=win;
+            bestLength=length;
+            offset=distance;
+
+            if(length>=_goodLength || length>=maxLength)
+              break;
+          }
+        }
+      }
+
+      candidate=_chain[candidate-1];
+    }
+
+    return bestWin>0 ? bestLength : 0;
+  }
+
+
+  /*
+   * Encode the block into _encoded (markers then data). Returns the encoded size or zero if
+   * it's not going to be smaller than the block itself.
+   */
+
+  uint32_t LzgCompressionOutputStream::encodeBlock() {
+
+    uint8_t *dst,*limit,symbol,lengthEnc;
+    uint32_t src,length,offset,symbolCost,i,lastInsert;
+
+    chooseMarkers();
+
+    // the block must be at least as big as the markers to be worth trying
+
+    if(_blockUsed<=4)
+      return 0;
+
+    memset(_head,0,sizeof(uint16_t) << _hashBits);
+
+    dst=_encoded;
+    limit=_encoded+_blockUsed;
+
+    *dst++=_markers[0];
+    *dst++=_markers[1];
+    *dst++=_markers[2];
+    *dst++=_markers[3];
+
+    // positions need three bytes for the hash
+
+    lastInsert=_blockUsed-2;
+    src=0;
+
+    while(src<_blockUsed) {
+
+      symbol=_input[src];
+      symbolCost=_isMarkerSymbolLUT[symbol] ? 2 : 1;
+
+      if(src<lastInsert) {
+        length=findMatch(src,symbolCost,offset);
+        insert(src);
+      }
+      else
+        length=0;
+
+      if(length) {
+
+        if(length<=6 && offset>=9 && offset<=71) {
+
+          // short copy
+
+          if(dst+2>limit)
+            return 0;
+
+          *dst++=_markers[2];
+          *dst++=((length-3) << 6) | (offset-8);
+        }
+        else if(offset<=8) {
+
+          // near copy
+
+          if(dst+2>limit)
+            return 0;
+
+          lengthEnc=lzgEncodeLength(length);
+          *dst++=_markers[3];
+          *dst++=((offset-1) << 5) | lengthEnc;
+        }
+        else if(offset>=2056) {
+
+          // distant copy
+
+          if(dst+4>limit)
+            return 0;
+
+          lengthEnc=lzgEncodeLength(length);
+          offset-=2056;
+          *dst++=_markers[0];
+          *dst++=((offset >> 11) & 0xe0) | lengthEnc;
+          *dst++=offset >> 8;
+          *dst++=offset;
+        }
+        else {
+
+          // medium copy
+
+          if(dst+3>limit)
+            return 0;
+
+          lengthEnc=lzgEncodeLength(length);
+          offset-=8;
+          *dst++=_markers[1];
+          *dst++=((offset >> 3) & 0xe0) | lengthEnc;
+          *dst++=offset;
+        }
+
+        // the skipped positions are candidates for later matches
+
+        for(i=src+1;i<src+length && i<lastInsert;i++)
+          insert(i);
+
+        src+=length;
+      }
+      else {
+
+        // literal, with a zero after it if it's a marker
+
+        if(dst+symbolCost>limit)
+          return 0;
+
+        *dst++=symbol;
+        if(symbolCost==2)
+          *dst++=0;
+
+        src++;
+      }
+    }
+
+    return dst-_encoded;
+  }
+}
@@ -15,55 +15,115 @@ namespace stm32plus {
 
 
   /**
-   * Constructor. Initiates the decompression.
+   * Constructor. Reads the header and initiates the decompression.
    * The error provider should be checked to ensure that nothing went wrong
    * while setting up the decompressor
    *
    * @param input The source of compressed bytes
-   * @param compressedSize the number of bytes of compressed data
+   * @param compressedSize the number of bytes of compressed data, including the header
+   * @param window The history window. Must not go out of scope while this object exists.
+   * @param windowSize The size of the window. Must be at least as large as the compressor's window.
    */
 
-  LzgDecompressionStream::LzgDecompressionStream(InputStream& input,uint32_t compressedSize)
+  LzgWindowDecompressionStream::LzgWindowDecompressionStream(InputStream& input,uint32_t compressedSize,uint8_t *window,uint32_t windowSize)
     : _input(input),
-      _compressedSize(compressedSize) {
-
+      _window(window),
+      _windowSize(windowSize),
+      _windowPosition(0),
+      _decodedRemaining(0),
+      _decodedSoFar(0),
+      _encodedRemaining(0),
+      _checksumA(1),
+      _checksumB(0),
+      _copyRemaining(0),
+      _inputPosition(0),
+      _inputAvailable(0) {
+
+    uint8_t header[HEADER_SIZE];
+    uint32_t count,actuallyRead,decodedSize;
     int i;
 
     // no error yet
 
     errorProvider.clear();
 
-    // initialize the output byte buffer
+    // read the header
 
-    _compressedDataAvailable=_compressedSize;
-    _historyCopyDataAvailable=0;
+    for(count=0;count<HEADER_SIZE;count+=actuallyRead) {
+      if(!_input.read(header+count,HEADER_SIZE-count,actuallyRead))
+        return;
 
-    _dst=_circbuf;
-    _dstEnd=_circbuf+sizeof(_circbuf);
+      if(actuallyRead==0) {
+        fail(E_CORRUPT_DATA);
+        return;
+      }
+    }
 
-    // skip header information
+    // check the magic number and get the sizes, checksum and method. all big-endian.
 
-    if(!input.skip(16))
+    if(header[0]!='L' || header[1]!='Z' || header[2]!='G') {
+      fail(E_CORRUPT_DATA);
       return;
+    }
+
+    decodedSize=(static_cast<uint32_t>(header[3]) << 24) | (header[4] << 16) | (header[5] << 8) | header[6];
+    _encodedRemaining=(static_cast<uint32_t>(header[7]) << 24) | (header[8] << 16) | (header[9] << 8) | header[10];
+    _checksum=(static_cast<uint32_t>(header[11]) << 24) | (header[12] << 16) | (header[13] << 8) | header[14];
+    _method=header[15];
+
+    if(compressedSize<HEADER_SIZE || _encodedRemaining>compressedSize-HEADER_SIZE) {
+      fail(E_CORRUPT_DATA);
+      return;
+    }
+
+    if(_method==METHOD_COPY) {
 
-    // Get marker symbols from the input stream
+      // stored without compression
 
-    _input >> _marker1;
-    _input >> _marker2;
-    _input >> _marker3;
-    _input >> _marker4;
+      if(decodedSize!=_encodedRemaining) {
+        fail(E_CORRUPT_DATA);
+        return;
+      }
+    }
+    else if(_method==METHOD_LZG1) {
+
+      // get marker symbols from the input stream
 
-    _compressedDataAvailable-=20;           // the header and 4 markers
+      if(!fillInput(4))
+        return;
 
-    // Initialize marker symbol LUT
+      _marker1=_inputBuffer[0];
+      _marker2=_inputBuffer[1];
+      _marker3=_inputBuffer[2];
+      _marker4=_inputBuffer[3];
+      _inputPosition=4;
 
-    for(i=0;i<256;++i)
-      _isMarkerSymbolLUT[i]=0;
+      // initialize marker symbol LUT
 
-    _isMarkerSymbolLUT[_marker1]=1;
-    _isMarkerSymbolLUT[_marker2]=1;
-    _isMarkerSymbolLUT[_marker3]=1;
-    _isMarkerSymbolLUT[_marker4]=1;
+      for(i=0;i<256;++i)
+        _isMarkerSymbolLUT[i]=false;
+
+      _isMarkerSymbolLUT[_marker1]=true;
+      _isMarkerSymbolLUT[_marker2]=true;
+      _isMarkerSymbolLUT[_marker3]=true;
+      _isMarkerSymbolLUT[_marker4]=true;
+    }
+    else {
+      fail(E_UNSUPPORTED_COMPRESSED_DATA);
+      return;
+    }
+
+    _decodedRemaining=decodedSize;
+  }
+
+
+  /**
+   * Get the size of the data after decompression, from the header
+   * @return The decompressed size
+   */
+
+  uint32_t LzgWindowDecompressionStream::getDecompressedSize() const {
+    return _decodedSoFar+_decodedRemaining;
   }
 
 
@@ -71,37 +131,62 @@ namespace stm32plus {
    * Read a byte from the stream, or return EOF or an error
    */
 
-  int16_t LzgDecompressionStream::read() {
+  int16_t LzgWindowDecompressionStream::read() {
 
     uint8_t nextByte;
+    uint32_t actuallyRead;
 
     // check for end of stream
 
-    if(_historyCopyDataAvailable==0 && _compressedDataAvailable==0)
+    if(_decodedRemaining==0)
       return E_END_OF_STREAM;
 
     // return the next byte
 
-    if(readNextUncompressedByte(nextByte))
-      return nextByte;
+    if(!read(&nextByte,1,actuallyRead))
+      return E_STREAM_ERROR;
 
-    return false;
+    return nextByte;
   }
 
 
-  bool LzgDecompressionStream::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
+  /*
+   * Read a block of bytes. Fewer than requested are returned only at the end of the stream.
+   */
+
+  bool LzgWindowDecompressionStream::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
 
     uint8_t *ptr;
+    uint32_t count;
 
     ptr=static_cast<uint8_t *>(buffer);
     actuallyRead=0;
 
-    while(size-- && available()) {
+    if(size>_decodedRemaining)
+      size=_decodedRemaining;
+
+    while(size) {
 
-      if(!readNextUncompressedByte(*ptr++))
+      if((count=decode(ptr,size))==0)
         return false;
 
-      actuallyRead++;
+      ptr+=count;
+      size-=count;
+      actuallyRead+=count;
+
+      _decodedRemaining-=count;
+      _decodedSoFar+=count;
+    }
+
+    // if that was the end then all the input should have been used and the checksum must match
+
+    if(actuallyRead && _decodedRemaining==0) {
+
+      if(_encodedRemaining || _inputPosition!=_inputAvailable)
+        return fail(E_CORRUPT_DATA);
+
+      if(((static_cast<uint32_t>(_checksumB) << 16) | _checksumA)!=_checksum)
+        return fail(E_CHECKSUM_MISMATCH);
     }
 
     return true;
@@ -112,17 +197,34 @@ namespace stm32plus {
    * Can't close, and can't go wrong either
    */
 
-  bool LzgDecompressionStream::close() {
+  bool LzgWindowDecompressionStream::close() {
     return true;
   }
 
 
   /*
-   * Can't skip
+   * Skip forward by decompressing and discarding the data
    */
 
-  bool LzgDecompressionStream::skip(uint32_t howMuch __attribute__((unused))) {
-    return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_OPERATION_NOT_SUPPORTED);
+  bool LzgWindowDecompressionStream::skip(uint32_t howMuch) {
+
+    uint8_t discard[32];
+    uint32_t count,actuallyRead;
+
+    if(howMuch>_decodedRemaining)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_END_OF_STREAM);
+
+    while(howMuch) {
+
+      count=howMuch<sizeof(discard) ? howMuch : sizeof(discard);
+
+      if(!read(discard,count,actuallyRead))
+        return false;
+
+      howMuch-=count;
+    }
+
+    return true;
   }
 
 
@@ -130,8 +232,8 @@ namespace stm32plus {
    * Return true if there is data available
    */
 
-  bool LzgDecompressionStream::available() {
-    return _compressedDataAvailable>0 || _historyCopyDataAvailable>0;
+  bool LzgWindowDecompressionStream::available() {
+    return _decodedRemaining>0;
   }
 
 
@@ -140,163 +242,347 @@ namespace stm32plus {
    * started at the beginning of the input stream
    */
 
-  bool LzgDecompressionStream::reset() {
+  bool LzgWindowDecompressionStream::reset() {
     return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_OPERATION_NOT_SUPPORTED);
   }
 
 
   /*
-   * Read the next uncompressed byte from the stream
+   * Decode at least one and up to size bytes. Returns the number decoded or zero if
+   * there was an error.
    */
 
-  bool LzgDecompressionStream::readNextUncompressedByte(uint8_t& nextByte) {
+  uint32_t LzgWindowDecompressionStream::decode(uint8_t *ptr,uint32_t size) {
 
-    uint8_t symbol,b,b2;
-    uint16_t offset,length;
+    uint32_t count;
 
-    // if we're in mid-copy from the history window, take the next byte from there
+    for(;;) {
 
-    if(_historyCopyDataAvailable>0) {
-      nextByte=getByteFromHistoryCopy();
-      return true;
+      // finish off a copy from the history window
+
+      if(_copyRemaining)
+        return decodeCopy(ptr,size);
+
+      // need some input
+
+      if(_inputPosition==_inputAvailable && !fillInput(1))
+        return 0;
+
+      // run of literals
+
+      if(_method==METHOD_COPY || !_isMarkerSymbolLUT[_inputBuffer[_inputPosition]])
+        return decodeLiterals(ptr,size);
+
+      // marker: either an escaped marker symbol or the start of a copy
+
+      if(!decodeMarker(ptr,count))
+        return 0;
+
+      if(count)
+        return count;
     }
+  }
+
+
+  /*
+   * Copy a run of literal bytes from the input buffer. In copy mode, once the buffer is
+   * empty, read directly from the input stream into the caller's buffer.
+   */
+
+  uint32_t LzgWindowDecompressionStream::decodeLiterals(uint8_t *ptr,uint32_t size) {
+
+    const uint8_t *first,*last,*end;
+    uint32_t count,actuallyRead;
+
+    first=_inputBuffer+_inputPosition;
+    count=_inputAvailable-_inputPosition;
 
-    // get the next symbol
+    if(count>size)
+      count=size;
+
+    end=first+count;
+
+    if(_method==METHOD_COPY) {
+
+      // fill up the rest of the caller's buffer straight from the input
+
+      memcpy(ptr,first,count);
+      _inputPosition+=count;
+
+      if(count<size && _encodedRemaining) {
+
+        if(!_input.read(ptr+count,size-count,actuallyRead))
+          return 0;
+
+        addToChecksum(ptr+count,actuallyRead);
+        _encodedRemaining-=actuallyRead;
+        count+=actuallyRead;
+      }
 
-    if(!nextByteFromStream(symbol))
+      return count;
+    }
+
+    // find the end of the run
+
+    for(last=first;last!=end && !_isMarkerSymbolLUT[*last];last++);
+
+    count=last-first;
+
+    memcpy(ptr,first,count);
+    addToWindow(first,count);
+
+    _inputPosition+=count;
+    return count;
+  }
+
+
+  /*
+   * Decode a marker symbol. An escaped marker is a literal and is written to ptr. Otherwise
+   * the offset and length of the copy are decoded and checked.
+   */
+
+  bool LzgWindowDecompressionStream::decodeMarker(uint8_t *ptr,uint32_t& produced) {
+
+    const uint8_t *p;
+    uint8_t symbol,b;
+    uint32_t offset,length;
+
+    produced=0;
+
+    if(!fillInput(2))
       return false;
 
-    // Marker symbol?
+    p=_inputBuffer+_inputPosition;
+    symbol=p[0];
+    b=p[1];
+
+    if(b==0) {
 
-    if(!_isMarkerSymbolLUT[symbol]) {
+      // single occurrence of a marker symbol
 
-      // Literal copy
+      *ptr=symbol;
+      addToWindow(ptr,1);
 
-      nextByte=symbol;
+      _inputPosition+=2;
+      produced=1;
+      return true;
+    }
 
-      *_dst++=symbol;
-      if(_dst==_dstEnd)
-        _dst=_circbuf;
-    } else {
+    if(symbol==_marker1) {
 
-      if(!nextByteFromStream(b))
+      // distant copy
+
+      if(!fillInput(4))
         return false;
 
-      if(b) {
+      p=_inputBuffer+_inputPosition;
 
-        // Decode offset / length parameters
+      length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+      offset=((static_cast<uint32_t>(b & 0xe0) << 11) | (p[2] << 8) | p[3])+2056;
 
-        if(symbol == _marker1) {
+      _inputPosition+=4;
+    }
+    else if(symbol==_marker2) {
 
-          // distant copy is not supported on the STM32 due to lack of SRAM)
+      // medium copy
 
-          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_UNSUPPORTED_COMPRESSED_DATA);
+      if(!fillInput(3))
+        return false;
 
-        } else if(symbol == _marker2) {
+      p=_inputBuffer+_inputPosition;
 
-          // Medium copy
+      length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+      offset=((static_cast<uint32_t>(b & 0xe0) << 3) | p[2])+8;
 
-          length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+      _inputPosition+=3;
+    }
+    else if(symbol==_marker3) {
 
-          if(!nextByteFromStream(b2))
-            return false;
+      // short copy
 
-          offset=(((uint16_t)(b & 0xe0)) << 3) | b2;
-          offset+=8;
-        } else if(symbol == _marker3) {
+      length=(b >> 6)+3;
+      offset=(b & 0x3f)+8;
 
-          // Short copy
+      _inputPosition+=2;
+    }
+    else {
+
+      // near copy (including RLE)
+
+      length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+      offset=(b >> 5)+1;
+
+      _inputPosition+=2;
+    }
 
-          length=(b >> 6) + 3;
-          offset=(b & 0x3f) + 8;
-        } else {
+    // the copy must refer to data that we've decoded, and still have, and it must
+    // not run past the end of the output
 
-          // Near copy (including RLE)
+    if(offset>_decodedSoFar || length>_decodedRemaining)
+      return fail(E_CORRUPT_DATA);
 
-          length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
-          offset=(b >> 5) + 1;
-        }
+    if(offset>_windowSize)
+      return fail(E_UNSUPPORTED_COMPRESSED_DATA);
+
+    _copyPosition=_windowPosition>=offset ? _windowPosition-offset : _windowPosition+_windowSize-offset;
+    _copyRemaining=length;
+
+    return true;
+  }
+
+
+  /*
+   * Continue a copy from the history window. The copy is done in chunks that don't cross the
+   * end of the window. Chunks where the source and destination don't overlap go with memcpy,
+   * the others (such as RLE) need a forward byte loop.
+   */
 
-        // Copy corresponding data from history window
+  uint32_t LzgWindowDecompressionStream::decodeCopy(uint8_t *ptr,uint32_t size) {
 
-        if(offset<=static_cast<uint16_t>(_dst-_circbuf))
-          _historyCopyPosition=_dst-offset;
-        else
-          _historyCopyPosition=_dstEnd-(offset-(uint16_t)(_dst-_circbuf));
+    uint8_t *src,*dst;
+    uint32_t count,chunk,distance,i;
 
-        _historyCopyDataAvailable=length;
+    count=_copyRemaining<size ? _copyRemaining : size;
+    _copyRemaining-=count;
+    size=count;
 
-        nextByte=getByteFromHistoryCopy();
+    while(size) {
 
-      } else {
+      chunk=size;
 
-        // single occurance of a marker symbol
+      if(chunk>_windowSize-_copyPosition)
+        chunk=_windowSize-_copyPosition;
 
-        nextByte=symbol;
+      if(chunk>_windowSize-_windowPosition)
+        chunk=_windowSize-_windowPosition;
 
-        *_dst++=symbol;
-        if(_dst==_dstEnd)
-          _dst=_circbuf;
+      src=_window+_copyPosition;
+      dst=_window+_windowPosition;
+
+      distance=dst>src ? dst-src : src-dst;
+
+      if(chunk<=distance)
+        memcpy(dst,src,chunk);
+      else {
+        for(i=0;i<chunk;i++)
+          dst[i]=src[i];
       }
+
+      memcpy(ptr,dst,chunk);
+
+      ptr+=chunk;
+      size-=chunk;
+
+      if((_copyPosition+=chunk)==_windowSize)
+        _copyPosition=0;
+
+      if((_windowPosition+=chunk)==_windowSize)
+        _windowPosition=0;
     }
 
-    return true;
+    return count;
   }
 
 
   /*
-   * Get next byte from input stream
+   * Make sure that there are at least 'required' unread bytes in the input buffer. The unread
+   * bytes are moved down to the start and the rest of the buffer is filled from the input.
    */
 
-  bool LzgDecompressionStream::nextByteFromStream(uint8_t& nextByte) {
+  bool LzgWindowDecompressionStream::fillInput(uint8_t required) {
 
-    int16_t value;
+    uint32_t count,actuallyRead;
 
-    // must have a byte to read
+    count=_inputAvailable-_inputPosition;
 
-    if(_compressedSize==0)
-      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_END_OF_STREAM);
+    if(count>=required)
+      return true;
 
-    // read next byte
+    memmove(_inputBuffer,_inputBuffer+_inputPosition,count);
 
-    if((value=_input.read())<0)
-      return false;
+    _inputPosition=0;
+    _inputAvailable=count;
+
+    while(_inputAvailable<required) {
+
+      if(_encodedRemaining==0)
+        return fail(E_CORRUPT_DATA);
+
+      count=INPUT_BUFFER_SIZE-_inputAvailable;
+      if(count>_encodedRemaining)
+        count=_encodedRemaining;
 
-    // return it
+      if(!_input.read(_inputBuffer+_inputAvailable,count,actuallyRead))
+        return false;
+
+      if(actuallyRead==0)
+        return fail(E_CORRUPT_DATA);
 
-    nextByte=value;
-    _compressedSize--;
+      addToChecksum(_inputBuffer+_inputAvailable,actuallyRead);
+
+      _inputAvailable+=actuallyRead;
+      _encodedRemaining-=actuallyRead;
+    }
 
     return true;
   }
 
 
   /*
-   * Get one byte from the available data in this history window.
-   * Data must be available!
+   * Add decoded data to the history window
    */
 
-  uint8_t LzgDecompressionStream::getByteFromHistoryCopy() {
+  void LzgWindowDecompressionStream::addToWindow(const uint8_t *ptr,uint32_t size) {
 
-    uint8_t retval;
+    uint32_t chunk;
 
-    // get the next value from the copy position, copy back to the circular buffer
+    while(size) {
 
-    retval=*_historyCopyPosition++;
-    *_dst++=retval;
+      chunk=_windowSize-_windowPosition;
+      if(chunk>size)
+        chunk=size;
 
-    // copy position and source pointer are both in the circular buffer and must be updated
+      memcpy(_window+_windowPosition,ptr,chunk);
 
-    if(_dst==_dstEnd)
-      _dst=_circbuf;
+      ptr+=chunk;
+      size-=chunk;
 
-    if(_historyCopyPosition==_dstEnd)
-      _historyCopyPosition=_circbuf;
+      if((_windowPosition+=chunk)==_windowSize)
+        _windowPosition=0;
+    }
+  }
+
+
+  /*
+   * Add encoded data to the running checksum
+   */
+
+  void LzgWindowDecompressionStream::addToChecksum(const uint8_t *ptr,uint32_t size) {
+
+    uint16_t a,b;
+
+    a=_checksumA;
+    b=_checksumB;
+
+    while(size--) {
+      a+=*ptr++;
+      b+=a;
+    }
+
+    _checksumA=a;
+    _checksumB=b;
+  }
+
+
+  /*
+   * Set an error and end the stream
+   */
 
-    // that's one less byte available for next time
+  bool LzgWindowDecompressionStream::fail(uint32_t errorCode) {
 
-    _historyCopyDataAvailable--;
+    _decodedRemaining=0;
+    _copyRemaining=0;
 
-    return retval;
+    return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,errorCode);
   }
 }
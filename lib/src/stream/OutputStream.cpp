@@ -90,4 +90,100 @@ namespace stm32plus {
     write(string,strlen(string));
     return *this;
   }
+
+
+  /**
+   * Write a list of buffers by calling write() for each one
+   * @param[in] vectors The buffers to write.
+   * @param[in] count The number of buffers.
+   * @return false if the write fails.
+   */
+
+  bool OutputStream::writev(const IoVector *vectors,uint32_t count) {
+
+    uint32_t i;
+
+    for(i=0;i<count;i++)
+      if(!write(vectors[i].data,vectors[i].size))
+        return false;
+
+    return true;
+  }
+
+
+  /*
+   * writev() for streams where each write() is expensive. The bounce buffer is filled from
+   * the list in order and written out whenever it's full, so neighbouring buffers share a
+   * write() even when one of them is large. The middle of a buffer that's at least as big
+   * as the bounce buffer is written in place so that large payloads aren't copied. Its
+   * tail is held back if that lets it go out with the buffers that follow it.
+   *
+   * e.g. with a 256 byte bounce buffer a 20 byte header, a 300 byte payload and a 10 byte
+   * trailer take two writes. A payload too big to share the two bounce writes needs a third
+   * in place.
+   */
+
+  bool OutputStream::writevBuffered(const IoVector *vectors,uint32_t count,uint8_t *buffer,uint32_t bufferSize) {
+
+    const uint8_t *data;
+    uint32_t i,j,used,size,chunk,following;
+
+    used=0;
+
+    for(i=0;i<count;i++) {
+
+      data=static_cast<const uint8_t *>(vectors[i].data);
+      size=vectors[i].size;
+
+      // top up a part-filled bounce buffer from the head of this one
+
+      if(used) {
+
+        chunk=bufferSize-used;
+        if(chunk>size)
+          chunk=size;
+
+        memcpy(buffer+used,data,chunk);
+
+        used+=chunk;
+        data+=chunk;
+        size-=chunk;
+
+        if(size==0)
+          continue;
+
+        // it's full
+
+        if(!write(buffer,used))
+          return false;
+
+        used=0;
+      }
+
+      if(size>=bufferSize) {
+
+        // add up what follows, up to a bounce buffer's worth, to see how much of the
+        // tail can go out with it
+
+        following=0;
+        for(j=i+1;j<count && following<bufferSize;j++)
+          following+=vectors[j].size;
+
+        chunk=following>0 && following<bufferSize ? bufferSize-following : 0;
+
+        if(!write(data,size-chunk))
+          return false;
+
+        data+=size-chunk;
+        size=chunk;
+      }
+
+      // gather what's left of it
+
+      memcpy(buffer,data,size);
+      used=size;
+    }
+
+    return used==0 || write(buffer,used);
+  }
 }
@@ -0,0 +1,268 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+#include "config/stream.h"
+
+
+namespace stm32plus {
+
+  /**
+   * Constructor
+   * @param source Where the data comes from
+   * @param sink Where the data goes to
+   * @param buffers bufferCount*bufferSize bytes of memory. Must not go out of scope while this object exists.
+   * @param bufferSize The size of each buffer. This is the most that's read or written at once.
+   * @param bufferCount The number of buffers, 2 to MAX_BUFFERS.
+   */
+
+  StreamPump::StreamPump(StreamPumpSource& source,StreamPumpSink& sink,void *buffers,uint32_t bufferSize,uint8_t bufferCount)
+    : _source(source),
+      _sink(sink),
+      _buffers(static_cast<uint8_t *>(buffers)),
+      _bufferSize(bufferSize),
+      _bufferCount(bufferCount>MAX_BUFFERS ? static_cast<uint8_t>(MAX_BUFFERS) : bufferCount) {
+
+    reset();
+  }
+
+
+  /**
+   * Get ready for a new transfer and reset the statistics. Don't call this while a transfer
+   * is in progress.
+   * @param limit The most bytes to transfer. The default is to transfer until the source
+   *   reports the end of its input.
+   */
+
+  void StreamPump::reset(uint32_t limit) {
+
+    _readIndex=0;
+    _writeIndex=0;
+    _filled=0;
+
+    _reading=false;
+    _writing=false;
+    _endOfInput=limit==0;
+    _sourceWaiting=false;
+    _sinkWaiting=false;
+
+    _remaining=limit;
+    _bytesRead=0;
+    _bytesWritten=0;
+    _sourceStalls=0;
+    _sinkStalls=0;
+    _startTime=_endTime=MillisecondTimer::millis();
+  }
+
+
+  /**
+   * Move the transfer on as far as it can go without waiting. Completed reads and writes are
+   * collected and then new ones are started. The write is started before the read so that a
+   * synchronous source runs while an asynchronous sink is busy.
+   * @return false if the source or sink failed
+   */
+
+  bool StreamPump::poll() {
+
+    bool complete;
+    uint32_t actuallyRead,size;
+
+    // collect a finished write
+
+    if(_writing) {
+
+      if(!_sink.pollWrite(complete))
+        return false;
+
+      if(complete) {
+        _bytesWritten+=_lengths[_writeIndex];
+        _writeIndex=nextIndex(_writeIndex);
+        _filled--;
+        _writing=false;
+      }
+    }
+
+    // collect a finished read
+
+    if(_reading) {
+
+      if(!_source.pollRead(complete,actuallyRead))
+        return false;
+
+      if(complete) {
+
+        _reading=false;
+
+        if(actuallyRead==0)
+          _endOfInput=true;
+        else {
+
+          _lengths[_readIndex]=actuallyRead;
+          _readIndex=nextIndex(_readIndex);
+          _filled++;
+
+          _bytesRead+=actuallyRead;
+
+          if((_remaining-=actuallyRead)==0)
+            _endOfInput=true;
+        }
+      }
+    }
+
+    // start a write if the sink is idle. count the times that it runs dry.
+
+    if(!_writing) {
+
+      if(_filled) {
+
+        if(!_sink.beginWrite(getBuffer(_writeIndex),_lengths[_writeIndex]))
+          return false;
+
+        _writing=true;
+        _sinkWaiting=false;
+      }
+      else if(!_sinkWaiting && !_endOfInput) {
+        _sinkWaiting=true;
+        _sinkStalls++;
+      }
+    }
+
+    // start a read if the source is idle. count the times that there's nowhere to put it.
+
+    if(!_reading && !_endOfInput) {
+
+      if(_filled<_bufferCount) {
+
+        size=_remaining<_bufferSize ? _remaining : _bufferSize;
+
+        if(!_source.beginRead(getBuffer(_readIndex),size))
+          return false;
+
+        _reading=true;
+        _sourceWaiting=false;
+      }
+      else if(!_sourceWaiting) {
+        _sourceWaiting=true;
+        _sourceStalls++;
+      }
+    }
+
+    if(isComplete())
+      _endTime=MillisecondTimer::millis();
+
+    return true;
+  }
+
+
+  /**
+   * Poll until the transfer is complete
+   * @return false if the source or sink failed
+   */
+
+  bool StreamPump::run() {
+
+    while(!isComplete())
+      if(!poll())
+        return false;
+
+    return true;
+  }
+
+
+  /**
+   * Check if the transfer has finished. The source has reached the end of its input or the
+   * limit, and everything read has been written.
+   * @return true if it has finished
+   */
+
+  bool StreamPump::isComplete() const {
+    return _endOfInput && !_reading && !_writing && _filled==0;
+  }
+
+
+  /**
+   * Get the number of bytes read from the source
+   * @return The number of bytes
+   */
+
+  uint32_t StreamPump::getBytesRead() const {
+    return _bytesRead;
+  }
+
+
+  /**
+   * Get the number of bytes written to the sink
+   * @return The number of bytes
+   */
+
+  uint32_t StreamPump::getBytesWritten() const {
+    return _bytesWritten;
+  }
+
+
+  /**
+   * Get the time taken by the transfer, or the time so far if it's still running
+   * @return The time in milliseconds
+   */
+
+  uint32_t StreamPump::getElapsedMillis() const {
+    return (isComplete() ? _endTime : MillisecondTimer::millis())-_startTime;
+  }
+
+
+  /**
+   * Get the average throughput of the transfer
+   * @return Bytes written per second
+   */
+
+  uint32_t StreamPump::getBytesPerSecond() const {
+
+    uint32_t elapsed;
+
+    elapsed=getElapsedMillis();
+    return elapsed ? static_cast<uint32_t>((static_cast<uint64_t>(_bytesWritten)*1000)/elapsed) : 0;
+  }
+
+
+  /**
+   * Get the number of times that the source was ready to read but all the buffers were
+   * full. A high count means the sink is the bottleneck.
+   * @return The stall count
+   */
+
+  uint32_t StreamPump::getSourceStalls() const {
+    return _sourceStalls;
+  }
+
+
+  /**
+   * Get the number of times that the sink was ready to write but there was nothing to
+   * write. A high count means the source is the bottleneck.
+   * @return The stall count
+   */
+
+  uint32_t StreamPump::getSinkStalls() const {
+    return _sinkStalls;
+  }
+
+
+  /*
+   * Get the address of a buffer
+   */
+
+  uint8_t *StreamPump::getBuffer(uint8_t index) const {
+    return _buffers+index*_bufferSize;
+  }
+
+
+  /*
+   * Get the index of the buffer after this one
+   */
+
+  uint8_t StreamPump::nextIndex(uint8_t index) const {
+    return index+1==_bufferCount ? 0 : index+1;
+  }
+}
@@ -13,6 +13,7 @@ namespace stm32plus {
 
 
   volatile uint32_t MillisecondTimer::_counter;
+  MillisecondTimer::TickHook * volatile MillisecondTimer::_tickHooks=nullptr;
 
 
   /**
@@ -46,6 +47,11 @@ namespace stm32plus {
 
 extern "C" {
   void __attribute__ ((weak,interrupt("IRQ"))) SysTick_Handler(void) {
+    stm32plus::MillisecondTimer::TickHook *hook;
+
     stm32plus::MillisecondTimer::_counter++;
+
+    for(hook=stm32plus::MillisecondTimer::_tickHooks;hook;hook=hook->next)
+      hook->function(hook->context);
   }
 }
@@ -0,0 +1,52 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "hosttest/VirtualClock.h"
+
+
+namespace stm32plus {
+
+  int IrqSuspend::depth=0;
+
+  volatile uint32_t MillisecondTimer::_counter;
+  MillisecondTimer::TickHook * volatile MillisecondTimer::_tickHooks=nullptr;
+
+  bool hosttest::VirtualClock::_ticking=false;
+
+
+  /**
+   * Nothing to set up on the host
+   */
+
+  void MillisecondTimer::initialise() {
+    _counter=0;
+  }
+
+
+  /**
+   * A delay on the host just moves the virtual clock on. Waiting inside a tick hook would hang
+   * the device so it's a test failure here.
+   */
+
+  void MillisecondTimer::delay(uint32_t millis) {
+
+    if(hosttest::VirtualClock::isTicking()) {
+      fprintf(stderr,"MillisecondTimer::delay() called from a tick hook\n");
+      abort();
+    }
+
+    hosttest::VirtualClock::advance(millis);
+  }
+
+
+  /**
+   * An IRQ is active while the tick hooks run
+   */
+
+  bool Nvic::isAnyIrqActive() {
+    return hosttest::VirtualClock::isTicking();
+  }
+}
@@ -0,0 +1,252 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * InternalFlashKeyValueStorage on the flash simulator.
+ *
+ *  1. A random workload of writes and removes, remounting now and again and comparing every
+ *     key with a model.
+ *  2. Every write that compacts a page is repeated with a power failure after each of its
+ *     flash operations. The store must mount again with every other key intact and this key
+ *     either old or new. It must also survive carrying on with the same object after the
+ *     failure, which must never erase a page whose records haven't been copied.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include "hosttest/Host.h"
+#include "hosttest/FlashShims.h"
+#include "flash/internal/InternalFlashWordWriter.h"
+#include "flash/internal/InternalFlashKeyValueStorage.h"
+#include "flash/internal/InternalFlashSimulator.h"
+
+
+using namespace stm32plus;
+
+typedef InternalFlashKeyValueStorage<InternalFlashSimulator,64> Storage;
+typedef std::map<int,std::string> Model;
+
+enum {
+  BASE = 0x08070000,
+  PROBE_KEY = 62            // keys from here up are scratch and not in the model
+};
+
+static int failures=0;
+
+#define CHECK(x) do { if(!(x)) { failures++; printf("FAIL %s:%d: %s (error %08x)\n",__FILE__,__LINE__,#x,errorProvider.getLast()); } } while(0)
+
+
+/*
+ * Compare the storage with the model, optionally ignoring one key
+ */
+
+static bool matches(const Storage& storage,Model& model,int skip=-1) {
+
+  char buffer[2048];
+  uint16_t actualSize;
+  bool found;
+  int key;
+
+  for(key=0;key<PROBE_KEY;key++) {
+
+    if(key==skip)
+      continue;
+
+    found=storage.read(key,buffer,sizeof(buffer),actualSize);
+
+    if(model.count(key)) {
+      if(!found || actualSize!=model[key].size() || memcmp(buffer,model[key].data(),actualSize)!=0)
+        return false;
+    }
+    else if(found)
+      return false;
+  }
+
+  return true;
+}
+
+
+static std::string randomValue(int length) {
+
+  std::string value;
+
+  while(length--)
+    value+=static_cast<char>(rand());
+
+  return value;
+}
+
+
+/*
+ * 1. Random workload
+ */
+
+static void testWorkload() {
+
+  std::vector<uint8_t> memory(2048*4);
+  InternalFlashSimulator flash(memory.data(),BASE,memory.size(),2048);
+  Storage::Parameters params(BASE,memory.size());
+  Model model;
+  std::string value;
+  int i,key;
+
+  flash.chipErase();
+
+  Storage storage(flash,params);
+
+  CHECK(!storage.mount());
+  CHECK(storage.format());
+
+  srand(1);
+
+  for(i=0;i<20000;i++) {
+
+    key=rand()%40;
+
+    if(rand()%10==0) {
+      CHECK(storage.remove(key));
+      model.erase(key);
+      continue;
+    }
+
+    value=randomValue(key<10 ? 4 : key<30 ? rand()%20 : rand()%100);
+
+    CHECK(storage.write(key,value.data(),value.size()));
+    model[key]=value;
+
+    if(i % 1000==0) {
+      Storage remounted(flash,params);
+      CHECK(remounted.mount() && matches(remounted,model));
+    }
+  }
+
+  printf("workload: %u word programs, %u page erases\n",flash.getWordProgramCount(),flash.getPageEraseCount());
+}
+
+
+/*
+ * 2. Power failures during compaction
+ */
+
+static void testCompactionPowerFail() {
+
+  std::vector<uint8_t> memory(1024*3),saved;
+  InternalFlashSimulator flash(memory.data(),BASE,memory.size(),1024);
+  Storage::Parameters params(BASE,memory.size());
+  Model model;
+  std::string value;
+  uint32_t operations,failAt,probe,readBack;
+  int trial,key,compactions,failPoints,i;
+  char buffer[64];
+  uint16_t actualSize;
+  bool isNew,isOld,found;
+
+  flash.chipErase();
+
+  {
+    Storage storage(flash,params);
+    CHECK(storage.format());
+  }
+
+  srand(3);
+  compactions=failPoints=0;
+
+  for(trial=0;trial<400;trial++) {
+
+    key=rand()%30;
+    value=randomValue(8+rand()%24);
+    saved=memory;
+
+    // count the flash operations in this write
+
+    {
+      Storage storage(flash,params);
+      CHECK(storage.mount());
+      flash.resetCounters();
+      CHECK(storage.write(key,value.data(),value.size()));
+      operations=flash.getWordProgramCount()+flash.getPageEraseCount();
+    }
+
+    if(flash.getPageEraseCount()>0) {
+
+      compactions++;
+
+      for(failAt=0;failAt<operations;failAt++) {
+
+        // fail, then remount
+
+        memory=saved;
+
+        {
+          Storage storage(flash,params);
+          CHECK(storage.mount());
+          flash.setOperationsUntilPowerFail(failAt);
+          storage.write(key,value.data(),value.size());
+          flash.setOperationsUntilPowerFail(UINT32_MAX);
+        }
+
+        Storage remounted(flash,params);
+
+        CHECK(remounted.mount());
+        CHECK(matches(remounted,model,key));
+
+        found=remounted.read(key,buffer,sizeof(buffer),actualSize);
+        isNew=found && actualSize==value.size() && memcmp(buffer,value.data(),actualSize)==0;
+        isOld=model.count(key) ? found && actualSize==model[key].size() && memcmp(buffer,model[key].data(),actualSize)==0 : !found;
+        CHECK(isNew || isOld);
+
+        probe=failAt;
+        CHECK(remounted.write(PROBE_KEY+1,probe) && remounted.read(PROBE_KEY+1,readBack) && readBack==probe);
+
+        // fail, then carry on with the same object
+
+        memory=saved;
+
+        {
+          Storage storage(flash,params);
+          CHECK(storage.mount());
+          flash.setOperationsUntilPowerFail(failAt);
+          storage.write(key,value.data(),value.size());
+          flash.setOperationsUntilPowerFail(UINT32_MAX);
+
+          for(i=0;i<40;i++) {
+            probe=i;
+            storage.write(PROBE_KEY,probe);
+          }
+        }
+
+        Storage carriedOn(flash,params);
+        CHECK(carriedOn.mount() && matches(carriedOn,model,key));
+
+        failPoints++;
+      }
+    }
+
+    // now do it for real
+
+    memory=saved;
+
+    {
+      Storage storage(flash,params);
+      CHECK(storage.mount() && storage.write(key,value.data(),value.size()));
+    }
+
+    model[key]=value;
+  }
+
+  printf("compaction power fail: %d compacting writes, %d failure points\n",compactions,failPoints);
+}
+
+
+int main() {
+
+  testWorkload();
+  testCompactionPowerFail();
+
+  printf(failures ? "FAILED (%d)\n" : "PASSED\n",failures);
+  return failures!=0;
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * The names that the internal flash headers refer to for the real device. The simulator
+ * replaces all of them, they only need to exist.
+ */
+
+#include "error/ErrorProvider.h"
+
+
+namespace stm32plus {
+
+  struct InternalFlashLockFeature {
+    struct LockManager {
+    };
+  };
+
+  enum {
+    PERIPHERAL_CRC
+  };
+
+  template<int TPeripheral>
+  struct ClockControl {
+    static void On() {}
+  };
+
+  inline void CRC_ResetDR() {}
+  inline void CRC_CalcCRC(uint32_t) {}
+  inline uint32_t CRC_GetCRC() { return 0; }
+}
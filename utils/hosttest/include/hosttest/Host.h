@@ -0,0 +1,63 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Host stand-ins for the few core peripheral classes that the portable parts of the library
+ * touch. Include this before any library header in a host test.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+
+namespace stm32plus {
+
+  namespace hosttest {
+    class VirtualClock;
+  }
+
+
+  /**
+   * IrqSuspend counts how deeply interrupts are suspended so tests can check that code
+   * doesn't leave them off or call out with them off.
+   */
+
+  struct IrqSuspend {
+
+    static int depth;
+
+    IrqSuspend() {
+      depth++;
+    }
+
+    ~IrqSuspend() {
+      depth--;
+    }
+
+    static void suspend() {
+      depth++;
+    }
+
+    static void resume() {
+      depth--;
+    }
+  };
+
+
+  /**
+   * The only NVIC call that portable code makes is the IRQ-context test. On the host an IRQ is
+   * active while the virtual clock is running the SysTick hooks.
+   */
+
+  struct Nvic {
+    static bool isAnyIrqActive();
+  };
+}
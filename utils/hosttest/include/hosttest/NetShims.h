@@ -0,0 +1,52 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Just enough of the device environment for the network timers to build against the host's
+ * standard library. Include after hosttest/VirtualClock.h and before the network headers.
+ */
+
+#include <list>
+#include "event/slot.h"
+
+
+/*
+ * The device STL has an slist. A list does the same job for the ticker's subscriber list.
+ */
+
+namespace std {
+  template<class T> struct slist : std::list<T> {
+  };
+}
+
+
+/*
+ * The event signatures are only needed by the network event sources
+ */
+
+#ifndef DECLARE_EVENT_SIGNATURE
+#define DECLARE_EVENT_SIGNATURE(name,signature)
+#endif
+
+
+namespace stm32plus {
+
+  /**
+   * The RTC counts seconds of virtual time
+   */
+
+  struct RtcBase {
+    uint32_t getTick() const {
+      return MillisecondTimer::millis()/1000;
+    }
+  };
+
+  struct RtcSecondInterruptFeature : RtcBase {
+  };
+}
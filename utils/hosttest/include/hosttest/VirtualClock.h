@@ -0,0 +1,87 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include "hosttest/Host.h"
+#include "timing/MillisecondTimer.h"
+
+
+namespace stm32plus {
+  namespace hosttest {
+
+
+    /**
+     * A virtual millisecond clock for host builds. It takes the place of the SysTick interrupt:
+     * each tick increments the MillisecondTimer counter and calls the tick hooks, so the
+     * NetworkIntervalTicker and everything on its timer wheel run as they do on the device
+     * but only when the test moves time on. Runs are repeatable and an hour of network time
+     * takes as long as the timers take to service.
+     */
+
+    class VirtualClock {
+
+      protected:
+        static bool _ticking;
+
+      public:
+        static void set(uint32_t now);
+        static void tick();
+        static void advance(uint32_t millis);
+        static bool isTicking();
+    };
+
+
+    /**
+     * Set the time. Do this before anything has armed a timer.
+     * @param now The new counter value
+     */
+
+    inline void VirtualClock::set(uint32_t now) {
+      MillisecondTimer::_counter=now;
+    }
+
+
+    /**
+     * Move time on by one millisecond and call the tick hooks, just like SysTick_Handler.
+     */
+
+    inline void VirtualClock::tick() {
+
+      MillisecondTimer::TickHook *hook;
+
+      MillisecondTimer::_counter++;
+
+      _ticking=true;
+
+      for(hook=MillisecondTimer::_tickHooks;hook;hook=hook->next)
+        hook->function(hook->context);
+
+      _ticking=false;
+    }
+
+
+    /**
+     * Move time on, ticking once per millisecond
+     * @param millis The number of milliseconds
+     */
+
+    inline void VirtualClock::advance(uint32_t millis) {
+      while(millis--)
+        tick();
+    }
+
+
+    /**
+     * Check if we're inside the virtual SysTick
+     * @return true if the tick hooks are running
+     */
+
+    inline bool VirtualClock::isTicking() {
+      return _ticking;
+    }
+  }
+}
@@ -0,0 +1,20 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Stands in for the library's config/net.h. Just the address types and the caches.
+ */
+
+#include "memory/scoped_array.h"
+#include "string/StringUtil.h"
+#include "net/NetUtil.h"
+#include "net/network/ip/IpAddress.h"
+#include "net/datalink/MacAddress.h"
+#include "net/network/arp/ArpCache.h"
+#include "net/application/dns/DnsCache.h"
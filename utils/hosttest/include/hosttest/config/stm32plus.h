@@ -0,0 +1,20 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Stands in for the library's config/stm32plus.h when a library source file is compiled for
+ * the host. Only the objects that need it put include/hosttest on the include path.
+ */
+
+#include <cctype>
+#include <strings.h>
+#include "hosttest/VirtualClock.h"
+#include "hosttest/NetShims.h"
+
+#define STM32PLUS_F4_HAS_MAC
@@ -0,0 +1,260 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests and benchmarks for spsc_ring_buffer.
+ *
+ *   1. A producer thread stands in for the IRQ handler and writes a numbered sequence while
+ *      the main thread reads it. Both sides mix the single element, copying and zero-copy
+ *      calls and pick their sizes at random. Every element must arrive once and in order.
+ *   2. The same with the free-running indices starting just below 2^32 so they wrap during
+ *      the run.
+ *   3. Single threaded throughput of spsc_ring_buffer against circular_buffer for single
+ *      elements and for blocks.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "hosttest/Host.h"
+#include "memory/circular_buffer.h"
+#include "memory/spsc_ring_buffer.h"
+
+
+using namespace stm32plus;
+
+static int failures=0;
+
+#define CHECK(x) do { if(!(x)) { failures++; printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#x); } } while(0)
+
+
+/*
+ * Lets a test start the indices anywhere
+ */
+
+class TestRingBuffer : public spsc_ring_buffer<uint32_t> {
+
+  public:
+    TestRingBuffer(uint32_t size,uint32_t startIndex)
+      : spsc_ring_buffer<uint32_t>(size) {
+      _writeIndex=_readIndex=startIndex;
+    }
+};
+
+
+/*
+ * The producer. Writes the numbers 0..count-1. When the buffer's full it yields so that the
+ * consumer gets to run on a single core host.
+ */
+
+static void producer(TestRingBuffer& ring,uint32_t count,unsigned seed) {
+
+  std::mt19937 random(seed);
+  spsc_ring_buffer<uint32_t>::region r;
+  uint32_t next,block[64],i,size,written;
+
+  next=0;
+
+  while(next!=count) {
+
+    if(ring.availableToWrite()==0)
+      std::this_thread::yield();
+
+    size=std::min<uint32_t>(random() % 64+1,count-next);
+
+    switch(random() % 3) {
+
+      case 0:
+        if(ring.write(next))
+          next++;
+        break;
+
+      case 1:
+        for(i=0;i<size;i++)
+          block[i]=next+i;
+        next+=ring.write(block,size);
+        break;
+
+      default:
+        written=std::min(size,ring.acquireWrite(r));
+        for(i=0;i<written;i++) {
+          if(i<r.first.size)
+            r.first.data[i]=next+i;
+          else
+            r.second.data[i-r.first.size]=next+i;
+        }
+        ring.commitWrite(written);
+        next+=written;
+        break;
+    }
+  }
+}
+
+
+/*
+ * Run the producer on another thread and check what arrives
+ */
+
+static void stress(uint32_t capacity,uint32_t startIndex,uint32_t count,unsigned seed) {
+
+  TestRingBuffer ring(capacity,startIndex);
+  std::mt19937 random(seed+1);
+  spsc_ring_buffer<uint32_t>::region r;
+  uint32_t expected,block[64],i,size,count2,value,errors;
+
+  std::thread thread(producer,std::ref(ring),count,seed);
+
+  expected=errors=0;
+
+  while(expected!=count) {
+
+    if(ring.availableToRead()==0)
+      std::this_thread::yield();
+
+    size=random() % 64+1;
+
+    switch(random() % 3) {
+
+      case 0:
+        if(ring.read(value)) {
+          if(value!=expected)
+            errors++;
+          expected++;
+        }
+        break;
+
+      case 1:
+        count2=ring.read(block,size);
+        for(i=0;i<count2;i++)
+          if(block[i]!=expected+i)
+            errors++;
+        expected+=count2;
+        break;
+
+      default:
+        count2=std::min(size,ring.peekRead(r));
+        for(i=0;i<count2;i++) {
+          value=i<r.first.size ? r.first.data[i] : r.second.data[i-r.first.size];
+          if(value!=expected+i)
+            errors++;
+        }
+        ring.consumeRead(count2);
+        expected+=count2;
+        break;
+    }
+
+    CHECK(ring.availableToRead()<=ring.capacity());
+  }
+
+  thread.join();
+
+  CHECK(errors==0);
+  CHECK(ring.availableToRead()==0);
+  CHECK(ring.availableToWrite()==ring.capacity());
+
+  printf("stress: capacity %u, start index %08x, %u elements, %u errors\n",capacity,startIndex,count,errors);
+}
+
+
+/*
+ * Benchmarks. Fill half the buffer and empty it again, repeatedly.
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+static double nanosPerElement(Clock::time_point start,uint64_t elements) {
+  return std::chrono::duration<double,std::nano>(Clock::now()-start).count()/elements;
+}
+
+
+static void benchmark() {
+
+  enum {
+    CAPACITY = 1024,
+    BLOCK = 256,
+    PASSES = 40000
+  };
+
+  spsc_ring_buffer<uint8_t> ring(CAPACITY);
+  volatile circular_buffer<uint8_t> circular(CAPACITY);
+  uint8_t block[BLOCK],value;
+  uint32_t pass,i,sum;
+  Clock::time_point start;
+  double spscSingle,circularSingle,spscBlock,circularBlock;
+
+  memset(block,0x55,sizeof(block));
+  sum=0;
+
+  // one element at a time, checking the space as an IRQ handler would
+
+  start=Clock::now();
+  for(pass=0;pass<PASSES;pass++) {
+    for(i=0;i<BLOCK;i++)
+      if(circular.availableToWrite())
+        circular.write(static_cast<uint8_t>(i));
+    for(i=0;i<BLOCK;i++)
+      if(circular.availableToRead())
+        sum+=circular.read();
+  }
+  circularSingle=nanosPerElement(start,2ull*PASSES*BLOCK);
+
+  start=Clock::now();
+  for(pass=0;pass<PASSES;pass++) {
+    for(i=0;i<BLOCK;i++)
+      ring.write(static_cast<uint8_t>(i));
+    for(i=0;i<BLOCK;i++)
+      if(ring.read(value))
+        sum+=value;
+  }
+  spscSingle=nanosPerElement(start,2ull*PASSES*BLOCK);
+
+  // blocks
+
+  start=Clock::now();
+  for(pass=0;pass<PASSES;pass++) {
+    if(circular.availableToWrite()>=BLOCK)
+      circular.write(block,BLOCK);
+    if(circular.availableToRead()>=BLOCK)
+      circular.read(block,BLOCK);
+    sum+=block[pass % BLOCK];
+  }
+  circularBlock=nanosPerElement(start,2ull*PASSES*BLOCK);
+
+  start=Clock::now();
+  for(pass=0;pass<PASSES;pass++) {
+    ring.write(block,BLOCK);
+    ring.read(block,BLOCK);
+    sum+=block[pass % BLOCK];
+  }
+  spscBlock=nanosPerElement(start,2ull*PASSES*BLOCK);
+
+  printf("benchmark (ns per element, checksum %u):\n",sum);
+  printf("  %-18s %8s %8s\n","","single","block");
+  printf("  %-18s %8.2f %8.2f\n","circular_buffer",circularSingle,circularBlock);
+  printf("  %-18s %8.2f %8.2f\n","spsc_ring_buffer",spscSingle,spscBlock);
+}
+
+
+int main() {
+
+  // 1
+
+  stress(64,0,4000000,1);
+  stress(8,0,1000000,2);
+
+  // 2
+
+  stress(64,0xfffff000,4000000,3);
+  stress(1,0xffffff00,100000,4);
+
+  // 3
+
+  benchmark();
+
+  printf(failures ? "FAILED (%d)\n" : "PASSED\n",failures);
+  return failures!=0;
+}
@@ -0,0 +1,279 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Lookup benchmarks for the ARP and DNS caches. Each cache is filled to a range of sizes and
+ * then looked up with entries that are present (hits) and entries that aren't (misses), in a
+ * random order. For comparison the same lookups are timed as a scan of all the entries, which
+ * is how the caches used to find things.
+ *
+ *   1. ArpCache with 8 to 254 entries on one subnet
+ *   2. DnsCache with 10 to 10000 entries
+ *
+ * Every hit must return what was stored and every miss must fail. The times are printed. The
+ * hash lookups should stay roughly flat as the caches grow while the scans grow with the size.
+ */
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include "hosttest/config/stm32plus.h"
+#include "hosttest/config/net.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+static int failures=0;
+
+#define CHECK(x) do { if(!(x)) { failures++; printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#x); } } while(0)
+
+typedef std::chrono::steady_clock Clock;
+
+enum {
+  LOOKUPS = 200000,
+  DNS_SCAN_LOOKUPS = 2000     // a scan of 10000 names takes tens of microseconds
+};
+
+
+static double nanosPerLookup(Clock::time_point start,uint32_t count) {
+  return std::chrono::duration<double,std::nano>(Clock::now()-start).count()/count;
+}
+
+
+/*
+ * 1. ARP
+ */
+
+static void benchmarkArp(RtcBase& rtc) {
+
+  static const uint16_t sizes[]={ 8,32,128,254 };
+
+  std::mt19937 random(1);
+  std::vector<IpAddress> ips,hits,misses;
+  MacAddress mac;
+  IpAddress ip;
+  bool refreshNeeded;
+  uint32_t i,j,found;
+  Clock::time_point start;
+  double hitNanos,missNanos,scanHitNanos,scanMissNanos;
+
+  printf("ArpCache\n");
+  printf("  %7s %10s %10s %10s %10s\n","entries","hit ns","miss ns","scan hit","scan miss");
+
+  for(uint16_t size : sizes) {
+
+    ArpCache cache;
+
+    CHECK(cache.initialise(size,3600,0,&rtc));
+
+    // hosts on 192.168.x.y, stored big-endian so the host part is the top byte
+
+    ips.clear();
+
+    for(i=0;i<size;i++) {
+
+      ip.ipAddress=0x0000a8c0 | ((i/250) << 16) | ((i % 250+1) << 24);
+      memset(mac.macAddress,0,sizeof(mac.macAddress));
+      memcpy(mac.macAddress,&ip.ipAddress,4);
+
+      cache.insert(mac,ip);
+      ips.push_back(ip);
+    }
+
+    hits.clear();
+    misses.clear();
+
+    for(i=0;i<LOOKUPS;i++) {
+      hits.push_back(ips[random() % size]);
+      ip.ipAddress=0x0000a8c0 | (10 << 16) | ((random() % 250+1) << 24);
+      misses.push_back(ip);
+    }
+
+    // hash lookups
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<LOOKUPS;i++)
+      if(cache.findMacAddress(hits[i],mac,refreshNeeded) && memcmp(mac.macAddress,&hits[i].ipAddress,4)==0)
+        found++;
+
+    hitNanos=nanosPerLookup(start,LOOKUPS);
+    CHECK(found==LOOKUPS);
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<LOOKUPS;i++)
+      if(cache.findMacAddress(misses[i],mac,refreshNeeded))
+        found++;
+
+    missNanos=nanosPerLookup(start,LOOKUPS);
+    CHECK(found==0);
+
+    // scans of the same addresses
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<LOOKUPS;i++)
+      for(j=0;j<size;j++)
+        if(ips[j]==hits[i]) {
+          found++;
+          break;
+        }
+
+    scanHitNanos=nanosPerLookup(start,LOOKUPS);
+    CHECK(found==LOOKUPS);
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<LOOKUPS;i++)
+      for(j=0;j<size;j++)
+        if(ips[j]==misses[i]) {
+          found++;
+          break;
+        }
+
+    scanMissNanos=nanosPerLookup(start,LOOKUPS);
+    CHECK(found==0);
+
+    printf("  %7u %10.1f %10.1f %10.1f %10.1f\n",size,hitNanos,missNanos,scanHitNanos,scanMissNanos);
+  }
+}
+
+
+/*
+ * 2. DNS
+ */
+
+static void benchmarkDns(RtcBase& rtc) {
+
+  static const uint32_t sizes[]={ 10,100,1000,10000 };
+
+  std::mt19937 random(2);
+  std::vector<std::vector<char>> names;
+  std::vector<const char *> hits,misses;
+  char name[40];
+  IpAddress address;
+  uint32_t i,j,found,index;
+  Clock::time_point start;
+  double hitNanos,missNanos,scanHitNanos,scanMissNanos;
+
+  // the misses are in the cache's format but never added
+
+  for(i=0;i<1000;i++) {
+    snprintf(name,sizeof(name),"absent%u.example.com",i);
+    names.emplace_back(name,name+strlen(name)+1);
+  }
+
+  printf("DnsCache\n");
+  printf("  %7s %10s %10s %10s %10s\n","entries","hit ns","miss ns","scan hit","scan miss");
+
+  for(uint32_t size : sizes) {
+
+    DnsCache cache;
+
+    CHECK(cache.initialise(size,&rtc));
+
+    names.resize(1000);
+
+    for(i=0;i<size;i++) {
+
+      snprintf(name,sizeof(name),"Host%u.Example.com",i);
+      names.emplace_back(name,name+strlen(name)+1);
+
+      address.ipAddress=i+1;
+      cache.add(name,address,3600);
+    }
+
+    // look up in a different case to the one stored
+
+    hits.clear();
+    misses.clear();
+
+    for(i=0;i<LOOKUPS;i++) {
+      index=random() % size;
+      snprintf(name,sizeof(name),"host%u.example.COM",index);
+      hits.push_back(strdup(name));
+      misses.push_back(&names[random() % 1000][0]);
+    }
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<LOOKUPS;i++)
+      if(cache.lookup(hits[i],address))
+        found++;
+
+    hitNanos=nanosPerLookup(start,LOOKUPS);
+    CHECK(found==LOOKUPS);
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<LOOKUPS;i++)
+      if(cache.lookup(misses[i],address))
+        found++;
+
+    missNanos=nanosPerLookup(start,LOOKUPS);
+    CHECK(found==0);
+
+    // scans with strcasecmp
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<DNS_SCAN_LOOKUPS;i++)
+      for(j=0;j<size;j++)
+        if(!strcasecmp(hits[i],&names[1000+j][0])) {
+          found++;
+          break;
+        }
+
+    scanHitNanos=nanosPerLookup(start,DNS_SCAN_LOOKUPS);
+    CHECK(found==DNS_SCAN_LOOKUPS);
+
+    found=0;
+    start=Clock::now();
+
+    for(i=0;i<DNS_SCAN_LOOKUPS;i++)
+      for(j=0;j<size;j++)
+        if(!strcasecmp(misses[i],&names[1000+j][0])) {
+          found++;
+          break;
+        }
+
+    scanMissNanos=nanosPerLookup(start,DNS_SCAN_LOOKUPS);
+    CHECK(found==0);
+
+    printf("  %7u %10.1f %10.1f %10.1f %10.1f\n",size,hitNanos,missNanos,scanHitNanos,scanMissNanos);
+
+    for(const char *hit : hits)
+      free(const_cast<char *>(hit));
+  }
+}
+
+
+int main() {
+
+  RtcBase rtc;
+
+  hosttest::VirtualClock::set(0);
+
+  // 1
+
+  benchmarkArp(rtc);
+
+  // 2
+
+  benchmarkDns(rtc);
+
+  printf(failures ? "FAILED (%d)\n" : "PASSED\n",failures);
+  return failures!=0;
+}
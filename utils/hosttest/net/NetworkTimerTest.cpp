@@ -0,0 +1,361 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * NetworkTimerWheel and NetworkIntervalTicker on the virtual clock.
+ *
+ *  1. Random arm/cancel/re-arm of 600 timers against a simple model, across the 32-bit wrap.
+ *  2. Interval subscriptions, tick hook chaining and the IRQ-context guard under the virtual
+ *     SysTick.
+ *  3. Benchmark: the retransmission and delayed-ACK timers of a few hundred connections for an
+ *     hour of virtual time, against polling every connection's deadline every millisecond.
+ */
+
+#include <cstddef>
+#include <vector>
+#include <chrono>
+#include "hosttest/VirtualClock.h"
+#include "hosttest/NetShims.h"
+#include "net/NetworkTimerWheel.h"
+#include "net/NetworkIntervalTicker.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace stm32plus::hosttest;
+
+static int failures=0;
+
+#define CHECK(x) do { if(!(x)) { failures++; printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#x); } } while(0)
+
+
+/*
+ * 1. The wheel against a model
+ */
+
+struct ModelTimer {
+  NetworkTimer timer;           // first, so the callback can find its model
+  uint32_t due;
+  bool armed;
+  int fired;
+};
+
+static std::vector<ModelTimer> modelTimers(600);
+static NetworkTimerWheel modelWheel;
+static bool modelRunningOut;
+
+
+static void modelArm(ModelTimer& mt,uint32_t delay) {
+
+  modelWheel.arm(mt.timer,delay);
+
+  if(delay==0)
+    delay=1;
+  else if(delay>NetworkTimerWheel::MAX_DELAY)
+    delay=NetworkTimerWheel::MAX_DELAY;
+
+  mt.armed=true;
+  mt.due=modelWheel.getNow()+delay;
+}
+
+
+struct ModelHandler {
+
+  void onFire(NetworkTimer& timer) {
+
+    ModelTimer& mt=reinterpret_cast<ModelTimer&>(timer);
+
+    CHECK(IrqSuspend::depth==0);
+    CHECK(mt.armed && mt.due==modelWheel.getNow());
+
+    mt.armed=false;
+    mt.fired++;
+
+    // callbacks may re-arm themselves and cancel others
+
+    if(!modelRunningOut && rand()%4==0)
+      modelArm(mt,1+rand()%5000);
+
+    if(rand()%8==0) {
+      ModelTimer& other=modelTimers[rand()%modelTimers.size()];
+      modelWheel.cancel(other.timer);
+      other.armed=false;
+    }
+  }
+} modelHandler;
+
+
+static void testWheelModel() {
+
+  uint32_t delay;
+  long fired;
+  int step,op,range;
+
+  srand(1);
+  modelRunningOut=false;
+  modelWheel.reset(0xFFFFF000);
+
+  for(auto& mt : modelTimers) {
+    mt.armed=false;
+    mt.fired=0;
+    mt.timer.callback=NetworkTimer::CallbackType::bind(&modelHandler,&ModelHandler::onFire);
+  }
+
+  for(step=0;step<400000;step++) {
+
+    ModelTimer& mt=modelTimers[rand()%modelTimers.size()];
+
+    op=rand()%100;
+
+    if(op<3) {
+      range=rand()%4;
+      delay=range==0 ? rand()%64 : range==1 ? rand()%4096 : range==2 ? rand()%300000 : rand()%20000000;
+      modelArm(mt,delay);
+    }
+    else if(op<4) {
+      modelWheel.cancel(mt.timer);
+      mt.armed=false;
+    }
+
+    modelWheel.advance(modelWheel.getNow()+(rand()%50==0 ? rand()%200 : 1));
+    CHECK(IrqSuspend::depth==0);
+  }
+
+  // run out everything that's left
+
+  modelRunningOut=true;
+  modelWheel.advance(modelWheel.getNow()+NetworkTimerWheel::MAX_DELAY+10);
+
+  fired=0;
+  for(auto& mt : modelTimers) {
+    CHECK(!mt.armed && !mt.timer.isArmed());
+    fired+=mt.fired;
+  }
+
+  printf("wheel model: %ld timers fired\n",fired);
+}
+
+
+/*
+ * 2. The ticker under the virtual SysTick
+ */
+
+struct Subscriber {
+
+  std::vector<uint32_t> calls;
+  uint32_t newInterval;
+  bool sawIrq;
+
+  Subscriber()
+    : newInterval(0),
+      sawIrq(true) {
+  }
+
+  void onTick(NetworkIntervalTickData& nitd) {
+
+    calls.push_back(MillisecondTimer::millis());
+    sawIrq&=Nvic::isAnyIrqActive();
+
+    if(newInterval) {
+      nitd.interval=newInterval;
+      newInterval=0;
+    }
+  }
+};
+
+
+struct CountingHook {
+
+  MillisecondTimer::TickHook hook;
+  uint32_t count;
+
+  CountingHook()
+    : count(0) {
+    hook.function=&CountingHook::onTick;
+    hook.context=this;
+  }
+
+  static void onTick(void *context) {
+    static_cast<CountingHook *>(context)->count++;
+  }
+};
+
+
+static void testTicker() {
+
+  RtcSecondInterruptFeature rtc;
+  NetworkIntervalTicker ticker;
+  NetworkIntervalTicker::Parameters params;
+  Subscriber a,b,c;
+  CountingHook before,after;
+
+  params.base_rtc=&rtc;
+
+  VirtualClock::set(0);
+  MillisecondTimer::addTickHook(before.hook);
+
+  ticker.initialise(params);
+  ticker.subscribeIntervalTicks(1,NetworkIntervalTicker::TickIntervalSlotType::bind(&a,&Subscriber::onTick));
+  ticker.subscribeIntervalTicks(0,NetworkIntervalTicker::TickIntervalSlotType::bind(&b,&Subscriber::onTick));
+  ticker.subscribeIntervalTicks(2,NetworkIntervalTicker::TickIntervalSlotType::bind(&c,&Subscriber::onTick));
+  ticker.startup();
+
+  MillisecondTimer::addTickHook(after.hook);
+
+  // c asks for an interval longer than the wheel's range (about 4.6 hours)
+
+  c.newInterval=40000;
+
+  VirtualClock::advance(5000);
+  CHECK(!Nvic::isAnyIrqActive());
+  CHECK(before.count==5000 && after.count==5000);
+
+  // b wakes up with a 3 second interval
+
+  ticker.updateIntervalTickSubscription(3,NetworkIntervalTicker::TickIntervalSlotType::bind(&b,&Subscriber::onTick));
+
+  // removing a hook leaves the others alone
+
+  MillisecondTimer::removeTickHook(before.hook);
+  MillisecondTimer::removeTickHook(before.hook);
+  VirtualClock::advance(100000000-5000);
+
+  MillisecondTimer::removeTickHook(after.hook);
+
+  CHECK(before.count==5000);
+  CHECK(after.count==100000000);
+  CHECK(a.calls.size()==100000 && a.calls[0]==1000 && a.calls[1]==2000);
+  CHECK(b.calls.size()>0 && b.calls[0]==8000);
+  CHECK(c.calls.size()==3 && c.calls[0]==2000 && c.calls[1]==2000+40000000u && c.calls[2]==2000+80000000u);
+  CHECK(a.sawIrq && b.sawIrq && c.sawIrq);
+
+  printf("ticker: %zu/%zu/%zu interval callbacks over %u virtual seconds\n",
+      a.calls.size(),b.calls.size(),c.calls.size(),MillisecondTimer::millis()/1000);
+}
+
+
+/*
+ * 3. Connection timers: the wheel against polling
+ */
+
+enum {
+  CONNECTIONS = 400,
+  BENCH_MILLIS = 3600000        // one hour
+};
+
+
+struct Connection {
+  NetworkTimer resendTimer;
+  NetworkTimer ackTimer;
+  uint32_t resendDue;
+  uint32_t ackDue;
+  uint32_t rto;
+};
+
+
+struct ConnectionTimers {
+
+  NetworkIntervalTicker *ticker;
+  std::vector<Connection> connections;
+  long fires;
+
+  ConnectionTimers()
+    : connections(CONNECTIONS),
+      fires(0) {
+  }
+
+  // each connection resends on a backing-off RTO and sends a delayed ACK every 200ms
+
+  uint32_t nextRto(Connection& c) {
+    c.rto=c.rto>=3200 ? 200+(&c-&connections[0])%400 : c.rto*2;
+    return c.rto;
+  }
+
+  void onResend(NetworkTimer& timer) {
+    Connection& c=reinterpret_cast<Connection&>(timer);
+    fires++;
+    ticker->armTimer(c.resendTimer,nextRto(c));
+  }
+
+  void onAck(NetworkTimer& timer) {
+    Connection& c=*reinterpret_cast<Connection *>(reinterpret_cast<uint8_t *>(&timer)-offsetof(Connection,ackTimer));
+    fires++;
+    ticker->armTimer(c.ackTimer,200);
+  }
+};
+
+
+static void benchConnectionTimers() {
+
+  RtcSecondInterruptFeature rtc;
+  NetworkIntervalTicker ticker;
+  NetworkIntervalTicker::Parameters params;
+  ConnectionTimers wheel,polled;
+  uint32_t now;
+  double wheelNs,polledNs;
+
+  params.base_rtc=&rtc;
+
+  VirtualClock::set(0);
+  ticker.initialise(params);
+  ticker.startup();
+
+  wheel.ticker=&ticker;
+
+  for(auto& c : wheel.connections) {
+    c.rto=200+(&c-&wheel.connections[0])%400;
+    c.resendTimer.callback=NetworkTimer::CallbackType::bind(&wheel,&ConnectionTimers::onResend);
+    c.ackTimer.callback=NetworkTimer::CallbackType::bind(&wheel,&ConnectionTimers::onAck);
+    ticker.armTimer(c.resendTimer,c.rto);
+    ticker.armTimer(c.ackTimer,1+(&c-&wheel.connections[0])%200);
+  }
+
+  auto start=std::chrono::steady_clock::now();
+  VirtualClock::advance(BENCH_MILLIS);
+  wheelNs=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+
+  // the same schedule, checking every deadline every millisecond
+
+  for(auto& c : polled.connections) {
+    c.rto=200+(&c-&polled.connections[0])%400;
+    c.resendDue=c.rto;
+    c.ackDue=1+(&c-&polled.connections[0])%200;
+  }
+
+  start=std::chrono::steady_clock::now();
+
+  for(now=1;now<=BENCH_MILLIS;now++) {
+    for(auto& c : polled.connections) {
+      if(c.resendDue==now) {
+        polled.fires++;
+        c.resendDue=now+polled.nextRto(c);
+      }
+      if(c.ackDue==now) {
+        polled.fires++;
+        c.ackDue=now+200;
+      }
+    }
+  }
+
+  polledNs=std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-start).count();
+
+  CHECK(wheel.fires==polled.fires);
+
+  printf("%d connections, 1 hour: %ld timer callbacks\n",CONNECTIONS,wheel.fires);
+  printf("  timer wheel: %8.1f ns per millisecond tick\n",wheelNs/BENCH_MILLIS);
+  printf("  polling:     %8.1f ns per millisecond tick\n",polledNs/BENCH_MILLIS);
+}
+
+
+int main() {
+
+  testWheelModel();
+  testTicker();
+  benchConnectionTimers();
+
+  printf(failures ? "FAILED (%d)\n" : "PASSED\n",failures);
+  return failures!=0;
+}
@@ -0,0 +1,466 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * A network simulator that measures TCP goodput with and without congestion control.
+ *
+ * The sender is the loop in TcpConnection::send() and the ACK processing in
+ * handleIncomingAck(), step for step, driving the library's TcpNewReno and
+ * TcpResendDelayCalculator on the virtual clock. Between the sender and the receiver is a
+ * path with:
+ *
+ *   - random loss
+ *   - a bottleneck link with a drop-tail queue of a few packets
+ *   - a fixed propagation delay in each direction
+ *
+ * The receiver buffers out-of-order segments, ACKs every second segment, sends a delayed
+ * ACK after 100ms and ACKs at once when there's a hole. Every run must deliver all the data
+ * in order. Each case is the average of 5 seeds.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <random>
+#include "hosttest/VirtualClock.h"
+#include "net/transport/tcp/TcpResendDelayCalculator.h"
+#include "net/transport/tcp/TcpCongestionControl.h"
+#include "net/transport/tcp/TcpNewReno.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace stm32plus::hosttest;
+
+static int failures=0;
+
+#define CHECK(x) do { if(!(x)) { failures++; printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#x); } } while(0)
+
+
+/*
+ * The path and the transfer
+ */
+
+struct PathConfig {
+  const char *name;
+  double lossRate;              // chance that a segment is lost
+  uint32_t bottleneckBps;       // bottleneck link speed
+  uint32_t delayMicros;         // propagation delay each way
+  uint32_t queuePackets;        // bottleneck queue length
+  uint32_t receiveWindow;       // advertised by the receiver
+  uint32_t transferBytes;
+};
+
+
+struct Result {
+  double seconds;
+  uint32_t segmentsSent;
+  uint32_t drops;
+  uint32_t timeouts;
+  uint32_t fastRetransmits;
+  bool delivered;
+};
+
+
+class Simulation {
+
+  protected:
+
+    enum {
+      MSS = 1460,
+      HEADERS = 40,
+      STEP_MICROS = 50,
+      DELAYED_ACK_MICROS = 100000,
+      MAX_RESEND_DELAY = 60000,
+      ISS = 1000
+    };
+
+    struct Segment {
+      uint32_t sequence;
+      uint32_t length;
+      uint64_t arrival;
+    };
+
+    struct Ack {
+      uint32_t ackNumber;
+      uint32_t window;
+      uint64_t arrival;
+    };
+
+    const PathConfig& _config;
+    std::mt19937 _random;
+    std::uniform_real_distribution<double> _uniform;
+    uint64_t _now;
+    Result _result;
+
+    // sender
+
+    TcpNewReno _newReno;
+    TcpCongestionControl *_congestionControl;
+    TcpResendDelayCalculator _resendDelayCalculator;
+    uint32_t _sendUnacknowledged;
+    uint32_t _sendWindow;
+    uint32_t _sendMax;
+    bool _retransmitRequested;
+
+    // path
+
+    std::deque<Segment> _queue;
+    std::deque<Segment> _inFlight;
+    std::deque<Ack> _acks;
+    uint64_t _linkFreeAt;
+
+    // receiver
+
+    uint32_t _receiveNext;
+    std::map<uint32_t,uint32_t> _outOfOrder;
+    uint32_t _unackedSegments;
+    uint64_t _delayedAckAt;
+
+  protected:
+    uint32_t getFlightSize() const;
+    uint32_t getSendLimit() const;
+    void transmit(uint32_t sequence,uint32_t length);
+    void receiverAck();
+    void runPath();
+    void handleIncomingAck(const Ack& ack);
+
+  public:
+    Simulation(const PathConfig& config,bool congestionControl,unsigned seed);
+    Result run();
+};
+
+
+Simulation::Simulation(const PathConfig& config,bool congestionControl,unsigned seed)
+  : _config(config),
+    _random(seed),
+    _uniform(0,1),
+    _now(0),
+    _result(),
+    _congestionControl(congestionControl ? &_newReno : nullptr),
+    _sendUnacknowledged(ISS+1),
+    _sendWindow(config.receiveWindow),
+    _sendMax(ISS+1),
+    _retransmitRequested(false),
+    _linkFreeAt(0),
+    _receiveNext(ISS+1),
+    _unackedSegments(0),
+    _delayedAckAt(0) {
+
+  VirtualClock::set(0);
+
+  _resendDelayCalculator.initialise(1000,MAX_RESEND_DELAY);
+
+  // as initialiseTransmitter() does when the handshake completes
+
+  if(_congestionControl)
+    _congestionControl->initialise(MSS,4*MSS,ISS);
+}
+
+
+uint32_t Simulation::getFlightSize() const {
+  return static_cast<int32_t>(_sendMax-_sendUnacknowledged)>0 ? _sendMax-_sendUnacknowledged : 0;
+}
+
+
+uint32_t Simulation::getSendLimit() const {
+
+  uint32_t limit;
+
+  limit=_sendWindow;
+
+  if(_congestionControl)
+    limit=std::min(limit,_congestionControl->getWindow());
+
+  return limit;
+}
+
+
+/*
+ * A segment leaves the sender. It may be lost on the way to the bottleneck or find the queue full.
+ */
+
+void Simulation::transmit(uint32_t sequence,uint32_t length) {
+
+  _result.segmentsSent++;
+
+  if(static_cast<int32_t>(sequence+length-_sendMax)>0)
+    _sendMax=sequence+length;
+
+  if(_uniform(_random)<_config.lossRate || _queue.size()>=_config.queuePackets) {
+    _result.drops++;
+    return;
+  }
+
+  _queue.push_back({ sequence,length,0 });
+}
+
+
+void Simulation::receiverAck() {
+  _acks.push_back({ _receiveNext,_config.receiveWindow,_now+_config.delayMicros });
+  _unackedSegments=0;
+  _delayedAckAt=0;
+}
+
+
+/*
+ * Move segments through the bottleneck to the receiver and ACKs back to the sender
+ */
+
+void Simulation::runPath() {
+
+  Segment segment;
+  uint64_t serialisation;
+  uint32_t end;
+
+  // the bottleneck sends one segment at a time
+
+  while(!_queue.empty() && _linkFreeAt<=_now) {
+
+    segment=_queue.front();
+    _queue.pop_front();
+
+    serialisation=static_cast<uint64_t>(segment.length+HEADERS)*8*1000000/_config.bottleneckBps;
+    _linkFreeAt=std::max(_linkFreeAt,_now)+serialisation;
+
+    segment.arrival=_linkFreeAt+_config.delayMicros;
+    _inFlight.push_back(segment);
+  }
+
+  // the receiver
+
+  while(!_inFlight.empty() && _inFlight.front().arrival<=_now) {
+
+    segment=_inFlight.front();
+    _inFlight.pop_front();
+
+    if(segment.sequence==_receiveNext) {
+
+      _receiveNext+=segment.length;
+
+      // pull in anything buffered that's now in order
+
+      while(!_outOfOrder.empty() && static_cast<int32_t>(_outOfOrder.begin()->first-_receiveNext)<=0) {
+
+        end=_outOfOrder.begin()->first+_outOfOrder.begin()->second;
+
+        if(static_cast<int32_t>(end-_receiveNext)>0)
+          _receiveNext=end;
+
+        _outOfOrder.erase(_outOfOrder.begin());
+      }
+
+      if(!_outOfOrder.empty() || ++_unackedSegments>=2)
+        receiverAck();
+      else if(!_delayedAckAt)
+        _delayedAckAt=_now+DELAYED_ACK_MICROS;
+    }
+    else {
+
+      // out of order or a duplicate: ACK at once
+
+      if(static_cast<int32_t>(segment.sequence-_receiveNext)>0)
+        _outOfOrder[segment.sequence]=segment.length;
+
+      receiverAck();
+    }
+  }
+
+  if(_delayedAckAt && _now>=_delayedAckAt)
+    receiverAck();
+
+  // the sender's IRQ
+
+  while(!_acks.empty() && _acks.front().arrival<=_now) {
+    handleIncomingAck(_acks.front());
+    _acks.pop_front();
+  }
+}
+
+
+/*
+ * The congestion control parts of TcpConnection::handleIncomingAck()
+ */
+
+void Simulation::handleIncomingAck(const Ack& ack) {
+
+  uint32_t acked,flightSize;
+
+  if(static_cast<int32_t>(ack.ackNumber-_sendUnacknowledged)>0) {
+
+    acked=ack.ackNumber-_sendUnacknowledged;
+    _sendUnacknowledged=ack.ackNumber;
+
+    if(_congestionControl && _congestionControl->onAck(ack.ackNumber,acked,getFlightSize()))
+      _retransmitRequested=true;
+  }
+  else if(_congestionControl &&
+          ack.ackNumber==_sendUnacknowledged &&
+          ack.window==_sendWindow &&
+          (flightSize=getFlightSize())>0) {
+
+    if(_congestionControl->onDuplicateAck(ack.ackNumber,flightSize,_sendMax)) {
+      _retransmitRequested=true;
+      _result.fastRetransmits++;
+    }
+  }
+
+  _sendWindow=ack.window;
+}
+
+
+/*
+ * The loop in TcpConnection::send() for one large write, with time moving on between passes
+ */
+
+Result Simulation::run() {
+
+  uint32_t start,end,nextToSend,acknowledged,unacknowledged,window,inFlight,tosend;
+  uint32_t resendtimeout,startwait,segmentcap,timedseq;
+  bool timing;
+
+  start=nextToSend=acknowledged=ISS+1;
+  end=start+_config.transferBytes;
+
+  resendtimeout=_resendDelayCalculator.getResendDelay();
+  startwait=MillisecondTimer::millis();
+  timing=false;
+  timedseq=0;
+  segmentcap=MSS;
+
+  for(;;) {
+
+    runPath();
+
+    unacknowledged=_sendUnacknowledged;
+
+    if(static_cast<int32_t>(unacknowledged-acknowledged)>0) {
+
+      if(static_cast<int32_t>(unacknowledged-end)>0)
+        unacknowledged=end;
+
+      acknowledged=unacknowledged;
+
+      if(timing && static_cast<int32_t>(acknowledged-timedseq)>=0) {
+        _resendDelayCalculator.stopTimer();
+        timing=false;
+      }
+
+      resendtimeout=_resendDelayCalculator.getResendDelay();
+      startwait=MillisecondTimer::millis();
+
+      if(static_cast<int32_t>(nextToSend-acknowledged)<0)
+        nextToSend=acknowledged;
+    }
+
+    if(acknowledged==end)
+      break;
+
+    if(MillisecondTimer::hasTimedOut(startwait,resendtimeout)) {
+
+      _result.timeouts++;
+
+      if(_congestionControl)
+        _congestionControl->onTimeout(getFlightSize(),_sendMax);
+
+      _retransmitRequested=false;
+
+      nextToSend=acknowledged;
+      resendtimeout=std::min<uint32_t>(MAX_RESEND_DELAY,resendtimeout*2);
+      startwait=MillisecondTimer::millis();
+
+      _resendDelayCalculator.cancelTimer();
+      timing=false;
+    }
+
+    if(_retransmitRequested) {
+
+      _retransmitRequested=false;
+      transmit(acknowledged,std::min(segmentcap,end-acknowledged));
+
+      _resendDelayCalculator.cancelTimer();
+      timing=false;
+    }
+
+    window=std::max<uint32_t>(1,getSendLimit());
+
+    while(nextToSend!=end && (inFlight=nextToSend-acknowledged)<window) {
+
+      tosend=std::min(std::min(segmentcap,end-nextToSend),window-inFlight);
+
+      if(!timing && static_cast<int32_t>(nextToSend-_sendMax)>=0) {
+        _resendDelayCalculator.startTimer();
+        timedseq=nextToSend+tosend;
+        timing=true;
+      }
+
+      transmit(nextToSend,tosend);
+      nextToSend+=tosend;
+    }
+
+    // move time on
+
+    _now+=STEP_MICROS;
+    VirtualClock::set(_now/1000);
+
+    if(_now>3600ull*1000000)
+      break;
+  }
+
+  _result.seconds=_now/1e6;
+  _result.delivered=acknowledged==end && _receiveNext==end;
+
+  return _result;
+}
+
+
+int main() {
+
+  static const PathConfig paths[]={
+    { "10Mbit 20ms queue 20     ",0,    10000000,10000,20,65535, 4 << 20 },
+    { "10Mbit 20ms queue 8      ",0,    10000000,10000,8, 65535, 4 << 20 },
+    { "10Mbit 20ms 1% loss      ",0.01, 10000000,10000,20,65535, 4 << 20 },
+    { "2Mbit 50ms window 256K   ",0,    2000000, 25000,10,262144,2 << 20 },
+    { "2Mbit 50ms 0.5% loss     ",0.005,2000000, 25000,10,65535, 2 << 20 }
+  };
+
+  enum { SEEDS = 5 };
+
+  double goodput;
+  uint32_t sent,drops,timeouts,fastRetransmits;
+  unsigned seed;
+  int cc;
+
+  printf("%-25s %-4s %12s %8s %8s %8s %8s\n","path","cc","goodput KB/s","segments","drops","RTOs","fast rtx");
+
+  for(const PathConfig& path : paths) {
+    for(cc=0;cc<2;cc++) {
+
+      goodput=0;
+      sent=drops=timeouts=fastRetransmits=0;
+
+      for(seed=1;seed<=SEEDS;seed++) {
+
+        Simulation simulation(path,cc!=0,seed);
+        Result result=simulation.run();
+
+        CHECK(result.delivered);
+
+        goodput+=path.transferBytes/1024.0/result.seconds;
+        sent+=result.segmentsSent;
+        drops+=result.drops;
+        timeouts+=result.timeouts;
+        fastRetransmits+=result.fastRetransmits;
+      }
+
+      printf("%-25s %-4s %12.1f %8u %8u %8u %8u\n",path.name,cc ? "on" : "off",
+          goodput/SEEDS,sent/SEEDS,drops/SEEDS,timeouts/SEEDS,fastRetransmits/SEEDS);
+    }
+  }
+
+  printf(failures ? "FAILED (%d)\n" : "PASSED\n",failures);
+  return failures!=0;
+}
@@ -0,0 +1,238 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Benchmarks for the growth policy and move support in the library's own STL. This is built
+ * twice, once with the default geometric growth and once with STM32PLUS_STL_ADDITIVE_GROWTH,
+ * the old fixed increment of 20. For append loops of increasing length it reports:
+ *
+ *   1. vector<int>::push_back: reallocations, elements relocated per append and time per append
+ *   2. string::operator+=(char): the same for a string
+ *   3. vector<Counted>::push_back of temporaries: copies made per append. Reallocation and
+ *      the appends themselves should move, never copy.
+ *
+ * With geometric growth the relocations per append stay constant as the length grows, so the
+ * loop is linear. With additive growth they go up in proportion to the length and the loop is
+ * quadratic.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <iterator>
+#include <vector>
+#include <string>
+
+
+static int failures=0;
+
+#define CHECK(x) do { if(!(x)) { failures++; printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#x); } } while(0)
+
+
+/*
+ * The device build gets this from LibraryHacks.cpp
+ */
+
+void *operator new(size_t,void *ptr) {
+  return ptr;
+}
+
+
+/*
+ * An element that counts how it's copied and moved
+ */
+
+struct Counted {
+
+  static uint32_t copies;
+  static uint32_t moves;
+
+  int *value;
+
+  Counted(int v) : value(new int(v)) {
+  }
+
+  Counted(const Counted& src) : value(new int(*src.value)) {
+    copies++;
+  }
+
+  Counted(Counted&& src) : value(src.value) {
+    src.value=nullptr;
+    moves++;
+  }
+
+  Counted& operator=(const Counted& src) {
+    *value=*src.value;
+    copies++;
+    return *this;
+  }
+
+  ~Counted() {
+    delete value;
+  }
+};
+
+uint32_t Counted::copies;
+uint32_t Counted::moves;
+
+
+/*
+ * Statistics for one append loop
+ */
+
+struct Growth {
+  uint32_t reallocations;
+  uint64_t relocated;
+  double nanos;
+
+  Growth() : reallocations(0), relocated(0), nanos(0) {
+  }
+
+  /*
+   * Call before each append to count what a reallocation would move
+   */
+
+  void beforeAppend(size_t size,size_t capacity) {
+    if(size==capacity) {
+      reallocations++;
+      relocated+=size;
+    }
+  }
+};
+
+
+static double now() {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1e9+ts.tv_nsec;
+}
+
+
+static Growth appendInts(uint32_t count) {
+
+  std::vector<int> v;
+  Growth growth;
+  uint32_t i;
+  double start;
+
+  // counting pass
+
+  for(i=0;i<count;i++) {
+    growth.beforeAppend(v.size(),v.capacity());
+    v.push_back(i);
+  }
+
+  CHECK(v.size()==count && v[count-1]==static_cast<int>(count-1));
+
+  // timed pass
+
+  v.clear();
+  std::vector<int>().swap(v);
+
+  start=now();
+
+  for(i=0;i<count;i++)
+    v.push_back(i);
+
+  growth.nanos=(now()-start)/count;
+  return growth;
+}
+
+
+static Growth appendChars(uint32_t count) {
+
+  std::string s;
+  Growth growth;
+  uint32_t i;
+  double start;
+
+  for(i=0;i<count;i++) {
+    growth.beforeAppend(s.size(),s.capacity());
+    s+='x';
+  }
+
+  CHECK(s.size()==count);
+
+  start=now();
+
+  {
+    std::string t;
+
+    for(i=0;i<count;i++)
+      t+='x';
+  }
+
+  growth.nanos=(now()-start)/count;
+  return growth;
+}
+
+
+static void appendCounted(uint32_t count,double& copiesPerAppend,double& movesPerAppend) {
+
+  std::vector<Counted> v;
+  uint32_t i;
+
+  Counted::copies=Counted::moves=0;
+
+  for(i=0;i<count;i++)
+    v.push_back(Counted(i));
+
+  CHECK(*v[0].value==0 && *v[count-1].value==static_cast<int>(count-1));
+
+  copiesPerAppend=static_cast<double>(Counted::copies)/count;
+  movesPerAppend=static_cast<double>(Counted::moves)/count;
+}
+
+
+int main() {
+
+  static const uint32_t lengths[]={ 1000,2000,4000,8000,16000,32000,64000 };
+
+  Growth ints,chars;
+  double copies,moves;
+
+#if defined(STM32PLUS_STL_ADDITIVE_GROWTH)
+  printf("growth policy: additive, +20\n");
+#else
+  printf("growth policy: geometric, x1.5\n");
+#endif
+
+  printf("%8s | %26s | %26s | %16s\n","","vector<int>::push_back","string::operator+=","vector<Counted>");
+  printf("%8s | %6s %9s %9s | %6s %9s %9s | %7s %8s\n",
+      "length","reallocs","moved/op","ns/op","reallocs","moved/op","ns/op","copy/op","move/op");
+
+  for(uint32_t length : lengths) {
+
+    ints=appendInts(length);
+    chars=appendChars(length);
+    appendCounted(length,copies,moves);
+
+    printf("%8u | %8u %9.2f %9.2f | %8u %9.2f %9.2f | %7.2f %8.2f\n",
+        length,
+        ints.reallocations,static_cast<double>(ints.relocated)/length,ints.nanos,
+        chars.reallocations,static_cast<double>(chars.relocated)/length,chars.nanos,
+        copies,moves);
+
+    // the appends and the reallocations both move
+
+    CHECK(copies==0);
+
+#if !defined(STM32PLUS_STL_ADDITIVE_GROWTH)
+
+    // geometric growth relocates each element a bounded number of times
+
+    CHECK(static_cast<double>(ints.relocated)/length<3);
+    CHECK(static_cast<double>(chars.relocated)/length<3);
+#endif
+  }
+
+  printf(failures ? "FAILED (%d)\n" : "PASSED\n",failures);
+  return failures!=0;
+}